@@ -0,0 +1,494 @@
+#!/usr/bin/env python
+#
+# Replays NetFlow v5/v9, IPFIX and sFlow v5 datagrams to nfacctd/sfacctd over
+# loopback at a controlled rate, to make ingest performance measurements
+# repeatable. Datagrams are either read from a pcap file (UDP payloads, only
+# standard Python modules are required) or synthesized for a configurable
+# amount of exporters and, for NetFlow v9/IPFIX, templates per exporter.
+#
+# Each original (or synthetic) exporter is sent from its own loopback source
+# address, 127.0.<n>.<m>, so that the collector keeps per-exporter state
+# (templates, sequence numbers, sampling) as it would in production. On Linux
+# addresses in 127.0.0.0/8 are all local, no setup is required.
+#
+# Synthetic exporters can optionally feed routes first via a BMP session to
+# the collector (bmp_daemon), from the same loopback source address, so that
+# flows get correlated to BGP info learnt via BMP Route Monitoring. Each BMP
+# session announces the flow source and destination prefixes from a set of
+# monitored peers, each of them both pre- and post-policy and each with its
+# own origin ASN: the ASNs the collector reports tell which route it picked.
+#
+# Datagrams and flows sent per second are reported every second. When the
+# collector listens on the local host, socket receive drops are read from
+# /proc/net/udp[6] and reported alongside: these are datagrams the kernel
+# could not queue because the collector was not keeping up. Pairing with a
+# plugin which does little work per record isolates the cost of decoding.
+#
+# Examples:
+#
+#   flow_replay.py -P 2100 -T v9 -e 100 -n 10 -r 20000 -d 30
+#       100 exporters, 10 NetFlow v9 templates each, 20k datagrams/s, 30 secs
+#
+#   flow_replay.py -P 6343 -f capture.pcap -p 6343 -l 0 -r 0
+#       replay sFlow datagrams from capture.pcap in a loop, as fast as possible
+#
+#   flow_replay.py -P 6343 -T sflow -x -S 65536 -c 100000 -r 0
+#       sFlow samples carrying extended router and gateway (AS-PATH,
+#       communities) records, 1:65536 sampling rate, as fast as possible
+#
+#   flow_replay.py -P 2100 -T v5 -e 10 -b 1790 -m 4 -c 1000
+#       10 exporters, each first announcing routes via BMP from 4 monitored
+#       peers, then 1000 NetFlow v5 datagrams
+
+from __future__ import print_function
+
+import sys, getopt, socket, struct, time
+
+def usage(tool):
+    print("")
+    print("Usage: %s [Args]" % tool)
+    print("")
+
+    print("Mandatory Args:")
+    print("  -P, --port".ljust(25) + "Define the collector UDP port")
+    print("  -f, --file".ljust(25) + "Replay datagrams from a pcap file, or ..")
+    print("  -T, --type".ljust(25) + ".. synthesize datagrams: 'v5', 'v9', 'ipfix' or 'sflow'")
+    print("")
+    print("Optional Args:")
+    print("  -h, --help".ljust(25) + "Print this help")
+    print("  -H, --host".ljust(25) + "Define the collector IP address [default: '127.0.0.1']")
+    print("  -r, --rate".ljust(25) + "Datagrams per second, 0 for unlimited [default: 1000]")
+    print("  -d, --duration".ljust(25) + "Stop after the given amount of secs [default: unlimited]")
+    print("  -c, --count".ljust(25) + "Stop after the given amount of datagrams [default: unlimited]")
+    print("")
+    print("pcap Args:")
+    print("  -p, --filter_port".ljust(25) + "Replay only UDP datagrams sent to this port [default: all]")
+    print("  -l, --loops".ljust(25) + "Times to replay the file, 0 for unlimited [default: 1]")
+    print("")
+    print("Synthetic Args:")
+    print("  -e, --exporters".ljust(25) + "Amount of exporters [default: 1]")
+    print("  -n, --templates".ljust(25) + "Templates per exporter, v9/IPFIX only [default: 1]")
+    print("  -R, --records".ljust(25) + "Flow records per datagram [default: 24]")
+    print("  -t, --template_refresh".ljust(25) + "Resend templates every N datagrams [default: 20]")
+    print("  -S, --sampling_rate".ljust(25) + "Sampling rate of sFlow samples [default: 1024]")
+    print("  -x, --sflow_extended".ljust(25) + "Add extended router and gateway records to sFlow samples")
+    print("  -b, --bmp_port".ljust(25) + "Announce routes via BMP to this collector TCP port first [default: none]")
+    print("  -m, --bmp_peers".ljust(25) + "Monitored peers per BMP session [default: 2]")
+
+def exporter_addr(idx):
+    # 127.0.1.1 onwards, skipping network and broadcast-looking octets
+    return "127.%u.%u.%u" % (((idx // 254) // 254) % 256, 1 + ((idx // 254) % 254), 1 + (idx % 254))
+
+def ip4(addr):
+    return socket.inet_aton(addr)
+
+#
+# pcap reader
+#
+def pcap_datagrams(filename, filter_port):
+    f = open(filename, "rb")
+    hdr = f.read(24)
+    if len(hdr) < 24:
+        raise ValueError("%s: truncated pcap header" % filename)
+
+    magic = struct.unpack("<I", hdr[:4])[0]
+    if magic in (0xa1b2c3d4, 0xa1b23c4d): endian = "<"
+    elif magic in (0xd4c3b2a1, 0x4d3cb2a1): endian = ">"
+    else: raise ValueError("%s: not a pcap file (pcapng is not supported)" % filename)
+    linktype = struct.unpack(endian + "I", hdr[20:24])[0]
+
+    while True:
+        rec = f.read(16)
+        if len(rec) < 16: break
+        caplen = struct.unpack(endian + "I", rec[8:12])[0]
+        pkt = f.read(caplen)
+        if len(pkt) < caplen: break
+
+        # link layer
+        if linktype == 1: # Ethernet
+            if len(pkt) < 14: continue
+            ethertype, off = struct.unpack("!H", pkt[12:14])[0], 14
+            while ethertype in (0x8100, 0x88a8) and len(pkt) >= off + 4:
+                ethertype, off = struct.unpack("!H", pkt[off+2:off+4])[0], off + 4
+        elif linktype == 113: # Linux cooked
+            if len(pkt) < 16: continue
+            ethertype, off = struct.unpack("!H", pkt[14:16])[0], 16
+        elif linktype in (12, 101): # raw IP
+            if not pkt: continue
+            ethertype, off = (0x0800 if (ord(pkt[0:1]) >> 4) == 4 else 0x86dd), 0
+        else:
+            raise ValueError("%s: unsupported link type %u" % (filename, linktype))
+
+        # network layer
+        if ethertype == 0x0800:
+            if len(pkt) < off + 20: continue
+            ihl = (ord(pkt[off:off+1]) & 0x0f) * 4
+            frag = struct.unpack("!H", pkt[off+6:off+8])[0]
+            if ord(pkt[off+9:off+10]) != 17 or (frag & 0x3fff): continue
+            src, off = socket.inet_ntop(socket.AF_INET, pkt[off+12:off+16]), off + ihl
+        elif ethertype == 0x86dd:
+            if len(pkt) < off + 40 or ord(pkt[off+6:off+7]) != 17: continue
+            src, off = socket.inet_ntop(socket.AF_INET6, pkt[off+8:off+24]), off + 40
+        else:
+            continue
+
+        # transport layer
+        if len(pkt) < off + 8: continue
+        dport, ulen = struct.unpack("!HH", pkt[off+2:off+6])
+        if filter_port and dport != filter_port: continue
+        yield src, pkt[off+8:off+ulen]
+
+    f.close()
+
+#
+# synthetic datagrams
+#
+V9_FIELDS = [
+    (8, 4),    # IPV4_SRC_ADDR
+    (12, 4),   # IPV4_DST_ADDR
+    (7, 2),    # L4_SRC_PORT
+    (11, 2),   # L4_DST_PORT
+    (4, 1),    # PROTOCOL
+    (5, 1),    # SRC_TOS
+    (10, 4),   # INPUT_SNMP
+    (14, 4),   # OUTPUT_SNMP
+    (2, 4),    # IN_PKTS
+    (1, 4),    # IN_BYTES
+    (22, 4),   # FIRST_SWITCHED
+    (21, 4),   # LAST_SWITCHED
+    (6, 1),    # TCP_FLAGS
+    (16, 4),   # SRC_AS
+    (17, 4),   # DST_AS
+]
+
+def template_fields(tpl):
+    # templates of an exporter differ by the amount of trailing fields, and so
+    # by length, making each of them a distinct decoding path
+    return V9_FIELDS[:len(V9_FIELDS) - (tpl % 4)]
+
+def flow_values(exp, seq, rec, uptime):
+    src = ip4("10.%u.%u.%u" % (exp % 256, (seq // 256) % 256, seq % 256))
+    dst = ip4("192.168.%u.%u" % ((rec // 256) % 256, rec % 256))
+    return {
+        8: src, 12: dst,
+        7: struct.pack("!H", 1024 + (rec % 60000)), 11: struct.pack("!H", 80),
+        4: struct.pack("!B", 6), 5: struct.pack("!B", 0),
+        10: struct.pack("!I", 1), 14: struct.pack("!I", 2),
+        2: struct.pack("!I", 1 + (rec % 10)), 1: struct.pack("!I", 64 * (1 + (rec % 10))),
+        22: struct.pack("!I", max(uptime - 1000, 0)), 21: struct.pack("!I", uptime),
+        6: struct.pack("!B", 0x18), 16: struct.pack("!I", 65000), 17: struct.pack("!I", 65001),
+    }
+
+def sflow_extended(exp, rec):
+    # extended router: next-hop, source and destination masks
+    nexthop = ip4("10.%u.255.%u" % (exp % 256, 1 + (rec % 4)))
+    router = struct.pack("!I", 1) + nexthop + struct.pack("!II", 16, 24)
+    # extended gateway: next-hop, ASNs, a 2 segments AS-PATH, communities, local preference
+    path = [65001 + (rec % 8), 3356, 1299, 64512 + (rec % 256)]
+    gateway = struct.pack("!I", 1) + nexthop + struct.pack("!IIII", 65000, 64999, 65001 + (rec % 8), 2) + \
+              struct.pack("!II", 2, 2) + b"".join(struct.pack("!I", a) for a in path[:2]) + \
+              struct.pack("!II", 2, 2) + b"".join(struct.pack("!I", a) for a in path[2:]) + \
+              struct.pack("!IIIII", 3, (65000 << 16) | (rec % 100), (3356 << 16) | 2, 0xFFFFFF01, 100)
+    return struct.pack("!II", 1002, len(router)) + router + struct.pack("!II", 1003, len(gateway)) + gateway
+
+class Exporter:
+    def __init__(self, idx, kind, templates, records, refresh, sampling=1024, extended=False):
+        self.idx = idx
+        self.kind = kind
+        self.templates = templates
+        self.records = records
+        self.refresh = refresh
+        self.sampling = sampling
+        self.extended = extended
+        self.seq = 0
+        self.datagrams = 0
+        self.boot = time.time()
+
+    def next(self):
+        now = time.time()
+        uptime = int((now - self.boot) * 1000) + 60000
+        if self.kind == "v5": dgram, flows = self.v5(now, uptime)
+        elif self.kind == "sflow": dgram, flows = self.sflow(uptime)
+        else: dgram, flows = self.v9(now, uptime)
+        self.datagrams += 1
+        return dgram, flows
+
+    def v5(self, now, uptime):
+        count = min(self.records, 30)
+        hdr = struct.pack("!HHIIIIBBH", 5, count, uptime, int(now), 0, self.seq, 0, 0, 0)
+        recs = []
+        for rec in range(count):
+            v = flow_values(self.idx, self.datagrams, rec, uptime)
+            recs.append(v[8] + v[12] + ip4("0.0.0.0") + struct.pack("!HH", 1, 2) + v[2] + v[1] +
+                        v[22] + v[21] + v[7] + v[11] + b"\x00" + v[6] + v[4] + v[5] +
+                        struct.pack("!HHBBH", 65000, 65001, 24, 24, 0))
+        self.seq += count
+        return hdr + b"".join(recs), count
+
+    def v9(self, now, uptime):
+        ipfix = (self.kind == "ipfix")
+        tpl = self.datagrams % self.templates
+        fields = template_fields(tpl)
+        sets = []
+
+        if not (self.datagrams % self.refresh):
+            body = b""
+            for t in range(self.templates):
+                tf = template_fields(t)
+                body += struct.pack("!HH", 256 + t, len(tf)) + b"".join(struct.pack("!HH", f, l) for f, l in tf)
+            sets.append(struct.pack("!HH", 2 if ipfix else 0, len(body) + 4) + body)
+
+        body = b""
+        for rec in range(self.records):
+            v = flow_values(self.idx, self.datagrams, rec, uptime)
+            body += b"".join(v[f] for f, l in fields)
+        body += b"\x00" * ((4 - (len(body) % 4)) % 4)
+        sets.append(struct.pack("!HH", 256 + tpl, len(body) + 4) + body)
+        payload = b"".join(sets)
+
+        if ipfix:
+            hdr = struct.pack("!HHIII", 10, len(payload) + 16, int(now), self.seq, self.idx)
+            self.seq += self.records
+        else:
+            hdr = struct.pack("!HHIIII", 9, len(sets), uptime, int(now), self.seq, self.idx)
+            self.seq += 1
+        return hdr + payload, self.records
+
+    def sflow(self, uptime):
+        samples = []
+        for rec in range(self.records):
+            v = flow_values(self.idx, self.datagrams, rec, uptime)
+            # Ethernet + IPv4 + TCP headers, as sampled off the wire
+            frame = 64 * (1 + (rec % 10))
+            iph = struct.pack("!BBHHHBBH", 0x45, 0, frame - 14, 0, 0, 64, 6, 0) + v[8] + v[12]
+            tcph = v[7] + v[11] + struct.pack("!IIBBHHH", 0, 0, 0x50, 0x18, 65535, 0, 0)
+            hdr = b"\x00\x11\x22\x33\x44\x55\x00\x66\x77\x88\x99\xaa\x08\x00" + iph + tcph
+            hdr_len = len(hdr)
+            hdr += b"\x00" * ((4 - (hdr_len % 4)) % 4)
+            raw = struct.pack("!IIII", 1, frame, 4, hdr_len) + hdr
+            record = struct.pack("!II", 1, len(raw)) + raw
+            nrecords = 1
+            if self.extended:
+                record += sflow_extended(self.idx, rec)
+                nrecords += 2
+            # sample pool, a 32 bits counter, wraps around
+            pool = ((self.seq + rec) * self.sampling) & 0xffffffff
+            sample = struct.pack("!IIIIIIII", self.seq + rec, 1, self.sampling, pool, 0, 1, 2, nrecords) + record
+            samples.append(struct.pack("!II", 1, len(sample)) + sample)
+        self.seq += self.records
+        hdr = struct.pack("!II", 5, 1) + ip4(exporter_addr(self.idx)) + \
+              struct.pack("!IIII", 0, self.datagrams, uptime, len(samples))
+        return hdr + b"".join(samples), self.records
+
+#
+# BMP feed: Initiation, Peer Up for each monitored peer, then Route
+# Monitoring: pre-policy routes of all peers in ascending address order, then
+# post-policy ones, likewise. The route to be selected (post-policy, lowest
+# peer address) is thus neither the first nor the last one received
+#
+BMP_INIT, BMP_PEER_UP, BMP_ROUTE = 4, 3, 0
+BMP_FLAGS_L = 0x40
+
+def bmp_msg(mtype, body):
+    return struct.pack("!BIB", 3, len(body) + 6, mtype) + body
+
+def bmp_peer_hdr(peer, asn, flags):
+    return struct.pack("!BB8s", 0, flags, b"\x00" * 8) + b"\x00" * 12 + ip4(peer) + \
+           struct.pack("!I", asn) + ip4(peer) + struct.pack("!II", int(time.time()), 0)
+
+def bgp_msg(mtype, body):
+    return b"\xff" * 16 + struct.pack("!HB", len(body) + 19, mtype) + body
+
+def bgp_open(asn, router_id):
+    return bgp_msg(1, struct.pack("!BHH", 4, asn if asn < 65536 else 23456, 90) + ip4(router_id) + b"\x00")
+
+def bgp_update(path, nexthop, prefixes):
+    aspath = struct.pack("!BB", 2, len(path)) + b"".join(struct.pack("!I", a) for a in path)
+    attrs = struct.pack("!BBBB", 0x40, 1, 1, 0) + struct.pack("!BBB", 0x40, 2, len(aspath)) + aspath + \
+            struct.pack("!BBB", 0x40, 3, 4) + ip4(nexthop)
+    nlri = b""
+    for prefix in prefixes:
+        net, plen = prefix.split("/")
+        plen = int(plen)
+        nlri += struct.pack("!B", plen) + ip4(net)[:(plen + 7) // 8]
+    return bgp_msg(2, struct.pack("!HH", 0, len(attrs)) + attrs + nlri)
+
+def bmp_feed(exp, peers):
+    # monitored peer N is 172.16.<exp>.<N+1>, AS 65100+N; its pre-policy
+    # routes originate from AS 64600+2N, its post-policy ones from 64601+2N
+    local = exporter_addr(exp)
+    msgs = [bmp_msg(BMP_INIT, struct.pack("!HH", 2, 10) + b"flowreplay")]
+    for peer_idx in range(peers):
+        peer, asn = "172.16.%u.%u" % (exp % 256, peer_idx + 1), 65100 + peer_idx
+        msgs.append(bmp_msg(BMP_PEER_UP, bmp_peer_hdr(peer, asn, 0) + b"\x00" * 12 + ip4(local) +
+                            struct.pack("!HH", 179, 179) + bgp_open(65000, local) + bgp_open(asn, peer)))
+    for flags in (0, BMP_FLAGS_L):
+        for peer_idx in range(peers):
+            peer, asn = "172.16.%u.%u" % (exp % 256, peer_idx + 1), 65100 + peer_idx
+            origin = 64600 + (peer_idx * 2) + (1 if flags else 0)
+            msgs.append(bmp_msg(BMP_ROUTE, bmp_peer_hdr(peer, asn, flags) + bgp_update([asn, origin], peer,
+                                ["10.%u.0.0/16" % (exp % 256), "192.168.0.0/16"])))
+    return b"".join(msgs)
+
+def bmp_connect(host, port, exp, peers, family, loopback):
+    s = socket.socket(family, socket.SOCK_STREAM)
+    if loopback and family == socket.AF_INET: s.bind((exporter_addr(exp), 0))
+    s.connect((host, port))
+    s.sendall(bmp_feed(exp, peers))
+    return s
+
+#
+# /proc/net/udp receive drops of the collector socket, if local
+#
+def udp_drops(port):
+    drops = None
+    for path in ("/proc/net/udp", "/proc/net/udp6"):
+        try:
+            f = open(path)
+        except IOError:
+            continue
+        for line in f.readlines()[1:]:
+            cols = line.split()
+            if len(cols) < 13 or int(cols[1].split(":")[1], 16) != port: continue
+            drops = (drops or 0) + int(cols[-1])
+        f.close()
+    return drops
+
+def main():
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "hP:H:f:T:r:d:c:p:l:e:n:R:t:b:m:S:x",
+                                   ["help", "port=", "host=", "file=", "type=", "rate=", "duration=",
+                                    "count=", "filter_port=", "loops=", "exporters=", "templates=",
+                                    "records=", "template_refresh=", "bmp_port=", "bmp_peers=",
+                                    "sampling_rate=", "sflow_extended"])
+    except getopt.GetoptError as err:
+        print(str(err))
+        usage(sys.argv[0])
+        sys.exit(2)
+
+    port = 0
+    host = "127.0.0.1"
+    filename = None
+    kind = None
+    rate = 1000
+    duration = 0
+    count = 0
+    filter_port = 0
+    loops = 1
+    exporters = 1
+    templates = 1
+    records = 24
+    refresh = 20
+    sampling = 1024
+    extended = False
+    bmp_port = 0
+    bmp_peers = 2
+
+    for o, a in opts:
+        if o in ("-h", "--help"):
+            usage(sys.argv[0])
+            sys.exit()
+        elif o in ("-P", "--port"): port = int(a)
+        elif o in ("-H", "--host"): host = a
+        elif o in ("-f", "--file"): filename = a
+        elif o in ("-T", "--type"): kind = a
+        elif o in ("-r", "--rate"): rate = int(a)
+        elif o in ("-d", "--duration"): duration = float(a)
+        elif o in ("-c", "--count"): count = int(a)
+        elif o in ("-p", "--filter_port"): filter_port = int(a)
+        elif o in ("-l", "--loops"): loops = int(a)
+        elif o in ("-e", "--exporters"): exporters = int(a)
+        elif o in ("-n", "--templates"): templates = int(a)
+        elif o in ("-R", "--records"): records = int(a)
+        elif o in ("-t", "--template_refresh"): refresh = int(a)
+        elif o in ("-S", "--sampling_rate"): sampling = int(a)
+        elif o in ("-x", "--sflow_extended"): extended = True
+        elif o in ("-b", "--bmp_port"): bmp_port = int(a)
+        elif o in ("-m", "--bmp_peers"): bmp_peers = int(a)
+        else:
+            assert False, "unhandled option"
+
+    if not port or bool(filename) == bool(kind) or (kind and kind not in ("v5", "v9", "ipfix", "sflow")) or \
+       (bmp_port and filename):
+        usage(sys.argv[0])
+        sys.exit(1)
+
+    family = socket.AF_INET6 if ":" in host else socket.AF_INET
+    loopback = host in ("127.0.0.1", "::1", "localhost")
+    sockets = {}
+
+    def sender(key, idx):
+        # one socket per exporter; bound to a distinct loopback source when
+        # the collector is local, so it can tell exporters apart
+        s = sockets.get(key)
+        if s is None:
+            s = socket.socket(family, socket.SOCK_DGRAM)
+            s.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 1048576)
+            if loopback and family == socket.AF_INET: s.bind((exporter_addr(idx), 0))
+            s.connect((host, port))
+            sockets[key] = s
+        return s
+
+    def source():
+        if filename:
+            loop, seen = 0, {}
+            while not loops or loop < loops:
+                for src, payload in pcap_datagrams(filename, filter_port):
+                    if src not in seen: seen[src] = len(seen)
+                    yield sender(src, seen[src]), payload, 0
+                loop += 1
+        else:
+            pool = [Exporter(idx, kind, max(templates, 1), max(records, 1), max(refresh, 1), max(sampling, 1), extended)
+                    for idx in range(exporters)]
+            while True:
+                for exp in pool:
+                    dgram, flows = exp.next()
+                    yield sender(exp.idx, exp.idx), dgram, flows
+
+    bmp_sessions = []
+    if bmp_port:
+        for idx in range(exporters):
+            bmp_sessions.append(bmp_connect(host, bmp_port, idx, max(bmp_peers, 1), family, loopback))
+        print("BMP sessions: %u, monitored peers: %u" % (len(bmp_sessions), len(bmp_sessions) * max(bmp_peers, 1)))
+        # let the collector ingest the routes before flows start
+        time.sleep(2)
+
+    drops_base = udp_drops(port) if loopback else None
+    sent = flows = errors = 0
+    last_sent = last_flows = 0
+    start = last = time.time()
+
+    try:
+        for s, payload, nflows in source():
+            if rate:
+                ahead = start + (float(sent) / rate) - time.time()
+                if ahead > 0: time.sleep(ahead)
+            try:
+                s.send(payload)
+            except socket.error:
+                errors += 1
+            sent += 1
+            flows += nflows
+
+            now = time.time()
+            if now - last >= 1:
+                report = "datagrams/s: %u" % ((sent - last_sent) / (now - last))
+                if not filename: report += "  flows/s: %u" % ((flows - last_flows) / (now - last))
+                if drops_base is not None: report += "  rcv drops: %u" % (udp_drops(port) - drops_base)
+                print(report)
+                last, last_sent, last_flows = now, sent, flows
+
+            if (count and sent >= count) or (duration and now - start >= duration): break
+    except KeyboardInterrupt:
+        pass
+
+    elapsed = max(time.time() - start, 0.000001)
+    print("")
+    print("datagrams sent: %u (%u/s), send errors: %u, exporters: %u" % (sent, sent / elapsed, errors, len(sockets)))
+    if not filename: print("flows sent: %u (%u/s)" % (flows, flows / elapsed))
+    if drops_base is not None:
+        time.sleep(1)
+        print("collector socket receive drops: %u" % (udp_drops(port) - drops_base))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# Benchmark of the MongoDB plugin purge against a local mongod. For each
+# amount of mongo_purge_workers, nfacctd is fed with NetFlow v5 datagrams
+# via flow_replay.py (every record a distinct aggregate) and then stopped:
+# the plugin purges its whole cache at once. Reported are the time between
+# the stop signal and the plugin being gone, documents/s overall, the per
+# stage rates logged by the plugin (BSON encoding per worker, inserts) and,
+# if the mongo shell is available, the documents found in the collection.
+#
+# Usage: mongodb_bench.sh <nfacctd binary> <work dir> [datagrams, 30 flows each] [workers list]
+#
+#   mongodb_bench.sh src/nfacctd /var/tmp/mb 10000 "1 2 4"
+#
+# Requires nfacctd built with --enable-mongodb and a mongod listening on
+# 127.0.0.1:27017; collections pmacct.bench_w<workers> are dropped first.
+
+NFACCTD=$1
+DIR=$2
+DATAGRAMS=${3:-10000}
+WORKERS=${4:-"1 2 4"}
+PORT=${PORT:-20992}
+HERE=$(cd "$(dirname "$0")" && pwd)
+
+if [ -z "$NFACCTD" ] || [ -z "$DIR" ]; then
+  echo "Usage: $0 <nfacctd binary> <work dir> [datagrams] [workers list]"
+  exit 1
+fi
+
+mkdir -p "$DIR" || exit 1
+
+MONGO_SHELL=
+if command -v mongosh > /dev/null; then MONGO_SHELL=mongosh
+elif command -v mongo > /dev/null; then MONGO_SHELL=mongo
+fi
+
+for workers in $WORKERS; do
+  TABLE=bench_w$workers
+  CONF=$DIR/bench_w$workers.conf
+  LOG=$DIR/bench_w$workers.log
+  rm -f "$LOG"
+  [ -n "$MONGO_SHELL" ] && $MONGO_SHELL --quiet pmacct --eval "db.$TABLE.drop()" > /dev/null
+
+  cat > "$CONF" <<EOF
+daemonize: false
+logfile: $LOG
+nfacctd_ip: 127.0.0.1
+nfacctd_port: $PORT
+plugin_pipe_size: 268435456
+plugin_buffer_size: 65536
+plugins: mongodb[m]
+aggregate[m]: src_host, dst_host, src_port, dst_port, proto
+mongo_host[m]: 127.0.0.1
+mongo_table[m]: pmacct.$TABLE
+mongo_refresh_time[m]: 3600
+mongo_cache_entries[m]: $((DATAGRAMS * 30 * 2 + 1))
+mongo_insert_batch[m]: 10000
+mongo_purge_workers[m]: $workers
+EOF
+
+  "$NFACCTD" -f "$CONF" > /dev/null 2>&1 &
+  CORE=$!
+  sleep 7
+
+  ${PYTHON:-python} "$HERE/flow_replay.py" -P $PORT -T v5 -R 30 -c $DATAGRAMS -r 5000 > /dev/null
+  # let the plugin drain its pipe
+  sleep 5
+
+  START=$(date +%s.%N)
+  kill -INT $CORE
+  while pgrep -f "nfacctd: .*\[m\]" > /dev/null || kill -0 $CORE 2> /dev/null; do sleep 0.1; done
+  END=$(date +%s.%N)
+
+  DOCS=$((DATAGRAMS * 30))
+  [ -n "$MONGO_SHELL" ] && DOCS=$($MONGO_SHELL --quiet pmacct --eval "db.$TABLE.countDocuments({})")
+  awk -v w=$workers -v s=$START -v e=$END -v d=$DOCS \
+    'BEGIN { printf("workers: %-3u docs: %u  purge: %.2f secs  docs/s: %u\n", w, d, e-s, d/(e-s)) }'
+  grep "BSON encoding" "$LOG" | tail -1 | sed 's/.*): /  /'
+done
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# On-disk benchmark of the sqlite3 plugin write path. For each variant a
+# fresh database is created, nfacctd is fed with NetFlow v5 datagrams via
+# flow_replay.py (every record a distinct aggregate) and then stopped: the
+# plugin purges its whole cache at once. Reported are the time between the
+# stop signal and the plugin being gone, the rows written and rows/s.
+#
+# Variants:
+#   text      rows printed into SQL text, as by default
+#   prepare   sqlite3_prepare: true
+#   tuned     sqlite3_prepare plus WAL journal, 64MB page cache and
+#             commits every 10000 rows
+#
+# Usage: sqlite3_bench.sh <nfacctd binary> <work dir> [datagrams, 30 flows each]
+#
+# Requires nfacctd built with --enable-sqlite3 and the sqlite3 command line
+# tool. The work dir should sit on the disk to be measured (not on tmpfs).
+
+NFACCTD=$1
+DIR=$2
+DATAGRAMS=${3:-10000}
+PORT=${PORT:-20991}
+HERE=$(cd "$(dirname "$0")" && pwd)
+SCHEMA=$HERE/../../sql/pmacct-create-table_v1.sqlite3
+
+if [ -z "$NFACCTD" ] || [ -z "$DIR" ]; then
+  echo "Usage: $0 <nfacctd binary> <work dir> [datagrams]"
+  exit 1
+fi
+
+mkdir -p "$DIR" || exit 1
+
+for variant in text prepare tuned; do
+  DB=$DIR/bench_$variant.db
+  CONF=$DIR/bench_$variant.conf
+  LOG=$DIR/bench_$variant.log
+  rm -f "$DB" "$DB-wal" "$DB-shm" "$LOG"
+  sqlite3 "$DB" < "$SCHEMA" || exit 1
+
+  cat > "$CONF" <<EOF
+daemonize: false
+logfile: $LOG
+nfacctd_ip: 127.0.0.1
+nfacctd_port: $PORT
+plugin_pipe_size: 268435456
+plugin_buffer_size: 65536
+plugins: sqlite3[s]
+aggregate[s]: src_host, dst_host, src_port, dst_port, proto
+sql_db[s]: $DB
+sql_table_version[s]: 1
+sql_refresh_time[s]: 3600
+sql_cache_entries[s]: $((DATAGRAMS * 30 * 2 + 1))
+EOF
+  case $variant in
+  prepare)
+    echo "sqlite3_prepare[s]: true" >> "$CONF"
+    ;;
+  tuned)
+    echo "sqlite3_prepare[s]: true" >> "$CONF"
+    echo "sqlite3_journal_mode[s]: wal" >> "$CONF"
+    echo "sqlite3_cache_size[s]: -65536" >> "$CONF"
+    echo "sqlite3_commit_batch[s]: 10000" >> "$CONF"
+    ;;
+  esac
+
+  "$NFACCTD" -f "$CONF" > /dev/null 2>&1 &
+  CORE=$!
+  sleep 7
+
+  ${PYTHON:-python} "$HERE/flow_replay.py" -P $PORT -T v5 -R 30 -c $DATAGRAMS -r 5000 > /dev/null
+  # let the plugin drain its pipe
+  sleep 5
+
+  START=$(date +%s.%N)
+  kill -INT $CORE
+  while pgrep -f "nfacctd: .*\[s\]" > /dev/null || kill -0 $CORE 2> /dev/null; do sleep 0.1; done
+  END=$(date +%s.%N)
+
+  ROWS=$(sqlite3 "$DB" "SELECT COUNT(*) FROM acct;")
+  awk -v v=$variant -v s=$START -v e=$END -v r=$ROWS \
+    'BEGIN { printf("%-8s rows: %u  purge: %.2f secs  rows/s: %u\n", v, r, e-s, r/(e-s)) }'
+done
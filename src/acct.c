@@ -26,6 +26,11 @@
 #include "imt_plugin.h"
 #include "crc32.c"
 
+/* secondary indexes stuff */
+static struct imt_index_chunk *index_chunks, *index_chunk_cur;
+static struct extra_primitives index_extras;
+static struct imt_index_node *index_free;
+
 /* functions */
 struct acc *search_accounting_structure(struct primitives_ptrs *prim_ptrs)
 {
@@ -299,6 +304,7 @@ void insert_accounting_structure(struct primitives_ptrs *prim_ptrs)
         elem_acc->bytes_counter += data->cst.ba;
         elem_acc->flow_counter += data->cst.fa;
       }
+      if (imt_indexes_num) insert_index_structures(elem_acc);
       lru_elem_ptr[config.buckets] = elem_acc;
       return;
     }
@@ -409,6 +415,7 @@ void insert_accounting_structure(struct primitives_ptrs *prim_ptrs)
         elem_acc->flow_counter += data->cst.fa;
       }
       elem_acc->next = NULL;
+      if (imt_indexes_num) insert_index_structures(elem_acc);
       lru_elem_ptr[config.buckets] = elem_acc;
       return;
     }
@@ -429,3 +436,176 @@ void reset_counters(struct acc *elem)
   elem->flow_type = 0;
   memcpy(&elem->rstamp, &cycle_stamp, sizeof(struct timeval));
 }
+
+unsigned int hash_masked_primitives(struct pkt_primitives *pprim, struct pkt_bgp_primitives *pbgp,
+		struct pkt_nat_primitives *pnat, struct pkt_mpls_primitives *pmpls, struct extra_primitives *extras)
+{
+  unsigned int hash;
+
+  hash = cache_crc32((unsigned char *)pprim, sizeof(struct pkt_primitives));
+  if (extras->off_pkt_bgp_primitives) hash ^= cache_crc32((unsigned char *)pbgp, sizeof(struct pkt_bgp_primitives));
+  if (extras->off_pkt_nat_primitives) hash ^= cache_crc32((unsigned char *)pnat, sizeof(struct pkt_nat_primitives));
+  if (extras->off_pkt_mpls_primitives) hash ^= cache_crc32((unsigned char *)pmpls, sizeof(struct pkt_mpls_primitives));
+
+  return hash;
+}
+
+/*
+  Secondary indexes: each index hashes entries on a subset of the
+  aggregation primitives (imt_index) so that pmacct -M/-N queries on
+  that subset do not need to walk the whole table. Entries get recycled
+  by insert_accounting_structure() once their counters are zeroed: their
+  nodes are then unlinked and put on a free list before being re-indexed.
+*/
+void init_index_structures(struct extra_primitives *extras)
+{
+  int idx, num = 0;
+
+  memcpy(&index_extras, extras, sizeof(struct extra_primitives));
+  index_chunks = NULL;
+  index_chunk_cur = NULL;
+  index_free = NULL;
+
+  for (idx = 0; idx < config.imt_index_num; idx++) {
+    if ((config.imt_index_wtc[idx] & ~config.what_to_count) ||
+        (config.imt_index_wtc_2[idx] & ~config.what_to_count_2)) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): imt_index #%u is not a subset of 'aggregate'. Ignored.\n", config.name, config.type, idx+1);
+      continue;
+    }
+
+    imt_indexes[num].what_to_count = config.imt_index_wtc[idx];
+    imt_indexes[num].what_to_count_2 = config.imt_index_wtc_2[idx];
+    imt_indexes[num].buckets = calloc(config.buckets, sizeof(struct imt_index_node *));
+    if (!imt_indexes[num].buckets) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (init_index_structures). Exiting ..\n", config.name, config.type);
+      exit_plugin(1);
+    }
+    num++;
+  }
+
+  imt_indexes_num = num;
+  if (num) Log(LOG_INFO, "INFO ( %s/%s ): %u secondary indexes on the memory table\n", config.name, config.type, num);
+}
+
+void clear_index_structures()
+{
+  int idx;
+
+  for (idx = 0; idx < imt_indexes_num; idx++)
+    memset(imt_indexes[idx].buckets, 0, config.buckets*sizeof(struct imt_index_node *));
+
+  /* chunks are kept around for reuse */
+  for (index_chunk_cur = index_chunks; index_chunk_cur; index_chunk_cur = index_chunk_cur->next)
+    index_chunk_cur->used = 0;
+  index_chunk_cur = index_chunks;
+  index_free = NULL;
+}
+
+static struct imt_index_node *alloc_index_node()
+{
+  struct imt_index_node *node;
+
+  if (index_free) {
+    node = index_free;
+    index_free = node->sibling;
+
+    return node;
+  }
+
+  if (!index_chunk_cur || index_chunk_cur->used == IMT_INDEX_CHUNK_SZ) {
+    if (index_chunk_cur && index_chunk_cur->next) index_chunk_cur = index_chunk_cur->next;
+    else {
+      struct imt_index_chunk *chunk = malloc(sizeof(struct imt_index_chunk));
+
+      if (!chunk) return NULL;
+
+      chunk->used = 0;
+      chunk->next = NULL;
+      if (index_chunk_cur) index_chunk_cur->next = chunk;
+      else index_chunks = chunk;
+      index_chunk_cur = chunk;
+    }
+  }
+
+  node = &index_chunk_cur->nodes[index_chunk_cur->used];
+  index_chunk_cur->used++;
+
+  return node;
+}
+
+void insert_index_structures(struct acc *elem)
+{
+  struct pkt_primitives tbuf;
+  struct pkt_bgp_primitives bbuf;
+  struct pkt_nat_primitives nbuf;
+  struct pkt_mpls_primitives mbuf;
+  struct imt_index_node *node;
+  unsigned int pos;
+  int idx;
+
+  /* a recycled entry is still linked under its former primitives */
+  if (elem->index_nodes) remove_index_structures(elem);
+
+  for (idx = 0; idx < imt_indexes_num; idx++) {
+    if (!(node = alloc_index_node())) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): malloc() failed (insert_index_structures). Entry not indexed.\n", config.name, config.type);
+      remove_index_structures(elem);
+      return;
+    }
+
+    mask_elem(&tbuf, &bbuf, &nbuf, &mbuf, elem, imt_indexes[idx].what_to_count, imt_indexes[idx].what_to_count_2, &index_extras);
+    pos = hash_masked_primitives(&tbuf, &bbuf, &nbuf, &mbuf, &index_extras) % config.buckets;
+
+    node->acc = elem;
+    node->next = imt_indexes[idx].buckets[pos];
+    node->pprev = &imt_indexes[idx].buckets[pos];
+    if (node->next) node->next->pprev = &node->next;
+    imt_indexes[idx].buckets[pos] = node;
+
+    node->sibling = elem->index_nodes;
+    elem->index_nodes = node;
+  }
+}
+
+void remove_index_structures(struct acc *elem)
+{
+  struct imt_index_node *node, *sibling;
+
+  for (node = elem->index_nodes; node; node = sibling) {
+    sibling = node->sibling;
+
+    *node->pprev = node->next;
+    if (node->next) node->next->pprev = node->pprev;
+
+    node->acc = NULL;
+    node->sibling = index_free;
+    index_free = node;
+  }
+
+  elem->index_nodes = NULL;
+}
+
+struct imt_index *search_index_structures(pm_cfgreg_t wtc, pm_cfgreg_t wtc_2)
+{
+  int idx;
+
+  wtc &= ~COUNT_COUNTERS;
+
+  for (idx = 0; idx < imt_indexes_num; idx++) {
+    if (imt_indexes[idx].what_to_count == wtc && imt_indexes[idx].what_to_count_2 == wtc_2)
+      return &imt_indexes[idx];
+  }
+
+  return NULL;
+}
+
+/* returns the bucket chain; nodes may be stale or hash collisions: callers do compare */
+struct imt_index_node *lookup_index_structure(struct imt_index *index, struct pkt_primitives *pprim,
+		struct pkt_bgp_primitives *pbgp, struct pkt_nat_primitives *pnat, struct pkt_mpls_primitives *pmpls)
+{
+  unsigned int pos;
+
+  pos = hash_masked_primitives(pprim, pbgp, pnat, pmpls, &index_extras) % config.buckets;
+
+  return index->buckets[pos];
+}
@@ -25,6 +25,7 @@
 /* includes */
 #include "pmacct.h"
 #include "bgp.h"
+#include "../bmp/bmp.h"
 #include "thread_pool.h"
 #if defined WITH_RABBITMQ
 #include "amqp_common.h"
@@ -47,7 +48,7 @@ void nfacctd_bgp_wrapper()
   if (!config.nfacctd_bgp_port) config.nfacctd_bgp_port = BGP_TCP_PORT;
 
   /* initialize threads pool */
-  bgp_pool = allocate_thread_pool(1);
+  bgp_pool = allocate_thread_pool(1, THREAD_POOL_PLACED);
   assert(bgp_pool);
   Log(LOG_DEBUG, "DEBUG ( %s/core/BGP ): %d thread(s) initialized\n", config.name, 1);
 
@@ -195,6 +196,13 @@ void skinny_bgp_daemon()
     exit_all(1);
   }
 
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].rib = rib;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].route_info_modulo = bgp_route_info_modulo;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].peer_buckets = config.bgp_table_peer_buckets;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].per_peer_buckets = config.bgp_table_per_peer_buckets;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].per_peer_hash = config.bgp_table_per_peer_hash;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].msglog_backend_methods = nfacctd_bgp_msglog_backend_methods;
+
   config.bgp_sock = socket(((struct sockaddr *)&server)->sa_family, SOCK_STREAM, 0);
   if (config.bgp_sock < 0) {
 #if (defined ENABLE_IPV6)
@@ -287,7 +295,7 @@ void skinny_bgp_daemon()
   /* Let's initialize clean shared RIB */
   for (afi = AFI_IP; afi < AFI_MAX; afi++) {
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++) {
-      rib[afi][safi] = bgp_table_init(afi, safi);
+      rib[afi][safi] = bgp_table_init(afi, safi, FUNC_TYPE_BGP);
     }
   }
 
@@ -469,7 +477,7 @@ void skinny_bgp_daemon()
 	  */
           if (bgp_batch_is_admitted(&bp_batch, now)) {
             peer = &peers[peers_idx];
-            if (bgp_peer_init(peer)) peer = NULL;
+            if (bgp_peer_init(peer, FUNC_TYPE_BGP)) peer = NULL;
 	    else recalc_fds = TRUE;
 
             log_notification_unset(&log_notifications.bgp_peers_throttling);
@@ -1068,11 +1076,11 @@ int bgp_update_msg(struct bgp_peer *peer, char *pkt)
   /* Everything is done.  We unintern temporary structures which
 	 interned in bgp_attr_parse(). */
   if (attr.aspath)
-	aspath_unintern(attr.aspath);
+	aspath_unintern(peer, attr.aspath);
   if (attr.community)
-	community_unintern(attr.community);
+	community_unintern(peer, attr.community);
   if (attr.ecommunity)
-	ecommunity_unintern(attr.ecommunity);
+	ecommunity_unintern(peer, attr.ecommunity);
 
   return 0;
 }
@@ -1151,7 +1159,7 @@ int bgp_attr_parse(struct bgp_peer *peer, struct bgp_attr *attr, char *ptr, int
 
   /* AS_PATH and AS4_PATH info are now fully merged;
 	 hence we can free up temporary structures. */
-    aspath_unintern(as4_path);
+    aspath_unintern(peer, as4_path);
 	
 	if (ret < 0) return ret;
   }
@@ -1163,14 +1171,14 @@ int bgp_attr_parse_aspath(struct bgp_peer *peer, u_int16_t len, struct bgp_attr
 {
   u_int8_t cap_4as = peer->cap_4as ? 1 : 0;
 
-  attr->aspath = aspath_parse(ptr, len, cap_4as);
+  attr->aspath = aspath_parse(peer, ptr, len, cap_4as);
 
   return 0;
 }
 
 int bgp_attr_parse_as4path(struct bgp_peer *peer, u_int16_t len, struct bgp_attr *attr, char *ptr, u_int8_t flag, struct aspath **aspath4)
 {
-  *aspath4 = aspath_parse(ptr, len, 1);
+  *aspath4 = aspath_parse(peer, ptr, len, 1);
 
   return 0;
 }
@@ -1192,7 +1200,7 @@ int bgp_attr_parse_nexthop(struct bgp_peer *peer, u_int16_t len, struct bgp_attr
 int bgp_attr_parse_community(struct bgp_peer *peer, u_int16_t len, struct bgp_attr *attr, char *ptr, u_int8_t flag)
 {
   if (len == 0) attr->community = NULL;
-  else attr->community = (struct community *) community_parse((u_int32_t *)ptr, len);
+  else attr->community = (struct community *) community_parse(peer, (u_int32_t *)ptr, len);
 
   return 0;
 }
@@ -1200,7 +1208,7 @@ int bgp_attr_parse_community(struct bgp_peer *peer, u_int16_t len, struct bgp_at
 int bgp_attr_parse_ecommunity(struct bgp_peer *peer, u_int16_t len, struct bgp_attr *attr, char *ptr, u_int8_t flag)
 {
   if (len == 0) attr->ecommunity = NULL;
-  else attr->ecommunity = (struct ecommunity *) ecommunity_parse(ptr, len);
+  else attr->ecommunity = (struct ecommunity *) ecommunity_parse(peer, ptr, len);
 
   return 0;
 }
@@ -1465,9 +1473,10 @@ int bgp_process_update(struct bgp_peer *peer, struct prefix *p, void *attr, afi_
   struct bgp_node *route = NULL;
   struct bgp_info *ri = NULL, *new = NULL;
   struct bgp_attr *attr_new = NULL;
-  u_int32_t modulo = bgp_route_info_modulo(peer, path_id);
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
+  u_int32_t modulo = inter_domain_routing_db->route_info_modulo(peer, path_id);
 
-  route = bgp_node_get(rib[afi][safi], p);
+  route = bgp_node_get(inter_domain_routing_db->rib[afi][safi], p);
 
   /* Check previously received route. */
   for (ri = route->info[modulo]; ri; ri = ri->next) {
@@ -1492,15 +1501,15 @@ int bgp_process_update(struct bgp_peer *peer, struct prefix *p, void *attr, afi_
     }
   }
 
-  attr_new = bgp_attr_intern(attr);
+  attr_new = bgp_attr_intern(peer, attr);
 
   if (ri) {
 	/* Received same information */
 	if (attrhash_cmp(ri->attr, attr_new)) {
 	  bgp_unlock_node (route);
-	  bgp_attr_unintern(attr_new);
+	  bgp_attr_unintern(peer, attr_new);
 
-	  if (nfacctd_bgp_msglog_backend_methods)
+	  if (inter_domain_routing_db->msglog_backend_methods)
 	    goto log_update;
 
 	  return 0;
@@ -1509,7 +1518,7 @@ int bgp_process_update(struct bgp_peer *peer, struct prefix *p, void *attr, afi_
 	  struct bgp_info_extra *rie = NULL;
 
 	  /* Update to new attribute.  */
-	  bgp_attr_unintern(ri->attr);
+	  bgp_attr_unintern(peer, ri->attr);
 	  ri->attr = attr_new;
 
 	  /* Install/update MPLS stuff if required */
@@ -1531,7 +1540,7 @@ int bgp_process_update(struct bgp_peer *peer, struct prefix *p, void *attr, afi_
 
 	  bgp_unlock_node (route);
 
-	  if (nfacctd_bgp_msglog_backend_methods)
+	  if (inter_domain_routing_db->msglog_backend_methods)
 	    goto log_update;
 
 	  return 0;
@@ -1569,7 +1578,7 @@ int bgp_process_update(struct bgp_peer *peer, struct prefix *p, void *attr, afi_
   /* route_node_get lock */
   bgp_unlock_node(route);
 
-  if (nfacctd_bgp_msglog_backend_methods) {
+  if (inter_domain_routing_db->msglog_backend_methods) {
     ri = new;
     goto log_update;
   }
@@ -1595,10 +1604,11 @@ int bgp_process_withdraw(struct bgp_peer *peer, struct prefix *p, void *attr, af
 {
   struct bgp_node *route = NULL;
   struct bgp_info *ri = NULL;
-  u_int32_t modulo = bgp_route_info_modulo(peer, path_id);
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
+  u_int32_t modulo = inter_domain_routing_db->route_info_modulo(peer, path_id);
 
   /* Lookup node. */
-  route = bgp_node_get(rib[afi][safi], p);
+  route = bgp_node_get(inter_domain_routing_db->rib[afi][safi], p);
 
   /* Check previously received route. */
   for (ri = route->info[modulo]; ri; ri = ri->next) {
@@ -1623,7 +1633,7 @@ int bgp_process_withdraw(struct bgp_peer *peer, struct prefix *p, void *attr, af
     }
   }
 
-  if (ri && nfacctd_bgp_msglog_backend_methods) {
+  if (ri && inter_domain_routing_db->msglog_backend_methods) {
     char event_type[] = "log";
 
     bgp_peer_log_msg(route, ri, safi, event_type, config.nfacctd_bgp_msglog_output, BGP_LOG_TYPE_WITHDRAW);
@@ -1845,7 +1855,7 @@ void bgp_info_delete(struct bgp_node *rn, struct bgp_info *ri, u_int32_t modulo)
 void bgp_info_free(struct bgp_info *ri)
 {
   if (ri->attr)
-	bgp_attr_unintern(ri->attr);
+	bgp_attr_unintern(ri->peer, ri->attr);
 
   bgp_info_extra_free(&ri->extra);
 
@@ -1857,9 +1867,14 @@ void bgp_info_free(struct bgp_info *ri)
 void bgp_attr_init()
 {
   aspath_init(&ashash);
-  attrhash_init(&attrhash);
-  community_init(&comhash);
-  ecommunity_init(&ecomhash);
+  attrhash_init(config.bgp_table_attr_hash_buckets, &attrhash);
+  community_init(config.bgp_table_attr_hash_buckets, &comhash);
+  ecommunity_init(config.bgp_table_attr_hash_buckets, &ecomhash);
+
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].attrhash = attrhash;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].ashash = ashash;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].comhash = comhash;
+  inter_domain_routing_dbs[FUNC_TYPE_BGP].ecomhash = ecomhash;
 }
 
 unsigned int attrhash_key_make(void *p)
@@ -1920,45 +1935,47 @@ int attrhash_cmp(const void *p1, const void *p2)
   return 0;
 }
 
-void attrhash_init(struct hash **loc_attrhash)
+void attrhash_init(int buckets, struct hash **loc_attrhash)
 {
-  (*loc_attrhash) = (struct hash *) hash_create(attrhash_key_make, attrhash_cmp);
+  (*loc_attrhash) = (struct hash *) hash_create_size(buckets, attrhash_key_make, attrhash_cmp);
 }
 
 /* Internet argument attribute. */
-struct bgp_attr *bgp_attr_intern(struct bgp_attr *attr)
+struct bgp_attr *bgp_attr_intern(struct bgp_peer *peer, struct bgp_attr *attr)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct bgp_attr *find;
  
   /* Intern referenced strucutre. */
   if (attr->aspath) {
     if (! attr->aspath->refcnt)
-      attr->aspath = aspath_intern (attr->aspath);
+      attr->aspath = aspath_intern (peer, attr->aspath);
   else
 	  attr->aspath->refcnt++;
   }
   if (attr->community) {
 	if (! attr->community->refcnt)
-	  attr->community = community_intern (attr->community);
+	  attr->community = community_intern (peer, attr->community);
 	else
 	  attr->community->refcnt++;
   }
   if (attr->ecommunity) {
  	if (!attr->ecommunity->refcnt)
-	  attr->ecommunity = ecommunity_intern (attr->ecommunity);
+	  attr->ecommunity = ecommunity_intern (peer, attr->ecommunity);
   else
 	attr->ecommunity->refcnt++;
   }
  
-  find = (struct bgp_attr *) hash_get(attrhash, attr, bgp_attr_hash_alloc);
+  find = (struct bgp_attr *) hash_get(inter_domain_routing_db->attrhash, attr, bgp_attr_hash_alloc);
   find->refcnt++;
 
   return find;
 }
 
 /* Free bgp attribute and aspath. */
-void bgp_attr_unintern(struct bgp_attr *attr)
+void bgp_attr_unintern(struct bgp_peer *peer, struct bgp_attr *attr)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct bgp_attr *ret;
   struct aspath *aspath;
   struct community *community;
@@ -1972,7 +1989,7 @@ void bgp_attr_unintern(struct bgp_attr *attr)
 
   /* If reference becomes zero then free attribute object. */
   if (attr->refcnt == 0) {
-	ret = (struct bgp_attr *) hash_release (attrhash, attr);
+	ret = (struct bgp_attr *) hash_release (inter_domain_routing_db->attrhash, attr);
 	// assert (ret != NULL);
 	if (!ret) Log(LOG_INFO, "INFO ( %s/core/BGP ): bgp_attr_unintern() hash lookup failed.\n", config.name);
 	free(attr);
@@ -1980,11 +1997,11 @@ void bgp_attr_unintern(struct bgp_attr *attr)
 
   /* aspath refcount shoud be decrement. */
   if (aspath)
-	aspath_unintern (aspath);
+	aspath_unintern (peer, aspath);
   if (community)
-	community_unintern (community);
+	community_unintern (peer, community);
   if (ecommunity)
-	ecommunity_unintern (ecommunity);
+	ecommunity_unintern (peer, ecommunity);
 }
 
 void *bgp_attr_hash_alloc (void *p)
@@ -2006,13 +2023,14 @@ void *bgp_attr_hash_alloc (void *p)
   return attr;
 }
 
-int bgp_peer_init(struct bgp_peer *peer)
+int bgp_peer_init(struct bgp_peer *peer, int type)
 {
   int ret = TRUE;
   afi_t afi;
   safi_t safi;
 
   memset(peer, 0, sizeof(struct bgp_peer));
+  peer->type = type;
   peer->status = Idle;
   peer->buf.len = BGP_BUFFER_SIZE;
   peer->buf.base = malloc(peer->buf.len);
@@ -2068,6 +2086,8 @@ void bgp_peer_close(struct bgp_peer *peer, int type)
   if (dump_file || dump_amqp_routing_key || dump_kafka_topic)
     bmp_dump_close_peer(peer);
 
+  if (type == FUNC_TYPE_BMP) bmp_mpeers_free(peer);
+
   close(peer->fd);
   peer->fd = 0;
   memset(&peer->id, 0, sizeof(peer->id));
@@ -2080,8 +2100,11 @@ void bgp_peer_close(struct bgp_peer *peer, int type)
     write_neighbors_file(neighbors_file);
 }
 
+/* Deletes all routes learnt from peer; on a BMP session this includes the
+   routes of all the peers it monitors (they share the session buckets) */
 void bgp_peer_info_delete(struct bgp_peer *peer)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct bgp_table *table;
   struct bgp_node *node;
   afi_t afi;
@@ -2089,19 +2112,19 @@ void bgp_peer_info_delete(struct bgp_peer *peer)
 
   for (afi = AFI_IP; afi < AFI_MAX; afi++) {
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++) {
-      table = rib[afi][safi];
+      table = inter_domain_routing_db->rib[afi][safi];
       node = bgp_table_top(table);
 
       while (node) {
-        u_int32_t modulo = bgp_route_info_modulo(peer, NULL);
+        u_int32_t modulo = inter_domain_routing_db->route_info_modulo(peer, NULL);
         u_int32_t peer_buckets;
         struct bgp_info *ri;
         struct bgp_info *ri_next;
 
-        for (peer_buckets = 0; peer_buckets < config.bgp_table_per_peer_buckets; peer_buckets++) {
+        for (peer_buckets = 0; peer_buckets < inter_domain_routing_db->per_peer_buckets; peer_buckets++) {
           for (ri = node->info[modulo+peer_buckets]; ri; ri = ri_next) {
-            if (ri->peer == peer) {
-	      if (nfacctd_bgp_msglog_backend_methods) {
+            if (BGP_INFO_PEER_MATCH(ri, peer)) {
+	      if (inter_domain_routing_db->msglog_backend_methods) {
 		char event_type[] = "log";
 
 		bgp_peer_log_msg(node, ri, safi, event_type, config.nfacctd_bgp_msglog_output, BGP_LOG_TYPE_DELETE);
@@ -2131,8 +2154,8 @@ int bgp_attr_munge_as4path(struct bgp_peer *peer, struct bgp_attr *attr, struct
   // XXX if (as4path && !attr->aspath) return -1;
 
   newpath = aspath_reconcile_as4(attr->aspath, as4path);
-  aspath_unintern(attr->aspath);
-  attr->aspath = aspath_intern(newpath);
+  aspath_unintern(peer, attr->aspath);
+  attr->aspath = aspath_intern(peer, newpath);
 
   return 0;
 }
@@ -2300,11 +2323,50 @@ as_t evaluate_first_asn(char *src)
   return asn;
 }
 
+/* Among the routes matching a flow exporter, returns TRUE if 'info' is
+   to be preferred over the currently selected 'cur'. A route learnt from
+   the exporter itself always wins; between BMP monitored peers the
+   post-policy (L flag) route wins over the pre-policy one, then the lowest
+   monitored peer address, then the lowest peer distinguisher. This makes
+   the choice independent of the order routes were received in */
+int bgp_info_peer_prefer(struct bgp_info *info, struct bgp_info *cur, struct bgp_peer *peer)
+{
+  struct bmp_mpeer *info_mp, *cur_mp;
+  int ret;
+
+  if (!cur) return TRUE;
+  if (cur->peer == peer) return FALSE;
+  if (info->peer == peer) return TRUE;
+
+  /* both monitored peers: struct bgp_peer is the first member of bmp_mpeer */
+  info_mp = (struct bmp_mpeer *) info->peer;
+  cur_mp = (struct bmp_mpeer *) cur->peer;
+
+  if ((info_mp->flags & BMP_PEER_FLAGS_L) != (cur_mp->flags & BMP_PEER_FLAGS_L))
+    return (info_mp->flags & BMP_PEER_FLAGS_L) ? TRUE : FALSE;
+
+  if (info_mp->peer.addr.family != cur_mp->peer.addr.family)
+    return (info_mp->peer.addr.family < cur_mp->peer.addr.family) ? TRUE : FALSE;
+
+  if (info_mp->peer.addr.family == AF_INET)
+    ret = memcmp(&info_mp->peer.addr.address.ipv4, &cur_mp->peer.addr.address.ipv4, 4);
+#if defined ENABLE_IPV6
+  else if (info_mp->peer.addr.family == AF_INET6)
+    ret = memcmp(&info_mp->peer.addr.address.ipv6, &cur_mp->peer.addr.address.ipv6, 16);
+#endif
+  else ret = 0;
+
+  if (!ret) ret = memcmp(info_mp->rd, cur_mp->rd, RD_LEN);
+
+  return (ret < 0) ? TRUE : FALSE;
+}
+
 void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
 {
   struct sockaddr *sa = (struct sockaddr *) pptrs->f_agent, sa_local;
   struct xflow_status_entry *xs_entry = (struct xflow_status_entry *) pptrs->f_status;
   struct bgp_peer *peer;
+  struct bgp_rt_structs *inter_domain_routing_db;
   struct bgp_node *default_node, *result;
   struct bgp_info *info;
   struct prefix default_prefix;
@@ -2393,13 +2455,25 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
     }
   }
 
+  /* No BGP session with the exporter: let's see if it's feeding us via BMP */
+  if (!peer && config.nfacctd_bmp && bmp_peers) {
+    for (peers_idx = 0; peers_idx < config.nfacctd_bmp_max_peers; peers_idx++) {
+      if (bmp_peers[peers_idx].fd && (!sa_addr_cmp(sa, &bmp_peers[peers_idx].addr) || !sa_addr_cmp(sa, &bmp_peers[peers_idx].id))) {
+        peer = &bmp_peers[peers_idx];
+        pptrs->bgp_peer = (char *) &bmp_peers[peers_idx];
+        break;
+      }
+    }
+  }
+
   if (peer) {
     struct host_addr peer_dst_ip;
 
-    modulo = bgp_route_info_modulo(peer, NULL);
+    inter_domain_routing_db = bgp_select_routing_db(peer->type);
+    modulo = inter_domain_routing_db->route_info_modulo(peer, NULL);
 
     // XXX: to be optimized 
-    if (config.bgp_table_per_peer_hash == BGP_ASPATH_HASH_PATHID) modulo_max = config.bgp_table_per_peer_buckets; 
+    if (inter_domain_routing_db->per_peer_hash == BGP_ASPATH_HASH_PATHID) modulo_max = inter_domain_routing_db->per_peer_buckets;
     else modulo_max = 1;
 
     if (peer->cap_add_paths && (config.acct_type == ACCT_NF || config.acct_type == ACCT_SF)) {
@@ -2423,7 +2497,7 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
     if (pptrs->l3_proto == ETHERTYPE_IP) {
       if (!pptrs->bgp_src) {
         memcpy(&pref4, &((struct my_iphdr *)pptrs->iph_ptr)->ip_src, sizeof(struct in_addr));
-	pptrs->bgp_src = (char *) bgp_node_match_ipv4(rib[AFI_IP][safi], &pref4, (struct bgp_peer *) pptrs->bgp_peer);
+	pptrs->bgp_src = (char *) bgp_node_match_ipv4(inter_domain_routing_db->rib[AFI_IP][safi], &pref4, (struct bgp_peer *) pptrs->bgp_peer);
       }
       if (!pptrs->bgp_src_info && pptrs->bgp_src) {
 	result = (struct bgp_node *) pptrs->bgp_src;	
@@ -2434,22 +2508,24 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
 
 	for (info = result->info[modulo]; info; info = info->next) {
 	  if (safi != SAFI_MPLS_VPN) {
-	    if (info->peer == peer) {
-	      pptrs->bgp_src_info = (char *) info;
-	      break;
+	    if (BGP_INFO_PEER_MATCH(info, peer)) {
+	      if (bgp_info_peer_prefer(info, (struct bgp_info *) pptrs->bgp_src_info, peer))
+	        pptrs->bgp_src_info = (char *) info;
+	      if (info->peer == peer) break;
 	    }
 	  }
 	  else {
-	    if (info->peer == peer && info->extra && !memcmp(&info->extra->rd, &rd, sizeof(rd_t))) {
-	      pptrs->bgp_src_info = (char *) info;
-	      break;
+	    if (BGP_INFO_PEER_MATCH(info, peer) && info->extra && !memcmp(&info->extra->rd, &rd, sizeof(rd_t))) {
+	      if (bgp_info_peer_prefer(info, (struct bgp_info *) pptrs->bgp_src_info, peer))
+	        pptrs->bgp_src_info = (char *) info;
+	      if (info->peer == peer) break;
 	    }
 	  }
 	}
       }
       if (!pptrs->bgp_dst) {
 	memcpy(&pref4, &((struct my_iphdr *)pptrs->iph_ptr)->ip_dst, sizeof(struct in_addr));
-	pptrs->bgp_dst = (char *) bgp_node_match_ipv4(rib[AFI_IP][safi], &pref4, (struct bgp_peer *) pptrs->bgp_peer);
+	pptrs->bgp_dst = (char *) bgp_node_match_ipv4(inter_domain_routing_db->rib[AFI_IP][safi], &pref4, (struct bgp_peer *) pptrs->bgp_peer);
       }
       if (!pptrs->bgp_dst_info && pptrs->bgp_dst) {
 	result = (struct bgp_node *) pptrs->bgp_dst;
@@ -2460,7 +2536,7 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
 
         for (local_modulo = modulo, modulo_idx = 0; modulo_idx < modulo_max; local_modulo++, modulo_idx++) {
           for (info = result->info[local_modulo]; info; info = info->next) {
-	    if (info->peer == peer) {
+	    if (BGP_INFO_PEER_MATCH(info, peer)) {
 	      int no_match = FALSE;
 
 	      /* flagging additional checks are required */
@@ -2483,8 +2559,9 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
 	      }
 
 	      if (!no_match) {
-	        pptrs->bgp_dst_info = (char *) info;
-	        break;
+	        if (bgp_info_peer_prefer(info, (struct bgp_info *) pptrs->bgp_dst_info, peer))
+	          pptrs->bgp_dst_info = (char *) info;
+	        if (info->peer == peer) break;
 	      }
 	    }
 	  }
@@ -2498,7 +2575,7 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
     else if (pptrs->l3_proto == ETHERTYPE_IPV6) {
       if (!pptrs->bgp_src) {
         memcpy(&pref6, &((struct ip6_hdr *)pptrs->iph_ptr)->ip6_src, sizeof(struct in6_addr));
-	pptrs->bgp_src = (char *) bgp_node_match_ipv6(rib[AFI_IP6][safi], &pref6, (struct bgp_peer *) pptrs->bgp_peer);
+	pptrs->bgp_src = (char *) bgp_node_match_ipv6(inter_domain_routing_db->rib[AFI_IP6][safi], &pref6, (struct bgp_peer *) pptrs->bgp_peer);
       }
       if (!pptrs->bgp_src_info && pptrs->bgp_src) {
 	result = (struct bgp_node *) pptrs->bgp_src;
@@ -2509,22 +2586,24 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
 
         for (info = result->info[modulo]; info; info = info->next) {
           if (safi != SAFI_MPLS_VPN) {
-            if (info->peer == peer) {
-              pptrs->bgp_src_info = (char *) info;
-              break;
+            if (BGP_INFO_PEER_MATCH(info, peer)) {
+              if (bgp_info_peer_prefer(info, (struct bgp_info *) pptrs->bgp_src_info, peer))
+                pptrs->bgp_src_info = (char *) info;
+              if (info->peer == peer) break;
             }
           }
           else {
-            if (info->peer == peer && info->extra && !memcmp(&info->extra->rd, &rd, sizeof(rd_t))) {
-              pptrs->bgp_src_info = (char *) info;
-              break;
+            if (BGP_INFO_PEER_MATCH(info, peer) && info->extra && !memcmp(&info->extra->rd, &rd, sizeof(rd_t))) {
+              if (bgp_info_peer_prefer(info, (struct bgp_info *) pptrs->bgp_src_info, peer))
+                pptrs->bgp_src_info = (char *) info;
+              if (info->peer == peer) break;
             }
           }
         }
       }
       if (!pptrs->bgp_dst) {
         memcpy(&pref6, &((struct ip6_hdr *)pptrs->iph_ptr)->ip6_dst, sizeof(struct in6_addr));
-	pptrs->bgp_dst = (char *) bgp_node_match_ipv6(rib[AFI_IP6][safi], &pref6, (struct bgp_peer *) pptrs->bgp_peer);
+	pptrs->bgp_dst = (char *) bgp_node_match_ipv6(inter_domain_routing_db->rib[AFI_IP6][safi], &pref6, (struct bgp_peer *) pptrs->bgp_peer);
       }
       if (!pptrs->bgp_dst_info && pptrs->bgp_dst) {
 	result = (struct bgp_node *) pptrs->bgp_dst; 
@@ -2535,7 +2614,7 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
 
         for (local_modulo = modulo, modulo_idx = 0; modulo_idx < modulo_max; local_modulo++, modulo_idx++) {
           for (info = result->info[local_modulo]; info; info = info->next) {
-            if (info->peer == peer) {
+            if (BGP_INFO_PEER_MATCH(info, peer)) {
               int no_match = FALSE;
 
               /* flagging additional checks are required */
@@ -2555,8 +2634,9 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
               }
 
               if (!no_match) {
-	        pptrs->bgp_dst_info = (char *) info;
-	        break;
+	        if (bgp_info_peer_prefer(info, (struct bgp_info *) pptrs->bgp_dst_info, peer))
+	          pptrs->bgp_dst_info = (char *) info;
+	        if (info->peer == peer) break;
 	      }
 	    }
           }
@@ -2646,7 +2726,7 @@ void bgp_srcdst_lookup(struct packet_ptrs *pptrs)
       }
     }
 
-    if (config.nfacctd_bgp_follow_nexthop[0].family && pptrs->bgp_dst && safi != SAFI_MPLS_VPN)
+    if (config.nfacctd_bgp_follow_nexthop[0].family && pptrs->bgp_dst && safi != SAFI_MPLS_VPN && peer->type == FUNC_TYPE_BGP)
       bgp_follow_nexthop_lookup(pptrs);
   }
 }
@@ -3057,13 +3137,21 @@ void process_bgp_md5_file(int sock, struct bgp_md5_table *bgp_md5)
 
 u_int32_t bgp_route_info_modulo_pathid(struct bgp_peer *peer, path_id_t *path_id)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   path_id_t local_path_id = 1;
 
   if (path_id && *path_id) local_path_id = *path_id;
 
-  return (((peer->fd * config.bgp_table_per_peer_buckets) +
-	  ((local_path_id - 1) % config.bgp_table_per_peer_buckets)) %
-	  (config.bgp_table_peer_buckets * config.bgp_table_per_peer_buckets));
+  return (((peer->fd * inter_domain_routing_db->per_peer_buckets) +
+	  ((local_path_id - 1) % inter_domain_routing_db->per_peer_buckets)) %
+	  (inter_domain_routing_db->peer_buckets * inter_domain_routing_db->per_peer_buckets));
+}
+
+struct bgp_rt_structs *bgp_select_routing_db(int peer_type)
+{
+  if (peer_type > 0 && peer_type < FUNC_TYPE_MAX) return &inter_domain_routing_dbs[peer_type];
+
+  return NULL;
 }
 
 void bgp_batch_init(struct bgp_peer_batch *bp_batch, int num, int interval)
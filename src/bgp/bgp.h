@@ -93,6 +93,7 @@ struct bgp_peer_buf {
 struct bgp_peer {
   int fd;
   int lock;
+  u_int8_t type; /* FUNC_TYPE_BGP, FUNC_TYPE_BMP: selects the routing DB */
   u_int8_t status;
   as_t myas;
   as_t as;
@@ -109,8 +110,30 @@ struct bgp_peer {
   struct bgp_peer_buf buf;
   struct bgp_peer_log *log;
   void *bmp_se; /* struct bmp_dump_se_ll */
+  struct bgp_peer *bmp_router; /* BMP monitored peer: BMP session it is learnt from */
+  void *bmp_mpeers; /* BMP session: struct bmp_mpeer list of monitored peers */
 };
 
+/* Routing DB: BGP and BMP share the parsing and RIB code, each with its
+   own RIB, attribute caches and bucketing; peer->type picks one */
+struct bgp_rt_structs {
+  struct hash *attrhash;
+  struct hash *ashash;
+  struct hash *comhash;
+  struct hash *ecomhash;
+  struct bgp_table *(*rib)[SAFI_MAX];
+  u_int32_t (*route_info_modulo)(struct bgp_peer *, path_id_t *);
+  u_int32_t peer_buckets;
+  u_int32_t per_peer_buckets;
+  int per_peer_hash;
+  int msglog_backend_methods;
+};
+
+/* BMP monitored peers share the BMP session buckets: a flow exporter
+   matches routes learnt from any of the peers it monitors; when several
+   match, bgp_info_peer_prefer() picks one deterministically */
+#define BGP_INFO_PEER_MATCH(info, peer) ((info)->peer == (peer) || (info)->peer->bmp_router == (peer))
+
 struct bgp_peer_batch {
   int num;
   int num_current;
@@ -184,10 +207,10 @@ EXT void bgp_info_add(struct bgp_node *, struct bgp_info *, u_int32_t);
 EXT void bgp_info_delete(struct bgp_node *, struct bgp_info *, u_int32_t);
 EXT void bgp_info_free(struct bgp_info *);
 EXT void bgp_attr_init();
-EXT struct bgp_attr *bgp_attr_intern(struct bgp_attr *);
-EXT void bgp_attr_unintern (struct bgp_attr *);
+EXT struct bgp_attr *bgp_attr_intern(struct bgp_peer *, struct bgp_attr *);
+EXT void bgp_attr_unintern (struct bgp_peer *, struct bgp_attr *);
 EXT void *bgp_attr_hash_alloc (void *);
-EXT int bgp_peer_init(struct bgp_peer *);
+EXT int bgp_peer_init(struct bgp_peer *, int);
 EXT void bgp_peer_close(struct bgp_peer *, int);
 EXT void bgp_peer_info_delete(struct bgp_peer *);
 EXT int bgp_attr_munge_as4path(struct bgp_peer *, struct bgp_attr *, struct aspath *);
@@ -197,10 +220,12 @@ EXT void evaluate_comm_patterns(char *, char *, char **, int);
 EXT as_t evaluate_last_asn(struct aspath *);
 EXT as_t evaluate_first_asn(char *);
 EXT void bgp_srcdst_lookup(struct packet_ptrs *);
+EXT int bgp_info_peer_prefer(struct bgp_info *, struct bgp_info *, struct bgp_peer *);
 EXT void bgp_follow_nexthop_lookup(struct packet_ptrs *);
 EXT void write_neighbors_file(char *);
 EXT void process_bgp_md5_file(int, struct bgp_md5_table *);
 EXT u_int32_t bgp_route_info_modulo_pathid(struct bgp_peer *, path_id_t *);
+EXT struct bgp_rt_structs *bgp_select_routing_db(int);
 
 EXT void bgp_batch_init(struct bgp_peer_batch *, int, int);
 EXT void bgp_batch_reset(struct bgp_peer_batch *, time_t);
@@ -214,7 +239,7 @@ EXT void bgp_batch_rollback(struct bgp_peer_batch *);
 
 EXT unsigned int attrhash_key_make(void *);
 EXT int attrhash_cmp(const void *, const void *);
-EXT void attrhash_init(struct hash **);
+EXT void attrhash_init(int, struct hash **);
 
 EXT void cache_to_pkt_bgp_primitives(struct pkt_bgp_primitives *, struct cache_bgp_primitives *);
 EXT void pkt_to_cache_bgp_primitives(struct cache_bgp_primitives *, struct pkt_bgp_primitives *, pm_cfgreg_t);
@@ -236,5 +261,6 @@ EXT struct bgp_table *rib[AFI_MAX][SAFI_MAX];
 EXT u_int32_t (*bgp_route_info_modulo)(struct bgp_peer *, path_id_t *);
 EXT int nfacctd_bgp_msglog_backend_methods;
 EXT int bgp_table_dump_backend_methods;
+EXT struct bgp_rt_structs inter_domain_routing_dbs[FUNC_TYPE_MAX];
 #undef EXT
 #endif 
@@ -340,8 +340,9 @@ aspath_free (struct aspath *aspath)
 
 /* Unintern aspath from AS path bucket. */
 void
-aspath_unintern (struct aspath *aspath)
+aspath_unintern (struct bgp_peer *peer, struct aspath *aspath)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct aspath *ret;
 
   if (aspath->refcnt)
@@ -350,7 +351,7 @@ aspath_unintern (struct aspath *aspath)
   if (aspath->refcnt == 0)
     {
       /* This aspath must exist in aspath hash table. */
-      ret = hash_release (ashash, aspath);
+      ret = hash_release (inter_domain_routing_db->ashash, aspath);
       assert (ret != NULL);
       aspath_free (aspath);
     }
@@ -637,15 +638,16 @@ aspath_str_update (struct aspath *as)
 
 /* Intern allocated AS path. */
 struct aspath *
-aspath_intern (struct aspath *aspath)
+aspath_intern (struct bgp_peer *peer, struct aspath *aspath)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct aspath *find;
   
   /* Assert this AS path structure is not interned. */
   assert (aspath->refcnt == 0);
 
   /* Check AS path hash. */
-  find = hash_get (ashash, aspath, hash_alloc_intern);
+  find = hash_get (inter_domain_routing_db->ashash, aspath, hash_alloc_intern);
 
   if (find != aspath)
     aspath_free (aspath);
@@ -771,8 +773,9 @@ assegments_parse(char *s, size_t length, int use32bit)
 
 /* AS path parse function. If there is same AS path in the the AS
    path hash then return it else make new AS path structure. */
-struct aspath *aspath_parse(char *s, size_t length, int use32bit)
+struct aspath *aspath_parse(struct bgp_peer *peer, char *s, size_t length, int use32bit)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer ? peer->type : FUNC_TYPE_BGP);
   struct aspath as;
   struct aspath *find;
 
@@ -788,7 +791,7 @@ struct aspath *aspath_parse(char *s, size_t length, int use32bit)
   as.segments = assegments_parse(s, length, use32bit);
   
   /* If already same aspath exist then return it. */
-  find = hash_get (ashash, &as, aspath_hash_alloc);
+  find = hash_get (inter_domain_routing_db->ashash, &as, aspath_hash_alloc);
   
   /* aspath_hash_alloc dupes segments too. that probably could be
    * optimised out.
@@ -1438,7 +1441,7 @@ aspath_segment_add (struct aspath *as, int type)
 struct aspath *
 aspath_empty (void)
 {
-  return aspath_parse (NULL, 0, 1); /* 32Bit ;-) */
+  return aspath_parse (NULL, NULL, 0, 1); /* 32Bit ;-) */
 }
 
 struct aspath *
@@ -67,6 +67,8 @@ struct aspath
 #define ASPATH_STR_DEFAULT_LEN 32
 
 /* Prototypes. */
+struct bgp_peer;
+
 #if (!defined __BGP_ASPATH_C)
 #define EXT extern
 #else
@@ -74,7 +76,7 @@ struct aspath
 #endif
 EXT void aspath_init (struct hash **);
 EXT void aspath_finish (void);
-EXT struct aspath *aspath_parse (char *, size_t, int);
+EXT struct aspath *aspath_parse (struct bgp_peer *, char *, size_t, int);
 EXT struct aspath *aspath_dup (struct aspath *);
 EXT struct aspath *aspath_aggregate (struct aspath *, struct aspath *);
 EXT struct aspath *aspath_prepend (struct aspath *, struct aspath *);
@@ -88,8 +90,8 @@ EXT struct aspath *aspath_empty (void);
 EXT struct aspath *aspath_empty_get (void);
 EXT struct aspath *aspath_str2aspath (const char *);
 EXT void aspath_free (struct aspath *);
-EXT struct aspath *aspath_intern (struct aspath *);
-EXT void aspath_unintern (struct aspath *);
+EXT struct aspath *aspath_intern (struct bgp_peer *, struct aspath *);
+EXT void aspath_unintern (struct bgp_peer *, struct aspath *);
 EXT const char *aspath_print (struct aspath *);
 EXT unsigned int aspath_key_make (void *);
 EXT int aspath_loop_check (struct aspath *, as_t);
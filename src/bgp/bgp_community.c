@@ -317,15 +317,16 @@ community_com2str  (struct community *com)
 
 /* Intern communities attribute.  */
 struct community *
-community_intern (struct community *com)
+community_intern (struct bgp_peer *peer, struct community *com)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct community *find;
 
   /* Assert this community structure is not interned. */
   assert (com->refcnt == 0);
 
   /* Lookup community hash. */
-  find = (struct community *) hash_get (comhash, com, hash_alloc_intern);
+  find = (struct community *) hash_get (inter_domain_routing_db->comhash, com, hash_alloc_intern);
 
   /* Arguemnt com is allocated temporary.  So when it is not used in
      hash, it should be freed.  */
@@ -344,8 +345,9 @@ community_intern (struct community *com)
 
 /* Free community attribute. */
 void
-community_unintern (struct community *com)
+community_unintern (struct bgp_peer *peer, struct community *com)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct community *ret;
 
   if (com->refcnt)
@@ -355,7 +357,7 @@ community_unintern (struct community *com)
   if (com->refcnt == 0)
     {
       /* Community value com must exist in hash. */
-      ret = (struct community *) hash_release (comhash, com);
+      ret = (struct community *) hash_release (inter_domain_routing_db->comhash, com);
       assert (ret != NULL);
 
       community_free (com);
@@ -364,7 +366,7 @@ community_unintern (struct community *com)
 
 /* Create new community attribute. */
 struct community *
-community_parse (u_int32_t *pnt, u_short length)
+community_parse (struct bgp_peer *peer, u_int32_t *pnt, u_short length)
 {
   struct community tmp;
   struct community *new;
@@ -379,7 +381,7 @@ community_parse (u_int32_t *pnt, u_short length)
 
   new = community_uniq_sort (&tmp);
 
-  return community_intern (new);
+  return community_intern (peer, new);
 }
 
 struct community *
@@ -667,8 +669,8 @@ community_hash (void)
 
 /* Initialize comminity related hash. */
 void
-community_init (struct hash **loc_comhash)
+community_init (int buckets, struct hash **loc_comhash)
 {
-  (*loc_comhash) = hash_create ((unsigned int (*) (void *))community_hash_make,
+  (*loc_comhash) = hash_create_size (buckets, (unsigned int (*) (void *))community_hash_make,
 			 (int (*) (const void *, const void *))community_cmp);
 }
@@ -57,17 +57,19 @@ struct community
 #define com_nthval(X,n)  ((X)->val + (n))
 
 /* Prototypes of communities attribute functions.  */
+struct bgp_peer;
+
 #if (!defined __BGP_COMMUNITY_C)
 #define EXT extern
 #else
 #define EXT
 #endif
-EXT void community_init (struct hash **);
+EXT void community_init (int, struct hash **);
 EXT void community_free (struct community *);
 EXT struct community *community_uniq_sort (struct community *);
-EXT struct community *community_parse (u_int32_t *, u_short);
-EXT struct community *community_intern (struct community *);
-EXT void community_unintern (struct community *);
+EXT struct community *community_parse (struct bgp_peer *, u_int32_t *, u_short);
+EXT struct community *community_intern (struct bgp_peer *, struct community *);
+EXT void community_unintern (struct bgp_peer *, struct community *);
 EXT char *community_str (struct community *);
 EXT unsigned int community_hash_make (struct community *);
 EXT struct community *community_str2com (const char *);
@@ -133,7 +133,7 @@ ecommunity_uniq_sort (struct ecommunity *ecom)
 
 /* Parse Extended Communites Attribute in BGP packet.  */
 struct ecommunity *
-ecommunity_parse (u_int8_t *pnt, u_short length)
+ecommunity_parse (struct bgp_peer *peer, u_int8_t *pnt, u_short length)
 {
   struct ecommunity tmp;
   struct ecommunity *new;
@@ -151,7 +151,7 @@ ecommunity_parse (u_int8_t *pnt, u_short length)
      Extended Communities value  */
   new = ecommunity_uniq_sort (&tmp);
 
-  return ecommunity_intern (new);
+  return ecommunity_intern (peer, new);
 }
 
 /* Duplicate the Extended Communities Attribute structure.  */
@@ -212,13 +212,14 @@ ecommunity_merge (struct ecommunity *ecom1, struct ecommunity *ecom2)
 
 /* Intern Extended Communities Attribute.  */
 struct ecommunity *
-ecommunity_intern (struct ecommunity *ecom)
+ecommunity_intern (struct bgp_peer *peer, struct ecommunity *ecom)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct ecommunity *find;
 
   assert (ecom->refcnt == 0);
 
-  find = (struct ecommunity *) hash_get (ecomhash, ecom, hash_alloc_intern);
+  find = (struct ecommunity *) hash_get (inter_domain_routing_db->ecomhash, ecom, hash_alloc_intern);
 
   if (find != ecom)
     ecommunity_free (ecom);
@@ -233,8 +234,9 @@ ecommunity_intern (struct ecommunity *ecom)
 
 /* Unintern Extended Communities Attribute.  */
 void
-ecommunity_unintern (struct ecommunity *ecom)
+ecommunity_unintern (struct bgp_peer *peer, struct ecommunity *ecom)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
   struct ecommunity *ret;
 
   if (ecom->refcnt)
@@ -244,7 +246,7 @@ ecommunity_unintern (struct ecommunity *ecom)
   if (ecom->refcnt == 0)
     {
       /* Extended community must be in the hash.  */
-      ret = (struct ecommunity *) hash_release (ecomhash, ecom);
+      ret = (struct ecommunity *) hash_release (inter_domain_routing_db->ecomhash, ecom);
       assert (ret != NULL);
 
       ecommunity_free (ecom);
@@ -282,9 +284,9 @@ ecommunity_cmp (const void *arg1, const void *arg2)
 
 /* Initialize Extended Comminities related hash. */
 void
-ecommunity_init (struct hash **loc_ecomhash)
+ecommunity_init (int buckets, struct hash **loc_ecomhash)
 {
-  (*loc_ecomhash) = hash_create (ecommunity_hash_make, ecommunity_cmp);
+  (*loc_ecomhash) = hash_create_size (buckets, ecommunity_hash_make, ecommunity_cmp);
 }
 
 /* Extended Communities token enum. */
@@ -71,20 +71,22 @@ struct ecommunity_val
 
 #define ecom_length(X)    ((X)->size * ECOMMUNITY_SIZE)
 
+struct bgp_peer;
+
 #if (!defined __BGP_ECOMMUNITY_C)
 #define EXT extern
 #else
 #define EXT
 #endif
-EXT void ecommunity_init (struct hash **);
+EXT void ecommunity_init (int, struct hash **);
 EXT void ecommunity_free (struct ecommunity *);
 EXT struct ecommunity *ecommunity_new (void);
-EXT struct ecommunity *ecommunity_parse (u_int8_t *, u_short);
+EXT struct ecommunity *ecommunity_parse (struct bgp_peer *, u_int8_t *, u_short);
 EXT struct ecommunity *ecommunity_dup (struct ecommunity *);
 EXT struct ecommunity *ecommunity_merge (struct ecommunity *, struct ecommunity *);
-EXT struct ecommunity *ecommunity_intern (struct ecommunity *);
+EXT struct ecommunity *ecommunity_intern (struct bgp_peer *, struct ecommunity *);
 EXT int ecommunity_cmp (const void *, const void *);
-EXT void ecommunity_unintern (struct ecommunity *);
+EXT void ecommunity_unintern (struct bgp_peer *, struct ecommunity *);
 EXT unsigned int ecommunity_hash_make (void *);
 EXT struct ecommunity *ecommunity_str2com (const char *, int, int);
 EXT char *ecommunity_ecom2str (struct ecommunity *, int);
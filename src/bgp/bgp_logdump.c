@@ -732,19 +732,20 @@ int bgp_peer_dump_close(struct bgp_peer *peer, struct bgp_dump_stats *bds, int o
 
 void bgp_handle_dump_event()
 {
-  char current_filename[SRVBUFLEN], last_filename[SRVBUFLEN], tmpbuf[SRVBUFLEN];
-  char latest_filename[SRVBUFLEN], event_type[] = "dump", *fd_buf = NULL;
-  int ret, peers_idx, duration, tables_num;
-  struct bgp_peer *peer, *saved_peer;
-  struct bgp_table *table;
-  struct bgp_node *node;
-  struct bgp_peer_log peer_log;
+  char current_filename[SRVBUFLEN], tmpbuf[SRVBUFLEN];
+  char latest_filename[SRVBUFLEN], event_type[] = "dump";
+  int ret, peers_idx, idx, duration, tables_num, workers, depth;
+  struct bgp_peer *peer;
+  struct bgp_peer_log *peers_dump;
   struct bgp_dump_stats bds;
+  struct bgp_dump_ctx ctx;
+  struct bgp_dump_worker *dw;
   afi_t afi;
   safi_t safi;
   pid_t dumper_pid;
   time_t start;
-  u_int64_t dump_elems;
+  u_int64_t dump_elems, dump_nodes;
+  char **fd_bufs;
 
   /* pre-flight check */
   if (!bgp_table_dump_backend_methods || !config.bgp_table_dump_refresh_time)
@@ -756,11 +757,42 @@ void bgp_handle_dump_event()
     signal(SIGINT, SIG_IGN);
     signal(SIGHUP, SIG_IGN);
     pm_setproctitle("%s %s [%s]", config.type, "Core Process -- BGP Dump Writer", config.name);
-    memset(last_filename, 0, sizeof(last_filename));
     memset(current_filename, 0, sizeof(current_filename));
-    memset(&peer_log, 0, sizeof(struct bgp_peer_log));
     memset(&bds, 0, sizeof(struct bgp_dump_stats));
-    fd_buf = malloc(BGP_LOG_BUFSZ);
+    memset(&ctx, 0, sizeof(struct bgp_dump_ctx));
+    ctx.event_type = event_type;
+
+    workers = config.bgp_table_dump_workers ? config.bgp_table_dump_workers : 1;
+#if defined ENABLE_THREADS
+    /* AMQP/Kafka hosts carry a per-message routing key/topic: not safe to share */
+    if (workers > 1 && (config.bgp_table_dump_amqp_routing_key || config.bgp_table_dump_kafka_topic)) {
+      Log(LOG_WARNING, "WARN ( %s/core/BGP ): bgp_table_dump_workers > 1 is supported only with bgp_table_dump_file. Using 1 worker.\n", config.name);
+      workers = 1;
+    }
+#else
+    workers = 1;
+#endif
+
+    peers_dump = malloc(config.nfacctd_bgp_max_peers*sizeof(struct bgp_peer_log));
+    fd_bufs = malloc(config.nfacctd_bgp_max_peers*sizeof(char *));
+    dw = malloc(workers*sizeof(struct bgp_dump_worker));
+    if (!peers_dump || !fd_bufs || !dw) {
+      Log(LOG_ERR, "ERROR ( %s/core/BGP ): Unable to allocate BGP dump structures. Exiting.\n", config.name);
+      exit(1);
+    }
+    memset(peers_dump, 0, config.nfacctd_bgp_max_peers*sizeof(struct bgp_peer_log));
+    memset(fd_bufs, 0, config.nfacctd_bgp_max_peers*sizeof(char *));
+    memset(dw, 0, workers*sizeof(struct bgp_dump_worker));
+
+    for (idx = 0; idx < workers; idx++) {
+      dw[idx].ctx = &ctx;
+      dw[idx].entries = malloc(config.nfacctd_bgp_max_peers*sizeof(u_int64_t));
+      if (!dw[idx].entries) {
+        Log(LOG_ERR, "ERROR ( %s/core/BGP ): Unable to allocate BGP dump structures. Exiting.\n", config.name);
+        exit(1);
+      }
+      memset(dw[idx].entries, 0, config.nfacctd_bgp_max_peers*sizeof(u_int64_t));
+    }
 
 #ifdef WITH_RABBITMQ
     if (config.bgp_table_dump_amqp_routing_key) {
@@ -782,98 +814,137 @@ void bgp_handle_dump_event()
     start = time(NULL);
     tables_num = 0;
 
-    for (peer = NULL, saved_peer = NULL, peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
-      if (peers[peers_idx].fd) {
-        peer = &peers[peers_idx];
-	peer->log = &peer_log; /* abusing struct bgp_peer a bit, but we are in a child */
-
-	if (config.bgp_table_dump_file)
-	  bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_file, peer);
-
-	if (config.bgp_table_dump_amqp_routing_key)
-	  bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_amqp_routing_key, peer);
-
-	if (config.bgp_table_dump_kafka_topic)
-	  bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_kafka_topic, peer);
-
-	strftime_same(current_filename, SRVBUFLEN, tmpbuf, &log_tstamp.tv_sec);
-
-	/*
-	   we close last_filename and open current_filename in case they differ;
-	   we are safe with this approach until $peer_src_ip is the only variable
-	   supported as part of bgp_table_dump_file configuration directive.
-        */
-	if (config.bgp_table_dump_file) {
-	  if (strcmp(last_filename, current_filename)) {
-	    if (saved_peer && saved_peer->log && strlen(last_filename)) {
-	      close_logfile(saved_peer->log->fd);
-
-	      if (config.bgp_table_dump_latest_file) {
-		bgp_peer_log_dynname(latest_filename, SRVBUFLEN, config.bgp_table_dump_latest_file, saved_peer);
-		link_latest_logfile(latest_filename, last_filename);
-	      }
-	    }
-	    peer->log->fd = open_logfile(current_filename, "w");
-	    if (fd_buf) {
-	      setbuffer(peer->log->fd, fd_buf, BGP_LOG_BUFSZ);
-	      memset(fd_buf, 0, BGP_LOG_BUFSZ); 
-	    }
+    /*
+       set up one output stream per peer; peers resolving to the same
+       filename share the stream of the first of them. Routes are then
+       fanned out to the streams while walking the RIB only once rather
+       than once per peer.
+    */
+    for (peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
+      peer = &peers[peers_idx];
+
+      if (!peer->fd) {
+	peer->log = NULL; /* abusing struct bgp_peer a bit, but we are in a child */
+	continue;
+      }
+
+      peer->log = &peers_dump[peers_idx];
+
+      if (config.bgp_table_dump_file)
+	bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_file, peer);
+
+      if (config.bgp_table_dump_amqp_routing_key)
+	bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_amqp_routing_key, peer);
+
+      if (config.bgp_table_dump_kafka_topic)
+	bgp_peer_log_dynname(current_filename, SRVBUFLEN, config.bgp_table_dump_kafka_topic, peer);
+
+      strftime_same(current_filename, SRVBUFLEN, tmpbuf, &log_tstamp.tv_sec);
+
+      if (config.bgp_table_dump_file) {
+	for (idx = 0; idx < peers_idx; idx++) {
+	  if (peers_dump[idx].refcnt && !strcmp(peers_dump[idx].filename, current_filename)) {
+	    peer->log = &peers_dump[idx];
+	    break;
 	  }
 	}
 
-	/*
-	   a bit pedantic maybe but should come at little cost and emulating
-	   bgp_table_dump_file behaviour will work
-	*/ 
-#ifdef WITH_RABBITMQ
-	if (config.bgp_table_dump_amqp_routing_key) {
-	  peer->log->amqp_host = &bgp_table_dump_amqp_host;
-	  strcpy(peer->log->filename, current_filename);
+	if (peer->log == &peers_dump[peers_idx]) {
+	  peer->log->fd = open_logfile(current_filename, "w");
+	  if (peer->log->fd) {
+	    fd_bufs[peers_idx] = malloc(BGP_DUMP_BUFSZ);
+	    if (fd_bufs[peers_idx]) setbuffer(peer->log->fd, fd_bufs[peers_idx], BGP_DUMP_BUFSZ);
+	  }
 	}
+      }
+
+      /*
+	 a bit pedantic maybe but should come at little cost and emulating
+	 bgp_table_dump_file behaviour will work
+      */
+#ifdef WITH_RABBITMQ
+      if (config.bgp_table_dump_amqp_routing_key)
+	peer->log->amqp_host = &bgp_table_dump_amqp_host;
 #endif
 
 #ifdef WITH_KAFKA
-	if (config.bgp_table_dump_kafka_topic) {
-	  peer->log->kafka_host = &bgp_table_dump_kafka_host;
-	  strcpy(peer->log->filename, current_filename);
-	}
+      if (config.bgp_table_dump_kafka_topic)
+	peer->log->kafka_host = &bgp_table_dump_kafka_host;
 #endif
 
-	bgp_peer_dump_init(peer, config.bgp_table_dump_output, FUNC_TYPE_BGP);
-	dump_elems = 0;
-
-	for (afi = AFI_IP; afi < AFI_MAX; afi++) {
-	  for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++) {
-	    table = rib[afi][safi];
-	    node = bgp_table_top(table);
+      strlcpy(peer->log->filename, current_filename, SRVBUFLEN);
+      peer->log->refcnt++;
 
-	    while (node) {
-	      u_int32_t modulo = bgp_route_info_modulo(peer, NULL);
-	      u_int32_t peer_buckets;
-	      struct bgp_info *ri;
+      bgp_peer_dump_init(peer, config.bgp_table_dump_output, FUNC_TYPE_BGP);
+    }
 
-	      for (peer_buckets = 0; peer_buckets < config.bgp_table_per_peer_buckets; peer_buckets++) {
-	        for (ri = node->info[modulo+peer_buckets]; ri; ri = ri->next) {
-		  if (ri->peer == peer) {
-	            bgp_peer_log_msg(node, ri, safi, event_type, config.bgp_table_dump_output, BGP_LOG_TYPE_MISC);
-	            dump_elems++;
-		  }
-		}
-	      }
+    /* slicing the RIB: a few units per worker to even out the load */
+    for (depth = 0; (1 << depth) < (workers * BGP_DUMP_UNITS_PER_WORKER); depth++);
+    if (workers == 1) depth = 0;
 
-	      node = bgp_route_next(node);
-	    }
+    for (afi = AFI_IP; afi < AFI_MAX; afi++) {
+      for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++) {
+	if (rib[afi][safi] && rib[afi][safi]->top) {
+	  if (bgp_dump_split(&ctx, rib[afi][safi]->top, safi, depth) == ERR) {
+	    Log(LOG_ERR, "ERROR ( %s/core/BGP ): Unable to allocate BGP dump structures. Exiting.\n", config.name);
+	    exit(1);
 	  }
 	}
+      }
+    }
+
+#if defined ENABLE_THREADS
+    pthread_mutex_init(&ctx.mutex, NULL);
+
+    if (workers > 1) {
+      pthread_t *threads;
+      int spawned;
 
-        saved_peer = peer;
-	tables_num++;
+      threads = malloc(workers*sizeof(pthread_t));
 
-        strlcpy(last_filename, current_filename, SRVBUFLEN);
-	bds.entries = dump_elems;
-	bds.tables = tables_num;
-        bgp_peer_dump_close(peer, &bds, config.bgp_table_dump_output, FUNC_TYPE_BGP);
+      for (idx = 0, spawned = 0; threads && idx < workers; idx++) {
+	if (!pthread_create(&threads[idx], NULL, bgp_dump_worker_run, &dw[idx])) spawned++;
+	else break;
       }
+
+      /* if we fail to spawn any worker we carry on by ourselves */
+      if (!spawned) bgp_dump_worker_run(&dw[0]);
+      for (idx = 0; idx < spawned; idx++) pthread_join(threads[idx], NULL);
+
+      if (threads) free(threads);
+    }
+    else
+#endif
+    bgp_dump_worker_run(&dw[0]);
+
+#if defined ENABLE_THREADS
+    pthread_mutex_destroy(&ctx.mutex);
+#endif
+
+    for (peers_idx = 0, dump_elems = 0, dump_nodes = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
+      peer = &peers[peers_idx];
+      if (!peer->log) continue;
+
+      tables_num++;
+      bds.entries = 0;
+      bds.tables = tables_num;
+      for (idx = 0; idx < workers; idx++) bds.entries += dw[idx].entries[peers_idx];
+      dump_elems += bds.entries;
+
+      bgp_peer_dump_close(peer, &bds, config.bgp_table_dump_output, FUNC_TYPE_BGP);
+    }
+
+    for (peers_idx = 0; peers_idx < config.nfacctd_bgp_max_peers; peers_idx++) {
+      if (config.bgp_table_dump_file && peers_dump[peers_idx].fd) {
+	close_logfile(peers_dump[peers_idx].fd);
+
+	if (config.bgp_table_dump_latest_file) {
+	  bgp_peer_log_dynname(latest_filename, SRVBUFLEN, config.bgp_table_dump_latest_file, &peers[peers_idx]);
+	  link_latest_logfile(latest_filename, peers_dump[peers_idx].filename);
+	}
+      }
+
+      if (fd_bufs[peers_idx]) free(fd_bufs[peers_idx]);
     }
 
 #ifdef WITH_RABBITMQ
@@ -886,14 +957,14 @@ void bgp_handle_dump_event()
       p_kafka_close(&bgp_table_dump_kafka_host, FALSE);
 #endif
 
-    if (config.bgp_table_dump_latest_file && peer) {
-      bgp_peer_log_dynname(latest_filename, SRVBUFLEN, config.bgp_table_dump_latest_file, peer);
-      link_latest_logfile(latest_filename, last_filename);
+    for (idx = 0; idx < workers; idx++) {
+      Log(LOG_DEBUG, "DEBUG ( %s/core/BGP ): BGP dump worker #%u: nodes=%llu\n", config.name, idx, dw[idx].nodes);
+      dump_nodes += dw[idx].nodes;
     }
 
     duration = time(NULL)-start;
-    Log(LOG_INFO, "INFO ( %s/core/BGP ): *** Dumping BGP tables - END (PID: %u, TABLES: %u ET: %u) ***\n",
-		config.name, dumper_pid, tables_num, duration);
+    Log(LOG_INFO, "INFO ( %s/core/BGP ): *** Dumping BGP tables - END (PID: %u, TABLES: %u ENTRIES: %llu NODES: %llu WORKERS: %u ET: %u) ***\n",
+		config.name, dumper_pid, tables_num, dump_elems, dump_nodes, workers, duration);
 
     exit(0);
   default: /* Parent */
@@ -905,6 +976,90 @@ void bgp_handle_dump_event()
   }
 }
 
+int bgp_dump_add_unit(struct bgp_dump_ctx *ctx, struct bgp_node *node, safi_t safi, u_int8_t subtree)
+{
+  struct bgp_dump_unit *units;
+
+  if (!(ctx->units_num % 64)) {
+    units = realloc(ctx->units, (ctx->units_num+64)*sizeof(struct bgp_dump_unit));
+    if (!units) return ERR;
+    ctx->units = units;
+  }
+
+  ctx->units[ctx->units_num].node = node;
+  ctx->units[ctx->units_num].safi = safi;
+  ctx->units[ctx->units_num].subtree = subtree;
+  ctx->units_num++;
+
+  return SUCCESS;
+}
+
+/* Splits the trie rooted at 'node' into sub-tries 'depth' levels down;
+   nodes above the cut are dumped as single-node units. */
+int bgp_dump_split(struct bgp_dump_ctx *ctx, struct bgp_node *node, safi_t safi, int depth)
+{
+  if (!node) return SUCCESS;
+
+  if (!depth || (!node->l_left && !node->l_right))
+    return bgp_dump_add_unit(ctx, node, safi, TRUE);
+
+  if (bgp_dump_add_unit(ctx, node, safi, FALSE) == ERR) return ERR;
+  if (bgp_dump_split(ctx, node->l_left, safi, depth-1) == ERR) return ERR;
+
+  return bgp_dump_split(ctx, node->l_right, safi, depth-1);
+}
+
+void bgp_dump_node(struct bgp_dump_worker *dw, struct bgp_node *node, safi_t safi)
+{
+  u_int32_t ri_idx, buckets = (config.bgp_table_peer_buckets * config.bgp_table_per_peer_buckets);
+  struct bgp_info *ri;
+  int peer_idx;
+
+  for (ri_idx = 0; ri_idx < buckets; ri_idx++) {
+    for (ri = node->info[ri_idx]; ri; ri = ri->next) {
+      if (!ri->peer || !ri->peer->log) continue;
+
+      peer_idx = ri->peer - peers;
+      if (peer_idx < 0 || peer_idx >= config.nfacctd_bgp_max_peers) continue;
+
+      bgp_peer_log_msg(node, ri, safi, dw->ctx->event_type, config.bgp_table_dump_output, BGP_LOG_TYPE_MISC);
+      dw->entries[peer_idx]++;
+    }
+  }
+
+  dw->nodes++;
+}
+
+void *bgp_dump_worker_run(void *arg)
+{
+  struct bgp_dump_worker *dw = (struct bgp_dump_worker *) arg;
+  struct bgp_dump_ctx *ctx = dw->ctx;
+  struct bgp_dump_unit *unit;
+  struct bgp_node *node;
+  int unit_idx;
+
+  for (;;) {
+#if defined ENABLE_THREADS
+    pthread_mutex_lock(&ctx->mutex);
+#endif
+    unit_idx = ctx->units_next++;
+#if defined ENABLE_THREADS
+    pthread_mutex_unlock(&ctx->mutex);
+#endif
+
+    if (unit_idx >= ctx->units_num) break;
+    unit = &ctx->units[unit_idx];
+
+    if (!unit->subtree) bgp_dump_node(dw, unit->node, unit->safi);
+    else {
+      for (node = unit->node; node; node = bgp_route_next_until_nolock(node, unit->node))
+	bgp_dump_node(dw, node, unit->safi);
+    }
+  }
+
+  return NULL;
+}
+
 #if defined WITH_RABBITMQ
 void bgp_daemon_msglog_init_amqp_host()
 {
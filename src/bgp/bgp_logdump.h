@@ -22,6 +22,10 @@
 #ifndef _BGP_LOGDUMP_H_
 #define _BGP_LOGDUMP_H_
 
+#if defined ENABLE_THREADS
+#include <pthread.h>
+#endif
+
 /* defines */
 #define BGP_LOGDUMP_ET_NONE	0
 #define BGP_LOGDUMP_ET_LOG	1
@@ -35,6 +39,8 @@
 #define BGP_LOG_TYPE_CLOSE	5
 
 #define BGP_LOG_BUFSZ		(100 * LARGEBUFLEN)
+#define BGP_DUMP_BUFSZ		(8 * LARGEBUFLEN)
+#define BGP_DUMP_UNITS_PER_WORKER	4
 
 struct bgp_peer_log {
   FILE *fd;
@@ -49,6 +55,30 @@ struct bgp_dump_stats {
   u_int32_t tables;
 };
 
+/* a slice of the RIB walked by a single dump worker: either a single
+   node or a whole sub-trie rooted at 'node' */
+struct bgp_dump_unit {
+  struct bgp_node *node;
+  safi_t safi;
+  u_int8_t subtree;
+};
+
+struct bgp_dump_ctx {
+  struct bgp_dump_unit *units;
+  int units_num;
+  int units_next;
+#if defined ENABLE_THREADS
+  pthread_mutex_t mutex;
+#endif
+  char *event_type;
+};
+
+struct bgp_dump_worker {
+  struct bgp_dump_ctx *ctx;
+  u_int64_t *entries;		/* per-peer, indexed as peers[] */
+  u_int64_t nodes;
+};
+
 /* prototypes */
 #if (!defined __BGP_LOGDUMP_C)
 #define EXT extern
@@ -64,6 +94,10 @@ EXT int bgp_peer_log_msg(struct bgp_node *, struct bgp_info *, safi_t, char *, i
 EXT int bgp_peer_dump_init(struct bgp_peer *, int, int);
 EXT int bgp_peer_dump_close(struct bgp_peer *, struct bgp_dump_stats *, int, int);
 EXT void bgp_handle_dump_event();
+EXT int bgp_dump_split(struct bgp_dump_ctx *, struct bgp_node *, safi_t, int);
+EXT int bgp_dump_add_unit(struct bgp_dump_ctx *, struct bgp_node *, safi_t, u_int8_t);
+EXT void bgp_dump_node(struct bgp_dump_worker *, struct bgp_node *, safi_t);
+EXT void *bgp_dump_worker_run(void *);
 EXT void bgp_daemon_msglog_init_amqp_host();
 EXT void bgp_table_dump_init_amqp_host();
 EXT int bgp_daemon_msglog_init_kafka_host();
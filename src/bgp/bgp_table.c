@@ -30,14 +30,16 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "pmacct.h"
 #include "bgp.h"
 
+static struct bgp_node *bgp_node_create (struct bgp_table *);
 static void bgp_node_delete (struct bgp_node *);
 static void bgp_node_free_aggressive (struct bgp_node *, safi_t);
 static void bgp_table_free (struct bgp_table *);
 
 struct bgp_table *
-bgp_table_init (afi_t afi, safi_t safi)
+bgp_table_init (afi_t afi, safi_t safi, int peer_type)
 {
   struct bgp_table *rt;
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer_type);
 
   rt = malloc (sizeof (struct bgp_table));
   if (rt) {
@@ -46,6 +48,8 @@ bgp_table_init (afi_t afi, safi_t safi)
     rt->type = BGP_TABLE_MAIN;
     rt->afi = afi;
     rt->safi = safi;
+    rt->peer_type = peer_type;
+    rt->info_buckets = (inter_domain_routing_db->peer_buckets * inter_domain_routing_db->per_peer_buckets);
   }
   else {
     Log(LOG_ERR, "ERROR ( %s/core/BGP ): malloc() failed (bgp_table_init). Exiting ..\n", config.name);
@@ -56,7 +60,7 @@ bgp_table_init (afi_t afi, safi_t safi)
 }
 
 static struct bgp_node *
-bgp_node_create ()
+bgp_node_create (struct bgp_table *table)
 {
   struct bgp_node *rn;
 
@@ -64,8 +68,8 @@ bgp_node_create ()
   if (rn) {
     memset (rn, 0, sizeof (struct bgp_node));
 
-    rn->info = (void **) malloc(sizeof(struct bgp_info *) * (config.bgp_table_peer_buckets * config.bgp_table_per_peer_buckets));
-    if (rn->info) memset (rn->info, 0, sizeof(struct bgp_info *) * (config.bgp_table_peer_buckets * config.bgp_table_per_peer_buckets));
+    rn->info = (void **) malloc(sizeof(struct bgp_info *) * table->info_buckets);
+    if (rn->info) memset (rn->info, 0, sizeof(struct bgp_info *) * table->info_buckets);
     else goto malloc_failed;
   }
   else goto malloc_failed;
@@ -83,7 +87,7 @@ bgp_node_set (struct bgp_table *table, struct prefix *prefix)
 {
   struct bgp_node *node;
   
-  node = bgp_node_create ();
+  node = bgp_node_create (table);
 
   prefix_copy (&node->p, prefix);
   node->table = table;
@@ -104,16 +108,17 @@ bgp_node_free (struct bgp_node *node)
 static void
 bgp_node_free_aggressive (struct bgp_node *node, safi_t safi)
 {
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(node->table->peer_type);
   struct bgp_info *ri, *next;
   u_int32_t ri_idx;
 
   /* XXX: this should be moved further outside */
-  if (nfacctd_bgp_msglog_backend_methods)
+  if (inter_domain_routing_db->msglog_backend_methods)
     gettimeofday(&log_tstamp, NULL);
 
-  for (ri_idx = 0; ri_idx < (config.bgp_table_peer_buckets * config.bgp_table_per_peer_buckets); ri_idx++) {
+  for (ri_idx = 0; ri_idx < node->table->info_buckets; ri_idx++) {
     for (ri = node->info[ri_idx]; ri; ri = next) {
-      if (nfacctd_bgp_msglog_backend_methods) {
+      if (inter_domain_routing_db->msglog_backend_methods) {
         char event_type[] = "log";
 
         bgp_peer_log_msg(node, ri, safi, event_type, config.nfacctd_bgp_msglog_output, BGP_LOG_TYPE_DELETE);
@@ -279,7 +284,8 @@ bgp_node_match (const struct bgp_table *table, struct prefix *p, struct bgp_peer
   struct bgp_node *node;
   struct bgp_node *matched;
   struct bgp_info *info;
-  u_int32_t modulo = bgp_route_info_modulo(peer, NULL);
+  struct bgp_rt_structs *inter_domain_routing_db = bgp_select_routing_db(peer->type);
+  u_int32_t modulo = inter_domain_routing_db->route_info_modulo(peer, NULL);
 
   matched = NULL;
   node = table->top;
@@ -288,7 +294,7 @@ bgp_node_match (const struct bgp_table *table, struct prefix *p, struct bgp_peer
      matched. */
   while (node && node->p.prefixlen <= p->prefixlen && prefix_match(&node->p, p)) {
     for (info = node->info[modulo]; info; info = info->next) {
-      if (info->peer == peer) {
+      if (BGP_INFO_PEER_MATCH(info, peer)) {
 	matched = node;
         break;
       }
@@ -363,7 +369,7 @@ bgp_node_get (struct bgp_table *const table, struct prefix *p)
     }
   else
     {
-      new = bgp_node_create ();
+      new = bgp_node_create (table);
       route_common (&node->p, p, &new->p);
       new->p.family = p->family;
       new->table = table;
@@ -397,7 +403,7 @@ bgp_node_delete (struct bgp_node *node)
   u_int32_t ri_idx;
 
   assert (node->lock == 0);
-  for (ri_idx = 0; ri_idx < (config.bgp_table_peer_buckets * config.bgp_table_per_peer_buckets); ri_idx++)
+  for (ri_idx = 0; ri_idx < node->table->info_buckets; ri_idx++)
     assert (node->info[ri_idx] == NULL);
 
   if (node->l_left && node->l_right)
@@ -532,6 +538,27 @@ bgp_route_next_until (struct bgp_node *node, struct bgp_node *limit)
   return NULL;
 }
 
+/* Same walk as bgp_route_next_until() but leaving reference counts alone:
+   meant for read-only walks over a table snapshot (ie. forked dump writer)
+   where concurrent threads would otherwise race on the node locks. */
+struct bgp_node *
+bgp_route_next_until_nolock (struct bgp_node *node, struct bgp_node *limit)
+{
+  if (node->l_left)
+    return node->l_left;
+  if (node->l_right)
+    return node->l_right;
+
+  while (node->parent && node != limit)
+    {
+      if (node->parent->l_left == node && node->parent->l_right)
+	return node->parent->l_right;
+      node = node->parent;
+    }
+
+  return NULL;
+}
+
 unsigned long
 bgp_table_count (const struct bgp_table *table)
 {
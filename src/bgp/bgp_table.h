@@ -46,6 +46,10 @@ struct bgp_table
   /* afi/safi of this table */
   afi_t afi;
   safi_t safi;
+
+  /* FUNC_TYPE_BGP, FUNC_TYPE_BMP: routing DB this table belongs to */
+  u_int8_t peer_type;
+  u_int32_t info_buckets;
   
   /* The owner of this 'bgp_table' structure. */
   void *owner;
@@ -104,12 +108,13 @@ struct bgp_info
 #else
 #define EXT
 #endif
-EXT struct bgp_table *bgp_table_init (afi_t, safi_t);
+EXT struct bgp_table *bgp_table_init (afi_t, safi_t, int);
 EXT void bgp_table_finish (struct bgp_table **);
 EXT void bgp_unlock_node (struct bgp_node *node);
 EXT struct bgp_node *bgp_table_top (const struct bgp_table *const);
 EXT struct bgp_node *bgp_route_next (struct bgp_node *);
 EXT struct bgp_node *bgp_route_next_until (struct bgp_node *, struct bgp_node *);
+EXT struct bgp_node *bgp_route_next_until_nolock (struct bgp_node *, struct bgp_node *);
 EXT struct bgp_node *bgp_node_get (struct bgp_table *const, struct prefix *);
 EXT struct bgp_node *bgp_lock_node (struct bgp_node *node);
 EXT struct bgp_node *bgp_node_match (const struct bgp_table *, struct prefix *, struct bgp_peer *);
@@ -48,7 +48,7 @@ void nfacctd_bmp_wrapper()
   if (!config.nfacctd_bmp_port) config.nfacctd_bmp_port = BMP_TCP_PORT;
 
   /* initialize threads pool */
-  bmp_pool = allocate_thread_pool(1);
+  bmp_pool = allocate_thread_pool(1, THREAD_POOL_PLACED);
   assert(bmp_pool);
   Log(LOG_DEBUG, "DEBUG ( %s/core/BMP ): %d thread(s) initialized\n", config.name, 1);
 
@@ -199,6 +199,14 @@ void skinny_bmp_daemon()
     exit_all(1);
   }
 
+  /* route monitoring is logged by bmp_log_msg(), not per prefix */
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].rib = bmp_rib;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].route_info_modulo = bmp_route_info_modulo;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].peer_buckets = config.bmp_table_peer_buckets;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].per_peer_buckets = config.bmp_table_per_peer_buckets;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].per_peer_hash = config.bmp_table_per_peer_hash;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].msglog_backend_methods = FALSE;
+
   config.bmp_sock = socket(((struct sockaddr *)&server)->sa_family, SOCK_STREAM, 0);
   if (config.bmp_sock < 0) {
 #if (defined ENABLE_IPV6)
@@ -285,7 +293,7 @@ void skinny_bmp_daemon()
   /* Let's initialize clean shared RIB */
   for (afi = AFI_IP; afi < AFI_MAX; afi++) {
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++) {
-      bmp_rib[afi][safi] = bgp_table_init(afi, safi);
+      bmp_rib[afi][safi] = bgp_table_init(afi, safi, FUNC_TYPE_BMP);
     }
   }
 
@@ -456,7 +464,7 @@ void skinny_bmp_daemon()
           */
           if (bgp_batch_is_admitted(&bp_batch, now)) {
             peer = &bmp_peers[peers_idx];
-            if (bgp_peer_init(peer)) peer = NULL;
+            if (bgp_peer_init(peer, FUNC_TYPE_BMP)) peer = NULL;
             else recalc_fds = TRUE;
 
             log_notification_unset(&log_notifications.bgp_peers_throttling);
@@ -595,7 +603,7 @@ u_int32_t bmp_process_packet(char *bmp_packet, u_int32_t len, struct bgp_peer *p
     }
 
     bmp_common_hdr_get_len(bch, &msg_len);
-    if (pkt_remaining_len < msg_len) return msg_start_len;
+    if (msg_start_len < msg_len) return msg_start_len;
 
     if (bch->type <= BMP_MSG_TYPE_MAX) {
       Log(LOG_DEBUG, "DEBUG ( %s/core/BMP ): [Id: %s] [common] type: %s (%u)\n",
@@ -604,7 +612,7 @@ u_int32_t bmp_process_packet(char *bmp_packet, u_int32_t len, struct bgp_peer *p
 
     switch (bch->type) {
     case BMP_MSG_ROUTE:
-      bmp_process_msg_route(&bmp_packet_ptr, &pkt_remaining_len, peer);
+      bmp_process_msg_route(&bmp_packet_ptr, &pkt_remaining_len, msg_len, peer);
       break;
     case BMP_MSG_STATS:
       bmp_process_msg_stats(&bmp_packet_ptr, &pkt_remaining_len, peer);
@@ -844,21 +852,27 @@ void bmp_process_msg_peer_down(char **bmp_packet, u_int32_t *len, struct bgp_pee
       bmp_dump_se_ll_append(peer, &bdata, &blpd, BMP_LOG_TYPE_PEER_DOWN);
   }
 
-  // XXX: withdraw routes from peer
+  bmp_mpeer_close(peer, bph, &bdata);
 }
 
-void bmp_process_msg_route(char **bmp_packet, u_int32_t *len, struct bgp_peer *peer)
+void bmp_process_msg_route(char **bmp_packet, u_int32_t *len, u_int32_t bmp_hdr_len, struct bgp_peer *peer)
 {
   struct bmp_data bdata;
   struct bmp_peer_hdr *bph;
   char tstamp_str[SRVBUFLEN], peer_ip[INET6_ADDRSTRLEN];
 
-  if (!(bph = (struct bmp_peer_hdr *) bmp_get_and_check_length(bmp_packet, len, sizeof(struct bmp_peer_hdr)))) {
+  memset(&bdata, 0, sizeof(bdata));
+
+  if (bmp_hdr_len < (sizeof(struct bmp_common_hdr) + sizeof(struct bmp_peer_hdr)) ||
+      !(bph = (struct bmp_peer_hdr *) bmp_get_and_check_length(bmp_packet, len, sizeof(struct bmp_peer_hdr)))) {
     Log(LOG_INFO, "INFO ( %s/core/BMP ): [Id: %s] [route] packet discarded: failed bmp_get_and_check_length() BMP peer hdr\n",
         config.name, peer->addr_str);
     return;
   }
 
+  /* what is left of this BMP message for the BGP UPDATE */
+  bmp_hdr_len -= (sizeof(struct bmp_common_hdr) + sizeof(struct bmp_peer_hdr));
+
   bmp_peer_hdr_get_family(bph, &bdata.family);
   bmp_peer_hdr_get_peer_ip(bph, &bdata.peer_ip, bdata.family);
   bmp_peer_hdr_get_bgp_id(bph, &bdata.bgp_id);
@@ -872,7 +886,45 @@ void bmp_process_msg_route(char **bmp_packet, u_int32_t *len, struct bgp_peer *p
   compose_timestamp(tstamp_str, SRVBUFLEN, &bdata.tstamp, TRUE, config.sql_history_since_epoch);
   addr_to_str(peer_ip, &bdata.peer_ip);
 
-  // XXX: parse BGP UPDATE(s)
+  /* BGP UPDATE, as received by the monitored peer */
+  {
+    struct bgp_header *bhdr;
+    struct bgp_peer *mpeer;
+    u_int16_t bgp_len;
+
+    if (!(bhdr = (struct bgp_header *) bmp_get_and_check_length(bmp_packet, len, BGP_HEADER_SIZE))) {
+      Log(LOG_INFO, "INFO ( %s/core/BMP ): [Id: %s] [route] packet discarded: failed bmp_get_and_check_length() BGP hdr\n",
+          config.name, peer->addr_str);
+      return;
+    }
+
+    bgp_len = ntohs(bhdr->bgpo_len);
+
+    /* the UPDATE must not spill over into the next BMP message */
+    if (bgp_len > bmp_hdr_len) {
+      Log(LOG_INFO, "INFO ( %s/core/BMP ): [Id: %s] [route] packet discarded: BGP UPDATE length (%u) exceeds BMP message (%u)\n",
+          config.name, peer->addr_str, bgp_len, bmp_hdr_len);
+      return;
+    }
+
+    if (bhdr->bgpo_type != BGP_UPDATE || bgp_len < BGP_MIN_UPDATE_MSG_SIZE) {
+      Log(LOG_INFO, "INFO ( %s/core/BMP ): [Id: %s] [route] packet discarded: not a BGP UPDATE (type: %u len: %u)\n",
+          config.name, peer->addr_str, bhdr->bgpo_type, bgp_len);
+      return;
+    }
+
+    if (!bmp_get_and_check_length(bmp_packet, len, (bgp_len - BGP_HEADER_SIZE))) {
+      Log(LOG_INFO, "INFO ( %s/core/BMP ): [Id: %s] [route] packet discarded: failed bmp_get_and_check_length() BGP UPDATE\n",
+          config.name, peer->addr_str);
+      return;
+    }
+
+    mpeer = bmp_mpeer_get(peer, bph, &bdata);
+    if (bgp_update_msg(mpeer, (char *) bhdr) < 0) {
+      Log(LOG_INFO, "INFO ( %s/core/BMP ): [Id: %s] [route] peer %s: malformed BGP UPDATE\n",
+          config.name, peer->addr_str, peer_ip);
+    }
+  }
 }
 
 void bmp_process_msg_stats(char **bmp_packet, u_int32_t *len, struct bgp_peer *peer)
@@ -1169,9 +1221,98 @@ void bmp_jump_offset(char **bmp_packet_ptr, u_int32_t *len, u_int32_t offset)
 void bmp_attr_init()
 {
   aspath_init(&bmp_ashash);
-  attrhash_init(&bmp_attrhash);
-  community_init(&bmp_comhash);
-  ecommunity_init(&bmp_ecomhash);
+  attrhash_init(config.bmp_table_attr_hash_buckets, &bmp_attrhash);
+  community_init(config.bmp_table_attr_hash_buckets, &bmp_comhash);
+  ecommunity_init(config.bmp_table_attr_hash_buckets, &bmp_ecomhash);
+
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].attrhash = bmp_attrhash;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].ashash = bmp_ashash;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].comhash = bmp_comhash;
+  inter_domain_routing_dbs[FUNC_TYPE_BMP].ecomhash = bmp_ecomhash;
+}
+
+/* Returns the monitored peer a BMP peer header refers to, creating it
+   on first sight. Most recently used peers are kept at the list head */
+struct bgp_peer *bmp_mpeer_get(struct bgp_peer *peer, struct bmp_peer_hdr *bph, struct bmp_data *bdata)
+{
+  struct bmp_mpeer *mpeer, *prev;
+
+  for (prev = NULL, mpeer = peer->bmp_mpeers; mpeer; prev = mpeer, mpeer = mpeer->next) {
+    if (!memcmp(&mpeer->peer.addr, &bdata->peer_ip, sizeof(struct host_addr)) &&
+	!memcmp(mpeer->rd, bph->rd, RD_LEN) &&
+	(mpeer->flags & BMP_PEER_FLAGS_L) == (bph->flags & BMP_PEER_FLAGS_L)) {
+      if (prev) {
+	prev->next = mpeer->next;
+	mpeer->next = peer->bmp_mpeers;
+	peer->bmp_mpeers = mpeer;
+      }
+
+      return &mpeer->peer;
+    }
+  }
+
+  mpeer = malloc(sizeof(struct bmp_mpeer));
+  if (!mpeer) {
+    Log(LOG_ERR, "ERROR ( %s/core/BMP ): malloc() failed (bmp_mpeer_get). Exiting ..\n", config.name);
+    exit_all(1);
+  }
+
+  memset(mpeer, 0, sizeof(struct bmp_mpeer));
+  mpeer->peer.type = FUNC_TYPE_BMP;
+  mpeer->peer.status = Established;
+  mpeer->peer.fd = peer->fd; /* shares the BMP session buckets */
+  mpeer->peer.as = bdata->peer_asn;
+  memcpy(&mpeer->peer.id, &bdata->bgp_id, sizeof(struct host_addr));
+  memcpy(&mpeer->peer.addr, &bdata->peer_ip, sizeof(struct host_addr));
+  addr_to_str(mpeer->peer.addr_str, &mpeer->peer.addr);
+  mpeer->peer.bmp_router = peer;
+
+  /* no OPEN seen: 4-octet AS_PATH unless the A flag says otherwise */
+  if (!(bph->flags & BMP_PEER_FLAGS_A)) mpeer->peer.cap_4as = (char *) &mpeer->peer.as;
+
+  memcpy(mpeer->rd, bph->rd, RD_LEN);
+  mpeer->flags = bph->flags;
+
+  mpeer->next = peer->bmp_mpeers;
+  peer->bmp_mpeers = mpeer;
+
+  Log(LOG_DEBUG, "DEBUG ( %s/core/BMP ): [Id: %s] new monitored peer %s AS%u (%s-policy)\n", config.name,
+      peer->addr_str, mpeer->peer.addr_str, mpeer->peer.as, (mpeer->flags & BMP_PEER_FLAGS_L) ? "post" : "pre");
+
+  return &mpeer->peer;
+}
+
+/* Peer down: withdraws the routes of, and forgets, the monitored peer */
+void bmp_mpeer_close(struct bgp_peer *peer, struct bmp_peer_hdr *bph, struct bmp_data *bdata)
+{
+  struct bmp_mpeer *mpeer, *prev, *next;
+
+  for (prev = NULL, mpeer = peer->bmp_mpeers; mpeer; mpeer = next) {
+    next = mpeer->next;
+
+    if (!memcmp(&mpeer->peer.addr, &bdata->peer_ip, sizeof(struct host_addr)) && !memcmp(mpeer->rd, bph->rd, RD_LEN)) {
+      bgp_peer_info_delete(&mpeer->peer);
+
+      if (prev) prev->next = next;
+      else peer->bmp_mpeers = next;
+
+      free(mpeer);
+    }
+    else prev = mpeer;
+  }
+}
+
+/* BMP session close: routes are already gone via bgp_peer_info_delete() */
+void bmp_mpeers_free(struct bgp_peer *peer)
+{
+  struct bmp_mpeer *mpeer, *next;
+
+  for (mpeer = peer->bmp_mpeers; mpeer; mpeer = next) {
+    next = mpeer->next;
+    free(mpeer);
+  }
+
+  peer->bmp_mpeers = NULL;
 }
 
 u_int32_t bmp_packet_adj_offset(char *bmp_packet, u_int32_t buf_len, u_int32_t recv_len, u_int32_t remaining_len, char *addr_str)
@@ -55,6 +55,10 @@ struct bmp_common_hdr {
 #define BMP_PEER_GLOBAL		0
 #define BMP_PEER_L3VPN		1
 
+#define BMP_PEER_FLAGS_V	0x80 /* IPv6 peer address */
+#define BMP_PEER_FLAGS_L	0x40 /* post-policy Adj-RIB-In */
+#define BMP_PEER_FLAGS_A	0x20 /* 2-octet AS_PATH format */
+
 
 struct bmp_peer_hdr {
   u_char	type;
@@ -155,6 +159,15 @@ struct bmp_data {
   struct timeval tstamp;
 };
 
+/* BGP peer monitored via a BMP session; keyed by peer address, peer
+   distinguisher and pre/post-policy flag. Routes are stored in bmp_rib */
+struct bmp_mpeer {
+  struct bgp_peer peer;
+  u_char rd[RD_LEN];
+  u_int8_t flags;
+  struct bmp_mpeer *next;
+};
+
 /* more includes */
 #include "bmp_logdump.h"
 
@@ -167,13 +180,16 @@ struct bmp_data {
 EXT void nfacctd_bmp_wrapper();
 EXT void skinny_bmp_daemon();
 EXT void bmp_attr_init();
+EXT struct bgp_peer *bmp_mpeer_get(struct bgp_peer *, struct bmp_peer_hdr *, struct bmp_data *);
+EXT void bmp_mpeer_close(struct bgp_peer *, struct bmp_peer_hdr *, struct bmp_data *);
+EXT void bmp_mpeers_free(struct bgp_peer *);
 EXT u_int32_t bmp_process_packet(char *, u_int32_t, struct bgp_peer *);
 EXT void bmp_process_msg_init(char **, u_int32_t *, u_int32_t, struct bgp_peer *);
 EXT void bmp_process_msg_term(char **, u_int32_t *, u_int32_t, struct bgp_peer *);
 EXT void bmp_process_msg_peer_up(char **, u_int32_t *, struct bgp_peer *);
 EXT void bmp_process_msg_peer_down(char **, u_int32_t *, struct bgp_peer *);
 EXT void bmp_process_msg_stats(char **, u_int32_t *, struct bgp_peer *);
-EXT void bmp_process_msg_route(char **, u_int32_t *, struct bgp_peer *);
+EXT void bmp_process_msg_route(char **, u_int32_t *, u_int32_t, struct bgp_peer *);
 
 EXT void bmp_common_hdr_get_len(struct bmp_common_hdr *, u_int32_t *);
 EXT void bmp_init_hdr_get_len(struct bmp_init_hdr *, u_int16_t *);
@@ -425,6 +425,8 @@ void set_default_values()
   while (list) {
     list->cfg.promisc = TRUE;
     list->cfg.maps_refresh = TRUE;
+    list->cfg.plugin_numa_node = ERR;
+    list->cfg.thread_pool_numa_node = ERR;
 
     list = list->next;
   }
@@ -27,6 +27,9 @@
 #define MAX_CUSTOM_PRIMITIVES		64
 #define MAX_CUSTOM_PRIMITIVE_NAMELEN	64
 #define MAX_CUSTOM_PRIMITIVE_PD_PTRS	8
+#define MAX_BGP_DUMP_WORKERS		64
+#define MAX_MONGO_PURGE_WORKERS		64
+#define MAX_IMT_INDEXES			4
 
 /* structures */
 struct _dictionary_line {
@@ -84,6 +87,15 @@ struct configuration {
   int pmacctd_nonroot;
   char *proc_name;
   int proc_priority;
+  int plugin_hugepages;
+  int plugin_numa_node;
+  char *proc_cpu_affinity;
+  int proc_sched_policy;
+  int proc_sched_priority;
+  char *thread_pool_cpu_affinity;
+  int thread_pool_numa_node;
+  int thread_pool_sched_policy;
+  int thread_pool_sched_priority;
   int sock;
   int bgp_sock;
   int acct_type; 
@@ -122,6 +134,9 @@ struct configuration {
   int num_hosts;
   char *imt_plugin_path;
   char *imt_plugin_passwd;
+  pm_cfgreg_t imt_index_wtc[MAX_IMT_INDEXES];
+  pm_cfgreg_t imt_index_wtc_2[MAX_IMT_INDEXES];
+  int imt_index_num;
   char *sql_db;
   char *sql_table;
   char *sql_table_schema;
@@ -150,12 +165,18 @@ struct configuration {
   char *sql_preprocess;
   int sql_preprocess_type;
   int sql_multi_values;
+  int sql_upsert_batch;
+  int sqlite3_prepare;
+  int sqlite3_commit_batch;
+  char *sqlite3_journal_mode;
+  int sqlite3_cache_size;
   int sql_aggressive_classification;
   char *sql_locking_style;
   int sql_use_copy;
   char *sql_delimiter;
   int timestamps_secs;
   int mongo_insert_batch;
+  int mongo_purge_workers;
   char *amqp_exchange_type;
   int amqp_persistent_msg;
   u_int32_t amqp_frame_max;
@@ -181,6 +202,7 @@ struct configuration {
   u_int32_t nfacctd_as;
   u_int32_t nfacctd_net;
   int nfacctd_pipe_size;
+  int nfacctd_workers;
   int sfacctd_renormalize;
   int sfacctd_counter_output;
   char *sfacctd_counter_file;
@@ -260,6 +282,7 @@ struct configuration {
   char *bgp_table_dump_file;
   char *bgp_table_dump_latest_file;
   int bgp_table_dump_refresh_time;
+  int bgp_table_dump_workers;
   char *bgp_table_dump_amqp_host;
   char *bgp_table_dump_amqp_vhost;
   char *bgp_table_dump_amqp_user;
@@ -415,13 +438,21 @@ struct configuration {
   char *sfprobe_agentip;
   int sfprobe_agentsubid;
   u_int64_t sfprobe_ifspeed;
+  int sfprobe_batch_size;
+  int sfprobe_datagram_size;
   int tee_transparent;
   int tee_max_receivers;
   int tee_max_receiver_pools;
   char *tee_receivers;
   int tee_pipe_size;
-  int uacctd_group;
+  int tee_batch_size;
+  int tee_gso;
+  int tee_balance_templates;
+  int tee_templates_refresh_time;
+  u_int32_t uacctd_group;
   int uacctd_nl_size;
+  int uacctd_nflog;
+  int uacctd_nflog_qthreshold;
   char *tunnel0;
   char *pkt_len_distrib_bins_str;
   char *pkt_len_distrib_bins[MAX_PKT_LEN_DISTRIB_BINS];
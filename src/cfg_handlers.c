@@ -187,79 +187,7 @@ int cfg_key_aggregate(char *filename, char *name, char *value_ptr)
   memset(&cpptrs, 0, sizeof(cpptrs));
 
   while (count_token = extract_token(&value_ptr, ',')) {
-    if (!strcmp(count_token, "src_host")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_HOST, count_token);
-    else if (!strcmp(count_token, "dst_host")) cfg_set_aggregate(filename, value, COUNT_INT_DST_HOST, count_token);
-    else if (!strcmp(count_token, "src_net")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_NET, count_token);
-    else if (!strcmp(count_token, "dst_net")) cfg_set_aggregate(filename, value, COUNT_INT_DST_NET, count_token);
-    else if (!strcmp(count_token, "sum")) cfg_set_aggregate(filename, value, COUNT_INT_SUM_HOST, count_token);
-    else if (!strcmp(count_token, "src_port")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_PORT, count_token);
-    else if (!strcmp(count_token, "dst_port")) cfg_set_aggregate(filename, value, COUNT_INT_DST_PORT, count_token);
-    else if (!strcmp(count_token, "proto")) cfg_set_aggregate(filename, value, COUNT_INT_IP_PROTO, count_token);
-#if defined (HAVE_L2)
-    else if (!strcmp(count_token, "src_mac")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_MAC, count_token);
-    else if (!strcmp(count_token, "dst_mac")) cfg_set_aggregate(filename, value, COUNT_INT_DST_MAC, count_token);
-    else if (!strcmp(count_token, "vlan")) cfg_set_aggregate(filename, value, COUNT_INT_VLAN, count_token);
-    else if (!strcmp(count_token, "sum_mac")) cfg_set_aggregate(filename, value, COUNT_INT_SUM_MAC, count_token);
-#else
-    else if (!strcmp(count_token, "src_mac") || !strcmp(count_token, "dst_mac") ||
-	     !strcmp(count_token, "vlan") || !strcmp(count_token, "sum_mac")) {
-      Log(LOG_WARNING, "WARN ( %s ): pmacct was compiled with --disable-l2 but 'aggregate' contains a L2 primitive. Ignored.\n", filename);
-    }
-#endif
-    else if (!strcmp(count_token, "tos")) cfg_set_aggregate(filename, value, COUNT_INT_IP_TOS, count_token);
-    else if (!strcmp(count_token, "none")) cfg_set_aggregate(filename, value, COUNT_INT_NONE, count_token);
-    else if (!strcmp(count_token, "src_as")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_AS, count_token);
-    else if (!strcmp(count_token, "dst_as")) cfg_set_aggregate(filename, value, COUNT_INT_DST_AS, count_token);
-    else if (!strcmp(count_token, "sum_host")) cfg_set_aggregate(filename, value, COUNT_INT_SUM_HOST, count_token);
-    else if (!strcmp(count_token, "sum_net")) cfg_set_aggregate(filename, value, COUNT_INT_SUM_NET, count_token);
-    else if (!strcmp(count_token, "sum_as")) cfg_set_aggregate(filename, value, COUNT_INT_SUM_AS, count_token);
-    else if (!strcmp(count_token, "sum_port")) cfg_set_aggregate(filename, value, COUNT_INT_SUM_PORT, count_token);
-    else if (!strcmp(count_token, "tag")) cfg_set_aggregate(filename, value, COUNT_INT_TAG, count_token);
-    else if (!strcmp(count_token, "tag2")) cfg_set_aggregate(filename, value, COUNT_INT_TAG2, count_token);
-    else if (!strcmp(count_token, "flows")) cfg_set_aggregate(filename, value, COUNT_INT_FLOWS, count_token);
-    else if (!strcmp(count_token, "class")) cfg_set_aggregate(filename, value, COUNT_INT_CLASS, count_token);
-    else if (!strcmp(count_token, "tcpflags")) cfg_set_aggregate(filename, value, COUNT_INT_TCPFLAGS, count_token);
-    else if (!strcmp(count_token, "std_comm")) cfg_set_aggregate(filename, value, COUNT_INT_STD_COMM, count_token);
-    else if (!strcmp(count_token, "ext_comm")) cfg_set_aggregate(filename, value, COUNT_INT_EXT_COMM, count_token);
-    else if (!strcmp(count_token, "as_path")) cfg_set_aggregate(filename, value, COUNT_INT_AS_PATH, count_token);
-    else if (!strcmp(count_token, "local_pref")) cfg_set_aggregate(filename, value, COUNT_INT_LOCAL_PREF, count_token);
-    else if (!strcmp(count_token, "med")) cfg_set_aggregate(filename, value, COUNT_INT_MED, count_token);
-    else if (!strcmp(count_token, "peer_src_as")) cfg_set_aggregate(filename, value, COUNT_INT_PEER_SRC_AS, count_token);
-    else if (!strcmp(count_token, "peer_dst_as")) cfg_set_aggregate(filename, value, COUNT_INT_PEER_DST_AS, count_token);
-    else if (!strcmp(count_token, "peer_src_ip")) cfg_set_aggregate(filename, value, COUNT_INT_PEER_SRC_IP, count_token);
-    else if (!strcmp(count_token, "peer_dst_ip")) cfg_set_aggregate(filename, value, COUNT_INT_PEER_DST_IP, count_token);
-    else if (!strcmp(count_token, "src_as_path")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_AS_PATH, count_token);
-    else if (!strcmp(count_token, "src_std_comm")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_STD_COMM, count_token);
-    else if (!strcmp(count_token, "src_ext_comm")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_EXT_COMM, count_token);
-    else if (!strcmp(count_token, "src_local_pref")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_LOCAL_PREF, count_token);
-    else if (!strcmp(count_token, "src_med")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_MED, count_token);
-    else if (!strcmp(count_token, "in_iface")) cfg_set_aggregate(filename, value, COUNT_INT_IN_IFACE, count_token);
-    else if (!strcmp(count_token, "out_iface")) cfg_set_aggregate(filename, value, COUNT_INT_OUT_IFACE, count_token);
-    else if (!strcmp(count_token, "src_mask")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_NMASK, count_token);
-    else if (!strcmp(count_token, "dst_mask")) cfg_set_aggregate(filename, value, COUNT_INT_DST_NMASK, count_token);
-    else if (!strcmp(count_token, "cos")) cfg_set_aggregate(filename, value, COUNT_INT_COS, count_token);
-    else if (!strcmp(count_token, "etype")) cfg_set_aggregate(filename, value, COUNT_INT_ETHERTYPE, count_token);
-    else if (!strcmp(count_token, "mpls_vpn_rd")) cfg_set_aggregate(filename, value, COUNT_INT_MPLS_VPN_RD, count_token);
-    else if (!strcmp(count_token, "sampling_rate")) cfg_set_aggregate(filename, value, COUNT_INT_SAMPLING_RATE, count_token);
-    else if (!strcmp(count_token, "src_host_country")) cfg_set_aggregate(filename, value, COUNT_INT_SRC_HOST_COUNTRY, count_token);
-    else if (!strcmp(count_token, "dst_host_country")) cfg_set_aggregate(filename, value, COUNT_INT_DST_HOST_COUNTRY, count_token);
-    else if (!strcmp(count_token, "pkt_len_distrib")) cfg_set_aggregate(filename, value, COUNT_INT_PKT_LEN_DISTRIB, count_token);
-    else if (!strcmp(count_token, "post_nat_src_host")) cfg_set_aggregate(filename, value, COUNT_INT_POST_NAT_SRC_HOST, count_token);
-    else if (!strcmp(count_token, "post_nat_dst_host")) cfg_set_aggregate(filename, value, COUNT_INT_POST_NAT_DST_HOST, count_token);
-    else if (!strcmp(count_token, "post_nat_src_port")) cfg_set_aggregate(filename, value, COUNT_INT_POST_NAT_SRC_PORT, count_token);
-    else if (!strcmp(count_token, "post_nat_dst_port")) cfg_set_aggregate(filename, value, COUNT_INT_POST_NAT_DST_PORT, count_token);
-    else if (!strcmp(count_token, "nat_event")) cfg_set_aggregate(filename, value, COUNT_INT_NAT_EVENT, count_token);
-    else if (!strcmp(count_token, "fw_event")) cfg_set_aggregate(filename, value, COUNT_INT_NAT_EVENT, count_token);
-    else if (!strcmp(count_token, "timestamp_start")) cfg_set_aggregate(filename, value, COUNT_INT_TIMESTAMP_START, count_token);
-    else if (!strcmp(count_token, "timestamp_end")) cfg_set_aggregate(filename, value, COUNT_INT_TIMESTAMP_END, count_token);
-    else if (!strcmp(count_token, "timestamp_arrival")) cfg_set_aggregate(filename, value, COUNT_INT_TIMESTAMP_ARRIVAL, count_token);
-    else if (!strcmp(count_token, "mpls_label_top")) cfg_set_aggregate(filename, value, COUNT_INT_MPLS_LABEL_TOP, count_token);
-    else if (!strcmp(count_token, "mpls_label_bottom")) cfg_set_aggregate(filename, value, COUNT_INT_MPLS_LABEL_BOTTOM, count_token);
-    else if (!strcmp(count_token, "mpls_stack_depth")) cfg_set_aggregate(filename, value, COUNT_INT_MPLS_STACK_DEPTH, count_token);
-    else if (!strcmp(count_token, "label")) cfg_set_aggregate(filename, value, COUNT_INT_LABEL, count_token);
-    else if (!strcmp(count_token, "export_proto_seqno")) cfg_set_aggregate(filename, value, COUNT_INT_EXPORT_PROTO_SEQNO, count_token);
-    else if (!strcmp(count_token, "export_proto_version")) cfg_set_aggregate(filename, value, COUNT_INT_EXPORT_PROTO_VERSION, count_token);
-    else {
+    if (!cfg_parse_aggregate_token(filename, value, count_token)) {
       cpptrs.primitive[cpptrs.num].name = count_token;
       cpptrs.num++;
     }
@@ -328,6 +256,236 @@ int cfg_key_proc_priority(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_plugin_hugepages(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  lower_string(value_ptr);
+  if (!strcmp(value_ptr, "none")) value = PM_HUGEPAGES_NONE;
+  else if (!strcmp(value_ptr, "transparent")) value = PM_HUGEPAGES_TRANSPARENT;
+  else if (!strcmp(value_ptr, "explicit")) value = PM_HUGEPAGES_EXPLICIT;
+  else {
+    Log(LOG_WARNING, "WARN ( %s ): 'plugin_hugepages' value has to be one of: none, transparent, explicit.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.plugin_hugepages = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.plugin_hugepages = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_plugin_numa_node(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 0 || value >= MAX_NUMA_NODES) {
+    Log(LOG_WARNING, "WARN ( %s ): 'plugin_numa_node' value has to be >= 0 and < %u.\n", filename, MAX_NUMA_NODES);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.plugin_numa_node = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.plugin_numa_node = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_proc_cpu_affinity(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  unsigned long cpus[MAX_NUMA_CPUS/(8*sizeof(unsigned long))];
+  char *value = value_ptr;
+  int changes = 0;
+
+  if (parse_cpu_list(value_ptr, cpus) == ERR) {
+    Log(LOG_WARNING, "WARN ( %s ): 'proc_cpu_affinity' value has to be a list of CPUs < %u, ie. '0-3,8'.\n", filename, MAX_NUMA_CPUS);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.proc_cpu_affinity = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.proc_cpu_affinity = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_proc_sched_policy(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_sched_policy(value_ptr);
+  if (value == ERR) {
+    Log(LOG_WARNING, "WARN ( %s ): 'proc_sched_policy' value has to be one of: other, batch, idle, fifo, rr.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.proc_sched_policy = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.proc_sched_policy = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_proc_sched_priority(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > 99) {
+    Log(LOG_WARNING, "WARN ( %s ): 'proc_sched_priority' value has to be >= 1 and <= 99.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.proc_sched_priority = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.proc_sched_priority = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_thread_pool_cpu_affinity(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  unsigned long cpus[MAX_NUMA_CPUS/(8*sizeof(unsigned long))];
+  char *value = value_ptr;
+  int changes = 0;
+
+  if (parse_cpu_list(value_ptr, cpus) == ERR) {
+    Log(LOG_WARNING, "WARN ( %s ): 'thread_pool_cpu_affinity' value has to be a list of CPUs < %u, ie. '0-3,8'.\n", filename, MAX_NUMA_CPUS);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.thread_pool_cpu_affinity = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.thread_pool_cpu_affinity = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_thread_pool_numa_node(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 0 || value >= MAX_NUMA_NODES) {
+    Log(LOG_WARNING, "WARN ( %s ): 'thread_pool_numa_node' value has to be >= 0 and < %u.\n", filename, MAX_NUMA_NODES);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.thread_pool_numa_node = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.thread_pool_numa_node = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_thread_pool_sched_policy(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_sched_policy(value_ptr);
+  if (value == ERR) {
+    Log(LOG_WARNING, "WARN ( %s ): 'thread_pool_sched_policy' value has to be one of: other, batch, idle, fifo, rr.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.thread_pool_sched_policy = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.thread_pool_sched_policy = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_thread_pool_sched_priority(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > 99) {
+    Log(LOG_WARNING, "WARN ( %s ): 'thread_pool_sched_priority' value has to be >= 1 and <= 99.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.thread_pool_sched_priority = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.thread_pool_sched_priority = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 int cfg_key_snaplen(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -664,6 +822,58 @@ int cfg_key_imt_mem_pools_number(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_imt_index(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  pm_cfgreg_t wtc[MAX_IMT_INDEXES], wtc_2[MAX_IMT_INDEXES];
+  char *index_token, *count_token;
+  u_int64_t value[3];
+  int num = 0, changes = 0;
+
+  trim_all_spaces(value_ptr);
+  lower_string(value_ptr);
+  memset(wtc, 0, sizeof(wtc));
+  memset(wtc_2, 0, sizeof(wtc_2));
+
+  while ((index_token = extract_token(&value_ptr, ';'))) {
+    if (num == MAX_IMT_INDEXES) {
+      Log(LOG_ERR, "WARN ( %s ): 'imt_index' supports up to %u indexes.\n", filename, MAX_IMT_INDEXES);
+      return ERR;
+    }
+
+    memset(&value, 0, sizeof(value));
+    while ((count_token = extract_token(&index_token, ','))) {
+      if (!cfg_parse_aggregate_token(filename, value, count_token)) {
+        Log(LOG_ERR, "WARN ( %s ): 'imt_index' does not support primitive '%s'.\n", filename, count_token);
+        return ERR;
+      }
+    }
+
+    wtc[num] = value[1];
+    wtc_2[num] = value[2];
+    num++;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) {
+    memcpy(list->cfg.imt_index_wtc, wtc, sizeof(wtc));
+    memcpy(list->cfg.imt_index_wtc_2, wtc_2, sizeof(wtc_2));
+    list->cfg.imt_index_num = num;
+  }
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        memcpy(list->cfg.imt_index_wtc, wtc, sizeof(wtc));
+        memcpy(list->cfg.imt_index_wtc_2, wtc_2, sizeof(wtc_2));
+        list->cfg.imt_index_num = num;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 int cfg_key_imt_mem_pools_size(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -1431,6 +1641,126 @@ int cfg_key_sql_multi_values(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_sql_upsert_batch(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int changes = 0, value = 0;
+
+  value = atoi(value_ptr);
+  if (value <= 0) {
+    Log(LOG_WARNING, "WARN ( %s ): 'sql_upsert_batch' has to be > 0.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.sql_upsert_batch = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.sql_upsert_batch = value; 
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_sqlite3_prepare(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.sqlite3_prepare = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.sqlite3_prepare = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_sqlite3_commit_batch(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int changes = 0, value = 0;
+
+  value = atoi(value_ptr);
+  if (value <= 0) {
+    Log(LOG_WARNING, "WARN ( %s ): 'sqlite3_commit_batch' has to be > 0.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.sqlite3_commit_batch = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.sqlite3_commit_batch = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_sqlite3_journal_mode(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int changes = 0;
+  char *value = value_ptr;
+
+  lower_string(value_ptr);
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.sqlite3_journal_mode = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.sqlite3_journal_mode = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_sqlite3_cache_size(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int changes = 0, value = 0;
+
+  /* as per PRAGMA cache_size: pages if positive, KiB if negative */
+  value = atoi(value_ptr);
+  if (!value) {
+    Log(LOG_WARNING, "WARN ( %s ): 'sqlite3_cache_size' has to be != 0.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.sqlite3_cache_size = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.sqlite3_cache_size = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 int cfg_key_mongo_insert_batch(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -1456,6 +1786,31 @@ int cfg_key_mongo_insert_batch(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_mongo_purge_workers(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int changes = 0, value = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > MAX_MONGO_PURGE_WORKERS) {
+    Log(LOG_WARNING, "WARN ( %s ): 'mongo_purge_workers' value has to be >= 1 and <= %u.\n", filename, MAX_MONGO_PURGE_WORKERS);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.mongo_purge_workers = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.mongo_purge_workers = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 int cfg_key_amqp_exchange_type(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -2142,6 +2497,23 @@ int cfg_key_nfacctd_pipe_size(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_nfacctd_workers(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 0 || value > NFACCTD_MAX_WORKERS) {
+    Log(LOG_ERR, "WARN ( %s ): 'nfacctd_workers' has to be >= 0 and <= %u.\n", filename, NFACCTD_MAX_WORKERS);
+    return ERR;
+  }
+
+  for (; list; list = list->next, changes++) list->cfg.nfacctd_workers = value;
+  if (name) Log(LOG_WARNING, "WARN ( %s ): plugin name not supported for key 'nfacctd_workers'. Globalized.\n", filename);
+
+  return changes;
+}
+
 int cfg_key_nfacctd_pro_rating(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -4975,6 +5347,56 @@ int cfg_key_sfprobe_ifspeed(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_sfprobe_batch_size(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 0 || value > 1024) {
+    Log(LOG_WARNING, "WARN ( %s ): invalid 'sfprobe_batch_size' value. Allowed values are >= 0 and <= 1024.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.sfprobe_batch_size = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.sfprobe_batch_size = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_sfprobe_datagram_size(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 200 || value > 1500) {
+    Log(LOG_WARNING, "WARN ( %s ): invalid 'sfprobe_datagram_size' value. Allowed values are >= 200 and <= 1500.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.sfprobe_datagram_size = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.sfprobe_datagram_size = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 int cfg_key_tee_transparent(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
@@ -5092,6 +5514,100 @@ int cfg_key_tee_pipe_size(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+int cfg_key_tee_batch_size(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 0 || value > 1024) {
+    Log(LOG_WARNING, "WARN ( %s ): invalid 'tee_batch_size' value. Allowed values are >= 0 and <= 1024.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.tee_batch_size = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.tee_batch_size = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_tee_gso(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.tee_gso = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.tee_gso = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_tee_balance_templates(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.tee_balance_templates = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.tee_balance_templates = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
+int cfg_key_tee_templates_refresh_time(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1) {
+    Log(LOG_WARNING, "WARN ( %s ): invalid 'tee_templates_refresh_time' value. Allowed values are >= 1.\n", filename);
+    return ERR;
+  }
+
+  if (!name) for (; list; list = list->next, changes++) list->cfg.tee_templates_refresh_time = value;
+  else {
+    for (; list; list = list->next) {
+      if (!strcmp(name, list->name)) {
+        list->cfg.tee_templates_refresh_time = value;
+        changes++;
+        break;
+      }
+    }
+  }
+
+  return changes;
+}
+
 void parse_time(char *filename, char *value, int *mu, int *howmany)
 {
   int k, j, len;
@@ -5151,14 +5667,52 @@ exit_lane:
 }
 
 int cfg_key_uacctd_group(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  char *token;
+  u_int32_t groups = 0;
+  int value, changes = 0;
+
+  while ((token = extract_token(&value_ptr, ','))) {
+    value = atoi(token);
+    if (value < 1 || value > 32) {
+      Log(LOG_ERR, "WARN ( %s ): 'uacctd_group' values have to be in the range 1-32.\n", filename);
+      return ERR;
+    }
+
+    groups |= (1U << (value-1));
+  }
+
+  if (!groups) return ERR;
+
+  for (; list; list = list->next, changes++) list->cfg.uacctd_group = groups;
+  return changes;
+}
+
+int cfg_key_uacctd_nflog(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = parse_truefalse(value_ptr);
+  if (value < 0) return ERR;
+
+  for (; list; list = list->next, changes++) list->cfg.uacctd_nflog = value;
+  return changes;
+}
+
+int cfg_key_uacctd_nflog_qthreshold(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
   int value, changes = 0;
 
   value = atoi(value_ptr);
-  if (value < 1 || value > 32) return ERR;
+  if (value < 1) {
+    Log(LOG_ERR, "WARN ( %s ): 'uacctd_nflog_qthreshold' has to be >= 1.\n", filename);
+    return ERR;
+  }
 
-  for (; list; list = list->next, changes++) list->cfg.uacctd_group = (1 << (value-1));
+  for (; list; list = list->next, changes++) list->cfg.uacctd_nflog_qthreshold = value;
   return changes;
 }
 
@@ -5244,6 +5798,89 @@ int cfg_key_pkt_len_distrib_bins(char *filename, char *name, char *value_ptr)
   return changes;
 }
 
+/*
+  Maps a primitive name onto the what_to_count registries; returns FALSE
+  if the primitive is not a built-in one, ie. it is a custom primitive.
+*/
+int cfg_parse_aggregate_token(char *filename, u_int64_t registry[], char *count_token)
+{
+  if (!strcmp(count_token, "src_host")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_HOST, count_token);
+  else if (!strcmp(count_token, "dst_host")) cfg_set_aggregate(filename, registry, COUNT_INT_DST_HOST, count_token);
+  else if (!strcmp(count_token, "src_net")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_NET, count_token);
+  else if (!strcmp(count_token, "dst_net")) cfg_set_aggregate(filename, registry, COUNT_INT_DST_NET, count_token);
+  else if (!strcmp(count_token, "sum")) cfg_set_aggregate(filename, registry, COUNT_INT_SUM_HOST, count_token);
+  else if (!strcmp(count_token, "src_port")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_PORT, count_token);
+  else if (!strcmp(count_token, "dst_port")) cfg_set_aggregate(filename, registry, COUNT_INT_DST_PORT, count_token);
+  else if (!strcmp(count_token, "proto")) cfg_set_aggregate(filename, registry, COUNT_INT_IP_PROTO, count_token);
+#if defined (HAVE_L2)
+  else if (!strcmp(count_token, "src_mac")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_MAC, count_token);
+  else if (!strcmp(count_token, "dst_mac")) cfg_set_aggregate(filename, registry, COUNT_INT_DST_MAC, count_token);
+  else if (!strcmp(count_token, "vlan")) cfg_set_aggregate(filename, registry, COUNT_INT_VLAN, count_token);
+  else if (!strcmp(count_token, "sum_mac")) cfg_set_aggregate(filename, registry, COUNT_INT_SUM_MAC, count_token);
+#else
+  else if (!strcmp(count_token, "src_mac") || !strcmp(count_token, "dst_mac") ||
+	   !strcmp(count_token, "vlan") || !strcmp(count_token, "sum_mac")) {
+    Log(LOG_WARNING, "WARN ( %s ): pmacct was compiled with --disable-l2 but 'aggregate' contains a L2 primitive. Ignored.\n", filename);
+  }
+#endif
+  else if (!strcmp(count_token, "tos")) cfg_set_aggregate(filename, registry, COUNT_INT_IP_TOS, count_token);
+  else if (!strcmp(count_token, "none")) cfg_set_aggregate(filename, registry, COUNT_INT_NONE, count_token);
+  else if (!strcmp(count_token, "src_as")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_AS, count_token);
+  else if (!strcmp(count_token, "dst_as")) cfg_set_aggregate(filename, registry, COUNT_INT_DST_AS, count_token);
+  else if (!strcmp(count_token, "sum_host")) cfg_set_aggregate(filename, registry, COUNT_INT_SUM_HOST, count_token);
+  else if (!strcmp(count_token, "sum_net")) cfg_set_aggregate(filename, registry, COUNT_INT_SUM_NET, count_token);
+  else if (!strcmp(count_token, "sum_as")) cfg_set_aggregate(filename, registry, COUNT_INT_SUM_AS, count_token);
+  else if (!strcmp(count_token, "sum_port")) cfg_set_aggregate(filename, registry, COUNT_INT_SUM_PORT, count_token);
+  else if (!strcmp(count_token, "tag")) cfg_set_aggregate(filename, registry, COUNT_INT_TAG, count_token);
+  else if (!strcmp(count_token, "tag2")) cfg_set_aggregate(filename, registry, COUNT_INT_TAG2, count_token);
+  else if (!strcmp(count_token, "flows")) cfg_set_aggregate(filename, registry, COUNT_INT_FLOWS, count_token);
+  else if (!strcmp(count_token, "class")) cfg_set_aggregate(filename, registry, COUNT_INT_CLASS, count_token);
+  else if (!strcmp(count_token, "tcpflags")) cfg_set_aggregate(filename, registry, COUNT_INT_TCPFLAGS, count_token);
+  else if (!strcmp(count_token, "std_comm")) cfg_set_aggregate(filename, registry, COUNT_INT_STD_COMM, count_token);
+  else if (!strcmp(count_token, "ext_comm")) cfg_set_aggregate(filename, registry, COUNT_INT_EXT_COMM, count_token);
+  else if (!strcmp(count_token, "as_path")) cfg_set_aggregate(filename, registry, COUNT_INT_AS_PATH, count_token);
+  else if (!strcmp(count_token, "local_pref")) cfg_set_aggregate(filename, registry, COUNT_INT_LOCAL_PREF, count_token);
+  else if (!strcmp(count_token, "med")) cfg_set_aggregate(filename, registry, COUNT_INT_MED, count_token);
+  else if (!strcmp(count_token, "peer_src_as")) cfg_set_aggregate(filename, registry, COUNT_INT_PEER_SRC_AS, count_token);
+  else if (!strcmp(count_token, "peer_dst_as")) cfg_set_aggregate(filename, registry, COUNT_INT_PEER_DST_AS, count_token);
+  else if (!strcmp(count_token, "peer_src_ip")) cfg_set_aggregate(filename, registry, COUNT_INT_PEER_SRC_IP, count_token);
+  else if (!strcmp(count_token, "peer_dst_ip")) cfg_set_aggregate(filename, registry, COUNT_INT_PEER_DST_IP, count_token);
+  else if (!strcmp(count_token, "src_as_path")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_AS_PATH, count_token);
+  else if (!strcmp(count_token, "src_std_comm")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_STD_COMM, count_token);
+  else if (!strcmp(count_token, "src_ext_comm")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_EXT_COMM, count_token);
+  else if (!strcmp(count_token, "src_local_pref")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_LOCAL_PREF, count_token);
+  else if (!strcmp(count_token, "src_med")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_MED, count_token);
+  else if (!strcmp(count_token, "in_iface")) cfg_set_aggregate(filename, registry, COUNT_INT_IN_IFACE, count_token);
+  else if (!strcmp(count_token, "out_iface")) cfg_set_aggregate(filename, registry, COUNT_INT_OUT_IFACE, count_token);
+  else if (!strcmp(count_token, "src_mask")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_NMASK, count_token);
+  else if (!strcmp(count_token, "dst_mask")) cfg_set_aggregate(filename, registry, COUNT_INT_DST_NMASK, count_token);
+  else if (!strcmp(count_token, "cos")) cfg_set_aggregate(filename, registry, COUNT_INT_COS, count_token);
+  else if (!strcmp(count_token, "etype")) cfg_set_aggregate(filename, registry, COUNT_INT_ETHERTYPE, count_token);
+  else if (!strcmp(count_token, "mpls_vpn_rd")) cfg_set_aggregate(filename, registry, COUNT_INT_MPLS_VPN_RD, count_token);
+  else if (!strcmp(count_token, "sampling_rate")) cfg_set_aggregate(filename, registry, COUNT_INT_SAMPLING_RATE, count_token);
+  else if (!strcmp(count_token, "src_host_country")) cfg_set_aggregate(filename, registry, COUNT_INT_SRC_HOST_COUNTRY, count_token);
+  else if (!strcmp(count_token, "dst_host_country")) cfg_set_aggregate(filename, registry, COUNT_INT_DST_HOST_COUNTRY, count_token);
+  else if (!strcmp(count_token, "pkt_len_distrib")) cfg_set_aggregate(filename, registry, COUNT_INT_PKT_LEN_DISTRIB, count_token);
+  else if (!strcmp(count_token, "post_nat_src_host")) cfg_set_aggregate(filename, registry, COUNT_INT_POST_NAT_SRC_HOST, count_token);
+  else if (!strcmp(count_token, "post_nat_dst_host")) cfg_set_aggregate(filename, registry, COUNT_INT_POST_NAT_DST_HOST, count_token);
+  else if (!strcmp(count_token, "post_nat_src_port")) cfg_set_aggregate(filename, registry, COUNT_INT_POST_NAT_SRC_PORT, count_token);
+  else if (!strcmp(count_token, "post_nat_dst_port")) cfg_set_aggregate(filename, registry, COUNT_INT_POST_NAT_DST_PORT, count_token);
+  else if (!strcmp(count_token, "nat_event")) cfg_set_aggregate(filename, registry, COUNT_INT_NAT_EVENT, count_token);
+  else if (!strcmp(count_token, "fw_event")) cfg_set_aggregate(filename, registry, COUNT_INT_NAT_EVENT, count_token);
+  else if (!strcmp(count_token, "timestamp_start")) cfg_set_aggregate(filename, registry, COUNT_INT_TIMESTAMP_START, count_token);
+  else if (!strcmp(count_token, "timestamp_end")) cfg_set_aggregate(filename, registry, COUNT_INT_TIMESTAMP_END, count_token);
+  else if (!strcmp(count_token, "timestamp_arrival")) cfg_set_aggregate(filename, registry, COUNT_INT_TIMESTAMP_ARRIVAL, count_token);
+  else if (!strcmp(count_token, "mpls_label_top")) cfg_set_aggregate(filename, registry, COUNT_INT_MPLS_LABEL_TOP, count_token);
+  else if (!strcmp(count_token, "mpls_label_bottom")) cfg_set_aggregate(filename, registry, COUNT_INT_MPLS_LABEL_BOTTOM, count_token);
+  else if (!strcmp(count_token, "mpls_stack_depth")) cfg_set_aggregate(filename, registry, COUNT_INT_MPLS_STACK_DEPTH, count_token);
+  else if (!strcmp(count_token, "label")) cfg_set_aggregate(filename, registry, COUNT_INT_LABEL, count_token);
+  else if (!strcmp(count_token, "export_proto_seqno")) cfg_set_aggregate(filename, registry, COUNT_INT_EXPORT_PROTO_SEQNO, count_token);
+  else if (!strcmp(count_token, "export_proto_version")) cfg_set_aggregate(filename, registry, COUNT_INT_EXPORT_PROTO_VERSION, count_token);
+  else return FALSE;
+
+  return TRUE;
+}
+
 void cfg_set_aggregate(char *filename, u_int64_t registry[], u_int64_t input, char *token)
 {
   u_int64_t index = (input >> COUNT_REGISTRY_BITS) & COUNT_INDEX_MASK;
@@ -5520,6 +6157,23 @@ int cfg_key_nfacctd_bgp_table_dump_refresh_time(char *filename, char *name, char
   return changes;
 }
 
+int cfg_key_nfacctd_bgp_table_dump_workers(char *filename, char *name, char *value_ptr)
+{
+  struct plugins_list_entry *list = plugins_list;
+  int value, changes = 0;
+
+  value = atoi(value_ptr);
+  if (value < 1 || value > MAX_BGP_DUMP_WORKERS) {
+    Log(LOG_ERR, "WARN ( %s ): 'bgp_table_dump_workers' value has to be >= 1 and <= %u.\n", filename, MAX_BGP_DUMP_WORKERS);
+    return ERR;
+  }
+
+  for (; list; list = list->next, changes++) list->cfg.bgp_table_dump_workers = value;
+  if (name) Log(LOG_WARNING, "WARN ( %s ): plugin name not supported for key 'bgp_table_dump_workers'. Globalized.\n", filename);
+
+  return changes;
+}
+
 int cfg_key_nfacctd_bgp_table_dump_amqp_host(char *filename, char *name, char *value_ptr)
 {
   struct plugins_list_entry *list = plugins_list;
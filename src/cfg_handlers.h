@@ -37,6 +37,15 @@ EXT int cfg_key_pidfile(char *, char *, char *);
 EXT int cfg_key_daemonize(char *, char *, char *);
 EXT int cfg_key_proc_name(char *, char *, char *);
 EXT int cfg_key_proc_priority(char *, char *, char *);
+EXT int cfg_key_plugin_hugepages(char *, char *, char *);
+EXT int cfg_key_plugin_numa_node(char *, char *, char *);
+EXT int cfg_key_proc_cpu_affinity(char *, char *, char *);
+EXT int cfg_key_proc_sched_policy(char *, char *, char *);
+EXT int cfg_key_proc_sched_priority(char *, char *, char *);
+EXT int cfg_key_thread_pool_cpu_affinity(char *, char *, char *);
+EXT int cfg_key_thread_pool_numa_node(char *, char *, char *);
+EXT int cfg_key_thread_pool_sched_policy(char *, char *, char *);
+EXT int cfg_key_thread_pool_sched_priority(char *, char *, char *);
 EXT int cfg_key_aggregate(char *, char *, char *);
 EXT int cfg_key_aggregate_primitives(char *, char *, char *);
 EXT int cfg_key_snaplen(char *, char *, char *);
@@ -58,6 +67,7 @@ EXT int cfg_key_imt_passwd(char *, char *, char *);
 EXT int cfg_key_imt_buckets(char *, char *, char *);
 EXT int cfg_key_imt_mem_pools_number(char *, char *, char *);
 EXT int cfg_key_imt_mem_pools_size(char *, char *, char *);
+EXT int cfg_key_imt_index(char *, char *, char *);
 EXT int cfg_key_sql_db(char *, char *, char *);
 EXT int cfg_key_sql_table(char *, char *, char *);
 EXT int cfg_key_sql_table_schema(char *, char *, char *);
@@ -83,12 +93,18 @@ EXT int cfg_key_sql_dont_try_update(char *, char *, char *);
 EXT int cfg_key_sql_preprocess(char *, char *, char *);
 EXT int cfg_key_sql_preprocess_type(char *, char *, char *);
 EXT int cfg_key_sql_multi_values(char *, char *, char *);
+EXT int cfg_key_sql_upsert_batch(char *, char *, char *);
+EXT int cfg_key_sqlite3_prepare(char *, char *, char *);
+EXT int cfg_key_sqlite3_commit_batch(char *, char *, char *);
+EXT int cfg_key_sqlite3_journal_mode(char *, char *, char *);
+EXT int cfg_key_sqlite3_cache_size(char *, char *, char *);
 EXT int cfg_key_sql_aggressive_classification(char *, char *, char *);
 EXT int cfg_key_sql_locking_style(char *, char *, char *);
 EXT int cfg_key_sql_use_copy(char *, char *, char *);
 EXT int cfg_key_sql_delimiter(char *, char *, char *);
 EXT int cfg_key_timestamps_secs(char *, char *, char *);
 EXT int cfg_key_mongo_insert_batch(char *, char *, char *);
+EXT int cfg_key_mongo_purge_workers(char *, char *, char *);
 EXT int cfg_key_amqp_exchange_type(char *, char *, char *);
 EXT int cfg_key_amqp_persistent_msg(char *, char *, char *);
 EXT int cfg_key_amqp_frame_max(char *, char *, char *);
@@ -138,6 +154,7 @@ EXT int cfg_key_nfacctd_net(char *, char *, char *);
 EXT int cfg_key_nfacctd_disable_checks(char *, char *, char *);
 EXT int cfg_key_nfacctd_mcast_groups(char *, char *, char *);
 EXT int cfg_key_nfacctd_pipe_size(char *, char *, char *);
+EXT int cfg_key_nfacctd_workers(char *, char *, char *);
 EXT int cfg_key_nfacctd_pro_rating(char *, char *, char *);
 EXT int cfg_key_nfacctd_account_options(char *, char *, char *);
 EXT int cfg_key_nfacctd_stitching(char *, char *, char *);
@@ -200,11 +217,17 @@ EXT int cfg_key_sfprobe_receiver(char *, char *, char *);
 EXT int cfg_key_sfprobe_agentip(char *, char *, char *);
 EXT int cfg_key_sfprobe_agentsubid(char *, char *, char *);
 EXT int cfg_key_sfprobe_ifspeed(char *, char *, char *);
+EXT int cfg_key_sfprobe_batch_size(char *, char *, char *);
+EXT int cfg_key_sfprobe_datagram_size(char *, char *, char *);
 EXT int cfg_key_tee_receivers(char *, char *, char *);
 EXT int cfg_key_tee_transparent(char *, char *, char *);
 EXT int cfg_key_tee_max_receivers(char *, char *, char *);
 EXT int cfg_key_tee_max_receiver_pools(char *, char *, char *);
 EXT int cfg_key_tee_pipe_size(char *, char *, char *);
+EXT int cfg_key_tee_batch_size(char *, char *, char *);
+EXT int cfg_key_tee_gso(char *, char *, char *);
+EXT int cfg_key_tee_balance_templates(char *, char *, char *);
+EXT int cfg_key_tee_templates_refresh_time(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_msglog_output(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_msglog_file(char *, char *, char *);
@@ -259,6 +282,7 @@ EXT int cfg_key_nfacctd_bgp_table_dump_output(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_file(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_latest_file(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_refresh_time(char *, char *, char *);
+EXT int cfg_key_nfacctd_bgp_table_dump_workers(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_amqp_host(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_amqp_vhost(char *, char *, char *);
 EXT int cfg_key_nfacctd_bgp_table_dump_amqp_user(char *, char *, char *);
@@ -346,10 +370,13 @@ EXT int cfg_key_geoip_ipv6_file(char *, char *, char *);
 EXT int cfg_key_geoipv2_file(char *, char *, char *);
 EXT int cfg_key_uacctd_group(char *, char *, char *);
 EXT int cfg_key_uacctd_nl_size(char *, char *, char *);
+EXT int cfg_key_uacctd_nflog(char *, char *, char *);
+EXT int cfg_key_uacctd_nflog_qthreshold(char *, char *, char *);
 EXT int cfg_key_tunnel_0(char *, char *, char *);
 EXT int cfg_key_pkt_len_distrib_bins(char *, char *, char *);
 EXT int cfg_key_tmp_net_own_field(char *, char *, char *);
 
 EXT void parse_time(char *, char *, int *, int *);
+EXT int cfg_parse_aggregate_token(char *, u_int64_t [], char *);
 EXT void cfg_set_aggregate(char *, u_int64_t [], u_int64_t, char *);
 #undef EXT
@@ -174,6 +174,8 @@ void imt_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   }
   else memset(lru_elem_ptr, 0, config.buckets*sizeof(struct acc *));
 
+  init_index_structures(&extras);
+
   current_pool = request_memory_pool(config.memory_pool_size);
   if (current_pool == NULL) {
     Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate more memory pools, try with larger value.\n", config.name, config.type);
@@ -331,6 +333,14 @@ void imt_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
         else Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d incoming bytes. ERRNO: %d\n", config.name, config.type, num, errno);
         Log(LOG_DEBUG, "DEBUG ( %s/%s ): Closing connection with client ...\n", config.name, config.type);
       }
+      else if (request == (WANT_STATS|WANT_TOPN) && num >= sizeof(struct query_header)+sizeof(struct query_topn) &&
+	       ((struct query_topn *)(srvbuf+sizeof(struct query_header)))->howmany &&
+	       !((struct query_topn *)(srvbuf+sizeof(struct query_header)))->what_to_count &&
+	       !((struct query_topn *)(srvbuf+sizeof(struct query_header)))->what_to_count_2) {
+	/* bounded top-N without group-by: a single walk and a small reply, no fork() */
+	process_query_data(sd2, srvbuf, num, &extras, datasize, FALSE);
+        Log(LOG_DEBUG, "DEBUG ( %s/%s ): Closing connection with client ...\n", config.name, config.type);
+      }
       else if (request == WANT_PKT_LEN_DISTRIB_TABLE) {
         if (num > 0) process_query_data(sd2, srvbuf, num, &extras, datasize, FALSE);
         else Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d incoming bytes. ERRNO: %d\n", config.name, config.type, num, errno);
@@ -375,6 +385,7 @@ void imt_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
       */
 	free_extra_allocs(); 
       clear_memory_pool_table();
+      clear_index_structures();
       current_pool = request_memory_pool(config.buckets*sizeof(struct acc));
       if (current_pool == NULL) {
         Log(LOG_ERR, "ERROR ( %s/%s ): Cannot allocate my first memory pool, try with larger value.\n", config.name, config.type);
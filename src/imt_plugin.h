@@ -26,6 +26,7 @@
 #define MEMORY_POOL_SIZE 8192
 #define MAX_HOSTS 32771 
 #define MAX_QUERIES 4096
+#define IMT_INDEX_CHUNK_SZ 4096
 
 /* Structures */
 struct acc {
@@ -43,6 +44,7 @@ struct acc {
   struct pkt_mpls_primitives *pmpls;
   char *pcust;
   struct pkt_vlen_hdr_primitives *pvlen;
+  struct imt_index_node *index_nodes;	/* secondary indexes: nodes linking this entry */
   struct acc *next;
 };
 
@@ -83,6 +85,47 @@ struct query_entry {
   struct pkt_vlen_hdr_primitives *pvlen;/* variable-length data */
 };
 
+/* follows the query_header in WANT_TOPN queries */
+struct query_topn {
+  int counter;				/* sort by: 0 none, 1 bytes, 2 packets, 3 flows */
+  unsigned int howmany;			/* entries to return, 0 for all */
+  pm_cfgreg_t what_to_count;		/* group-by; 0 returns table entries as they are */
+  pm_cfgreg_t what_to_count_2;		/* group-by */
+};
+
+struct imt_topn_item {
+  pm_counter_t key;
+  void *ptr;
+};
+
+struct imt_topn_group {
+  struct pkt_data data;
+  struct pkt_bgp_primitives pbgp;
+  struct pkt_nat_primitives pnat;
+  struct pkt_mpls_primitives pmpls;
+  unsigned int hash;
+  int next;
+};
+
+struct imt_index_node {
+  struct acc *acc;
+  struct imt_index_node *next;
+  struct imt_index_node **pprev;	/* for unlinking */
+  struct imt_index_node *sibling;	/* next node of the same entry, or free list */
+};
+
+struct imt_index_chunk {
+  struct imt_index_node nodes[IMT_INDEX_CHUNK_SZ];
+  int used;
+  struct imt_index_chunk *next;
+};
+
+struct imt_index {
+  pm_cfgreg_t what_to_count;
+  pm_cfgreg_t what_to_count_2;
+  struct imt_index_node **buckets;
+};
+
 struct reply_buffer {
   unsigned char buf[LARGEBUFLEN];
   unsigned char *ptr;
@@ -126,6 +169,15 @@ struct imt_custom_primitives {
 EXT void insert_accounting_structure(struct primitives_ptrs *);
 EXT struct acc *search_accounting_structure(struct primitives_ptrs *);
 EXT int compare_accounting_structure(struct acc *, struct primitives_ptrs *);
+EXT unsigned int hash_masked_primitives(struct pkt_primitives *, struct pkt_bgp_primitives *, struct pkt_nat_primitives *,
+			struct pkt_mpls_primitives *, struct extra_primitives *);
+EXT void init_index_structures(struct extra_primitives *);
+EXT void clear_index_structures();
+EXT void insert_index_structures(struct acc *);
+EXT void remove_index_structures(struct acc *);
+EXT struct imt_index *search_index_structures(pm_cfgreg_t, pm_cfgreg_t);
+EXT struct imt_index_node *lookup_index_structure(struct imt_index *, struct pkt_primitives *, struct pkt_bgp_primitives *,
+			struct pkt_nat_primitives *, struct pkt_mpls_primitives *);
 #undef EXT
 
 #if (!defined __MEMORY_C)
@@ -151,6 +203,10 @@ EXT void mask_elem(struct pkt_primitives *, struct pkt_bgp_primitives *, struct
 			struct pkt_mpls_primitives *, struct acc *, u_int64_t, u_int64_t,
 			struct extra_primitives *);
 EXT void enQueue_elem(int, struct reply_buffer *, void *, int, int);
+EXT void enQueue_acc(int, struct reply_buffer *, struct acc *, struct extra_primitives *, int);
+EXT void process_topn_query(int, struct reply_buffer *, struct query_topn *, struct extra_primitives *, int);
+EXT void topn_insert(struct imt_topn_item **, u_int32_t *, u_int32_t *, u_int32_t, pm_counter_t, void *);
+EXT int topn_cmp(const void *, const void *);
 EXT void Accumulate_Counters(struct pkt_data *, struct acc *);
 EXT int test_zero_elem(struct acc *);
 #undef EXT
@@ -184,4 +240,6 @@ EXT struct acc **lru_elem_ptr; /* pointer to Last Recently Used (lru) element in
 EXT int no_more_space;
 EXT struct timeval cycle_stamp; /* timestamp for the current cycle */
 EXT struct timeval table_reset_stamp; /* global table reset timestamp */
+EXT struct imt_index imt_indexes[MAX_IMT_INDEXES]; /* secondary indexes */
+EXT int imt_indexes_num;
 #undef EXT
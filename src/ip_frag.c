@@ -28,17 +28,8 @@
 #include "ip_frag.h"
 #include "jhash.h"
 
-u_int32_t ipft_total_nodes;  
-time_t prune_deadline;
-time_t emergency_prune;
 u_int32_t trivial_hash_rnd = 140281; /* ummmh */
 
-#if defined ENABLE_IPV6
-u_int32_t ipft6_total_nodes;
-time_t prune_deadline6;
-time_t emergency_prune6;
-#endif
-
 void init_ip_fragment_handler()
 {
   init_ip4_fragment_handler();
@@ -49,158 +40,111 @@ void init_ip_fragment_handler()
 
 void init_ip4_fragment_handler()
 {
-  if (config.frag_bufsz) ipft_total_nodes = config.frag_bufsz / sizeof(struct ip_fragment);
-  else ipft_total_nodes = DEFAULT_FRAG_BUFFER_SIZE / sizeof(struct ip_fragment); 
-
-  memset(ipft, 0, sizeof(ipft));
-  lru_list.root = (struct ip_fragment *) malloc(sizeof(struct ip_fragment)); 
-  lru_list.last = lru_list.root;
-  memset(lru_list.root, 0, sizeof(struct ip_fragment));
-  prune_deadline = time(NULL)+PRUNE_INTERVAL;
-  emergency_prune = 0;
+  u_int32_t bufsz;
+
+  if (config.frag_bufsz) bufsz = config.frag_bufsz;
+  else bufsz = DEFAULT_FRAG_BUFFER_SIZE;
+
+  memset(&ipft, 0, sizeof(ipft));
+  ipft.nodes_budget = bufsz / sizeof(struct ip_fragment);
+
+  /* the table starts small and doubles up to a size matching the buffer */
+  for (ipft.buckets_max = IPFT_HASHSZ; ipft.buckets_max < (ipft.nodes_budget / IPFT_LOAD_FACTOR);
+       ipft.buckets_max <<= 1);
+  ipft.buckets_num = IPFT_HASHSZ;
+
+  ipft.buckets = (struct ip_fragment **) calloc(ipft.buckets_num, sizeof(struct ip_fragment *));
+  if (!ipft.buckets) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate Fragment/4 table. Exiting.\n", config.name);
+    exit_all(1);
+  }
+
+  ipft.wheel_now = time(NULL);
 }
 
 int ip_fragment_handler(struct packet_ptrs *pptrs)
 {
   u_int32_t now = time(NULL);
 
-  if (now > prune_deadline) {
-    prune_old_fragments(now, PRUNE_OFFSET);
-    prune_deadline = now+PRUNE_INTERVAL;
-  }
+  prune_old_fragments(now);
   return find_fragment(now, pptrs);
 }
 
 int find_fragment(u_int32_t now, struct packet_ptrs *pptrs)
 {
   struct my_iphdr *iphp = (struct my_iphdr *)pptrs->iph_ptr;
-  struct ip_fragment *fp, *candidate = NULL, *last_seen = NULL;
-  unsigned int bucket = hash_fragment(iphp->ip_id, iphp->ip_src.s_addr,
-				      iphp->ip_dst.s_addr, iphp->ip_p);
+  struct ip_fragment *fp;
+  u_int32_t hash = hash_fragment(iphp->ip_id, iphp->ip_src.s_addr,
+				 iphp->ip_dst.s_addr, iphp->ip_p);
 
-  for (fp = ipft[bucket]; fp; fp = fp->next) {
+  /* expired nodes were already reclaimed by prune_old_fragments() */
+  for (fp = ipft.buckets[hash & (ipft.buckets_num-1)]; fp; fp = fp->next) {
     if (fp->ip_id == iphp->ip_id && fp->ip_src == iphp->ip_src.s_addr &&
 	fp->ip_dst == iphp->ip_dst.s_addr && fp->ip_p == iphp->ip_p) {
-      /* fragment found; will check for its deadline */
-      if (fp->deadline > now) {
-	if (fp->got_first) {
-	  // pptrs->tlh_ptr = fp->tlhdr; 
-	  memcpy(pptrs->tlh_ptr, fp->tlhdr, MyTLHdrSz); 
+      if (fp->got_first) {
+	// pptrs->tlh_ptr = fp->tlhdr; 
+	memcpy(pptrs->tlh_ptr, fp->tlhdr, MyTLHdrSz); 
+	return TRUE;
+      }
+      else {
+	if (!(iphp->ip_off & htons(IP_OFFMASK))) {
+	  /* we got our first fragment */
+	  fp->got_first = TRUE;
+	  memcpy(fp->tlhdr, pptrs->tlh_ptr, MyTLHdrSz);
+
+	  fp->a += ntohs(iphp->ip_len);
+	  iphp->ip_len = htons(fp->a);
+	  pptrs->pf = fp->pa;
+	  fp->pa = 0;
+	  fp->a = 0;
 	  return TRUE;
 	}
-	else {
-	  if (!(iphp->ip_off & htons(IP_OFFMASK))) {
-	    /* we got our first fragment */
-	    fp->got_first = TRUE;
-	    memcpy(fp->tlhdr, pptrs->tlh_ptr, MyTLHdrSz);
-
+	else { /* we still don't have the first fragment; increase accumulators */
+	  if (!config.ext_sampling_rate) {
+	    fp->pa++;
 	    fp->a += ntohs(iphp->ip_len);
-	    iphp->ip_len = htons(fp->a);
-	    pptrs->pf = fp->pa;
-	    fp->pa = 0;
-	    fp->a = 0;
-            return TRUE;
 	  }
-	  else { /* we still don't have the first fragment; increase accumulators */
-	    if (!config.ext_sampling_rate) {
-	      fp->pa++;
-	      fp->a += ntohs(iphp->ip_len);
-	    }
-	    return FALSE;
-	  } 
-	}
-      } 
-      else {
-	candidate = fp;
-	if (!candidate->got_first) notify_orphan_fragment(candidate);
-	goto create;
+	  return FALSE;
+	} 
       }
     }
-    if ((fp->deadline < now) && !candidate) {
-      candidate = fp; 
-      if (!candidate->got_first) notify_orphan_fragment(candidate);
-    }
-    last_seen = fp;
   } 
 
-  create:
-  if (candidate) return create_fragment(now, candidate, TRUE, bucket, pptrs);
-  else return create_fragment(now, last_seen, FALSE, bucket, pptrs); 
+  return create_fragment(now, hash, pptrs);
 }
 
-int create_fragment(u_int32_t now, struct ip_fragment *fp, u_int8_t is_candidate, unsigned int bucket, struct packet_ptrs *pptrs)
+int create_fragment(u_int32_t now, u_int32_t hash, struct packet_ptrs *pptrs)
 {
   struct my_iphdr *iphp = (struct my_iphdr *)pptrs->iph_ptr;
-  struct ip_fragment *newf;
-
-  if (!ipft_total_nodes) {
-    if (now > emergency_prune+EMER_PRUNE_INTERVAL) {
-      Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Skipping fragments.\n", config.name);
-      emergency_prune = now;
-      prune_old_fragments(now, 0);
-    }
-    return FALSE; 
-  }
+  struct ip_fragment *fp, **head;
 
-  if (fp) {
-    /* a 'not candidate' is simply the tail (last node) of the
-       list. We need to allocate a new node */
-    if (!is_candidate) { 
-      newf = (struct ip_fragment *) malloc(sizeof(struct ip_fragment));
-      if (!newf) { 
-	if (now > emergency_prune+EMER_PRUNE_INTERVAL) {
-	  Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Skipping fragments.\n", config.name);
-	  emergency_prune = now;
-	  prune_old_fragments(now, 0);
-	}
-	return FALSE;
-      }
-      else ipft_total_nodes--;
-      memset(newf, 0, sizeof(struct ip_fragment));
-      fp->next = newf;
-      newf->prev = fp;  
-      lru_list.last->lru_next = newf; /* placing new node as LRU tail */
-      newf->lru_prev = lru_list.last;
-      lru_list.last = newf;
-      fp = newf;
-    }
-    else {
-      if (fp->lru_next) { /* if fp->lru_next==NULL the node is already the tail */ 
-        fp->lru_prev->lru_next = fp->lru_next; 
-	fp->lru_next->lru_prev = fp->lru_prev;
-	lru_list.last->lru_next = fp;
-	fp->lru_prev = lru_list.last;
-	fp->lru_next = NULL;
-	lru_list.last = fp;
-      }
-    }
-  }
-  else {
-    /* we don't have any fragment pointer; this is because current
-       bucket doesn't contain any node; we'll allocate first one */ 
-    fp = (struct ip_fragment *) malloc(sizeof(struct ip_fragment));  
-    if (!fp) {
-      if (now > emergency_prune+EMER_PRUNE_INTERVAL) {
-        Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Skipping fragments.\n", config.name);
-        emergency_prune = now;
-        prune_old_fragments(now, 0);
-      }
-      return FALSE;
-    }
-    else ipft_total_nodes--;
-    memset(fp, 0, sizeof(struct ip_fragment));
-    ipft[bucket] = fp;
-    lru_list.last->lru_next = fp; /* placing new node as LRU tail */ 
-    fp->lru_prev = lru_list.last;
-    lru_list.last = fp;
-  }
+  fp = alloc_fragment(now);
+  if (!fp) return FALSE;
 
   fp->deadline = now+IPF_TIMEOUT;
   fp->ip_id = iphp->ip_id;
   fp->ip_p = iphp->ip_p;
   fp->ip_src = iphp->ip_src.s_addr;
   fp->ip_dst = iphp->ip_dst.s_addr;
-  fp->bucket = bucket;
+  fp->hash = hash;
+
+  /* linking to bucket head */
+  head = &ipft.buckets[hash & (ipft.buckets_num-1)];
+  fp->next = *head;
+  if (*head) (*head)->prev = fp;
+  *head = fp;
+
+  /* linking to timer-wheel slot */
+  head = &ipft.wheel[fp->deadline & (IPF_WHEEL_SZ-1)];
+  fp->tw_next = *head;
+  if (*head) (*head)->tw_prev = fp;
+  *head = fp;
+
+  ipft.nodes_used++;
+  ipft.stats.created++;
+
+  if (ipft.nodes_used > ipft.buckets_num*IPFT_LOAD_FACTOR && ipft.buckets_num < ipft.buckets_max)
+    resize_fragment_table();
 
   if (!(iphp->ip_off & htons(IP_OFFMASK))) {
     /* it's a first fragment */
@@ -218,51 +162,139 @@ int create_fragment(u_int32_t now, struct ip_fragment *fp, u_int8_t is_candidate
   }
 }
 
-void prune_old_fragments(u_int32_t now, u_int32_t off)
+/*
+   Nodes come from the free list or are carved from pool chunks until
+   the buffer budget is reached; from there on the node closest to its
+   deadline is evicted to make room for the new one.
+*/
+struct ip_fragment *alloc_fragment(u_int32_t now)
+{
+  struct ip_fragment *fp = NULL;
+  u_int32_t idx, chunk;
+
+  if (!ipft.free_list && !ipft.pool_left && ipft.nodes_alloc < ipft.nodes_budget) {
+    chunk = MIN(IPFT_POOL_CHUNK, ipft.nodes_budget-ipft.nodes_alloc);
+    ipft.pool = (struct ip_fragment *) malloc(chunk*sizeof(struct ip_fragment));
+    if (ipft.pool) ipft.pool_left = chunk;
+  }
+
+  if (ipft.free_list) {
+    fp = ipft.free_list;
+    ipft.free_list = fp->next;
+  }
+  else if (ipft.pool_left) {
+    fp = ipft.pool;
+    ipft.pool++;
+    ipft.pool_left--;
+    ipft.nodes_alloc++;
+  }
+  else {
+    for (idx = 1; idx <= IPF_WHEEL_SZ && !fp; idx++)
+      fp = ipft.wheel[(ipft.wheel_now+idx) & (IPF_WHEEL_SZ-1)];
+
+    if (now > ipft.emergency_log+EMER_PRUNE_INTERVAL) {
+      if (fp) Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Evicting oldest fragments.\n", config.name);
+      else Log(LOG_INFO, "INFO ( %s/core ): Fragment/4 buffer full. Skipping fragments.\n", config.name);
+      ipft.emergency_log = now;
+    }
+    if (!fp) return NULL;
+
+    if (!fp->got_first) {
+      notify_orphan_fragment(fp);
+      ipft.stats.orphans++;
+    }
+    ipft.stats.evictions++;
+    release_fragment(fp);
+
+    fp = ipft.free_list;
+    ipft.free_list = fp->next;
+  }
+
+  memset(fp, 0, sizeof(struct ip_fragment));
+
+  return fp;
+}
+
+void release_fragment(struct ip_fragment *fp)
 {
-  struct ip_fragment *fp, *temp;
-  u_int32_t deadline = now-off;
-
-  fp = lru_list.root->lru_next;
-  while (fp) {
-    if (deadline > fp->deadline) {
-      /* we found a stale element; we'll prune it */
-      if (fp->lru_next) temp = fp->lru_next;
-      else temp = NULL;
-
-      /* rearranging bucket's pointers */ 
-      if (fp->prev && fp->next) {
-	fp->prev->next = fp->next;
-        fp->next->prev = fp->prev;
-      }
-      else if (fp->prev) fp->prev->next = NULL;
-      else if (fp->next) {
-	ipft[fp->bucket] = fp->next;
-	fp->next->prev = NULL; 
-      }
-      else ipft[fp->bucket] = NULL;
+  if (fp->prev) fp->prev->next = fp->next;
+  else ipft.buckets[fp->hash & (ipft.buckets_num-1)] = fp->next;
+  if (fp->next) fp->next->prev = fp->prev;
 
-      free(fp);
-      ipft_total_nodes++;
+  if (fp->tw_prev) fp->tw_prev->tw_next = fp->tw_next;
+  else ipft.wheel[fp->deadline & (IPF_WHEEL_SZ-1)] = fp->tw_next;
+  if (fp->tw_next) fp->tw_next->tw_prev = fp->tw_prev;
+
+  fp->next = ipft.free_list;
+  ipft.free_list = fp;
+  ipft.nodes_used--;
+}
 
-      if (temp) fp = temp;
-      else fp = NULL;
+void resize_fragment_table()
+{
+  struct ip_fragment **buckets, *fp, *next;
+  u_int32_t idx, buckets_num = ipft.buckets_num << 1;
+
+  buckets = (struct ip_fragment **) calloc(buckets_num, sizeof(struct ip_fragment *));
+  if (!buckets) {
+    Log(LOG_WARNING, "WARN ( %s/core ): Unable to grow Fragment/4 table; staying at %u buckets.\n",
+	config.name, ipft.buckets_num);
+    ipft.buckets_max = ipft.buckets_num;
+    return;
+  }
+
+  for (idx = 0; idx < ipft.buckets_num; idx++) {
+    for (fp = ipft.buckets[idx]; fp; fp = next) {
+      next = fp->next;
+      fp->prev = NULL;
+      fp->next = buckets[fp->hash & (buckets_num-1)];
+      if (fp->next) fp->next->prev = fp;
+      buckets[fp->hash & (buckets_num-1)] = fp;
     }
-    else break;
   }
 
-  if (fp) {
-    fp->lru_prev = lru_list.root;
-    lru_list.root->lru_next = fp;
+  free(ipft.buckets);
+  ipft.buckets = buckets;
+  ipft.buckets_num = buckets_num;
+}
+
+/*
+   Advances the timer wheel up to 'now'. Deadlines are never more than
+   IPF_TIMEOUT seconds ahead so each slot holds a single deadline and a
+   tick only walks nodes which are actually due.
+*/
+void prune_old_fragments(u_int32_t now)
+{
+  struct ip_fragment *fp, *next;
+  u_int32_t tick;
+
+  if (now <= ipft.wheel_now) return;
+
+  /* idle for longer than a full turn: visit each slot once */
+  if (now-ipft.wheel_now > IPF_WHEEL_SZ) ipft.wheel_now = now-IPF_WHEEL_SZ;
+
+  for (tick = ipft.wheel_now+1; tick <= now; tick++) {
+    for (fp = ipft.wheel[tick & (IPF_WHEEL_SZ-1)]; fp; fp = next) {
+      next = fp->tw_next;
+      if (fp->deadline <= tick) {
+	if (!fp->got_first) {
+	  notify_orphan_fragment(fp);
+	  ipft.stats.orphans++;
+	}
+	ipft.stats.expired++;
+	release_fragment(fp);
+      }
+    }
   }
-  else lru_list.last = lru_list.root;
+
+  ipft.wheel_now = now;
 }
 
 /* hash_fragment() is taken (it has another name there) from Linux kernel 2.4;
    see full credits contained in jhash.h */ 
 unsigned int hash_fragment(u_int16_t id, u_int32_t src, u_int32_t dst, u_int8_t proto)
 {
-  return jhash_3words((u_int32_t)id << 16 | proto, src, dst, trivial_hash_rnd) & (IPFT_HASHSZ-1);
+  return jhash_3words((u_int32_t)id << 16 | proto, src, dst, trivial_hash_rnd);
 }
 
 void notify_orphan_fragment(struct ip_fragment *frag)
@@ -284,25 +316,32 @@ void notify_orphan_fragment(struct ip_fragment *frag)
 #if defined ENABLE_IPV6
 void init_ip6_fragment_handler()
 {
-  if (config.frag_bufsz) ipft6_total_nodes = config.frag_bufsz / sizeof(struct ip6_fragment);
-  else ipft6_total_nodes = DEFAULT_FRAG_BUFFER_SIZE / sizeof(struct ip6_fragment);
-
-  memset(ipft6, 0, sizeof(ipft6));
-  lru_list6.root = (struct ip6_fragment *) malloc(sizeof(struct ip6_fragment));
-  lru_list6.last = lru_list6.root;
-  memset(lru_list6.root, 0, sizeof(struct ip6_fragment));
-  prune_deadline6 = time(NULL)+PRUNE_INTERVAL;
-  emergency_prune6 = 0;
+  u_int32_t bufsz;
+
+  if (config.frag_bufsz) bufsz = config.frag_bufsz;
+  else bufsz = DEFAULT_FRAG_BUFFER_SIZE;
+
+  memset(&ipft6, 0, sizeof(ipft6));
+  ipft6.nodes_budget = bufsz / sizeof(struct ip6_fragment);
+
+  for (ipft6.buckets_max = IPFT_HASHSZ; ipft6.buckets_max < (ipft6.nodes_budget / IPFT_LOAD_FACTOR);
+       ipft6.buckets_max <<= 1);
+  ipft6.buckets_num = IPFT_HASHSZ;
+
+  ipft6.buckets = (struct ip6_fragment **) calloc(ipft6.buckets_num, sizeof(struct ip6_fragment *));
+  if (!ipft6.buckets) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate Fragment/6 table. Exiting.\n", config.name);
+    exit_all(1);
+  }
+
+  ipft6.wheel_now = time(NULL);
 }
 
 int ip6_fragment_handler(struct packet_ptrs *pptrs, struct ip6_frag *fhdr)
 {
   u_int32_t now = time(NULL);
 
-  if (now > prune_deadline6) {
-    prune_old_fragments6(now, PRUNE_OFFSET);
-    prune_deadline6 = now+PRUNE_INTERVAL;
-  }
+  prune_old_fragments6(now);
   return find_fragment6(now, pptrs, fhdr);
 }
 
@@ -330,138 +369,79 @@ unsigned int hash_fragment6(u_int32_t id, struct in6_addr *saddr, struct in6_add
         c += id;
         __jhash_mix(a, b, c);
 
-        return c & (IPFT_HASHSZ - 1);
+        return c;
 }
 
 int find_fragment6(u_int32_t now, struct packet_ptrs *pptrs, struct ip6_frag *fhdr)
 {
   struct ip6_hdr *iphp = (struct ip6_hdr *)pptrs->iph_ptr;
-  struct ip6_fragment *fp, *candidate = NULL, *last_seen = NULL;
-  unsigned int bucket = hash_fragment6(fhdr->ip6f_ident, &iphp->ip6_src, &iphp->ip6_dst);
+  struct ip6_fragment *fp;
+  u_int32_t hash = hash_fragment6(fhdr->ip6f_ident, &iphp->ip6_src, &iphp->ip6_dst);
 
-  for (fp = ipft6[bucket]; fp; fp = fp->next) {
+  for (fp = ipft6.buckets[hash & (ipft6.buckets_num-1)]; fp; fp = fp->next) {
     if (fp->id == fhdr->ip6f_ident && !ip6_addr_cmp(&fp->src, &iphp->ip6_src) &&
         !ip6_addr_cmp(&fp->dst, &iphp->ip6_dst)) {
-      /* fragment found; will check for its deadline */
-      if (fp->deadline > now) {
-        if (fp->got_first) {
-          // pptrs->tlh_ptr = fp->tlhdr;
-          memcpy(pptrs->tlh_ptr, fp->tlhdr, MyTLHdrSz);
+      if (fp->got_first) {
+        // pptrs->tlh_ptr = fp->tlhdr;
+        memcpy(pptrs->tlh_ptr, fp->tlhdr, MyTLHdrSz);
+        return TRUE;
+      }
+      else {
+        if (!(fhdr->ip6f_offlg & htons(IP6F_OFF_MASK))) {
+          /* we got our first fragment */
+          fp->got_first = TRUE;
+          memcpy(fp->tlhdr, pptrs->tlh_ptr, MyTLHdrSz);
+
+          fp->a += ntohs(iphp->ip6_plen); /* IPv6 Header length will be added later */
+          iphp->ip6_plen = htons(fp->a);
+	  pptrs->pf = fp->pa;
+          fp->pa = 0;
+          fp->a = 0;
           return TRUE;
         }
-        else {
-          if (!(fhdr->ip6f_offlg & htons(IP6F_OFF_MASK))) {
-            /* we got our first fragment */
-            fp->got_first = TRUE;
-            memcpy(fp->tlhdr, pptrs->tlh_ptr, MyTLHdrSz);
-
-            fp->a += ntohs(iphp->ip6_plen); /* IPv6 Header length will be added later */
-            iphp->ip6_plen = htons(fp->a);
-	    pptrs->pf = fp->pa;
-            fp->pa = 0;
-            fp->a = 0;
-            return TRUE;
-          }
-          else { /* we still don't have the first fragment; increase accumulators */
-	    if (!config.ext_sampling_rate) {
-	      fp->pa++;
-              fp->a += IP6HdrSz+ntohs(iphp->ip6_plen);
-	    }
-            return FALSE;
-          }
+        else { /* we still don't have the first fragment; increase accumulators */
+	  if (!config.ext_sampling_rate) {
+	    fp->pa++;
+            fp->a += IP6HdrSz+ntohs(iphp->ip6_plen);
+	  }
+          return FALSE;
         }
       }
-      else {
-        candidate = fp;
-	if (!candidate->got_first) notify_orphan_fragment6(candidate);
-        goto create;
-      }
     }
-    if ((fp->deadline < now) && !candidate) {
-      candidate = fp;
-      if (!candidate->got_first) notify_orphan_fragment6(candidate);
-    }
-    last_seen = fp;
   }
 
-  create:
-  if (candidate) return create_fragment6(now, candidate, TRUE, bucket, pptrs, fhdr);
-  else return create_fragment6(now, last_seen, FALSE, bucket, pptrs, fhdr);
+  return create_fragment6(now, hash, pptrs, fhdr);
 }
 
-int create_fragment6(u_int32_t now, struct ip6_fragment *fp, u_int8_t is_candidate, unsigned int bucket,
-			struct packet_ptrs *pptrs, struct ip6_frag *fhdr)
+int create_fragment6(u_int32_t now, u_int32_t hash, struct packet_ptrs *pptrs, struct ip6_frag *fhdr)
 {
   struct ip6_hdr *iphp = (struct ip6_hdr *)pptrs->iph_ptr;
-  struct ip6_fragment *newf;
-
-  if (!ipft6_total_nodes) { 
-    if (now > emergency_prune6+EMER_PRUNE_INTERVAL) {
-      Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Skipping fragments.\n", config.name);
-      emergency_prune6 = now;
-      prune_old_fragments6(now, 0);
-    }
-    return FALSE;
-  }
+  struct ip6_fragment *fp, **head;
 
-  if (fp) {
-    /* a 'not candidate' is simply the tail (last node) of the
-       list. We need to allocate a new node */
-    if (!is_candidate) {
-      newf = (struct ip6_fragment *) malloc(sizeof(struct ip6_fragment));
-      if (!newf) {
-	if (now > emergency_prune6+EMER_PRUNE_INTERVAL) {
-	  Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Skipping fragments.\n", config.name);
-	  emergency_prune6 = now;
-	  prune_old_fragments6(now, 0);
-	}
-	return FALSE;
-      }
-      else ipft6_total_nodes--;
-      memset(newf, 0, sizeof(struct ip6_fragment));
-      fp->next = newf;
-      newf->prev = fp;
-      lru_list6.last->lru_next = newf; /* placing new node as LRU tail */
-      newf->lru_prev = lru_list6.last;
-      lru_list6.last = newf;
-      fp = newf;
-    }
-    else {
-      if (fp->lru_next) { /* if fp->lru_next==NULL the node is already the tail */
-        fp->lru_prev->lru_next = fp->lru_next;
-        fp->lru_next->lru_prev = fp->lru_prev;
-        lru_list6.last->lru_next = fp;
-        fp->lru_prev = lru_list6.last;
-        fp->lru_next = NULL;
-        lru_list6.last = fp;
-      }
-    }
-  }
-  else {
-    /* we don't have any fragment pointer; this is because current
-       bucket doesn't contain any node; we'll allocate first one */
-    fp = (struct ip6_fragment *) malloc(sizeof(struct ip6_fragment));
-    if (!fp) {
-      if (now > emergency_prune6+EMER_PRUNE_INTERVAL) {
-        Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Skipping fragments.\n", config.name);
-        emergency_prune6 = now;
-        prune_old_fragments6(now, 0);
-      }
-      return FALSE;
-    }
-    else ipft6_total_nodes--;
-    memset(fp, 0, sizeof(struct ip6_fragment));
-    ipft6[bucket] = fp;
-    lru_list6.last->lru_next = fp; /* placing new node as LRU tail */
-    fp->lru_prev = lru_list6.last;
-    lru_list6.last = fp;
-  }
+  fp = alloc_fragment6(now);
+  if (!fp) return FALSE;
 
   fp->deadline = now+IPF_TIMEOUT;
   fp->id = fhdr->ip6f_ident;
   ip6_addr_cpy(&fp->src, &iphp->ip6_src);
   ip6_addr_cpy(&fp->dst, &iphp->ip6_dst);
-  fp->bucket = bucket;
+  fp->hash = hash;
+
+  head = &ipft6.buckets[hash & (ipft6.buckets_num-1)];
+  fp->next = *head;
+  if (*head) (*head)->prev = fp;
+  *head = fp;
+
+  head = &ipft6.wheel[fp->deadline & (IPF_WHEEL_SZ-1)];
+  fp->tw_next = *head;
+  if (*head) (*head)->tw_prev = fp;
+  *head = fp;
+
+  ipft6.nodes_used++;
+  ipft6.stats.created++;
+
+  if (ipft6.nodes_used > ipft6.buckets_num*IPFT_LOAD_FACTOR && ipft6.buckets_num < ipft6.buckets_max)
+    resize_fragment_table6();
 
   if (!(fhdr->ip6f_offlg & htons(IP6F_OFF_MASK))) {
     /* it's a first fragment */
@@ -479,44 +459,121 @@ int create_fragment6(u_int32_t now, struct ip6_fragment *fp, u_int8_t is_candida
   }
 }
 
-void prune_old_fragments6(u_int32_t now, u_int32_t off)
+struct ip6_fragment *alloc_fragment6(u_int32_t now)
 {
-  struct ip6_fragment *fp, *temp;
-  u_int32_t deadline = now-off;
-
-  fp = lru_list6.root->lru_next;
-  while (fp) {
-    if (deadline > fp->deadline) {
-      /* we found a stale element; we'll prune it */
-      if (fp->lru_next) temp = fp->lru_next;
-      else temp = NULL;
-
-      /* rearranging bucket's pointers */
-      if (fp->prev && fp->next) {
-        fp->prev->next = fp->next;
-        fp->next->prev = fp->prev;
-      }
-      else if (fp->prev) fp->prev->next = NULL;
-      else if (fp->next) {
-        ipft6[fp->bucket] = fp->next;
-        fp->next->prev = NULL;
-      }
-      else ipft6[fp->bucket] = NULL;
+  struct ip6_fragment *fp = NULL;
+  u_int32_t idx, chunk;
+
+  if (!ipft6.free_list && !ipft6.pool_left && ipft6.nodes_alloc < ipft6.nodes_budget) {
+    chunk = MIN(IPFT_POOL_CHUNK, ipft6.nodes_budget-ipft6.nodes_alloc);
+    ipft6.pool = (struct ip6_fragment *) malloc(chunk*sizeof(struct ip6_fragment));
+    if (ipft6.pool) ipft6.pool_left = chunk;
+  }
+
+  if (ipft6.free_list) {
+    fp = ipft6.free_list;
+    ipft6.free_list = fp->next;
+  }
+  else if (ipft6.pool_left) {
+    fp = ipft6.pool;
+    ipft6.pool++;
+    ipft6.pool_left--;
+    ipft6.nodes_alloc++;
+  }
+  else {
+    for (idx = 1; idx <= IPF_WHEEL_SZ && !fp; idx++)
+      fp = ipft6.wheel[(ipft6.wheel_now+idx) & (IPF_WHEEL_SZ-1)];
+
+    if (now > ipft6.emergency_log+EMER_PRUNE_INTERVAL) {
+      if (fp) Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Evicting oldest fragments.\n", config.name);
+      else Log(LOG_INFO, "INFO ( %s/core ): Fragment/6 buffer full. Skipping fragments.\n", config.name);
+      ipft6.emergency_log = now;
+    }
+    if (!fp) return NULL;
+
+    if (!fp->got_first) {
+      notify_orphan_fragment6(fp);
+      ipft6.stats.orphans++;
+    }
+    ipft6.stats.evictions++;
+    release_fragment6(fp);
+
+    fp = ipft6.free_list;
+    ipft6.free_list = fp->next;
+  }
+
+  memset(fp, 0, sizeof(struct ip6_fragment));
+
+  return fp;
+}
 
-      free(fp);
-      ipft6_total_nodes++;
+void release_fragment6(struct ip6_fragment *fp)
+{
+  if (fp->prev) fp->prev->next = fp->next;
+  else ipft6.buckets[fp->hash & (ipft6.buckets_num-1)] = fp->next;
+  if (fp->next) fp->next->prev = fp->prev;
+
+  if (fp->tw_prev) fp->tw_prev->tw_next = fp->tw_next;
+  else ipft6.wheel[fp->deadline & (IPF_WHEEL_SZ-1)] = fp->tw_next;
+  if (fp->tw_next) fp->tw_next->tw_prev = fp->tw_prev;
 
-      if (temp) fp = temp;
-      else fp = NULL;
+  fp->next = ipft6.free_list;
+  ipft6.free_list = fp;
+  ipft6.nodes_used--;
+}
+
+void resize_fragment_table6()
+{
+  struct ip6_fragment **buckets, *fp, *next;
+  u_int32_t idx, buckets_num = ipft6.buckets_num << 1;
+
+  buckets = (struct ip6_fragment **) calloc(buckets_num, sizeof(struct ip6_fragment *));
+  if (!buckets) {
+    Log(LOG_WARNING, "WARN ( %s/core ): Unable to grow Fragment/6 table; staying at %u buckets.\n",
+	config.name, ipft6.buckets_num);
+    ipft6.buckets_max = ipft6.buckets_num;
+    return;
+  }
+
+  for (idx = 0; idx < ipft6.buckets_num; idx++) {
+    for (fp = ipft6.buckets[idx]; fp; fp = next) {
+      next = fp->next;
+      fp->prev = NULL;
+      fp->next = buckets[fp->hash & (buckets_num-1)];
+      if (fp->next) fp->next->prev = fp;
+      buckets[fp->hash & (buckets_num-1)] = fp;
     }
-    else break;
   }
 
-  if (fp) {
-    fp->lru_prev = lru_list6.root;
-    lru_list6.root->lru_next = fp;
+  free(ipft6.buckets);
+  ipft6.buckets = buckets;
+  ipft6.buckets_num = buckets_num;
+}
+
+void prune_old_fragments6(u_int32_t now)
+{
+  struct ip6_fragment *fp, *next;
+  u_int32_t tick;
+
+  if (now <= ipft6.wheel_now) return;
+
+  if (now-ipft6.wheel_now > IPF_WHEEL_SZ) ipft6.wheel_now = now-IPF_WHEEL_SZ;
+
+  for (tick = ipft6.wheel_now+1; tick <= now; tick++) {
+    for (fp = ipft6.wheel[tick & (IPF_WHEEL_SZ-1)]; fp; fp = next) {
+      next = fp->tw_next;
+      if (fp->deadline <= tick) {
+	if (!fp->got_first) {
+	  notify_orphan_fragment6(fp);
+	  ipft6.stats.orphans++;
+	}
+	ipft6.stats.expired++;
+	release_fragment6(fp);
+      }
+    }
   }
-  else lru_list6.last = lru_list6.root;
+
+  ipft6.wheel_now = now;
 }
 
 void notify_orphan_fragment6(struct ip6_fragment *frag)
@@ -20,11 +20,12 @@
 */
 
 /* defines */
-#define IPFT_HASHSZ 256 
+#define IPFT_HASHSZ 256 		/* initial number of buckets */
+#define IPFT_LOAD_FACTOR 4		/* max average chain length before doubling buckets */
+#define IPFT_POOL_CHUNK 1024		/* nodes carved from the heap at once */
 #define IPF_TIMEOUT 60 
-#define PRUNE_INTERVAL 7200
+#define IPF_WHEEL_SZ 64			/* timer-wheel slots; power of two > IPF_TIMEOUT */ 
 #define EMER_PRUNE_INTERVAL 60
-#define PRUNE_OFFSET 1800 
 #define DEFAULT_FRAG_BUFFER_SIZE 4096000 /* 4 Mb */
 
 /* structures */
@@ -38,16 +39,34 @@ struct ip_fragment {
   u_int8_t ip_p;
   u_int32_t ip_src;
   u_int32_t ip_dst;
-  u_int16_t bucket;
-  struct ip_fragment *lru_next;
-  struct ip_fragment *lru_prev;
+  u_int32_t hash;		/* full hash; bucket is hash & (buckets-1) */
+  struct ip_fragment *tw_next;	/* timer-wheel slot list */
+  struct ip_fragment *tw_prev;
   struct ip_fragment *next;
   struct ip_fragment *prev;
 };
 
-struct lru_l {
-  struct ip_fragment *root;
-  struct ip_fragment *last;
+struct ip_frag_stats {
+  u_int64_t created;
+  u_int64_t expired;
+  u_int64_t orphans;		/* expired/evicted without ever seeing the first fragment */
+  u_int64_t evictions;		/* reclaimed before deadline because the budget was exhausted */
+};
+
+struct ip_frag_table {
+  struct ip_fragment **buckets;
+  u_int32_t buckets_num;	/* power of two */
+  u_int32_t buckets_max;
+  struct ip_fragment *wheel[IPF_WHEEL_SZ];
+  u_int32_t wheel_now;		/* last second the wheel was advanced to */
+  struct ip_fragment *free_list;
+  struct ip_fragment *pool;	/* current chunk being carved */
+  u_int32_t pool_left;
+  u_int32_t nodes_budget;
+  u_int32_t nodes_alloc;
+  u_int32_t nodes_used;
+  time_t emergency_log;
+  struct ip_frag_stats stats;
 };
 
 #if defined ENABLE_IPV6
@@ -60,26 +79,35 @@ struct ip6_fragment {
   u_int32_t id;
   u_int32_t src[4];
   u_int32_t dst[4];
-  u_int16_t bucket;
-  struct ip6_fragment *lru_next;
-  struct ip6_fragment *lru_prev;
+  u_int32_t hash;
+  struct ip6_fragment *tw_next;
+  struct ip6_fragment *tw_prev;
   struct ip6_fragment *next;
   struct ip6_fragment *prev;
 };
 
-struct lru_l6 {
-  struct ip6_fragment *root;
-  struct ip6_fragment *last;
+struct ip6_frag_table {
+  struct ip6_fragment **buckets;
+  u_int32_t buckets_num;
+  u_int32_t buckets_max;
+  struct ip6_fragment *wheel[IPF_WHEEL_SZ];
+  u_int32_t wheel_now;
+  struct ip6_fragment *free_list;
+  struct ip6_fragment *pool;
+  u_int32_t pool_left;
+  u_int32_t nodes_budget;
+  u_int32_t nodes_alloc;
+  u_int32_t nodes_used;
+  time_t emergency_log;
+  struct ip_frag_stats stats;
 };
 #endif
 
 /* global vars */
-struct ip_fragment *ipft[IPFT_HASHSZ];
-struct lru_l lru_list;
+struct ip_frag_table ipft;
 
 #if defined ENABLE_IPV6
-struct ip6_fragment *ipft6[IPFT_HASHSZ];
-struct lru_l6 lru_list6;
+struct ip6_frag_table ipft6;
 #endif
 
 /* prototypes */
@@ -92,18 +120,24 @@ EXT void init_ip_fragment_handler(); /* wrapper */
 EXT void init_ip4_fragment_handler(); 
 EXT int ip_fragment_handler(struct packet_ptrs *); 
 EXT int find_fragment(u_int32_t, struct packet_ptrs *); 
-EXT int create_fragment(u_int32_t, struct ip_fragment *, u_int8_t, unsigned int, struct packet_ptrs *); 
+EXT int create_fragment(u_int32_t, u_int32_t, struct packet_ptrs *); 
+EXT struct ip_fragment *alloc_fragment(u_int32_t);
+EXT void release_fragment(struct ip_fragment *);
+EXT void resize_fragment_table();
 EXT unsigned int hash_fragment(u_int16_t, u_int32_t, u_int32_t, u_int8_t);
-EXT void prune_old_fragments(u_int32_t, u_int32_t); 
+EXT void prune_old_fragments(u_int32_t); 
 EXT void notify_orphan_fragment(struct ip_fragment *);
 
 #if defined ENABLE_IPV6
 EXT void init_ip6_fragment_handler();
-EXT int ip6_fragment_handler6(struct packet_ptrs *, struct ip6_frag *);
+EXT int ip6_fragment_handler(struct packet_ptrs *, struct ip6_frag *);
 EXT unsigned int hash_fragment6(u_int32_t, struct in6_addr *, struct in6_addr *);
 EXT int find_fragment6(u_int32_t, struct packet_ptrs *, struct ip6_frag *);
-EXT int create_fragment6(u_int32_t, struct ip6_fragment *, u_int8_t, unsigned int, struct packet_ptrs *, struct ip6_frag *);
-EXT void prune_old_fragments6(u_int32_t, u_int32_t); 
+EXT int create_fragment6(u_int32_t, u_int32_t, struct packet_ptrs *, struct ip6_frag *);
+EXT struct ip6_fragment *alloc_fragment6(u_int32_t);
+EXT void release_fragment6(struct ip6_fragment *);
+EXT void resize_fragment_table6();
+EXT void prune_old_fragments6(u_int32_t); 
 EXT void notify_orphan_fragment6(struct ip6_fragment *);
 #endif
 #undef EXT
@@ -63,7 +63,7 @@ thread_pool_t *isis_pool;
 void nfacctd_isis_wrapper()
 {
   /* initialize threads pool */
-  isis_pool = allocate_thread_pool(1);
+  isis_pool = allocate_thread_pool(1, THREAD_POOL_PLACED);
   assert(isis_pool);
   Log(LOG_DEBUG, "DEBUG ( %s/core/ISIS ): %d thread(s) initialized\n", config.name, 1);
 
@@ -276,30 +276,17 @@ void mongodb_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
 void MongoDB_cache_purge(struct chained_cache *queue[], int index)
 {
-  struct pkt_primitives *data = NULL;
-  struct pkt_bgp_primitives *pbgp = NULL;
-  struct pkt_nat_primitives *pnat = NULL;
-  struct pkt_mpls_primitives *pmpls = NULL;
-  char *pcust = NULL;
-  struct pkt_vlen_hdr_primitives *pvlen = NULL;
-  struct pkt_bgp_primitives empty_pbgp;
-  struct pkt_nat_primitives empty_pnat;
-  struct pkt_mpls_primitives empty_pmpls;
-  char *empty_pcust = NULL;
-  char src_mac[18], dst_mac[18], src_host[INET6_ADDRSTRLEN], dst_host[INET6_ADDRSTRLEN], ip_address[INET6_ADDRSTRLEN];
-  char rd_str[SRVBUFLEN], misc_str[SRVBUFLEN], tmpbuf[LONGLONGSRVBUFLEN], mongo_database[SRVBUFLEN];
-  char *as_path, *bgp_comm, default_table[] = "test.acct";
+  char tmpbuf[LONGLONGSRVBUFLEN], mongo_database[SRVBUFLEN];
+  char default_table[] = "test.acct";
   char default_user[] = "pmacct", default_passwd[] = "arealsmartpwd";
-  int qn = 0, i, j, stop, db_status, batch_idx, go_to_pending, saved_index = index;
+  int j, stop, db_status, go_to_pending, workers, saved_index = index;
   time_t stamp, start, duration;
   char current_table[SRVBUFLEN], elem_table[SRVBUFLEN];
   struct primitives_ptrs prim_ptrs;
   struct pkt_data dummy_data;
+  struct mongodb_pipeline pl;
   pid_t writer_pid = getpid();
 
-  const bson **bson_batch;
-  bson *bson_elem;
-
   if (!index) {
     Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - START (PID: %u) ***\n", config.name, config.type, writer_pid);
     Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: 0/0, ET: 0) ***\n", config.name, config.type, writer_pid);
@@ -330,16 +317,16 @@ void MongoDB_cache_purge(struct chained_cache *queue[], int index)
   }
   else Log(LOG_INFO, "INFO ( %s/%s ): Connection succeeded (MONGO_OK) to MongoDB\n", config.name, config.type);
 
-  empty_pcust = malloc(config.cpptrs.len);
-  if (!empty_pcust) {
-    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to malloc() empty_pcust. Exiting.\n", config.name, config.type);
+  workers = config.mongo_purge_workers ? config.mongo_purge_workers : 1;
+#if !defined ENABLE_THREADS
+  workers = 1;
+#endif
+
+  if (MongoDB_pipeline_init(&pl, index, workers) == ERR) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to allocate BSON encoding buffers. Exiting.\n", config.name, config.type);
     exit_plugin(1);
   }
 
-  memset(&empty_pbgp, 0, sizeof(struct pkt_bgp_primitives));
-  memset(&empty_pnat, 0, sizeof(struct pkt_nat_primitives));
-  memset(&empty_pmpls, 0, sizeof(struct pkt_mpls_primitives));
-  memset(empty_pcust, 0, config.cpptrs.len);
   memset(mongo_database, 0, sizeof(mongo_database));
   memset(&prim_ptrs, 0, sizeof(prim_ptrs));
   memset(&dummy_data, 0, sizeof(dummy_data));
@@ -352,12 +339,6 @@ void MongoDB_cache_purge(struct chained_cache *queue[], int index)
   if (strchr(config.sql_table, '%') || strchr(config.sql_table, '$')) dyn_table = TRUE;
   else dyn_table = FALSE;
 
-  bson_batch = (bson **) malloc(sizeof(bson *) * index);
-  if (!bson_batch) {
-    Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed: bson_batch\n", config.name, config.type);
-    return;
-  }
-
   /* If there is any signs of auth in the config, then try to auth */
   if (config.sql_user || config.sql_passwd) {
     if (!config.sql_user) config.sql_user = default_user;
@@ -365,6 +346,7 @@ void MongoDB_cache_purge(struct chained_cache *queue[], int index)
     db_status = mongo_cmd_authenticate(&db_conn, mongo_database, config.sql_user, config.sql_passwd);
     if (db_status != MONGO_OK) {
       Log(LOG_ERR, "ERROR ( %s/%s ): Authentication failed to MongoDB\n", config.name, config.type);
+      MongoDB_pipeline_free(&pl);
       return;
     }
     else Log(LOG_INFO, "INFO ( %s/%s ): Successful authentication (MONGO_OK) to MongoDB\n", config.name, config.type);
@@ -396,7 +378,8 @@ void MongoDB_cache_purge(struct chained_cache *queue[], int index)
     if (config.sql_table_schema) MongoDB_create_indexes(&db_conn, tmpbuf);
   }
 
-  for (j = 0, batch_idx = 0; j < index; j++) {
+  /* elements going to the current collection are selected first, then encoded and inserted */
+  for (j = 0, pl.elems_num = 0; j < index; j++) {
     go_to_pending = FALSE;
 
     if (queue[j]->valid != PRINT_CACHE_COMMITTED) continue;
@@ -422,440 +405,666 @@ void MongoDB_cache_purge(struct chained_cache *queue[], int index)
     }
 
     if (!go_to_pending) {
-      bson_elem = (bson *) malloc(sizeof(bson));
-      if (!bson_elem) {
-        Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed: bson_elem (elem# %u batch# %u\n", config.name, config.type, j, batch_idx);
-        return;
-      }
+      pl.elems[pl.elems_num] = queue[j];
+      pl.elems_num++;
+    }
+  }
 
-      bson_init(bson_elem);
-      bson_append_new_oid(bson_elem, "_id" );
+  pl.table = (dyn_table ? current_table : config.sql_table);
+  MongoDB_pipeline_run(&pl);
 
-      data = &queue[j]->primitives;
-      if (queue[j]->pbgp) pbgp = queue[j]->pbgp;
-      else pbgp = &empty_pbgp;
+  /* If we have pending queries then start again */
+  if (pqq_ptr) goto start;
 
-      if (queue[j]->pnat) pnat = queue[j]->pnat;
-      else pnat = &empty_pnat;
-  
-      if (queue[j]->pmpls) pmpls = queue[j]->pmpls;
-      else pmpls = &empty_pmpls;
-  
-      if (queue[j]->pcust) pcust = queue[j]->pcust;
-      else pcust = empty_pcust;
+  duration = time(NULL)-start;
+  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
+		config.name, config.type, writer_pid, pl.qn, saved_index, duration);
+
+  if (pl.qn && pl.encode_usecs && pl.insert_usecs)
+    Log(LOG_INFO, "INFO ( %s/%s ): BSON encoding: %llu docs/s per worker (workers: %u); inserts: %llu docs/s\n",
+		config.name, config.type, (unsigned long long) pl.qn*1000000/pl.encode_usecs, pl.workers,
+		(unsigned long long) pl.qn*1000000/pl.insert_usecs);
+
+  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
 
-      if (queue[j]->pvlen) pvlen = queue[j]->pvlen;
-      else pvlen = NULL;
+  MongoDB_pipeline_free(&pl);
+}
+
+void MongoDB_encode_elem(struct mongodb_pipeline *pl, bson *bson_elem, struct chained_cache *elem)
+{
+  struct pkt_primitives *data = NULL;
+  struct pkt_bgp_primitives *pbgp = NULL;
+  struct pkt_nat_primitives *pnat = NULL;
+  struct pkt_mpls_primitives *pmpls = NULL;
+  char *pcust = NULL;
+  struct pkt_vlen_hdr_primitives *pvlen = NULL;
+  char src_mac[18], dst_mac[18], src_host[INET6_ADDRSTRLEN], dst_host[INET6_ADDRSTRLEN], ip_address[INET6_ADDRSTRLEN];
+  char rd_str[SRVBUFLEN], misc_str[SRVBUFLEN];
+  char *as_path, *bgp_comm;
+
+  data = &elem->primitives;
+  if (elem->pbgp) pbgp = elem->pbgp;
+  else pbgp = &pl->empty_pbgp;
+
+  if (elem->pnat) pnat = elem->pnat;
+  else pnat = &pl->empty_pnat;
   
-      if (queue[j]->valid == PRINT_CACHE_FREE) continue;
+  if (elem->pmpls) pmpls = elem->pmpls;
+  else pmpls = &pl->empty_pmpls;
   
-      if (config.what_to_count & COUNT_TAG) bson_append_long(bson_elem, "tag", data->tag);
-      if (config.what_to_count & COUNT_TAG2) bson_append_long(bson_elem, "tag2", data->tag2);
-      if (config.what_to_count_2 & COUNT_LABEL) MongoDB_append_label(bson_elem, "label", pvlen, COUNT_INT_LABEL); 
-
-      if (config.what_to_count & COUNT_CLASS) bson_append_string(bson_elem, "class", ((data->class && class[(data->class)-1].id) ? class[(data->class)-1].protocol : "unknown" ));
-  #if defined (HAVE_L2)
-      if (config.what_to_count & (COUNT_SRC_MAC|COUNT_SUM_MAC)) {
-        etheraddr_string(data->eth_shost, src_mac);
-        bson_append_string(bson_elem, "mac_src", src_mac);
-      }
-      if (config.what_to_count & COUNT_DST_MAC) {
-        etheraddr_string(data->eth_dhost, dst_mac);
-        bson_append_string(bson_elem, "mac_dst", dst_mac);
-      }
+  if (elem->pcust) pcust = elem->pcust;
+  else pcust = pl->empty_pcust;
+
+  if (elem->pvlen) pvlen = elem->pvlen;
+  else pvlen = NULL;
+
+  if (config.what_to_count & COUNT_TAG) bson_append_long(bson_elem, "tag", data->tag);
+  if (config.what_to_count & COUNT_TAG2) bson_append_long(bson_elem, "tag2", data->tag2);
+  if (config.what_to_count_2 & COUNT_LABEL) MongoDB_append_label(bson_elem, "label", pvlen, COUNT_INT_LABEL); 
+
+  if (config.what_to_count & COUNT_CLASS) bson_append_string(bson_elem, "class", ((data->class && class[(data->class)-1].id) ? class[(data->class)-1].protocol : "unknown" ));
+#if defined (HAVE_L2)
+  if (config.what_to_count & (COUNT_SRC_MAC|COUNT_SUM_MAC)) {
+    etheraddr_string(data->eth_shost, src_mac);
+    bson_append_string(bson_elem, "mac_src", src_mac);
+  }
+  if (config.what_to_count & COUNT_DST_MAC) {
+    etheraddr_string(data->eth_dhost, dst_mac);
+    bson_append_string(bson_elem, "mac_dst", dst_mac);
+  }
   
-      if (config.what_to_count & COUNT_VLAN) bson_append_int(bson_elem, "vlan_id", data->vlan_id);
-      if (config.what_to_count & COUNT_COS) bson_append_int(bson_elem, "cos", data->cos);
-      if (config.what_to_count & COUNT_ETHERTYPE) {
-        sprintf(misc_str, "%x", data->etype); 
-        bson_append_string(bson_elem, "etype", misc_str);
-      }
-  #endif
-      if (config.what_to_count & (COUNT_SRC_AS|COUNT_SUM_AS)) bson_append_int(bson_elem, "as_src", data->src_as);
-      if (config.what_to_count & COUNT_DST_AS) bson_append_int(bson_elem, "as_dst", data->dst_as);
+  if (config.what_to_count & COUNT_VLAN) bson_append_int(bson_elem, "vlan_id", data->vlan_id);
+  if (config.what_to_count & COUNT_COS) bson_append_int(bson_elem, "cos", data->cos);
+  if (config.what_to_count & COUNT_ETHERTYPE) {
+    sprintf(misc_str, "%x", data->etype); 
+    bson_append_string(bson_elem, "etype", misc_str);
+  }
+#endif
+  if (config.what_to_count & (COUNT_SRC_AS|COUNT_SUM_AS)) bson_append_int(bson_elem, "as_src", data->src_as);
+  if (config.what_to_count & COUNT_DST_AS) bson_append_int(bson_elem, "as_dst", data->dst_as);
   
-      if (config.what_to_count & COUNT_STD_COMM) {
-        bgp_comm = pbgp->std_comms;
-        while (bgp_comm) {
-          bgp_comm = strchr(pbgp->std_comms, ' ');
-          if (bgp_comm) *bgp_comm = '_';
-        }
+  if (config.what_to_count & COUNT_STD_COMM) {
+    bgp_comm = pbgp->std_comms;
+    while (bgp_comm) {
+      bgp_comm = strchr(pbgp->std_comms, ' ');
+      if (bgp_comm) *bgp_comm = '_';
+    }
   
-        if (strlen(pbgp->std_comms)) 
-          bson_append_string(bson_elem, "comms", pbgp->std_comms);
-        else
-          bson_append_null(bson_elem, "comms");
-      }
+    if (strlen(pbgp->std_comms)) 
+      bson_append_string(bson_elem, "comms", pbgp->std_comms);
+    else
+      bson_append_null(bson_elem, "comms");
+  }
 
-      if (config.what_to_count & COUNT_EXT_COMM && !(config.what_to_count & COUNT_STD_COMM)) {
-        bgp_comm = pbgp->ext_comms;
-        while (bgp_comm) {
-          bgp_comm = strchr(pbgp->ext_comms, ' ');
-          if (bgp_comm) *bgp_comm = '_';
-        }
+  if (config.what_to_count & COUNT_EXT_COMM && !(config.what_to_count & COUNT_STD_COMM)) {
+    bgp_comm = pbgp->ext_comms;
+    while (bgp_comm) {
+      bgp_comm = strchr(pbgp->ext_comms, ' ');
+      if (bgp_comm) *bgp_comm = '_';
+    }
 
-        if (strlen(pbgp->ext_comms))
-          bson_append_string(bson_elem, "comms", pbgp->ext_comms);
-        else
-          bson_append_null(bson_elem, "comms");
-      }
+    if (strlen(pbgp->ext_comms))
+      bson_append_string(bson_elem, "comms", pbgp->ext_comms);
+    else
+      bson_append_null(bson_elem, "comms");
+  }
   
-      if (config.what_to_count & COUNT_AS_PATH) {
-        as_path = pbgp->as_path;
-        while (as_path) {
-          as_path = strchr(pbgp->as_path, ' ');
-          if (as_path) *as_path = '_';
-        }
-        if (strlen(pbgp->as_path))
-          bson_append_string(bson_elem, "as_path", pbgp->as_path);
-        else
-          bson_append_null(bson_elem, "as_path");
-      }
+  if (config.what_to_count & COUNT_AS_PATH) {
+    as_path = pbgp->as_path;
+    while (as_path) {
+      as_path = strchr(pbgp->as_path, ' ');
+      if (as_path) *as_path = '_';
+    }
+    if (strlen(pbgp->as_path))
+      bson_append_string(bson_elem, "as_path", pbgp->as_path);
+    else
+      bson_append_null(bson_elem, "as_path");
+  }
   
-      if (config.what_to_count & COUNT_LOCAL_PREF) bson_append_int(bson_elem, "local_pref", pbgp->local_pref);
-      if (config.what_to_count & COUNT_MED) bson_append_int(bson_elem, "med", pbgp->med);
-      if (config.what_to_count & COUNT_PEER_SRC_AS) bson_append_int(bson_elem, "peer_as_src", pbgp->peer_src_as);
-      if (config.what_to_count & COUNT_PEER_DST_AS) bson_append_int(bson_elem, "peer_as_dst", pbgp->peer_dst_as);
+  if (config.what_to_count & COUNT_LOCAL_PREF) bson_append_int(bson_elem, "local_pref", pbgp->local_pref);
+  if (config.what_to_count & COUNT_MED) bson_append_int(bson_elem, "med", pbgp->med);
+  if (config.what_to_count & COUNT_PEER_SRC_AS) bson_append_int(bson_elem, "peer_as_src", pbgp->peer_src_as);
+  if (config.what_to_count & COUNT_PEER_DST_AS) bson_append_int(bson_elem, "peer_as_dst", pbgp->peer_dst_as);
   
-      if (config.what_to_count & COUNT_PEER_SRC_IP) {
-        addr_to_str(ip_address, &pbgp->peer_src_ip);
-        bson_append_string(bson_elem, "peer_ip_src", ip_address);
-      }
-      if (config.what_to_count & COUNT_PEER_DST_IP) {
-        addr_to_str(ip_address, &pbgp->peer_dst_ip);
-        bson_append_string(bson_elem, "peer_ip_dst", ip_address);
-      }
+  if (config.what_to_count & COUNT_PEER_SRC_IP) {
+    addr_to_str(ip_address, &pbgp->peer_src_ip);
+    bson_append_string(bson_elem, "peer_ip_src", ip_address);
+  }
+  if (config.what_to_count & COUNT_PEER_DST_IP) {
+    addr_to_str(ip_address, &pbgp->peer_dst_ip);
+    bson_append_string(bson_elem, "peer_ip_dst", ip_address);
+  }
 
-      if (config.what_to_count & COUNT_SRC_STD_COMM) {
-        bgp_comm = pbgp->src_std_comms;
-        while (bgp_comm) {
-          bgp_comm = strchr(pbgp->src_std_comms, ' ');
-          if (bgp_comm) *bgp_comm = '_';
-        }
+  if (config.what_to_count & COUNT_SRC_STD_COMM) {
+    bgp_comm = pbgp->src_std_comms;
+    while (bgp_comm) {
+      bgp_comm = strchr(pbgp->src_std_comms, ' ');
+      if (bgp_comm) *bgp_comm = '_';
+    }
 
-        if (strlen(pbgp->src_std_comms))
-          bson_append_string(bson_elem, "src_comms", pbgp->src_std_comms);
-        else
-          bson_append_null(bson_elem, "src_comms");
-      }
+    if (strlen(pbgp->src_std_comms))
+      bson_append_string(bson_elem, "src_comms", pbgp->src_std_comms);
+    else
+      bson_append_null(bson_elem, "src_comms");
+  }
 
-      if (config.what_to_count & COUNT_SRC_EXT_COMM && !(config.what_to_count & COUNT_SRC_STD_COMM)) {
-        bgp_comm = pbgp->src_ext_comms;
-        while (bgp_comm) {
-          bgp_comm = strchr(pbgp->src_ext_comms, ' ');
-          if (bgp_comm) *bgp_comm = '_';
-        }
+  if (config.what_to_count & COUNT_SRC_EXT_COMM && !(config.what_to_count & COUNT_SRC_STD_COMM)) {
+    bgp_comm = pbgp->src_ext_comms;
+    while (bgp_comm) {
+      bgp_comm = strchr(pbgp->src_ext_comms, ' ');
+      if (bgp_comm) *bgp_comm = '_';
+    }
 
-        if (strlen(pbgp->src_ext_comms))
-          bson_append_string(bson_elem, "src_comms", pbgp->src_ext_comms);
-        else
-          bson_append_null(bson_elem, "src_comms");
-      }
+    if (strlen(pbgp->src_ext_comms))
+      bson_append_string(bson_elem, "src_comms", pbgp->src_ext_comms);
+    else
+      bson_append_null(bson_elem, "src_comms");
+  }
 
-      if (config.what_to_count & COUNT_SRC_AS_PATH) {
-        as_path = pbgp->src_as_path;
-        while (as_path) {
-          as_path = strchr(pbgp->src_as_path, ' ');
-          if (as_path) *as_path = '_';
-        }
-        if (strlen(pbgp->src_as_path))
-          bson_append_string(bson_elem, "src_as_path", pbgp->src_as_path);
-        else
-          bson_append_null(bson_elem, "src_as_path");
-      }
+  if (config.what_to_count & COUNT_SRC_AS_PATH) {
+    as_path = pbgp->src_as_path;
+    while (as_path) {
+      as_path = strchr(pbgp->src_as_path, ' ');
+      if (as_path) *as_path = '_';
+    }
+    if (strlen(pbgp->src_as_path))
+      bson_append_string(bson_elem, "src_as_path", pbgp->src_as_path);
+    else
+      bson_append_null(bson_elem, "src_as_path");
+  }
 
-      if (config.what_to_count & COUNT_LOCAL_PREF) bson_append_int(bson_elem, "src_local_pref", pbgp->src_local_pref);
-      if (config.what_to_count & COUNT_MED) bson_append_int(bson_elem, "src_med", pbgp->src_med);
+  if (config.what_to_count & COUNT_LOCAL_PREF) bson_append_int(bson_elem, "src_local_pref", pbgp->src_local_pref);
+  if (config.what_to_count & COUNT_MED) bson_append_int(bson_elem, "src_med", pbgp->src_med);
   
-      if (config.what_to_count & COUNT_IN_IFACE) bson_append_int(bson_elem, "iface_in", data->ifindex_in);
-      if (config.what_to_count & COUNT_OUT_IFACE) bson_append_int(bson_elem, "iface_out", data->ifindex_out);
+  if (config.what_to_count & COUNT_IN_IFACE) bson_append_int(bson_elem, "iface_in", data->ifindex_in);
+  if (config.what_to_count & COUNT_OUT_IFACE) bson_append_int(bson_elem, "iface_out", data->ifindex_out);
   
-      if (config.what_to_count & COUNT_MPLS_VPN_RD) {
-        bgp_rd2str(rd_str, &pbgp->mpls_vpn_rd);
-        bson_append_string(bson_elem, "mpls_vpn_rd", rd_str);
-      }
+  if (config.what_to_count & COUNT_MPLS_VPN_RD) {
+    bgp_rd2str(rd_str, &pbgp->mpls_vpn_rd);
+    bson_append_string(bson_elem, "mpls_vpn_rd", rd_str);
+  }
   
-      if (!config.tmp_net_own_field) {
-        if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
-          addr_to_str(src_host, &data->src_ip);
-          bson_append_string(bson_elem, "ip_src", src_host);
-        }
+  if (!config.tmp_net_own_field) {
+    if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
+      addr_to_str(src_host, &data->src_ip);
+      bson_append_string(bson_elem, "ip_src", src_host);
+    }
 
-        if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
-          addr_to_str(src_host, &data->src_net);
-          bson_append_string(bson_elem, "ip_src", src_host);
-        }
-      }
-      else {
-        if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
-          addr_to_str(src_host, &data->src_ip);
-          bson_append_string(bson_elem, "ip_src", src_host);
-        }
+    if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
+      addr_to_str(src_host, &data->src_net);
+      bson_append_string(bson_elem, "ip_src", src_host);
+    }
+  }
+  else {
+    if (config.what_to_count & (COUNT_SRC_HOST|COUNT_SUM_HOST)) {
+      addr_to_str(src_host, &data->src_ip);
+      bson_append_string(bson_elem, "ip_src", src_host);
+    }
 
-        if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
-          addr_to_str(src_host, &data->src_net);
-          bson_append_string(bson_elem, "net_src", src_host);
-        }
-      }
+    if (config.what_to_count & (COUNT_SRC_NET|COUNT_SUM_NET)) {
+      addr_to_str(src_host, &data->src_net);
+      bson_append_string(bson_elem, "net_src", src_host);
+    }
+  }
 
-      if (!config.tmp_net_own_field) {
-        if (config.what_to_count & COUNT_DST_HOST) {
-          addr_to_str(dst_host, &data->dst_ip);
-          bson_append_string(bson_elem, "ip_dst", dst_host);
-        }
+  if (!config.tmp_net_own_field) {
+    if (config.what_to_count & COUNT_DST_HOST) {
+      addr_to_str(dst_host, &data->dst_ip);
+      bson_append_string(bson_elem, "ip_dst", dst_host);
+    }
 
-        if (config.what_to_count & COUNT_DST_NET) {
-          addr_to_str(dst_host, &data->dst_net);
-          bson_append_string(bson_elem, "ip_dst", dst_host);
-        }
-      }
-      else {
-        if (config.what_to_count & COUNT_DST_HOST) {
-          addr_to_str(dst_host, &data->dst_ip);
-          bson_append_string(bson_elem, "ip_dst", dst_host);
-        }
+    if (config.what_to_count & COUNT_DST_NET) {
+      addr_to_str(dst_host, &data->dst_net);
+      bson_append_string(bson_elem, "ip_dst", dst_host);
+    }
+  }
+  else {
+    if (config.what_to_count & COUNT_DST_HOST) {
+      addr_to_str(dst_host, &data->dst_ip);
+      bson_append_string(bson_elem, "ip_dst", dst_host);
+    }
 
-        if (config.what_to_count & COUNT_DST_NET) {
-          addr_to_str(dst_host, &data->dst_net);
-          bson_append_string(bson_elem, "net_dst", dst_host);
-        }
-      }
+    if (config.what_to_count & COUNT_DST_NET) {
+      addr_to_str(dst_host, &data->dst_net);
+      bson_append_string(bson_elem, "net_dst", dst_host);
+    }
+  }
   
-      if (config.what_to_count & COUNT_SRC_NMASK) bson_append_int(bson_elem, "mask_src", data->src_nmask);
-      if (config.what_to_count & COUNT_DST_NMASK) bson_append_int(bson_elem, "mask_dst", data->dst_nmask);
-      if (config.what_to_count & (COUNT_SRC_PORT|COUNT_SUM_PORT)) bson_append_int(bson_elem, "port_src", data->src_port);
-      if (config.what_to_count & COUNT_DST_PORT) bson_append_int(bson_elem, "port_dst", data->dst_port);
-
-  #if defined (WITH_GEOIP)
-      if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) {
-        if (data->src_ip_country.id > 0)
-  	bson_append_string(bson_elem, "country_ip_src", GeoIP_code_by_id(data->src_ip_country.id));
-        else
-  	bson_append_null(bson_elem, "country_ip_src");
-      }
-      if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) {
-        if (data->dst_ip_country.id > 0)
-  	bson_append_string(bson_elem, "country_ip_dst", GeoIP_code_by_id(data->dst_ip_country.id));
-        else
-  	bson_append_null(bson_elem, "country_ip_dst");
-      }
-  #endif
-  #if defined (WITH_GEOIPV2)
-      if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) {
-        if (strlen(data->src_ip_country.str))
-        bson_append_string(bson_elem, "country_ip_src", data->src_ip_country.str);
-        else
-        bson_append_null(bson_elem, "country_ip_src");
-      }
-      if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) {
-        if (strlen(data->dst_ip_country.str))
-        bson_append_string(bson_elem, "country_ip_dst", data->dst_ip_country.str);
-        else
-        bson_append_null(bson_elem, "country_ip_dst");
-      }
-  #endif
+  if (config.what_to_count & COUNT_SRC_NMASK) bson_append_int(bson_elem, "mask_src", data->src_nmask);
+  if (config.what_to_count & COUNT_DST_NMASK) bson_append_int(bson_elem, "mask_dst", data->dst_nmask);
+  if (config.what_to_count & (COUNT_SRC_PORT|COUNT_SUM_PORT)) bson_append_int(bson_elem, "port_src", data->src_port);
+  if (config.what_to_count & COUNT_DST_PORT) bson_append_int(bson_elem, "port_dst", data->dst_port);
+
+#if defined (WITH_GEOIP)
+  if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) {
+    if (data->src_ip_country.id > 0)
+      bson_append_string(bson_elem, "country_ip_src", GeoIP_code_by_id(data->src_ip_country.id));
+    else
+      bson_append_null(bson_elem, "country_ip_src");
+  }
+  if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) {
+    if (data->dst_ip_country.id > 0)
+      bson_append_string(bson_elem, "country_ip_dst", GeoIP_code_by_id(data->dst_ip_country.id));
+    else
+      bson_append_null(bson_elem, "country_ip_dst");
+  }
+#endif
+#if defined (WITH_GEOIPV2)
+  if (config.what_to_count_2 & COUNT_SRC_HOST_COUNTRY) {
+    if (strlen(data->src_ip_country.str))
+      bson_append_string(bson_elem, "country_ip_src", data->src_ip_country.str);
+    else
+      bson_append_null(bson_elem, "country_ip_src");
+  }
+  if (config.what_to_count_2 & COUNT_DST_HOST_COUNTRY) {
+    if (strlen(data->dst_ip_country.str))
+      bson_append_string(bson_elem, "country_ip_dst", data->dst_ip_country.str);
+    else
+      bson_append_null(bson_elem, "country_ip_dst");
+  }
+#endif
 
-      if (config.what_to_count & COUNT_TCPFLAGS) {
-        sprintf(misc_str, "%u", queue[j]->tcp_flags);
-        bson_append_string(bson_elem, "tcp_flags", misc_str);
-      }
+  if (config.what_to_count & COUNT_TCPFLAGS) {
+    sprintf(misc_str, "%u", elem->tcp_flags);
+    bson_append_string(bson_elem, "tcp_flags", misc_str);
+  }
   
-      if (config.what_to_count & COUNT_IP_PROTO) {
-        if (!config.num_protos && (data->proto < protocols_number))
-	  bson_append_string(bson_elem, "ip_proto", _protocols[data->proto].name);
-        else {
-          sprintf(misc_str, "%u", data->proto);
-          bson_append_string(bson_elem, "ip_proto", misc_str);
-        }
-      }
+  if (config.what_to_count & COUNT_IP_PROTO) {
+    if (!config.num_protos && (data->proto < protocols_number))
+      bson_append_string(bson_elem, "ip_proto", _protocols[data->proto].name);
+    else {
+      sprintf(misc_str, "%u", data->proto);
+      bson_append_string(bson_elem, "ip_proto", misc_str);
+    }
+  }
   
-      if (config.what_to_count & COUNT_IP_TOS) bson_append_int(bson_elem, "tos", data->tos);
-      if (config.what_to_count_2 & COUNT_SAMPLING_RATE) bson_append_int(bson_elem, "sampling_rate", data->sampling_rate);
-      if (config.what_to_count_2 & COUNT_PKT_LEN_DISTRIB)
-        bson_append_string(bson_elem, "pkt_len_distrib", config.pkt_len_distrib_bins[data->pkt_len_distrib]);
+  if (config.what_to_count & COUNT_IP_TOS) bson_append_int(bson_elem, "tos", data->tos);
+  if (config.what_to_count_2 & COUNT_SAMPLING_RATE) bson_append_int(bson_elem, "sampling_rate", data->sampling_rate);
+  if (config.what_to_count_2 & COUNT_PKT_LEN_DISTRIB)
+    bson_append_string(bson_elem, "pkt_len_distrib", config.pkt_len_distrib_bins[data->pkt_len_distrib]);
   
-      if (config.what_to_count_2 & COUNT_POST_NAT_SRC_HOST) {
-        addr_to_str(src_host, &pnat->post_nat_src_ip);
-        bson_append_string(bson_elem, "post_nat_ip_src", src_host);
-      }
-      if (config.what_to_count_2 & COUNT_POST_NAT_DST_HOST) {
-        addr_to_str(dst_host, &pnat->post_nat_dst_ip);
-        bson_append_string(bson_elem, "post_nat_ip_dst", dst_host);
-      }
-      if (config.what_to_count_2 & COUNT_POST_NAT_SRC_PORT) bson_append_int(bson_elem, "post_nat_port_src", pnat->post_nat_src_port);
-      if (config.what_to_count_2 & COUNT_POST_NAT_DST_PORT) bson_append_int(bson_elem, "post_nat_port_dst", pnat->post_nat_dst_port);
-      if (config.what_to_count_2 & COUNT_NAT_EVENT) bson_append_int(bson_elem, "nat_event", pnat->nat_event);
-      if (config.what_to_count_2 & COUNT_MPLS_LABEL_TOP) bson_append_int(bson_elem, "mpls_label_top", pmpls->mpls_label_top);
-      if (config.what_to_count_2 & COUNT_MPLS_LABEL_BOTTOM) bson_append_int(bson_elem, "mpls_label_bottom", pmpls->mpls_label_bottom);
-      if (config.what_to_count_2 & COUNT_MPLS_STACK_DEPTH) bson_append_int(bson_elem, "mpls_stack_depth", pmpls->mpls_stack_depth);
+  if (config.what_to_count_2 & COUNT_POST_NAT_SRC_HOST) {
+    addr_to_str(src_host, &pnat->post_nat_src_ip);
+    bson_append_string(bson_elem, "post_nat_ip_src", src_host);
+  }
+  if (config.what_to_count_2 & COUNT_POST_NAT_DST_HOST) {
+    addr_to_str(dst_host, &pnat->post_nat_dst_ip);
+    bson_append_string(bson_elem, "post_nat_ip_dst", dst_host);
+  }
+  if (config.what_to_count_2 & COUNT_POST_NAT_SRC_PORT) bson_append_int(bson_elem, "post_nat_port_src", pnat->post_nat_src_port);
+  if (config.what_to_count_2 & COUNT_POST_NAT_DST_PORT) bson_append_int(bson_elem, "post_nat_port_dst", pnat->post_nat_dst_port);
+  if (config.what_to_count_2 & COUNT_NAT_EVENT) bson_append_int(bson_elem, "nat_event", pnat->nat_event);
+  if (config.what_to_count_2 & COUNT_MPLS_LABEL_TOP) bson_append_int(bson_elem, "mpls_label_top", pmpls->mpls_label_top);
+  if (config.what_to_count_2 & COUNT_MPLS_LABEL_BOTTOM) bson_append_int(bson_elem, "mpls_label_bottom", pmpls->mpls_label_bottom);
+  if (config.what_to_count_2 & COUNT_MPLS_STACK_DEPTH) bson_append_int(bson_elem, "mpls_stack_depth", pmpls->mpls_stack_depth);
   
-      if (config.what_to_count_2 & COUNT_TIMESTAMP_START) {
-	if (config.sql_history_since_epoch) {
-	  char tstamp_str[SRVBUFLEN];
+  if (config.what_to_count_2 & COUNT_TIMESTAMP_START) {
+    if (config.sql_history_since_epoch) {
+      char tstamp_str[SRVBUFLEN];
 
-	  compose_timestamp(tstamp_str, SRVBUFLEN, &pnat->timestamp_start, TRUE, config.sql_history_since_epoch);
-	  bson_append_string(bson_elem, "timestamp_start", tstamp_str);
-	}
-	else {
-          bson_date_t bdate;
+      compose_timestamp(tstamp_str, SRVBUFLEN, &pnat->timestamp_start, TRUE, config.sql_history_since_epoch);
+      bson_append_string(bson_elem, "timestamp_start", tstamp_str);
+    }
+    else {
+      bson_date_t bdate;
   
-	  bdate = 1000*pnat->timestamp_start.tv_sec;
-	  if (pnat->timestamp_start.tv_usec) bdate += (pnat->timestamp_start.tv_usec/1000);
+      bdate = 1000*pnat->timestamp_start.tv_sec;
+      if (pnat->timestamp_start.tv_usec) bdate += (pnat->timestamp_start.tv_usec/1000);
 
-	  bson_append_date(bson_elem, "timestamp_start", bdate);
-	}
-      }
-      if (config.what_to_count_2 & COUNT_TIMESTAMP_END) {
-        if (config.sql_history_since_epoch) {
-          char tstamp_str[SRVBUFLEN];
+      bson_append_date(bson_elem, "timestamp_start", bdate);
+    }
+  }
+  if (config.what_to_count_2 & COUNT_TIMESTAMP_END) {
+    if (config.sql_history_since_epoch) {
+      char tstamp_str[SRVBUFLEN];
 
-          compose_timestamp(tstamp_str, SRVBUFLEN, &pnat->timestamp_end, TRUE, config.sql_history_since_epoch);
-          bson_append_string(bson_elem, "timestamp_end", tstamp_str);
-        }
-        else {
-          bson_date_t bdate;
+      compose_timestamp(tstamp_str, SRVBUFLEN, &pnat->timestamp_end, TRUE, config.sql_history_since_epoch);
+      bson_append_string(bson_elem, "timestamp_end", tstamp_str);
+    }
+    else {
+      bson_date_t bdate;
 
-          bdate = 1000*pnat->timestamp_end.tv_sec;
-          if (pnat->timestamp_end.tv_usec) bdate += (pnat->timestamp_end.tv_usec/1000);
+      bdate = 1000*pnat->timestamp_end.tv_sec;
+      if (pnat->timestamp_end.tv_usec) bdate += (pnat->timestamp_end.tv_usec/1000);
 
-          bson_append_date(bson_elem, "timestamp_end", bdate);
-	}
-      }
-      if (config.what_to_count_2 & COUNT_TIMESTAMP_ARRIVAL) {
-        if (config.sql_history_since_epoch) {
-          char tstamp_str[SRVBUFLEN];
+      bson_append_date(bson_elem, "timestamp_end", bdate);
+    }
+  }
+  if (config.what_to_count_2 & COUNT_TIMESTAMP_ARRIVAL) {
+    if (config.sql_history_since_epoch) {
+      char tstamp_str[SRVBUFLEN];
 
-          compose_timestamp(tstamp_str, SRVBUFLEN, &pnat->timestamp_arrival, TRUE, config.sql_history_since_epoch);
-          bson_append_string(bson_elem, "timestamp_arrival", tstamp_str);
-        }
-        else {
-          bson_date_t bdate;
+      compose_timestamp(tstamp_str, SRVBUFLEN, &pnat->timestamp_arrival, TRUE, config.sql_history_since_epoch);
+      bson_append_string(bson_elem, "timestamp_arrival", tstamp_str);
+    }
+    else {
+      bson_date_t bdate;
 
-          bdate = 1000*pnat->timestamp_arrival.tv_sec;
-          if (pnat->timestamp_arrival.tv_usec) bdate += (pnat->timestamp_arrival.tv_usec/1000);
+      bdate = 1000*pnat->timestamp_arrival.tv_sec;
+      if (pnat->timestamp_arrival.tv_usec) bdate += (pnat->timestamp_arrival.tv_usec/1000);
 
-          bson_append_date(bson_elem, "timestamp_arrival", bdate);
-        }
-      }
+      bson_append_date(bson_elem, "timestamp_arrival", bdate);
+    }
+  }
 
-      if (config.nfacctd_stitching && queue[j]->stitch) {
-        if (config.sql_history_since_epoch) {
-          char tstamp_str[SRVBUFLEN];
+  if (config.nfacctd_stitching) {
+    struct pkt_stitching *stitch = stitch_get(elem->stitch);
 
-          compose_timestamp(tstamp_str, SRVBUFLEN, &queue[j]->stitch->timestamp_min, TRUE, config.sql_history_since_epoch);
-          bson_append_string(bson_elem, "timestamp_min", tstamp_str);
+    if (config.sql_history_since_epoch) {
+      char tstamp_str[SRVBUFLEN];
 
-          compose_timestamp(tstamp_str, SRVBUFLEN, &queue[j]->stitch->timestamp_max, TRUE, config.sql_history_since_epoch);
-          bson_append_string(bson_elem, "timestamp_max", tstamp_str);
-        }
-	else {
-          bson_date_t bdate_min, bdate_max;
+      compose_timestamp(tstamp_str, SRVBUFLEN, &stitch->timestamp_min, TRUE, config.sql_history_since_epoch);
+      bson_append_string(bson_elem, "timestamp_min", tstamp_str);
 
-          bdate_min = 1000*queue[j]->stitch->timestamp_min.tv_sec;
-          if (queue[j]->stitch->timestamp_min.tv_usec) bdate_min += (queue[j]->stitch->timestamp_min.tv_usec/1000);
-          bson_append_date(bson_elem, "timestamp_min", bdate_min);
+      compose_timestamp(tstamp_str, SRVBUFLEN, &stitch->timestamp_max, TRUE, config.sql_history_since_epoch);
+      bson_append_string(bson_elem, "timestamp_max", tstamp_str);
+    }
+    else {
+      bson_date_t bdate_min, bdate_max;
 
-          bdate_max = 1000*queue[j]->stitch->timestamp_max.tv_sec;
-          if (queue[j]->stitch->timestamp_max.tv_usec) bdate_max += (queue[j]->stitch->timestamp_max.tv_usec/1000);
-          bson_append_date(bson_elem, "timestamp_max", bdate_max);
-	}
-      }
+      bdate_min = 1000*stitch->timestamp_min.tv_sec;
+      if (stitch->timestamp_min.tv_usec) bdate_min += (stitch->timestamp_min.tv_usec/1000);
+      bson_append_date(bson_elem, "timestamp_min", bdate_min);
 
-      if (config.what_to_count_2 & COUNT_EXPORT_PROTO_SEQNO) bson_append_int(bson_elem, "export_proto_seqno", data->export_proto_seqno);
-      if (config.what_to_count_2 & COUNT_EXPORT_PROTO_VERSION) bson_append_int(bson_elem, "export_proto_version", data->export_proto_version);
+      bdate_max = 1000*stitch->timestamp_max.tv_sec;
+      if (stitch->timestamp_max.tv_usec) bdate_max += (stitch->timestamp_max.tv_usec/1000);
+      bson_append_date(bson_elem, "timestamp_max", bdate_max);
+    }
+  }
+
+  if (config.what_to_count_2 & COUNT_EXPORT_PROTO_SEQNO) bson_append_int(bson_elem, "export_proto_seqno", data->export_proto_seqno);
+  if (config.what_to_count_2 & COUNT_EXPORT_PROTO_VERSION) bson_append_int(bson_elem, "export_proto_version", data->export_proto_version);
   
-      /* all custom primitives printed here */
-      {
-        int cp_idx;
+  /* all custom primitives printed here */
+  {
+    int cp_idx;
   
-        for (cp_idx = 0; cp_idx < config.cpptrs.num; cp_idx++) {
-	  if (config.cpptrs.primitive[cp_idx].ptr->len != PM_VARIABLE_LENGTH) {
-	    char cp_str[SRVBUFLEN];
-
-	    custom_primitive_value_print(cp_str, SRVBUFLEN, pcust, &config.cpptrs.primitive[cp_idx], FALSE);
-	    bson_append_string(bson_elem, config.cpptrs.primitive[cp_idx].name, cp_str);
-	  }
-	  else {
-	    char *label_ptr = NULL;
+    for (cp_idx = 0; cp_idx < config.cpptrs.num; cp_idx++) {
+      if (config.cpptrs.primitive[cp_idx].ptr->len != PM_VARIABLE_LENGTH) {
+        char cp_str[SRVBUFLEN];
 
-	    vlen_prims_get(pvlen, config.cpptrs.primitive[cp_idx].ptr->type, &label_ptr);
-	    if (!label_ptr) bson_append_null(bson_elem, config.cpptrs.primitive[cp_idx].name);
-	    else bson_append_string(bson_elem, config.cpptrs.primitive[cp_idx].name, label_ptr);
-	  }
-        }
-      }
-  
-      if (config.sql_history) {
-        bson_append_date(bson_elem, "stamp_inserted", (bson_date_t) 1000*queue[j]->basetime.tv_sec);
-        bson_append_date(bson_elem, "stamp_updated", (bson_date_t) 1000*time(NULL));
+        custom_primitive_value_print(cp_str, SRVBUFLEN, pcust, &config.cpptrs.primitive[cp_idx], FALSE);
+        bson_append_string(bson_elem, config.cpptrs.primitive[cp_idx].name, cp_str);
       }
-  
-      if (queue[j]->flow_type != NF9_FTYPE_EVENT && queue[j]->flow_type != NF9_FTYPE_OPTION) {
-  #if defined HAVE_64BIT_COUNTERS
-        bson_append_long(bson_elem, "packets", queue[j]->packet_counter);
-        if (config.what_to_count & COUNT_FLOWS) bson_append_long(bson_elem, "flows", queue[j]->flow_counter);
-        bson_append_long(bson_elem, "bytes", queue[j]->bytes_counter);
-  #else
-        bson_append_int(bson_elem, "packets", queue[j]->packet_counter);
-        if (config.what_to_count & COUNT_FLOWS) bson_append_int(bson_elem, "flows", queue[j]->flow_counter);
-        bson_append_int(bson_elem, "bytes", queue[j]->bytes_counter);
-  #endif
+      else {
+        char *label_ptr = NULL;
+
+        vlen_prims_get(pvlen, config.cpptrs.primitive[cp_idx].ptr->type, &label_ptr);
+        if (!label_ptr) bson_append_null(bson_elem, config.cpptrs.primitive[cp_idx].name);
+        else bson_append_string(bson_elem, config.cpptrs.primitive[cp_idx].name, label_ptr);
       }
+    }
+  }
   
-      bson_finish(bson_elem);
-      bson_batch[batch_idx] = bson_elem;
-      batch_idx++;
-      qn++;
-  
-      if (config.debug) bson_print(bson_elem);
-  
-      if (batch_idx == config.mongo_insert_batch) {
-	if (dyn_table) db_status = mongo_insert_batch(&db_conn, current_table, bson_batch, batch_idx, NULL, MONGO_CONTINUE_ON_ERROR);
-	else db_status = mongo_insert_batch(&db_conn, config.sql_table, bson_batch, batch_idx, NULL, MONGO_CONTINUE_ON_ERROR);
-	if (db_status != MONGO_OK) {
-   	  Log(LOG_ERR, "ERROR ( %s/%s ): Unable to insert all elements in batch: try a smaller mongo_insert_batch value.\n", config.name, config.type);
-	  Log(LOG_ERR, "ERROR ( %s/%s ): Server error: %s. (PID: %u, QN: %u/%u)\n", config.name, config.type, db_conn.lasterrstr, writer_pid, qn, saved_index);
-	}
+  if (config.sql_history) {
+    bson_append_date(bson_elem, "stamp_inserted", (bson_date_t) 1000*elem->basetime.tv_sec);
+    bson_append_date(bson_elem, "stamp_updated", (bson_date_t) 1000*time(NULL));
+  }
   
-        for (i = 0; i < batch_idx; i++) {
-          bson_elem = (bson *) bson_batch[i];
-          bson_destroy(bson_elem);
-          free(bson_elem);
+  if (elem->flow_type != NF9_FTYPE_EVENT && elem->flow_type != NF9_FTYPE_OPTION) {
+#if defined HAVE_64BIT_COUNTERS
+    bson_append_long(bson_elem, "packets", elem->packet_counter);
+    if (config.what_to_count & COUNT_FLOWS) bson_append_long(bson_elem, "flows", elem->flow_counter);
+    bson_append_long(bson_elem, "bytes", elem->bytes_counter);
+#else
+    bson_append_int(bson_elem, "packets", elem->packet_counter);
+    if (config.what_to_count & COUNT_FLOWS) bson_append_int(bson_elem, "flows", elem->flow_counter);
+    bson_append_int(bson_elem, "bytes", elem->bytes_counter);
+#endif
+  }
+}
+
+/*
+   Encoding and insertion are pipelined: encoder threads fill whole batches
+   of BSON documents while the purging process, the only one talking to the
+   server over db_conn, inserts the batches already complete. Batch slots
+   are recycled once inserted, hence no more than slots_num batches are ever
+   in flight.
+*/
+int MongoDB_pipeline_init(struct mongodb_pipeline *pl, int index, int workers)
+{
+  struct mongodb_batch *mb;
+  int idx;
+
+  memset(pl, 0, sizeof(struct mongodb_pipeline));
+
+  pl->empty_pcust = malloc(config.cpptrs.len);
+  if (!pl->empty_pcust) return ERR;
+  memset(pl->empty_pcust, 0, config.cpptrs.len);
+
+  pl->elems = malloc(index*sizeof(struct chained_cache *));
+  if (!pl->elems) return ERR;
+
+  pl->workers = workers;
+  pl->batch_size = MIN(config.mongo_insert_batch, index);
+  pl->slots_num = (workers > 1 ? workers*MONGO_PURGE_SLOTS_PER_WORKER : 1);
+  pl->doc_size = MONGO_BSON_INITIAL_SIZE;
+
+  pl->slots = malloc(pl->slots_num*sizeof(struct mongodb_batch));
+  if (!pl->slots) return ERR;
+  memset(pl->slots, 0, pl->slots_num*sizeof(struct mongodb_batch));
+
+  for (idx = 0; idx < pl->slots_num; idx++) {
+    mb = &pl->slots[idx];
+
+    mb->docs = malloc(pl->batch_size*sizeof(bson));
+    mb->docs_ptr = malloc(pl->batch_size*sizeof(bson *));
+    mb->oids = malloc(pl->batch_size*sizeof(bson_oid_t));
+    if (!mb->docs || !mb->docs_ptr || !mb->oids) return ERR;
+  }
+
+#if defined ENABLE_THREADS
+  pthread_mutex_init(&pl->mutex, NULL);
+  pthread_cond_init(&pl->slot_free, NULL);
+  pthread_cond_init(&pl->slot_ready, NULL);
+#endif
+
+  return SUCCESS;
+}
+
+void MongoDB_pipeline_free(struct mongodb_pipeline *pl)
+{
+  int idx;
+
+  if (pl->slots) {
+    for (idx = 0; idx < pl->slots_num; idx++) {
+      if (pl->slots[idx].docs) free(pl->slots[idx].docs);
+      if (pl->slots[idx].docs_ptr) free(pl->slots[idx].docs_ptr);
+      if (pl->slots[idx].oids) free(pl->slots[idx].oids);
+    }
+
+    free(pl->slots);
+
+#if defined ENABLE_THREADS
+    pthread_mutex_destroy(&pl->mutex);
+    pthread_cond_destroy(&pl->slot_free);
+    pthread_cond_destroy(&pl->slot_ready);
+#endif
+  }
+
+  if (pl->elems) free(pl->elems);
+  if (pl->empty_pcust) free(pl->empty_pcust);
+
+  memset(pl, 0, sizeof(struct mongodb_pipeline));
+}
+
+void MongoDB_pipeline_lock(struct mongodb_pipeline *pl)
+{
+#if defined ENABLE_THREADS
+  pthread_mutex_lock(&pl->mutex);
+#endif
+}
+
+void MongoDB_pipeline_unlock(struct mongodb_pipeline *pl)
+{
+#if defined ENABLE_THREADS
+  pthread_mutex_unlock(&pl->mutex);
+#endif
+}
+
+/* encodes and inserts pl->elems into pl->table */
+void MongoDB_pipeline_run(struct mongodb_pipeline *pl)
+{
+  int batch, spawned = 0;
+
+  if (!pl->elems_num) return;
+
+  pl->batches_num = (pl->elems_num+pl->batch_size-1)/pl->batch_size;
+  pl->batches_next = 0;
+
+#if defined ENABLE_THREADS
+  if (pl->workers > 1 && pl->batches_num > 1) {
+    struct mongodb_batch *mb;
+    pthread_t *threads;
+    int idx;
+
+    threads = malloc(pl->workers*sizeof(pthread_t));
+
+    for (idx = 0; threads && idx < pl->workers && idx < pl->batches_num; idx++) {
+      if (!pthread_create(&threads[idx], NULL, MongoDB_encoder_run, pl)) spawned++;
+      else break;
+    }
+
+    if (spawned) {
+      for (batch = 0; batch < pl->batches_num; batch++) {
+        pthread_mutex_lock(&pl->mutex);
+        for (mb = NULL; !mb; ) {
+          for (idx = 0; idx < pl->slots_num; idx++) {
+            if (pl->slots[idx].state == MONGO_BATCH_READY) {
+              mb = &pl->slots[idx];
+              break;
+            }
+          }
+
+          if (!mb) pthread_cond_wait(&pl->slot_ready, &pl->mutex);
         }
-  
-        batch_idx = 0;
+        mb->state = MONGO_BATCH_BUSY;
+        pthread_mutex_unlock(&pl->mutex);
+
+        MongoDB_insert_batch(pl, mb);
+
+        pthread_mutex_lock(&pl->mutex);
+        mb->state = MONGO_BATCH_FREE;
+        pthread_cond_broadcast(&pl->slot_free);
+        pthread_mutex_unlock(&pl->mutex);
       }
+
+      for (idx = 0; idx < spawned; idx++) pthread_join(threads[idx], NULL);
     }
+
+    if (threads) free(threads);
   }
+#endif
 
-  /* last round on the lollipop */
-  if (batch_idx) {
-    if (dyn_table) db_status = mongo_insert_batch(&db_conn, current_table, bson_batch, batch_idx, NULL, MONGO_CONTINUE_ON_ERROR);
-    else db_status = mongo_insert_batch(&db_conn, config.sql_table, bson_batch, batch_idx, NULL, MONGO_CONTINUE_ON_ERROR);
-    if (db_status != MONGO_OK) {
-      Log(LOG_ERR, "ERROR ( %s/%s ): Unable to insert all elements in batch: try a smaller mongo_insert_batch value.\n", config.name, config.type);
-      Log(LOG_ERR, "ERROR ( %s/%s ): Server error: %s. (PID: %u, QN: %u/%u)\n", config.name, config.type, db_conn.lasterrstr, writer_pid, qn, saved_index);
+  /* single encoder, or no threads could be spawned: we carry on by ourselves */
+  if (!spawned) {
+    for (batch = pl->batches_next; batch < pl->batches_num; batch++) {
+      MongoDB_encode_batch(pl, &pl->slots[0], batch);
+      MongoDB_insert_batch(pl, &pl->slots[0]);
+    }
+  }
+}
+
+#if defined ENABLE_THREADS
+void *MongoDB_encoder_run(void *arg)
+{
+  struct mongodb_pipeline *pl = (struct mongodb_pipeline *) arg;
+  struct mongodb_batch *mb;
+  int batch, idx;
+
+  for (;;) {
+    pthread_mutex_lock(&pl->mutex);
+    for (mb = NULL; !mb && pl->batches_next < pl->batches_num; ) {
+      for (idx = 0; idx < pl->slots_num; idx++) {
+        if (pl->slots[idx].state == MONGO_BATCH_FREE) {
+          mb = &pl->slots[idx];
+          break;
+        }
+      }
+
+      if (!mb) pthread_cond_wait(&pl->slot_free, &pl->mutex);
     }
 
-    for (i = 0; i < batch_idx; i++) {
-      bson_elem = (bson *) bson_batch[i];
-      bson_destroy(bson_elem);
-      free(bson_elem);
+    if (!mb) {
+      pthread_mutex_unlock(&pl->mutex);
+      break;
     }
 
-    batch_idx = 0;
+    mb->state = MONGO_BATCH_BUSY;
+    batch = pl->batches_next;
+    pl->batches_next++;
+    pthread_mutex_unlock(&pl->mutex);
+
+    MongoDB_encode_batch(pl, mb, batch);
+
+    pthread_mutex_lock(&pl->mutex);
+    mb->state = MONGO_BATCH_READY;
+    pthread_cond_signal(&pl->slot_ready);
+    pthread_mutex_unlock(&pl->mutex);
   }
 
-  /* If we have pending queries then start again */
-  if (pqq_ptr) goto start;
+  return NULL;
+}
+#endif
 
-  duration = time(NULL)-start;
-  Log(LOG_INFO, "INFO ( %s/%s ): *** Purging cache - END (PID: %u, QN: %u/%u, ET: %u) ***\n",
-		config.name, config.type, writer_pid, qn, saved_index, duration);
+void MongoDB_encode_batch(struct mongodb_pipeline *pl, struct mongodb_batch *mb, int batch)
+{
+  struct timeval start, end;
+  int idx, first, doc_size;
+
+  gettimeofday(&start, NULL);
+  first = batch*pl->batch_size;
+  mb->num = MIN(pl->batch_size, pl->elems_num-first);
+
+  /* bson_oid_gen() is not thread-safe: a batch worth of OIDs at once */
+  MongoDB_pipeline_lock(pl);
+  for (idx = 0; idx < mb->num; idx++) bson_oid_gen(&mb->oids[idx]);
+  doc_size = pl->doc_size;
+  MongoDB_pipeline_unlock(pl);
+
+  for (idx = 0; idx < mb->num; idx++) {
+    /* pre-sized after the largest document seen so far: no reallocs */
+    bson_init_size(&mb->docs[idx], doc_size);
+    bson_append_oid(&mb->docs[idx], "_id", &mb->oids[idx]);
+    MongoDB_encode_elem(pl, &mb->docs[idx], pl->elems[first+idx]);
+    bson_finish(&mb->docs[idx]);
+    mb->docs_ptr[idx] = &mb->docs[idx];
+
+    if (bson_size(&mb->docs[idx]) > doc_size) doc_size = bson_size(&mb->docs[idx]);
+  }
 
-  if (config.sql_trigger_exec) P_trigger_exec(config.sql_trigger_exec); 
+  gettimeofday(&end, NULL);
+
+  MongoDB_pipeline_lock(pl);
+  if (doc_size > pl->doc_size) pl->doc_size = doc_size;
+  pl->encode_usecs += ((end.tv_sec-start.tv_sec)*1000000+(end.tv_usec-start.tv_usec));
+  MongoDB_pipeline_unlock(pl);
+}
+
+void MongoDB_insert_batch(struct mongodb_pipeline *pl, struct mongodb_batch *mb)
+{
+  struct timeval start, end;
+  int idx, db_status;
+
+  gettimeofday(&start, NULL);
+
+  if (config.debug) {
+    for (idx = 0; idx < mb->num; idx++) bson_print(&mb->docs[idx]);
+  }
+
+  db_status = mongo_insert_batch(&db_conn, pl->table, mb->docs_ptr, mb->num, NULL, MONGO_CONTINUE_ON_ERROR);
+  pl->qn += mb->num;
+
+  if (db_status != MONGO_OK) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to insert all elements in batch: try a smaller mongo_insert_batch value.\n", config.name, config.type);
+    Log(LOG_ERR, "ERROR ( %s/%s ): Server error: %s. (PID: %u, QN: %u/%u)\n", config.name, config.type, db_conn.lasterrstr, getpid(), pl->qn, pl->elems_num);
+  }
+
+  for (idx = 0; idx < mb->num; idx++) bson_destroy(&mb->docs[idx]);
+  mb->num = 0;
 
-  if (empty_pcust) free(empty_pcust);
+  gettimeofday(&end, NULL);
+  pl->insert_usecs += ((end.tv_sec-start.tv_sec)*1000000+(end.tv_usec-start.tv_usec));
 }
 
 int MongoDB_get_database(char *db, int dblen, char *db_table)
@@ -23,6 +23,9 @@
 #include <stdlib.h>
 #include <sys/poll.h>
 #include <time.h>
+#if defined ENABLE_THREADS
+#include <pthread.h>
+#endif
 
 /* defines */
 #if (!defined MONGO_HAVE_STDINT)
@@ -31,8 +34,49 @@
 #include <mongo.h>
 
 #define DEFAULT_MONGO_INSERT_BATCH 10000
+#define MONGO_PURGE_SLOTS_PER_WORKER 2
+#define MONGO_BSON_INITIAL_SIZE 128
+
+#define MONGO_BATCH_FREE	0
+#define MONGO_BATCH_BUSY	1
+#define MONGO_BATCH_READY	2
 
 /* structures */
+struct mongodb_batch {
+  bson *docs;
+  const bson **docs_ptr;
+  bson_oid_t *oids;
+  int num;
+  int state;
+};
+
+struct mongodb_pipeline {
+  struct pkt_bgp_primitives empty_pbgp;
+  struct pkt_nat_primitives empty_pnat;
+  struct pkt_mpls_primitives empty_pmpls;
+  char *empty_pcust;
+
+  struct chained_cache **elems;	/* elements going to 'table' */
+  int elems_num;
+  char *table;
+
+  int workers;
+  int batch_size;
+  int batches_num;
+  int batches_next;		/* next batch to be encoded */
+  struct mongodb_batch *slots;
+  int slots_num;
+  int doc_size;			/* BSON buffers sizing hint */
+#if defined ENABLE_THREADS
+  pthread_mutex_t mutex;
+  pthread_cond_t slot_free;
+  pthread_cond_t slot_ready;
+#endif
+
+  int qn;
+  u_int64_t encode_usecs;	/* summed over all encoders */
+  u_int64_t insert_usecs;
+};
 
 /* prototypes */
 #if (!defined __MONGODB_PLUGIN_C)
@@ -46,6 +90,15 @@ EXT void MongoDB_create_indexes(mongo *, const char *);
 EXT int MongoDB_get_database(char *, int, char *);
 EXT void MongoDB_append_label(bson *, char *, struct pkt_vlen_hdr_primitives *, pm_cfgreg_t);
 EXT int MongoDB_oid_fuzz();
+EXT int MongoDB_pipeline_init(struct mongodb_pipeline *, int, int);
+EXT void MongoDB_pipeline_free(struct mongodb_pipeline *);
+EXT void MongoDB_pipeline_lock(struct mongodb_pipeline *);
+EXT void MongoDB_pipeline_unlock(struct mongodb_pipeline *);
+EXT void MongoDB_pipeline_run(struct mongodb_pipeline *);
+EXT void *MongoDB_encoder_run(void *);
+EXT void MongoDB_encode_batch(struct mongodb_pipeline *, struct mongodb_batch *, int);
+EXT void MongoDB_insert_batch(struct mongodb_pipeline *, struct mongodb_batch *);
+EXT void MongoDB_encode_elem(struct mongodb_pipeline *, bson *, struct chained_cache *);
 
 /* global vars */
 EXT void (*insert_func)(struct primitives_ptrs *, struct insert_data *); /* pointer to INSERT function */
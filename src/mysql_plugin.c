@@ -272,9 +272,10 @@ void mysql_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 int MY_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_data *idata)
 {
   char *ptr_values, *ptr_where, *ptr_mv, *ptr_set, *ptr_insert;
-  int num=0, num_set=0, ret=0, have_flows=0, len=0;
+  int num=0, num_set=0, ret=0, have_flows=0, len=0, upsert=FALSE;
 
   if (idata->mv.last_queue_elem) {
+    if (config.sql_upsert_batch) sql_upsert_close(idata);
     ret = mysql_query(db->desc, multi_values_buffer);
     Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d VALUES statements sent to the MySQL server.\n",
                     config.name, config.type, idata->mv.buffer_elem_num);
@@ -287,6 +288,8 @@ int MY_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
   }
 
   if (config.what_to_count & COUNT_FLOWS) have_flows = TRUE;
+  if (config.sql_upsert_batch && cache_elem->flow_type != NF9_FTYPE_EVENT &&
+      cache_elem->flow_type != NF9_FTYPE_OPTION) upsert = TRUE;
 
   /* constructing sql query */
   ptr_where = where_clause;
@@ -311,8 +314,8 @@ int MY_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
   }
   
   /* sending UPDATE query a) if not switched off and
-     b) if we actually have something to update */
-  if (!config.sql_dont_try_update && num_set) {
+     b) if we actually have something to update; UPSERTs skip it */
+  if (!config.sql_dont_try_update && !upsert && num_set) {
     strncpy(sql_data, update_clause, SPACELEFT(sql_data));
     strncat(sql_data, set_clause, SPACELEFT(sql_data));
     strncat(sql_data, where_clause, SPACELEFT(sql_data));
@@ -321,7 +324,7 @@ int MY_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
     if (ret) goto signal_error; 
   }
 
-  if (config.sql_dont_try_update || !num_set || (mysql_affected_rows(db->desc) == 0)) {
+  if (config.sql_dont_try_update || upsert || !num_set || (mysql_affected_rows(db->desc) == 0)) {
     /* UPDATE failed, trying with an INSERT query */ 
     if (cache_elem->flow_type == NF9_FTYPE_EVENT || cache_elem->flow_type == NF9_FTYPE_OPTION) {
       strncpy(insert_full_clause, insert_clause, SPACELEFT(insert_full_clause));
@@ -340,7 +343,19 @@ int MY_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
 #endif
     }
 
-    if (config.sql_multi_values) { 
+    if (upsert) {
+      if (sql_upsert_append(idata)) {
+	ret = mysql_query(db->desc, sql_upsert_close(idata));
+	Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d rows UPSERTed to the MySQL server.\n",
+			config.name, config.type, idata->mv.buffer_elem_num);
+	if (ret) goto signal_error;
+	idata->iqn++;
+	idata->mv.buffer_elem_num = FALSE;
+	idata->mv.head_buffer_elem = FALSE;
+	idata->mv.buffer_offset = 0;
+      }
+    }
+    else if (config.sql_multi_values) { 
       multi_values_handling:
       len = config.sql_multi_values-idata->mv.buffer_offset; 
       if (!idata->mv.buffer_elem_num) {
@@ -648,6 +663,9 @@ int MY_compose_static_queries()
     }
   }
 
+  /* "... ON DUPLICATE KEY UPDATE ..." stuff */
+  if (config.sql_upsert_batch) sql_compose_upsert_clause(" ON DUPLICATE KEY UPDATE ", "VALUES(%s)");
+
   return primitives;
 }
 
@@ -764,6 +782,7 @@ void MY_init_default_values(struct insert_data *idata)
 
   if (config.sql_backup_host) idata->recover = TRUE;
 
+  sql_init_upsert();
   if (config.sql_multi_values) {
     multi_values_buffer = malloc(config.sql_multi_values);
     if (!multi_values_buffer) {
@@ -30,15 +30,68 @@
 #include "addr.h"
 #include "jhash.h"
 
-void load_networks(char *filename, struct networks_table *nt, struct networks_cache *nc)
+/* compiled networks_file currently mapped; more than one table per
+   process (ie. live and standby) may be in use at the same time */
+static struct {
+  void *base;
+  size_t len;
+} networks_maps[NETWORKS_MAP_SLOTS];
+
+static int networks_map_find(void *ptr)
 {
-  load_networks4(filename, nt, nc);
+  int idx;
+
+  if (!ptr) return ERR;
+
+  for (idx = 0; idx < NETWORKS_MAP_SLOTS; idx++) {
+    if (networks_maps[idx].base && (u_char *) ptr >= (u_char *) networks_maps[idx].base &&
+	(u_char *) ptr < (u_char *) networks_maps[idx].base+networks_maps[idx].len) return idx;
+  }
+
+  return ERR;
+}
+
+static void networks_map_release(int idx)
+{
+  munmap(networks_maps[idx].base, networks_maps[idx].len);
+  networks_maps[idx].base = NULL;
+  networks_maps[idx].len = 0;
+}
+
+int load_networks(char *filename, struct networks_table *nt, struct networks_cache *nc)
+{
+  struct networks_table bkt;
+  int ret, mapped;
+
+  if (filename && is_networks_map(filename)) return load_networks_map(filename, nt, nc);
+
+  /* moving from a compiled map back to a text file: mapped tables
+     must not reach free() in the loaders, so we hide them and either
+     release or restore them afterwards */
+  if ((mapped = networks_map_find(nt->table)) != ERR) {
+    memcpy(&bkt, nt, sizeof(struct networks_table));
+    nt->table = NULL;
+    nt->num = 0;
+#if defined ENABLE_IPV6
+    nt->table6 = NULL;
+    nt->num6 = 0;
+#endif
+  }
+
+  ret = load_networks4(filename, nt, nc);
 #if defined ENABLE_IPV6
-  load_networks6(filename, nt, nc);
+  if (load_networks6(filename, nt, nc) != SUCCESS) ret = ERR;
 #endif
+
+  if (mapped != ERR) {
+    if (ret == SUCCESS) networks_map_release(mapped);
+    else memcpy(nt, &bkt, sizeof(struct networks_table));
+  }
+
+  return ret;
 }
 
-void load_networks4(char *filename, struct networks_table *nt, struct networks_cache *nc)
+int load_networks4(char *filename, struct networks_table *nt, struct networks_cache *nc)
 {
   FILE *file;
   struct networks_table tmp, *tmpt = &tmp; 
@@ -49,14 +102,17 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
   unsigned int index, fake_row = 0;
   struct stat st;
 
-  /* dummy & broken on purpose */
-  memset(&dummy_entry, 0, sizeof(struct networks_table_entry));
-  dummy_entry.masknum = 255;
+  /* dummy & broken on purpose; set once as it may be in use by lookups
+     while a new table is being loaded in background */
+  if (dummy_entry.masknum != 255) {
+    memset(&dummy_entry, 0, sizeof(struct networks_table_entry));
+    dummy_entry.masknum = 255;
+  }
 
   memset(&bkt, 0, sizeof(bkt));
   memset(&tmp, 0, sizeof(tmp));
   memset(&st, 0, sizeof(st));
-  default_route_in_networks4_table = FALSE;
+  nc->default_route4 = FALSE;
 
   /* backing up pre-existing table and cache */ 
   if (nt->num) {
@@ -73,7 +129,7 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
     if ((file = fopen(filename,"r")) == NULL) {
       if (!(config.nfacctd_net & NF_NET_KEEP && config.nfacctd_as & NF_AS_KEEP)) {
         Log(LOG_WARNING, "WARN: network file '%s' not found\n", filename);
-	return;
+	return ERR;
       }
 
       Log(LOG_ERR, "ERROR: network file '%s' not found\n", filename);
@@ -340,7 +396,7 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
 	}
 	if (!nt->table[index].mask) {
 	  Log(LOG_DEBUG, "DEBUG ( %s ): [networks table IPv4] contains a default route\n", filename);
-	  default_route_in_networks4_table = TRUE;
+	  nc->default_route4 = TRUE;
 	}
 	index++;
       }
@@ -368,7 +424,7 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
     }
   }
 
-  return;
+  return SUCCESS;
 
   /* 
      error handling: if we have a copy of the old table we will rollback it;
@@ -390,7 +446,11 @@ void load_networks4(char *filename, struct networks_table *nt, struct networks_c
       nt->timestamp = st.st_mtime;
     }
   }
-  else exit_plugin(1);
+  /* a table loaded before (ie. live while this one is built aside) is
+     not a reason to exit */
+  else if (!nt->timestamp) exit_plugin(1);
+
+  return ERR;
 }
 
 /* sort the (sub)array v from start to end */
@@ -519,6 +579,46 @@ struct networks_table_entry *networks_cache_search(struct networks_cache *nc, u_
   else return NULL;
 }
 
+/*
+   Gives threads doing lookups against the same networks table a private
+   (empty) cache, sized as the source one; to be called again whenever
+   the source one is swapped upon a reload.
+*/
+int networks_cache_clone(struct networks_cache *dst, struct networks_cache *src)
+{
+  if (dst->num != src->num) {
+    if (dst->cache) free(dst->cache);
+    dst->cache = NULL;
+    dst->num = 0;
+
+    if (src->cache) {
+      dst->cache = (struct networks_cache_entry *) malloc(src->num*sizeof(struct networks_cache_entry));
+      if (!dst->cache) return ERR;
+      dst->num = src->num;
+    }
+  }
+  if (dst->cache) memset(dst->cache, 0, dst->num*sizeof(struct networks_cache_entry));
+  dst->default_route4 = src->default_route4;
+
+#if defined ENABLE_IPV6
+  if (dst->num6 != src->num6) {
+    if (dst->cache6) free(dst->cache6);
+    dst->cache6 = NULL;
+    dst->num6 = 0;
+
+    if (src->cache6) {
+      dst->cache6 = (struct networks6_cache_entry *) malloc(src->num6*sizeof(struct networks6_cache_entry));
+      if (!dst->cache6) return ERR;
+      dst->num6 = src->num6;
+    }
+  }
+  if (dst->cache6) memset(dst->cache6, 0, dst->num6*sizeof(struct networks6_cache_entry));
+  dst->default_route6 = src->default_route6;
+#endif
+
+  return SUCCESS;
+}
+
 void set_net_funcs(struct networks_table *nt)
 {
   u_int8_t count = 0;
@@ -899,7 +999,7 @@ void search_src_host(struct networks_table *nt, struct networks_cache *nc, struc
 	p->src_ip.address.ipv4.s_addr = 0;
     }
     else {
-      if (!res->net && !default_route_in_networks4_table) {
+      if (!res->net && !nc->default_route4) {
 	if (config.networks_file_filter)
 	  p->src_ip.address.ipv4.s_addr = 0; /* it may have been cached */
       }
@@ -913,7 +1013,7 @@ void search_src_host(struct networks_table *nt, struct networks_cache *nc, struc
 	memset(&p->src_ip.address.ipv6, 0, IP6AddrSz);
     }
     else {
-      if (!res6->net[0] && !default_route_in_networks6_table) {
+      if (!res6->net[0] && !nc->default_route6) {
 	if (config.networks_file_filter)
 	  memset(&p->src_ip.address.ipv6, 0, IP6AddrSz); /* it may have been cached */
       }
@@ -937,7 +1037,7 @@ void search_dst_host(struct networks_table *nt, struct networks_cache *nc, struc
 	p->dst_ip.address.ipv4.s_addr = 0;
     }
     else {
-      if (!res->net && !default_route_in_networks4_table) {
+      if (!res->net && !nc->default_route4) {
 	if (config.networks_file_filter) 
 	  p->dst_ip.address.ipv4.s_addr = 0; /* it may have been cached */
       }
@@ -951,7 +1051,7 @@ void search_dst_host(struct networks_table *nt, struct networks_cache *nc, struc
 	memset(&p->dst_ip.address.ipv6, 0, IP6AddrSz);
     }
     else {
-      if (!res6->net[0] && !default_route_in_networks6_table) {
+      if (!res6->net[0] && !nc->default_route6) {
 	if (config.networks_file_filter)
 	  memset(&p->dst_ip.address.ipv6, 0, IP6AddrSz); /* it may have been cached */
       }
@@ -1013,14 +1113,14 @@ void search_src_nmask(struct networks_table *nt, struct networks_cache *nc, stru
 
   if (nfd->family == AF_INET) {
     res = (struct networks_table_entry *) nfd->entry;
-    default_route_in_networks_table = default_route_in_networks4_table;
+    default_route_in_networks_table = nc->default_route4;
     if (!res) mask = 0;
     else mask = res->masknum;
   }
 #if defined ENABLE_IPV6
   else if (nfd->family == AF_INET6) {
     res6 = (struct networks6_table_entry *) nfd->entry;
-    default_route_in_networks_table = default_route_in_networks6_table;
+    default_route_in_networks_table = nc->default_route6;
     if (!res6) mask = 0;
     else mask = res6->masknum; 
   }
@@ -1055,14 +1155,14 @@ void search_dst_nmask(struct networks_table *nt, struct networks_cache *nc, stru
 
   if (nfd->family == AF_INET) {
     res = (struct networks_table_entry *) nfd->entry;
-    default_route_in_networks_table = default_route_in_networks4_table;
+    default_route_in_networks_table = nc->default_route4;
     if (!res) mask = 0;
     else mask = res->masknum;
   }
 #if defined ENABLE_IPV6
   else if (nfd->family == AF_INET6) {
     res6 = (struct networks6_table_entry *) nfd->entry;
-    default_route_in_networks_table = default_route_in_networks6_table;
+    default_route_in_networks_table = nc->default_route6;
     if (!res6) mask = 0;
     else mask = res6->masknum;
   }
@@ -1386,7 +1486,7 @@ as_t search_pretag_dst_as(struct networks_table *nt, struct networks_cache *nc,
 }
 
 #if defined ENABLE_IPV6
-void load_networks6(char *filename, struct networks_table *nt, struct networks_cache *nc)
+int load_networks6(char *filename, struct networks_table *nt, struct networks_cache *nc)
 {
   FILE *file;
   struct networks_table tmp, *tmpt = &tmp;
@@ -1398,14 +1498,16 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
   u_int32_t tmpmask[4], tmpnet[4];
   struct stat st;
 
-  /* dummy & broken on purpose */
-  memset(&dummy_entry6, 0, sizeof(struct networks6_table_entry));
-  dummy_entry6.masknum = 255;
+  /* dummy & broken on purpose; see load_networks4() */
+  if (dummy_entry6.masknum != 255) {
+    memset(&dummy_entry6, 0, sizeof(struct networks6_table_entry));
+    dummy_entry6.masknum = 255;
+  }
 
   memset(&bkt, 0, sizeof(bkt));
   memset(&tmp, 0, sizeof(tmp));
   memset(&st, 0, sizeof(st));
-  default_route_in_networks6_table = FALSE;
+  nc->default_route6 = FALSE;
 
   /* backing up pre-existing table and cache */
   if (nt->num6) {
@@ -1422,11 +1524,11 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
     if ((file = fopen(filename,"r")) == NULL) {
       if (!(config.nfacctd_net & NF_NET_KEEP && config.nfacctd_as & NF_AS_KEEP)) {
         Log(LOG_WARNING, "WARN: network file '%s' not found\n", filename);
-        return;
+        return ERR;
       }
 
       Log(LOG_ERR, "ERROR: network file '%s' not found\n", filename);
-      exit_plugin(1);
+      goto handle_error;
     }
     else {
       rows = 0;
@@ -1690,7 +1792,7 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
 	if (!nt->table6[index].mask[0] && !nt->table6[index].mask[1] &&
 	    !nt->table6[index].mask[2] && !nt->table6[index].mask[3])
 	  Log(LOG_DEBUG, "DEBUG ( %s ): [networks table IPv6] contains a default route\n", filename);
-	  default_route_in_networks6_table = TRUE;
+	  nc->default_route6 = TRUE;
         index++;
       }
 
@@ -1717,7 +1819,7 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
     }
   }
 
-  return;
+  return SUCCESS;
 
   /*
      error handling: if we have a copy of the old table we will rollback it;
@@ -1739,7 +1841,9 @@ void load_networks6(char *filename, struct networks_table *nt, struct networks_c
       nt->timestamp = st.st_mtime;
     }
   }
-  else exit_plugin(1);
+  else if (!nt->timestamp) exit_plugin(1);
+
+  return ERR;
 }
 
 /* sort the (sub)array v from start to end */
@@ -1930,3 +2034,373 @@ unsigned int networks_cache_hash6(void *key)
 }
 #endif
 
+
+int is_networks_map(char *filename)
+{
+  char magic[sizeof(NETWORKS_MAP_MAGIC)-1];
+  int fd, ret = FALSE;
+
+  if ((fd = open(filename, O_RDONLY)) == -1) return FALSE;
+  if (read(fd, magic, sizeof(magic)) == sizeof(magic) && !memcmp(magic, NETWORKS_MAP_MAGIC, sizeof(magic))) ret = TRUE;
+  close(fd);
+
+  return ret;
+}
+
+static u_int32_t networks_map_flags()
+{
+  u_int32_t flags = 0;
+
+#if defined ENABLE_IPV6
+  flags |= NETWORKS_MAP_F_IPV6;
+#endif
+#if defined ENABLE_PLABEL
+  flags |= NETWORKS_MAP_F_PLABEL;
+#endif
+
+  return flags;
+}
+
+static u_int64_t networks_map_align(u_int64_t len)
+{
+  return ((len + 7) & ~7);
+}
+
+static u_int32_t networks_map_count(struct networks_table_entry *table, u_int32_t num)
+{
+  u_int32_t index, total = num;
+
+  for (index = 0; index < num; index++) {
+    if (table[index].childs_table.table)
+      total += networks_map_count(table[index].childs_table.table, table[index].childs_table.num);
+  }
+
+  return total;
+}
+
+#if defined ENABLE_IPV6
+static u_int32_t networks_map_count6(struct networks6_table_entry *table, u_int32_t num)
+{
+  u_int32_t index, total = num;
+
+  for (index = 0; index < num; index++) {
+    if (table[index].childs_table.table6)
+      total += networks_map_count6(table[index].childs_table.table6, table[index].childs_table.num6);
+  }
+
+  return total;
+}
+#endif
+
+/*
+   Parses networks_file (text) with the regular loaders and dumps the
+   resulting tables to 'out'. The file is written aside and renamed in
+   place so that running daemons, which map it privately, never see a
+   partially written map.
+*/
+int compile_networks(char *filename, char *out)
+{
+  struct networks_table cnt;
+  struct networks_cache cnc;
+  struct networks_map_hdr hdr;
+  struct networks_table_entry *table;
+  u_char *payload = NULL;
+  u_int32_t index, len4 = 0, len6 = 0;
+  char tmpfile[SRVBUFLEN];
+  struct stat st;
+  FILE *file = NULL;
+#if defined ENABLE_IPV6
+  struct networks6_table_entry *table6;
+#endif
+
+  memset(&cnt, 0, sizeof(cnt));
+  memset(&cnc, 0, sizeof(cnc));
+  memset(&hdr, 0, sizeof(hdr));
+
+  if (!filename) {
+    Log(LOG_ERR, "ERROR: no networks_file to compile.\n");
+    return ERR;
+  }
+
+  if (stat(filename, &st)) {
+    Log(LOG_ERR, "ERROR ( %s ): unable to stat() networks_file: %s\n", filename, strerror(errno));
+    return ERR;
+  }
+
+  if (is_networks_map(filename)) {
+    Log(LOG_ERR, "ERROR ( %s ): networks_file is already compiled.\n", filename);
+    return ERR;
+  }
+
+  load_networks4(filename, &cnt, &cnc);
+#if defined ENABLE_IPV6
+  load_networks6(filename, &cnt, &cnc);
+#endif
+  if (!cnt.table) {
+    Log(LOG_ERR, "ERROR ( %s ): unable to load networks_file.\n", filename);
+    return ERR;
+  }
+
+  memcpy(hdr.magic, NETWORKS_MAP_MAGIC, sizeof(hdr.magic));
+  hdr.version = NETWORKS_MAP_VERSION;
+  hdr.flags = networks_map_flags();
+  hdr.hdr_len = networks_map_align(sizeof(struct networks_map_hdr));
+  hdr.entry_len = sizeof(struct networks_table_entry);
+  hdr.num = cnt.num;
+  hdr.total = networks_map_count(cnt.table, cnt.num);
+  if (cnc.default_route4) hdr.default_route |= NETWORKS_MAP_DEFAULT_ROUTE4;
+  len4 = networks_map_align(hdr.total*hdr.entry_len);
+#if defined ENABLE_IPV6
+  hdr.entry6_len = sizeof(struct networks6_table_entry);
+  if (cnt.table6) {
+    hdr.num6 = cnt.num6;
+    hdr.total6 = networks_map_count6(cnt.table6, cnt.num6);
+  }
+  if (cnc.default_route6) hdr.default_route |= NETWORKS_MAP_DEFAULT_ROUTE6;
+  len6 = networks_map_align(hdr.total6*hdr.entry6_len);
+#endif
+  hdr.src_mtime = st.st_mtime;
+  hdr.src_size = st.st_size;
+
+  payload = malloc(len4+len6);
+  if (!payload) {
+    Log(LOG_ERR, "ERROR ( %s ): malloc() failed while compiling networks_file.\n", filename);
+    goto exit_lane;
+  }
+  memset(payload, 0, len4+len6);
+
+  table = (struct networks_table_entry *) payload;
+  memcpy(table, cnt.table, hdr.total*hdr.entry_len);
+  for (index = 0; index < hdr.total; index++) {
+    if (table[index].childs_table.table)
+      table[index].childs_table.table = (struct networks_table_entry *) (table[index].childs_table.table - cnt.table + 1);
+  }
+
+#if defined ENABLE_IPV6
+  if (hdr.total6) {
+    table6 = (struct networks6_table_entry *) (payload+len4);
+    memcpy(table6, cnt.table6, hdr.total6*hdr.entry6_len);
+    for (index = 0; index < hdr.total6; index++) {
+      if (table6[index].childs_table.table6)
+        table6[index].childs_table.table6 = (struct networks6_table_entry *) (table6[index].childs_table.table6 - cnt.table6 + 1);
+    }
+  }
+#endif
+
+  hdr.checksum = jhash2((u_int32_t *) payload, (len4+len6)/4, NETWORKS_MAP_VERSION);
+
+  snprintf(tmpfile, sizeof(tmpfile), "%s.%u", out, getpid());
+  if ((file = fopen(tmpfile, "w")) == NULL) {
+    Log(LOG_ERR, "ERROR ( %s ): unable to open '%s': %s\n", filename, tmpfile, strerror(errno));
+    goto exit_lane;
+  }
+
+  if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 || fseek(file, hdr.hdr_len, SEEK_SET) ||
+      fwrite(payload, 1, len4+len6, file) != (len4+len6)) {
+    Log(LOG_ERR, "ERROR ( %s ): unable to write '%s': %s\n", filename, tmpfile, strerror(errno));
+    fclose(file);
+    unlink(tmpfile);
+    goto exit_lane;
+  }
+
+  if (fclose(file) || rename(tmpfile, out)) {
+    Log(LOG_ERR, "ERROR ( %s ): unable to write '%s': %s\n", filename, out, strerror(errno));
+    unlink(tmpfile);
+    goto exit_lane;
+  }
+
+  Log(LOG_INFO, "INFO ( %s ): compiled into '%s' (IPv4 entries: %u, IPv6 entries: %u).\n", filename, out, hdr.total, hdr.total6);
+
+  free(payload);
+  free(cnt.table);
+  free(cnc.cache);
+#if defined ENABLE_IPV6
+  if (cnt.table6) free(cnt.table6);
+  if (cnc.cache6) free(cnc.cache6);
+#endif
+
+  return SUCCESS;
+
+  exit_lane:
+  if (payload) free(payload);
+  free(cnt.table);
+  free(cnc.cache);
+#if defined ENABLE_IPV6
+  if (cnt.table6) free(cnt.table6);
+  if (cnc.cache6) free(cnc.cache6);
+#endif
+
+  return ERR;
+}
+
+/*
+   Maps a compiled networks_file privately: only pages holding entries
+   which have childs get written (by the relocation below) and hence
+   copied; the rest is shared via the page cache among all processes
+   mapping the same file.
+*/
+int load_networks_map(char *filename, struct networks_table *nt, struct networks_cache *nc)
+{
+  struct networks_map_hdr *hdr;
+  struct networks_table_entry *table;
+  struct stat st;
+  u_char *base = MAP_FAILED;
+  u_int64_t len4, len6 = 0;
+  u_int32_t index, child;
+  int fd, slot, mapped;
+#if defined ENABLE_IPV6
+  struct networks6_table_entry *table6 = NULL;
+#endif
+
+  if (dummy_entry.masknum != 255) {
+    memset(&dummy_entry, 0, sizeof(struct networks_table_entry));
+    dummy_entry.masknum = 255;
+  }
+#if defined ENABLE_IPV6
+  if (dummy_entry6.masknum != 255) {
+    memset(&dummy_entry6, 0, sizeof(struct networks6_table_entry));
+    dummy_entry6.masknum = 255;
+  }
+#endif
+  memset(&st, 0, sizeof(st));
+
+  for (slot = 0; slot < NETWORKS_MAP_SLOTS && networks_maps[slot].base; slot++);
+  if (slot == NETWORKS_MAP_SLOTS) {
+    Log(LOG_ERR, "ERROR ( %s ): too many compiled networks_file mapped.\n", filename);
+    goto handle_error;
+  }
+
+  if ((fd = open(filename, O_RDONLY)) == -1) {
+    Log(LOG_ERR, "ERROR ( %s ): unable to open compiled networks_file: %s\n", filename, strerror(errno));
+    goto handle_error;
+  }
+
+  if (fstat(fd, &st) || st.st_size < sizeof(struct networks_map_hdr)) {
+    Log(LOG_ERR, "ERROR ( %s ): compiled networks_file is truncated.\n", filename);
+    close(fd);
+    goto handle_error;
+  }
+
+  base = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    Log(LOG_ERR, "ERROR ( %s ): mmap() failed: %s\n", filename, strerror(errno));
+    goto handle_error;
+  }
+
+  hdr = (struct networks_map_hdr *) base;
+  if (hdr->version != NETWORKS_MAP_VERSION || hdr->flags != networks_map_flags() ||
+      hdr->hdr_len != networks_map_align(sizeof(struct networks_map_hdr)) ||
+      hdr->entry_len != sizeof(struct networks_table_entry)
+#if defined ENABLE_IPV6
+      || hdr->entry6_len != sizeof(struct networks6_table_entry)
+#endif
+      ) {
+    Log(LOG_ERR, "ERROR ( %s ): compiled networks_file version or build options mismatch; please re-compile it.\n", filename);
+    goto handle_error;
+  }
+
+  len4 = networks_map_align((u_int64_t) hdr->total*hdr->entry_len);
+#if defined ENABLE_IPV6
+  len6 = networks_map_align((u_int64_t) hdr->total6*hdr->entry6_len);
+#endif
+  if (!hdr->total || hdr->num > hdr->total || hdr->num6 > hdr->total6 ||
+      st.st_size != (off_t) hdr->hdr_len+len4+len6) {
+    Log(LOG_ERR, "ERROR ( %s ): compiled networks_file is inconsistent.\n", filename);
+    goto handle_error;
+  }
+
+  if (jhash2((u_int32_t *) (base+hdr->hdr_len), (len4+len6)/4, NETWORKS_MAP_VERSION) != hdr->checksum) {
+    Log(LOG_ERR, "ERROR ( %s ): compiled networks_file checksum mismatch.\n", filename);
+    goto handle_error;
+  }
+
+  table = (struct networks_table_entry *) (base+hdr->hdr_len);
+  for (index = 0; index < hdr->total; index++) {
+    if ((child = (u_int32_t) (u_long) table[index].childs_table.table)) {
+      if ((u_int64_t) child+table[index].childs_table.num > (u_int64_t) hdr->total+1) {
+        Log(LOG_ERR, "ERROR ( %s ): compiled networks_file is inconsistent.\n", filename);
+        goto handle_error;
+      }
+      table[index].childs_table.table = &table[child-1];
+    }
+  }
+
+#if defined ENABLE_IPV6
+  if (hdr->total6) {
+    table6 = (struct networks6_table_entry *) (base+hdr->hdr_len+len4);
+    for (index = 0; index < hdr->total6; index++) {
+      if ((child = (u_int32_t) (u_long) table6[index].childs_table.table6)) {
+        if ((u_int64_t) child+table6[index].childs_table.num6 > (u_int64_t) hdr->total6+1) {
+          Log(LOG_ERR, "ERROR ( %s ): compiled networks_file is inconsistent.\n", filename);
+          goto handle_error;
+        }
+        table6[index].childs_table.table6 = &table6[child-1];
+      }
+    }
+  }
+#endif
+
+  /* create networks cache BUT only for the first time */
+  if (!nc->cache) {
+    if (!config.networks_cache_entries) nc->num = NETWORKS_CACHE_ENTRIES;
+    else nc->num = config.networks_cache_entries;
+    nc->cache = (struct networks_cache_entry *) malloc(nc->num*sizeof(struct networks_cache_entry));
+    if (!nc->cache) {
+      Log(LOG_ERR, "ERROR: malloc() failed while building Networks Cache.\n");
+      goto handle_error;
+    }
+  }
+#if defined ENABLE_IPV6
+  if (!nc->cache6) {
+    if (!config.networks_cache_entries) nc->num6 = NETWORKS6_CACHE_ENTRIES;
+    else nc->num6 = config.networks_cache_entries;
+    nc->cache6 = (struct networks6_cache_entry *) malloc(nc->num6*sizeof(struct networks6_cache_entry));
+    if (!nc->cache6) {
+      Log(LOG_ERR, "ERROR: malloc() failed while building Networks Cache.\n");
+      goto handle_error;
+    }
+  }
+#endif
+
+  /* swapping tables: the old ones are either mapped or malloc()'ed */
+  if ((mapped = networks_map_find(nt->table)) != ERR) networks_map_release(mapped);
+  else {
+    if (nt->table) free(nt->table);
+#if defined ENABLE_IPV6
+    if (nt->table6) free(nt->table6);
+#endif
+  }
+
+  networks_maps[slot].base = base;
+  networks_maps[slot].len = st.st_size;
+
+  nt->table = table;
+  nt->num = hdr->num;
+  nc->default_route4 = (hdr->default_route & NETWORKS_MAP_DEFAULT_ROUTE4) ? TRUE : FALSE;
+  memset(nc->cache, 0, nc->num*sizeof(struct networks_cache_entry));
+#if defined ENABLE_IPV6
+  nt->table6 = table6;
+  nt->num6 = hdr->num6;
+  nc->default_route6 = (hdr->default_route & NETWORKS_MAP_DEFAULT_ROUTE6) ? TRUE : FALSE;
+  memset(nc->cache6, 0, nc->num6*sizeof(struct networks6_cache_entry));
+#endif
+  nt->timestamp = st.st_mtime;
+
+  Log(LOG_DEBUG, "DEBUG ( %s ): compiled networks_file loaded (IPv4 entries: %u, IPv6 entries: %u).\n", filename, hdr->total, hdr->total6);
+
+  return SUCCESS;
+
+  handle_error:
+  if (base != MAP_FAILED) munmap(base, st.st_size);
+
+  if (nt->table) {
+    Log(LOG_WARNING, "WARN: Rolling back the old Networks Table.\n");
+
+    /* we update the timestamp to avoid loops */
+    nt->timestamp = st.st_mtime;
+  }
+  else if (!nt->timestamp) exit_plugin(1);
+
+  return ERR;
+}
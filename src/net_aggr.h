@@ -26,6 +26,15 @@
 #define RETURN_AS 1
 #define NET_FUNCS_N 32
 
+/* compiled (mmap-able) networks_file */
+#define NETWORKS_MAP_MAGIC "PMNETMAP"
+#define NETWORKS_MAP_VERSION 1
+#define NETWORKS_MAP_F_IPV6 0x00000001
+#define NETWORKS_MAP_F_PLABEL 0x00000002
+#define NETWORKS_MAP_DEFAULT_ROUTE4 0x01
+#define NETWORKS_MAP_DEFAULT_ROUTE6 0x02
+#define NETWORKS_MAP_SLOTS 4
+
 /* structures */
 struct networks_cache_entry {
   u_int32_t key;
@@ -35,9 +44,11 @@ struct networks_cache_entry {
 struct networks_cache {
   struct networks_cache_entry *cache;
   unsigned int num;
+  u_int8_t default_route4;
 #if defined ENABLE_IPV6
   struct networks6_cache_entry *cache6;
   unsigned int num6;
+  u_int8_t default_route6;
 #endif
 };
 
@@ -97,6 +108,32 @@ struct networks_file_data {
   u_char *entry;
 };
 
+/*
+   Header of a compiled networks_file: it is followed by the IPv4 table and
+   then by the IPv6 one, both in their final hierarchical layout and 8 bytes
+   aligned; child table pointers are stored as (index + 1) into their own
+   table and relocated at load time. Tables are only meaningful to a build
+   with the same flags and entry sizes; checksum is jhash2() over everything
+   past the header.
+*/
+struct networks_map_hdr {
+  char magic[8];
+  u_int32_t version;
+  u_int32_t flags;
+  u_int32_t hdr_len;
+  u_int32_t entry_len;
+  u_int32_t entry6_len;
+  u_int32_t num;
+  u_int32_t total;
+  u_int32_t num6;
+  u_int32_t total6;
+  u_int32_t default_route;
+  u_int64_t src_mtime;
+  u_int64_t src_size;
+  u_int32_t checksum;
+  u_int32_t pad;
+};
+
 typedef void (*net_func) (struct networks_table *, struct networks_cache *, struct pkt_primitives *, struct pkt_bgp_primitives *, struct networks_file_data *);
 
 /* prototypes */
@@ -138,16 +175,20 @@ EXT void clear_dst_nmask(struct networks_table *, struct networks_cache *, struc
 EXT as_t search_pretag_src_as(struct networks_table *, struct networks_cache *, struct packet_ptrs *);
 EXT as_t search_pretag_dst_as(struct networks_table *, struct networks_cache *, struct packet_ptrs *);
 
-EXT void load_networks(char *, struct networks_table *, struct networks_cache *); /* wrapper */ 
-EXT void load_networks4(char *, struct networks_table *, struct networks_cache *); 
+EXT int load_networks(char *, struct networks_table *, struct networks_cache *); /* wrapper */ 
+EXT int load_networks4(char *, struct networks_table *, struct networks_cache *); 
+EXT int is_networks_map(char *);
+EXT int load_networks_map(char *, struct networks_table *, struct networks_cache *);
+EXT int compile_networks(char *, char *);
 EXT void merge_sort(char *, struct networks_table_entry *, int, int);
 EXT void merge(char *, struct networks_table_entry *, int, int, int);
 EXT struct networks_table_entry *binsearch(struct networks_table *, struct networks_cache *, struct host_addr *);
 EXT void networks_cache_insert(struct networks_cache *, u_int32_t *, struct networks_table_entry *);
 EXT struct networks_table_entry *networks_cache_search(struct networks_cache *, u_int32_t *);
+EXT int networks_cache_clone(struct networks_cache *, struct networks_cache *);
 
 #if defined ENABLE_IPV6
-EXT void load_networks6(char *, struct networks_table *, struct networks_cache *); 
+EXT int load_networks6(char *, struct networks_table *, struct networks_cache *); 
 EXT void merge_sort6(char *, struct networks6_table_entry *, int, int);
 EXT void merge6(char *, struct networks6_table_entry *, int, int, int);
 EXT struct networks6_table_entry *binsearch6(struct networks_table *, struct networks_cache *, struct host_addr *);
@@ -164,12 +205,10 @@ EXT unsigned int networks_cache_hash6(void *);
 #define EXT
 #endif
 EXT struct networks_table nt;
-EXT struct networks_cache nc;
+EXT ThreadLocal struct networks_cache nc;
 EXT struct networks_table_entry dummy_entry;
-EXT int default_route_in_networks4_table;
 
 #if defined ENABLE_IPV6
 EXT struct networks6_table_entry dummy_entry6;
-EXT int default_route_in_networks6_table;
 #endif
 #undef EXT
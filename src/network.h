@@ -309,6 +309,7 @@ struct packet_ptrs {
   u_char *f_tpl; /* ptr to NetFlow V9 template */
   u_char *f_status; /* ptr to status table entry */
   u_char *f_status_g; /* ptr to status table entry. global per f_agent */
+  u_char *f_cols; /* ptr to NetFlow v5 columns decoded per packet, if any */
   u_char *bpas_table; /* ptr to bgp_peer_as_src table map */
   u_char *blp_table; /* ptr to bgp_src_local_pref table map */
   u_char *bmed_table; /* ptr to bgp_src_med table map */
@@ -327,6 +328,7 @@ struct packet_ptrs {
   u_int8_t have_tag2; /* have tag2? */
   pt_label_t label; /* pre tag label */
   u_int8_t have_label; /* have label? */
+  u_int64_t pretag_last_matched; /* pretag map: key matched last for the entry being evaluated */
   pm_id_t bpas; /* bgp_peer_as_src */
   pm_id_t blp; /* bgp_src_local_pref */
   pm_id_t bmed; /* bgp_src_med */
@@ -486,7 +488,11 @@ struct pkt_extras {
 // #define PKT_MSG_SIZE 1550
 #define PKT_MSG_SIZE 10000
 struct pkt_msg {
+#if defined ENABLE_IPV6
+  struct sockaddr_storage agent;
+#else
   struct sockaddr agent;
+#endif
   u_int32_t seqno;
   u_int16_t len;
   u_char payload[PKT_MSG_SIZE];
@@ -34,6 +34,16 @@
 #include "net_aggr.h"
 #include "bgp/bgp_packet.h"
 #include "bgp/bgp.h"
+#if defined ENABLE_THREADS
+#include "thread_pool.h"
+#include <sys/poll.h>
+#endif
+/* SSSE3 v5 decoding is built in regardless of -march and picked at runtime */
+#if (defined __x86_64__ || defined __i386__) && \
+    (defined __clang__ || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define NFV5_COLUMNS_SSSE3
+#include <tmmintrin.h>
+#endif
 
 /* variables to be exported away */
 int debug;
@@ -42,6 +52,11 @@ struct plugins_list_entry *plugins_list = NULL; /* linked list of each plugin co
 struct channels_list_entry channels_list[MAX_N_PLUGINS]; /* communication channels: core <-> plugins */
 int have_num_memory_pools; /* global getopt() stuff */
 pid_t failed_plugins[MAX_N_PLUGINS]; /* plugins failed during startup phase */
+#if defined ENABLE_THREADS
+/* set by workers_signal_handler() */
+static volatile sig_atomic_t workers_stop_signal, workers_stats_signal;
+static int workers_signal_pipe[2];
+#endif
 
 /* Functions */
 void usage_daemon(char *prog_name)
@@ -60,8 +75,9 @@ void usage_daemon(char *prog_name)
   printf("  -c  \tAggregation method, see full list of primitives with -a (DEFAULT: src_host)\n");
   printf("  -D  \tDaemonize\n"); 
   printf("  -n  \tPath to a file containing Network definitions\n");
+  printf("  -C  \tCompile the Network definitions file into the specified binary map and exit\n");
   printf("  -o  \tPath to a file containing Port definitions\n");
-  printf("  -P  \t[ memory | print | mysql | pgsql | sqlite3 | mongodb | tee ] \n\tActivate plugin\n"); 
+  printf("  -P  \t[ memory | print | null | mysql | pgsql | sqlite3 | mongodb | tee ] \n\tActivate plugin\n"); 
   printf("  -d  \tEnable debug\n");
   printf("  -S  \t[ auth | mail | daemon | kern | user | local[0-7] ] \n\tLog to the specified syslog facility\n");
   printf("  -F  \tWrite Core Process PID into the specified file\n");
@@ -91,8 +107,9 @@ int main(int argc,char **argv, char **envp)
   struct plugin_requests req;
   struct packet_ptrs_vector pptrs;
   char config_file[SRVBUFLEN];
-  unsigned char netflow_packet[NETFLOW_MSG_SIZE];
-  int logf, rc, yes=1, no=0, allowed;
+  char *networks_map_out = NULL;
+  unsigned char netflow_packet_buf[NETFLOW_MSG_SIZE], *netflow_packet = netflow_packet_buf;
+  int logf, rc, yes=1, no=0, allowed, recv_flags = 0;
   struct host_addr addr;
   struct hosts_table allow;
   struct id_table bpas_table;
@@ -114,25 +131,7 @@ int main(int argc,char **argv, char **envp)
   int clen = sizeof(client), slen;
   struct ip_mreq multi_req4;
 
-  unsigned char dummy_packet[64]; 
-  unsigned char dummy_packet_vlan[64]; 
-  unsigned char dummy_packet_mpls[128]; 
-  unsigned char dummy_packet_vlan_mpls[128]; 
-  struct pcap_pkthdr dummy_pkthdr;
-  struct pcap_pkthdr dummy_pkthdr_vlan;
-  struct pcap_pkthdr dummy_pkthdr_mpls;
-  struct pcap_pkthdr dummy_pkthdr_vlan_mpls;
-
-#if defined ENABLE_IPV6
-  unsigned char dummy_packet6[92]; 
-  unsigned char dummy_packet_vlan6[92]; 
-  unsigned char dummy_packet_mpls6[128]; 
-  unsigned char dummy_packet_vlan_mpls6[128]; 
-  struct pcap_pkthdr dummy_pkthdr6;
-  struct pcap_pkthdr dummy_pkthdr_vlan6;
-  struct pcap_pkthdr dummy_pkthdr_mpls6;
-  struct pcap_pkthdr dummy_pkthdr_vlan_mpls6;
-#endif
+  struct nf_dummy_packets dummy;
 
   /* getopt() stuff */
   extern char *optarg;
@@ -296,6 +295,9 @@ int main(int argc,char **argv, char **envp)
       usage_daemon(argv[0]);
       exit(0);
       break;
+    case 'C':
+      networks_map_out = optarg;
+      break;
     case 'V':
       version_daemon(NFACCTD_USAGE_HEADER);
       exit(0);
@@ -337,6 +339,8 @@ int main(int argc,char **argv, char **envp)
 
   if (config.files_umask) umask(config.files_umask);
 
+  if (networks_map_out) exit(compile_networks(config.networks_file, networks_map_out) == SUCCESS ? 0 : 1);
+
   if (config.daemon) {
     list = plugins_list;
     while (list) {
@@ -377,6 +381,10 @@ int main(int argc,char **argv, char **envp)
     else Log(LOG_INFO, "INFO ( %s/core ): proc_priority set to %d\n", config.name, getpriority(PRIO_PROCESS, 0));
   }
 
+  /* inherited by threads; plugins reset what they don't define on their own */
+  set_placement(config.name, "core", "process", config.plugin_numa_node, config.proc_cpu_affinity, ERR,
+		config.proc_sched_policy, config.proc_sched_priority);
+
   if (strlen(config_file)) {
     char canonical_path[PATH_MAX], *canonical_path_ptr;
 
@@ -450,8 +458,8 @@ int main(int argc,char **argv, char **envp)
 	    Log(LOG_ERR, "ERROR ( %s/%s ): AS aggregation selected but NO 'networks_file' specified. Exiting...\n\n", list->name, list->type.string);
 	    exit(1);
 	  }
-          if (!list->cfg.nfacctd_bgp && list->cfg.nfacctd_as == NF_AS_BGP) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): AS aggregation selected but 'bgp_daemon' is not enabled. Exiting...\n\n", list->name, list->type.string);
+          if (!list->cfg.nfacctd_bgp && !list->cfg.nfacctd_bmp && list->cfg.nfacctd_as == NF_AS_BGP) {
+            Log(LOG_ERR, "ERROR ( %s/%s ): AS aggregation selected but neither 'bgp_daemon' nor 'bmp_daemon' is enabled. Exiting...\n\n", list->name, list->type.string);
             exit(1);
 	  }
           if (list->cfg.nfacctd_as & NF_AS_FALLBACK && list->cfg.networks_file)
@@ -466,7 +474,7 @@ int main(int argc,char **argv, char **envp)
 	  else {
 	    if ((list->cfg.nfacctd_net == NF_NET_NEW && !list->cfg.networks_file) || 
 	        (list->cfg.nfacctd_net == NF_NET_STATIC && !list->cfg.networks_mask) || 
-	        (list->cfg.nfacctd_net == NF_NET_BGP && !list->cfg.nfacctd_bgp) ||
+	        (list->cfg.nfacctd_net == NF_NET_BGP && !list->cfg.nfacctd_bgp && !list->cfg.nfacctd_bmp) ||
 	        (list->cfg.nfacctd_net == NF_NET_IGP && !list->cfg.nfacctd_isis)) {
 	      Log(LOG_ERR, "ERROR ( %s/%s ): network aggregation selected but none of 'bgp_daemon', 'isis_daemon', 'networks_file', 'networks_mask' is specified. Exiting ...\n\n", list->name, list->type.string);
 	      exit(1);
@@ -603,15 +611,15 @@ int main(int argc,char **argv, char **envp)
 
   if (config.sampling_map) {
     load_id_file(MAP_SAMPLING, config.sampling_map, &sampling_table, &req, &sampling_map_allocated);
-    set_sampling_table(&pptrs, (u_char *) &sampling_table);
+    packet_tables.sampling_table = (u_char *) &sampling_table;
   }
-  else set_sampling_table(&pptrs, NULL);
+  else packet_tables.sampling_table = NULL;
 
   if (config.nfacctd_flow_to_rd_map) {
     load_id_file(MAP_FLOW_TO_RD, config.nfacctd_flow_to_rd_map, &bitr_table, &req, &bitr_map_allocated);
-    pptrs.v4.bitr_table = (u_char *) &bitr_table;
+    packet_tables.bitr_table = (u_char *) &bitr_table;
   }
-  else pptrs.v4.bitr_table = NULL;
+  else packet_tables.bitr_table = NULL;
 
   if (config.aggregate_primitives) {
     req.key_value_table = (void *) &custom_primitives_registry;
@@ -646,44 +654,44 @@ int main(int argc,char **argv, char **envp)
     if (config.nfacctd_bgp_peer_as_src_type == BGP_SRC_PRIMITIVES_MAP) {
       if (config.nfacctd_bgp_peer_as_src_map) {
         load_id_file(MAP_BGP_PEER_AS_SRC, config.nfacctd_bgp_peer_as_src_map, &bpas_table, &req, &bpas_map_allocated);
-        pptrs.v4.bpas_table = (u_char *) &bpas_table;
+        packet_tables.bpas_table = (u_char *) &bpas_table;
       }
       else {
 	Log(LOG_ERR, "ERROR: bgp_peer_as_src_type set to 'map' but no map defined. Exiting.\n");
 	exit(1);
       }
     }
-    else pptrs.v4.bpas_table = NULL;
+    else packet_tables.bpas_table = NULL;
 
     if (config.nfacctd_bgp_src_local_pref_type == BGP_SRC_PRIMITIVES_MAP) {
       if (config.nfacctd_bgp_src_local_pref_map) {
         load_id_file(MAP_BGP_SRC_LOCAL_PREF, config.nfacctd_bgp_src_local_pref_map, &blp_table, &req, &blp_map_allocated);
-        pptrs.v4.blp_table = (u_char *) &blp_table;
+        packet_tables.blp_table = (u_char *) &blp_table;
       }
       else {
 	Log(LOG_ERR, "ERROR: bgp_src_local_pref_type set to 'map' but no map defined. Exiting.\n");
 	exit(1);
       }
     }
-    else pptrs.v4.blp_table = NULL;
+    else packet_tables.blp_table = NULL;
 
     if (config.nfacctd_bgp_src_med_type == BGP_SRC_PRIMITIVES_MAP) {
       if (config.nfacctd_bgp_src_med_map) {
         load_id_file(MAP_BGP_SRC_MED, config.nfacctd_bgp_src_med_map, &bmed_table, &req, &bmed_map_allocated);
-        pptrs.v4.bmed_table = (u_char *) &bmed_table;
+        packet_tables.bmed_table = (u_char *) &bmed_table;
       }
       else {
 	Log(LOG_ERR, "ERROR: bgp_src_med_type set to 'map' but no map defined. Exiting.\n");
 	exit(1);
       }
     }
-    else pptrs.v4.bmed_table = NULL;
+    else packet_tables.bmed_table = NULL;
 
     if (config.nfacctd_bgp_to_agent_map) {
       load_id_file(MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, &req, &bta_map_allocated);
-      pptrs.v4.bta_table = (u_char *) &bta_table;
+      packet_tables.bta_table = (u_char *) &bta_table;
     }
-    else pptrs.v4.bta_table = NULL;
+    else packet_tables.bta_table = NULL;
 
     nfacctd_bgp_wrapper();
 
@@ -715,6 +723,11 @@ int main(int argc,char **argv, char **envp)
     Log(LOG_ERR, "ERROR ( %s/core ): 'bmp_daemon' is available only with threads (--enable-threads). Exiting.\n", config.name);
     exit(1);
   }
+
+  if (config.nfacctd_workers) {
+    Log(LOG_ERR, "ERROR ( %s/core ): 'nfacctd_workers' is available only with threads (--enable-threads). Exiting.\n", config.name);
+    exit(1);
+  }
 #endif
 
 #if defined WITH_GEOIP
@@ -747,6 +760,32 @@ int main(int argc,char **argv, char **envp)
   if (config.pidfile) write_pid_file(config.pidfile);
   load_networks(config.networks_file, &nt, &nc);
 
+  /* maps are reloaded in background; to be started after plugins are forked */
+  if (config.maps_refresh) {
+    if (config.nfacctd_bgp && config.nfacctd_bgp_peer_as_src_map)
+      map_reload_add(MAP_BGP_PEER_AS_SRC, config.nfacctd_bgp_peer_as_src_map, &bpas_table, FALSE, FALSE);
+    if (config.nfacctd_bgp && config.nfacctd_bgp_src_local_pref_map)
+      map_reload_add(MAP_BGP_SRC_LOCAL_PREF, config.nfacctd_bgp_src_local_pref_map, &blp_table, FALSE, FALSE);
+    if (config.nfacctd_bgp && config.nfacctd_bgp_src_med_map)
+      map_reload_add(MAP_BGP_SRC_MED, config.nfacctd_bgp_src_med_map, &bmed_table, FALSE, FALSE);
+    if (config.nfacctd_bgp && config.nfacctd_bgp_to_agent_map)
+      map_reload_add(MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, FALSE, FALSE);
+    if (config.nfacctd_flow_to_rd_map)
+      map_reload_add(MAP_FLOW_TO_RD, config.nfacctd_flow_to_rd_map, &bitr_table, FALSE, FALSE);
+    if (config.sampling_map)
+      map_reload_add(MAP_SAMPLING, config.sampling_map, &sampling_table, FALSE, FALSE);
+
+    for (idx = 0; channels_list[idx].aggregation || channels_list[idx].aggregation_2; idx++) {
+      struct plugins_list_entry *p = channels_list[idx].plugin;
+
+      if (p->cfg.pre_tag_map && find_id_func)
+	map_reload_add(config.acct_type, p->cfg.pre_tag_map, &p->cfg.ptm, p->cfg.maps_entries, p->cfg.maps_row_len);
+    }
+
+    map_reload_add_networks(config.networks_file);
+    map_reload_init();
+  }
+
   /* signals to be handled only by pmacctd;
      we set proper handlers after plugin creation */
   signal(SIGINT, my_sigint_handler);
@@ -755,129 +794,13 @@ int main(int argc,char **argv, char **envp)
   kill(getpid(), SIGCHLD);
 
   /* initializing template cache */ 
-  memset(&tpl_cache, 0, sizeof(tpl_cache));
-  tpl_cache.num = TEMPLATE_CACHE_ENTRIES;
+  init_template_cache();
 
   /* arranging static pointers to dummy packet; to speed up things into the
      main loop we mantain two packet_ptrs structures when IPv6 is enabled:
      we will sync here 'pptrs6' for common tables and pointers */
-  memset(dummy_packet, 0, sizeof(dummy_packet));
-  pptrs.v4.f_agent = (u_char *) &client;
-  pptrs.v4.packet_ptr = dummy_packet;
-  pptrs.v4.pkthdr = &dummy_pkthdr;
-  Assign16(((struct eth_header *)pptrs.v4.packet_ptr)->ether_type, htons(ETHERTYPE_IP)); /* 0x800 */
-  pptrs.v4.mac_ptr = (u_char *)((struct eth_header *)pptrs.v4.packet_ptr)->ether_dhost; 
-  pptrs.v4.iph_ptr = pptrs.v4.packet_ptr + ETHER_HDRLEN; 
-  pptrs.v4.tlh_ptr = pptrs.v4.packet_ptr + ETHER_HDRLEN + sizeof(struct my_iphdr); 
-  Assign8(((struct my_iphdr *)pptrs.v4.iph_ptr)->ip_vhl, 5);
-  // pptrs.v4.pkthdr->caplen = 38; /* eth_header + my_iphdr + my_tlhdr */
-  pptrs.v4.pkthdr->caplen = 55; 
-  pptrs.v4.pkthdr->len = 100; /* fake len */ 
-  pptrs.v4.l3_proto = ETHERTYPE_IP;
-
-  memset(dummy_packet_vlan, 0, sizeof(dummy_packet_vlan));
-  pptrs.vlan4.f_agent = (u_char *) &client;
-  pptrs.vlan4.packet_ptr = dummy_packet_vlan;
-  pptrs.vlan4.pkthdr = &dummy_pkthdr_vlan;
-  Assign16(((struct eth_header *)pptrs.vlan4.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
-  pptrs.vlan4.mac_ptr = (u_char *)((struct eth_header *)pptrs.vlan4.packet_ptr)->ether_dhost;
-  pptrs.vlan4.vlan_ptr = pptrs.vlan4.packet_ptr + ETHER_HDRLEN;
-  Assign16(*(pptrs.vlan4.vlan_ptr+2), htons(ETHERTYPE_IP));
-  pptrs.vlan4.iph_ptr = pptrs.vlan4.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
-  pptrs.vlan4.tlh_ptr = pptrs.vlan4.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN + sizeof(struct my_iphdr);
-  Assign8(((struct my_iphdr *)pptrs.vlan4.iph_ptr)->ip_vhl, 5);
-  // pptrs.vlan4.pkthdr->caplen = 42; /* eth_header + vlan + my_iphdr + my_tlhdr */
-  pptrs.vlan4.pkthdr->caplen = 59;
-  pptrs.vlan4.pkthdr->len = 100; /* fake len */
-  pptrs.vlan4.l3_proto = ETHERTYPE_IP;
-
-  memset(dummy_packet_mpls, 0, sizeof(dummy_packet_mpls));
-  pptrs.mpls4.f_agent = (u_char *) &client;
-  pptrs.mpls4.packet_ptr = dummy_packet_mpls;
-  pptrs.mpls4.pkthdr = &dummy_pkthdr_mpls;
-  Assign16(((struct eth_header *)pptrs.mpls4.packet_ptr)->ether_type, htons(ETHERTYPE_MPLS));
-  pptrs.mpls4.mac_ptr = (u_char *)((struct eth_header *)pptrs.mpls4.packet_ptr)->ether_dhost;
-  pptrs.mpls4.mpls_ptr = pptrs.mpls4.packet_ptr + ETHER_HDRLEN;
-  // pptrs.mpls4.pkthdr->caplen = 78; /* eth_header + upto 10 MPLS labels + my_iphdr + my_tlhdr */
-  pptrs.mpls4.pkthdr->caplen = 95; 
-  pptrs.mpls4.pkthdr->len = 100; /* fake len */
-  pptrs.mpls4.l3_proto = ETHERTYPE_IP;
-
-  memset(dummy_packet_vlan_mpls, 0, sizeof(dummy_packet_vlan_mpls));
-  pptrs.vlanmpls4.f_agent = (u_char *) &client;
-  pptrs.vlanmpls4.packet_ptr = dummy_packet_vlan_mpls;
-  pptrs.vlanmpls4.pkthdr = &dummy_pkthdr_vlan_mpls;
-  Assign16(((struct eth_header *)pptrs.vlanmpls4.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
-  pptrs.vlanmpls4.mac_ptr = (u_char *)((struct eth_header *)pptrs.vlanmpls4.packet_ptr)->ether_dhost;
-  pptrs.vlanmpls4.vlan_ptr = pptrs.vlanmpls4.packet_ptr + ETHER_HDRLEN;
-  Assign16(*(pptrs.vlanmpls4.vlan_ptr+2), htons(ETHERTYPE_MPLS));
-  pptrs.vlanmpls4.mpls_ptr = pptrs.vlanmpls4.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
-  // pptrs.vlanmpls4.pkthdr->caplen = 82; /* eth_header + vlan + upto 10 MPLS labels + my_iphdr + my_tlhdr */
-  pptrs.vlanmpls4.pkthdr->caplen = 99; 
-  pptrs.vlanmpls4.pkthdr->len = 100; /* fake len */
-  pptrs.vlanmpls4.l3_proto = ETHERTYPE_IP;
-
-#if defined ENABLE_IPV6
-  memset(dummy_packet6, 0, sizeof(dummy_packet6));
-  pptrs.v6.f_agent = (u_char *) &client;
-  pptrs.v6.packet_ptr = dummy_packet6;
-  pptrs.v6.pkthdr = &dummy_pkthdr6;
-  Assign16(((struct eth_header *)pptrs.v6.packet_ptr)->ether_type, htons(ETHERTYPE_IPV6)); 
-  pptrs.v6.mac_ptr = (u_char *)((struct eth_header *)pptrs.v6.packet_ptr)->ether_dhost; 
-  pptrs.v6.iph_ptr = pptrs.v6.packet_ptr + ETHER_HDRLEN;
-  pptrs.v6.tlh_ptr = pptrs.v6.packet_ptr + ETHER_HDRLEN + sizeof(struct ip6_hdr);
-  Assign16(((struct ip6_hdr *)pptrs.v6.iph_ptr)->ip6_plen, htons(100));
-  Assign16(((struct ip6_hdr *)pptrs.v6.iph_ptr)->ip6_hlim, htons(64));
-  // pptrs.v6.pkthdr->caplen = 60; /* eth_header + ip6_hdr + my_tlhdr */
-  pptrs.v6.pkthdr->caplen = 77; 
-  pptrs.v6.pkthdr->len = 100; /* fake len */
-  pptrs.v6.l3_proto = ETHERTYPE_IPV6;
-
-  memset(dummy_packet_vlan6, 0, sizeof(dummy_packet_vlan6));
-  pptrs.vlan6.f_agent = (u_char *) &client;
-  pptrs.vlan6.packet_ptr = dummy_packet_vlan6;
-  pptrs.vlan6.pkthdr = &dummy_pkthdr_vlan6;
-  Assign16(((struct eth_header *)pptrs.vlan6.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
-  pptrs.vlan6.mac_ptr = (u_char *)((struct eth_header *)pptrs.vlan6.packet_ptr)->ether_dhost;
-  pptrs.vlan6.vlan_ptr = pptrs.vlan6.packet_ptr + ETHER_HDRLEN;
-  Assign8(*(pptrs.vlan6.vlan_ptr+2), 0x86);
-  Assign8(*(pptrs.vlan6.vlan_ptr+3), 0xDD);
-  pptrs.vlan6.iph_ptr = pptrs.vlan6.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
-  pptrs.vlan6.tlh_ptr = pptrs.vlan6.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN + sizeof(struct ip6_hdr);
-  Assign16(((struct ip6_hdr *)pptrs.vlan6.iph_ptr)->ip6_plen, htons(100));
-  Assign16(((struct ip6_hdr *)pptrs.vlan6.iph_ptr)->ip6_hlim, htons(64));
-  // pptrs.vlan6.pkthdr->caplen = 64; /* eth_header + vlan + ip6_hdr + my_tlhdr */
-  pptrs.vlan6.pkthdr->caplen = 81;
-  pptrs.vlan6.pkthdr->len = 100; /* fake len */
-  pptrs.vlan6.l3_proto = ETHERTYPE_IPV6;
-
-  memset(dummy_packet_mpls6, 0, sizeof(dummy_packet_mpls6));
-  pptrs.mpls6.f_agent = (u_char *) &client;
-  pptrs.mpls6.packet_ptr = dummy_packet_mpls6;
-  pptrs.mpls6.pkthdr = &dummy_pkthdr_mpls6;
-  Assign16(((struct eth_header *)pptrs.mpls6.packet_ptr)->ether_type, htons(ETHERTYPE_MPLS));
-  pptrs.mpls6.mac_ptr = (u_char *)((struct eth_header *)pptrs.mpls6.packet_ptr)->ether_dhost;
-  pptrs.mpls6.mpls_ptr = pptrs.mpls6.packet_ptr + ETHER_HDRLEN;
-  // pptrs.mpls6.pkthdr->caplen = 100; /* eth_header + upto 10 MPLS labels + ip6_hdr + my_tlhdr */
-  pptrs.mpls6.pkthdr->caplen = 117; 
-  pptrs.mpls6.pkthdr->len = 128; /* fake len */
-  pptrs.mpls6.l3_proto = ETHERTYPE_IPV6;
-
-  memset(dummy_packet_vlan_mpls6, 0, sizeof(dummy_packet_vlan_mpls6));
-  pptrs.vlanmpls6.f_agent = (u_char *) &client;
-  pptrs.vlanmpls6.packet_ptr = dummy_packet_vlan_mpls6;
-  pptrs.vlanmpls6.pkthdr = &dummy_pkthdr_vlan_mpls6;
-  Assign16(((struct eth_header *)pptrs.vlanmpls6.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
-  pptrs.vlanmpls6.mac_ptr = (u_char *)((struct eth_header *)pptrs.vlanmpls6.packet_ptr)->ether_dhost;
-  pptrs.vlanmpls6.vlan_ptr = pptrs.vlanmpls6.packet_ptr + ETHER_HDRLEN;
-  Assign8(*(pptrs.vlanmpls6.vlan_ptr+2), 0x88);
-  Assign8(*(pptrs.vlanmpls6.vlan_ptr+3), 0x47);
-  pptrs.vlanmpls6.mpls_ptr = pptrs.vlanmpls6.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
-  // pptrs.vlanmpls6.pkthdr->caplen = 104; /* eth_header + vlan + upto 10 MPLS labels + ip6_hdr + my_tlhdr */
-  pptrs.vlanmpls6.pkthdr->caplen = 121;
-  pptrs.vlanmpls6.pkthdr->len = 128; /* fake len */
-  pptrs.vlanmpls6.l3_proto = ETHERTYPE_IPV6;
-#endif
+  set_packet_tables(&pptrs);
+  init_dummy_packets(&pptrs, &dummy, (u_char *) &client);
 
   {
     char srv_string[INET6_ADDRSTRLEN];
@@ -893,13 +816,40 @@ int main(int argc,char **argv, char **envp)
   /* fixing NetFlow v9/IPFIX template func pointers */
   get_ext_db_ie_by_type = &ext_db_get_ie;
 
+#if defined ENABLE_THREADS
+  if (config.nfacctd_workers) {
+    init_nfacctd_workers(&req);
+
+    if (pipe(workers_signal_pipe) == -1) {
+      Log(LOG_ERR, "ERROR ( %s/core ): unable to create workers signal pipe. Exiting.\n", config.name);
+      exit_all(1);
+    }
+    fcntl(workers_signal_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(workers_signal_pipe[1], F_SETFL, O_NONBLOCK);
+
+    recv_flags = MSG_DONTWAIT;
+    signal(SIGINT, workers_signal_handler);
+    signal(SIGTERM, workers_signal_handler);
+    signal(SIGUSR1, workers_signal_handler);
+  }
+#endif
+
   /* Main loop */
   for(;;) {
-    ret = recvfrom(config.sock, netflow_packet, NETFLOW_MSG_SIZE, 0, (struct sockaddr *) &client, &clen);
+    ret = recvfrom(config.sock, netflow_packet, NETFLOW_MSG_SIZE, recv_flags, (struct sockaddr *) &client, &clen);
 
-    if (ret < 1) continue; /* we don't have enough data to decode the version */ 
+#if defined ENABLE_THREADS
+    if (config.nfacctd_workers) {
+      if (workers_stop_signal || workers_stats_signal) handle_workers_signals();
+
+      if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        wait_for_datagrams();
+        continue;
+      }
+    }
+#endif
 
-    pptrs.v4.f_len = ret;
+    if (ret < 1) continue; /* we don't have enough data to decode the version */ 
 
 #if defined ENABLE_IPV6
     ipv4_mapped_to_ipv4(&client);
@@ -909,68 +859,509 @@ int main(int argc,char **argv, char **envp)
     if (allow.num) allowed = check_allow(&allow, (struct sockaddr *)&client); 
     if (!allowed) continue;
 
-    if (reload_map) {
-      bta_map_caching = TRUE;
-      sampling_map_caching = TRUE;
+    if (reload_map && map_reload_kick(&req)) {
       req.key_value_table = NULL;
+      reload_map = FALSE;
+      reload_map_exec_plugins = FALSE;
+    }
 
-      load_networks(config.networks_file, &nt, &nc);
-
-      if (config.nfacctd_bgp && config.nfacctd_bgp_peer_as_src_map) 
-        load_id_file(MAP_BGP_PEER_AS_SRC, config.nfacctd_bgp_peer_as_src_map, &bpas_table, &req, &bpas_map_allocated); 
-      if (config.nfacctd_bgp && config.nfacctd_bgp_src_local_pref_map) 
-        load_id_file(MAP_BGP_SRC_LOCAL_PREF, config.nfacctd_bgp_src_local_pref_map, &blp_table, &req, &blp_map_allocated); 
-      if (config.nfacctd_bgp && config.nfacctd_bgp_src_med_map) 
-        load_id_file(MAP_BGP_SRC_MED, config.nfacctd_bgp_src_med_map, &bmed_table, &req, &bmed_map_allocated); 
-      if (config.nfacctd_bgp && config.nfacctd_bgp_to_agent_map)
-        load_id_file(MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, &req, &bta_map_allocated);
-      if (config.nfacctd_flow_to_rd_map)
-        load_id_file(MAP_FLOW_TO_RD, config.nfacctd_flow_to_rd_map, &bitr_table, &req, &bitr_map_allocated);
-      if (config.sampling_map) {
-        load_id_file(MAP_SAMPLING, config.sampling_map, &sampling_table, &req, &sampling_map_allocated);
-        set_sampling_table(&pptrs, (u_char *) &sampling_table);
+    if (map_reload_ready()) {
+      hold_workers();
+      if (map_reload_publish(&bta_map_caching, &sampling_map_caching))
+        gettimeofday(&reload_map_tstamp, NULL);
+      release_workers();
+    }
+
+#if defined ENABLE_THREADS
+    if (config.nfacctd_workers) {
+#if defined WITH_GEOIPV2
+      if (reload_geoipv2_file && config.geoipv2_file) {
+        hold_workers();
+        pm_geoipv2_close();
+        pm_geoipv2_init();
+        reload_geoipv2_file = FALSE;
+        release_workers();
       }
+#endif
 
-      reload_map = FALSE;
-      gettimeofday(&reload_map_tstamp, NULL);
+      netflow_packet = dispatch_to_worker(netflow_packet, ret, (struct sockaddr *) &client, clen);
+      continue;
     }
+#endif
 
-    if (data_plugins) {
-      /* We will change byte ordering in order to avoid a bunch of ntohs() calls */
-      ((struct struct_header_v5 *)netflow_packet)->version = ntohs(((struct struct_header_v5 *)netflow_packet)->version);
-      reset_tag_label_status(&pptrs);
-      reset_shadow_status(&pptrs);
-
-      switch(((struct struct_header_v5 *)netflow_packet)->version) {
-      case 1:
-	process_v1_packet(netflow_packet, ret, &pptrs.v4, &req);
-	break;
-      case 5:
-	process_v5_packet(netflow_packet, ret, &pptrs.v4, &req); 
-	break;
-      case 7:
-	process_v7_packet(netflow_packet, ret, &pptrs.v4, &req);
-	break;
-      case 8:
-	process_v8_packet(netflow_packet, ret, &pptrs.v4, &req);
-	break;
-      /* NetFlow v9 + IPFIX */
-      case 9:
-      case 10:
-	process_v9_packet(netflow_packet, ret, &pptrs, &req, ((struct struct_header_v5 *)netflow_packet)->version);
-	break;
-      default:
-        if (!config.nfacctd_disable_checks) {
-	  notify_malf_packet(LOG_INFO, "INFO: Discarding unknown packet", (struct sockaddr *) pptrs.v4.f_agent, 0);
-	  xflow_tot_bad_datagrams++;
-        }
-	break;
+    process_nf_packet(netflow_packet, ret, &pptrs, &req);
+  }
+}
+
+void process_nf_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vector *pptrs, struct plugin_requests *req)
+{
+  pptrs->v4.f_len = len;
+
+  if (data_plugins) {
+    /* We will change byte ordering in order to avoid a bunch of ntohs() calls */
+    ((struct struct_header_v5 *)pkt)->version = ntohs(((struct struct_header_v5 *)pkt)->version);
+    reset_tag_label_status(pptrs);
+    reset_shadow_status(pptrs);
+
+    switch(((struct struct_header_v5 *)pkt)->version) {
+    case 1:
+      process_v1_packet(pkt, len, &pptrs->v4, req);
+      break;
+    case 5:
+      process_v5_packet(pkt, len, &pptrs->v4, req); 
+      break;
+    case 7:
+      process_v7_packet(pkt, len, &pptrs->v4, req);
+      break;
+    case 8:
+      process_v8_packet(pkt, len, &pptrs->v4, req);
+      break;
+    /* NetFlow v9 + IPFIX */
+    case 9:
+    case 10:
+      process_v9_packet(pkt, len, pptrs, req, ((struct struct_header_v5 *)pkt)->version);
+      break;
+    default:
+      if (!config.nfacctd_disable_checks) {
+        notify_malf_packet(LOG_INFO, "INFO: Discarding unknown packet", (struct sockaddr *) pptrs->v4.f_agent, 0);
+        xflow_tot_bad_datagrams++;
+      }
+      break;
+    }
+  }
+  else if (tee_plugins) {
+    process_raw_packet(pkt, len, pptrs, req);
+  }
+}
+
+/*
+   Exporter-affine workers: the receive loop hands datagrams over to
+   worker threads by hashing the exporter address, so all of the state
+   built per exporter (templates, status table entries, sampling info)
+   is private to a single worker, in thread-local storage, and decoding
+   takes no locks. Each worker fills in its own copies of the plugin
+   channel buffers, see init_producer_channels(). Maps are swapped, and
+   other global state changed, only while workers are held at a
+   datagram boundary.
+*/
+#if defined ENABLE_THREADS
+struct nf_worker_datagram {
+  unsigned char *pkt;
+  u_int16_t len;
+  struct sockaddr_storage client;
+};
+
+struct nf_worker {
+  thread_pool_t *pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct nf_worker_datagram queue[NFACCTD_WORKER_QUEUE];
+  u_int32_t head;
+  u_int32_t tail;
+  int hold;
+  int held;
+  int ready;
+  int stop;
+  int stopped;
+  struct packet_ptrs_vector pptrs;
+  struct plugin_requests req;
+  struct nf_dummy_packets dummy;
+  struct sockaddr_storage client;
+  struct channels_list_entry channels[MAX_N_PLUGINS];
+  struct networks_cache *nc;
+  struct xflow_status_shard shard;
+};
+
+static struct nf_worker *workers;
+static int workers_num;
+
+void init_nfacctd_workers(struct plugin_requests *req)
+{
+  struct nf_worker *w;
+  int idx, slot;
+
+  workers = calloc(config.nfacctd_workers, sizeof(struct nf_worker));
+  if (!workers) {
+    Log(LOG_ERR, "ERROR ( %s/core ): unable to allocate workers. Exiting.\n", config.name);
+    exit(1);
+  }
+
+  for (idx = 0; idx < config.nfacctd_workers; idx++) {
+    w = &workers[idx];
+
+    for (slot = 0; slot < NFACCTD_WORKER_QUEUE; slot++) {
+      w->queue[slot].pkt = malloc(NETFLOW_MSG_SIZE);
+      if (!w->queue[slot].pkt) {
+        Log(LOG_ERR, "ERROR ( %s/core ): unable to allocate worker queues. Exiting.\n", config.name);
+        exit(1);
       }
     }
-    else if (tee_plugins) {
-      process_raw_packet(netflow_packet, ret, &pptrs, &req);
+
+    if (init_producer_channels(w->channels) == ERR) {
+      Log(LOG_ERR, "ERROR ( %s/core ): unable to allocate worker channels. Exiting.\n", config.name);
+      exit(1);
     }
+
+    memcpy(&w->req, req, sizeof(struct plugin_requests));
+    w->nc = &nc;
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+
+    w->pool = allocate_thread_pool(1, THREAD_POOL_INHERIT);
+    assert(w->pool);
+    send_to_pool(w->pool, nfacctd_worker_thread, w);
+
+    /* workers register their status table: one at a time */
+    pthread_mutex_lock(&w->mutex);
+    while (!w->ready) pthread_cond_wait(&w->cond, &w->mutex);
+    pthread_mutex_unlock(&w->mutex);
   }
+
+  workers_num = config.nfacctd_workers;
+  Log(LOG_INFO, "INFO ( %s/core ): %u decoding workers started\n", config.name, workers_num);
+}
+
+void nfacctd_worker_thread(void *arg)
+{
+  struct nf_worker *w = arg;
+  struct nf_worker_datagram *d;
+  u_int32_t head, tail;
+  sigset_t mask;
+
+  /* signals are for the receive loop to handle */
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  init_template_cache();
+  if (networks_cache_clone(&nc, w->nc) == ERR) {
+    Log(LOG_ERR, "ERROR ( %s/core ): unable to allocate worker networks cache. Exiting.\n", config.name);
+    exit_all(1);
+  }
+  producer_channels = w->channels;
+  set_packet_tables(&w->pptrs);
+  init_dummy_packets(&w->pptrs, &w->dummy, (u_char *) &w->client);
+
+  w->shard.table = &xflow_status_table;
+  w->shard.tot_bad_datagrams = &xflow_tot_bad_datagrams;
+  register_status_shard(&w->shard);
+
+  pthread_mutex_lock(&w->mutex);
+  w->ready = TRUE;
+  pthread_cond_broadcast(&w->cond);
+
+  for (;;) {
+    while (w->head == w->tail && !w->hold && !w->stop) pthread_cond_wait(&w->cond, &w->mutex);
+
+    if (w->hold) {
+      w->held = TRUE;
+      pthread_cond_broadcast(&w->cond);
+      while (w->hold) pthread_cond_wait(&w->cond, &w->mutex);
+      w->held = FALSE;
+
+      /* the networks table may have been swapped */
+      if (networks_cache_clone(&nc, w->nc) == ERR) {
+        Log(LOG_ERR, "ERROR ( %s/core ): unable to allocate worker networks cache. Exiting.\n", config.name);
+        exit_all(1);
+      }
+      continue;
+    }
+
+    /* queue drained: hand over what is left in our buffers and quit */
+    if (w->head == w->tail && w->stop) {
+      flush_producer_channels(w->channels);
+      w->stopped = TRUE;
+      pthread_cond_broadcast(&w->cond);
+      pthread_mutex_unlock(&w->mutex);
+      return;
+    }
+
+    head = w->head;
+    tail = w->tail;
+    pthread_mutex_unlock(&w->mutex);
+
+    for (; head != tail; head++) {
+      d = &w->queue[head & (NFACCTD_WORKER_QUEUE-1)];
+      memcpy(&w->client, &d->client, sizeof(struct sockaddr_storage));
+      process_nf_packet(d->pkt, d->len, &w->pptrs, &w->req);
+    }
+
+    pthread_mutex_lock(&w->mutex);
+    w->head = tail;
+  }
+}
+
+/*
+   Queues the datagram to the worker owning the exporter; the slot buffer
+   is handed back, to receive the next datagram into. If the worker is
+   lagging behind, the datagram is dropped (and accounted for).
+*/
+unsigned char *dispatch_to_worker(unsigned char *pkt, u_int16_t len, struct sockaddr *client, int clen)
+{
+  struct nf_worker *w = &workers[hash_status_table(client, 0, 0) % workers_num];
+  struct nf_worker_datagram *d;
+  unsigned char *spare;
+
+  pthread_mutex_lock(&w->mutex);
+
+  if (w->tail-w->head == NFACCTD_WORKER_QUEUE) {
+    w->shard.drops++;
+    pthread_mutex_unlock(&w->mutex);
+    return pkt;
+  }
+
+  d = &w->queue[w->tail & (NFACCTD_WORKER_QUEUE-1)];
+  spare = d->pkt;
+  d->pkt = pkt;
+  d->len = len;
+  memcpy(&d->client, client, MIN(clen, sizeof(struct sockaddr_storage)));
+
+  w->tail++;
+  w->shard.datagrams++;
+  if (w->tail-w->head == 1) pthread_cond_signal(&w->cond);
+
+  pthread_mutex_unlock(&w->mutex);
+
+  return spare;
+}
+
+/*
+   With workers, SIGINT/SIGTERM and SIGUSR1 are only noted by the signal
+   handler, which may fire while a worker lock is held or in any thread,
+   and acted upon by the receive loop, see handle_workers_signals(). The
+   receive loop reads without blocking and, when idle, polls the socket
+   along with a self-pipe the handler writes to.
+*/
+void workers_signal_handler(int signum)
+{
+  int saved_errno = errno;
+
+  if (signum == SIGUSR1) workers_stats_signal = TRUE;
+  else workers_stop_signal = signum;
+
+  if (write(workers_signal_pipe[1], "", 1) < 0) {
+    /* pipe full: a wakeup is pending anyway */
+  }
+
+  signal(signum, workers_signal_handler);
+  errno = saved_errno;
+}
+
+void wait_for_datagrams()
+{
+  struct pollfd pfd[2];
+
+  pfd[0].fd = config.sock;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = workers_signal_pipe[0];
+  pfd[1].events = POLLIN;
+
+  if (poll(pfd, 2, -1) > 0 && (pfd[1].revents & POLLIN)) {
+    char buf[16];
+
+    while (read(workers_signal_pipe[0], buf, sizeof(buf)) > 0);
+  }
+}
+
+void handle_workers_signals()
+{
+  if (workers_stats_signal) {
+    workers_stats_signal = FALSE;
+
+    /* workers update their status tables lock-free */
+    hold_workers();
+    push_stats();
+    release_workers();
+    signal(SIGUSR1, workers_signal_handler);
+  }
+
+  if (workers_stop_signal) stop_nfacctd_workers();
+}
+
+void stop_nfacctd_workers()
+{
+  struct nf_worker *w;
+  int idx;
+
+  for (idx = 0; idx < workers_num; idx++) {
+    w = &workers[idx];
+
+    pthread_mutex_lock(&w->mutex);
+    w->stop = TRUE;
+    pthread_cond_broadcast(&w->cond);
+    while (!w->stopped) pthread_cond_wait(&w->cond, &w->mutex);
+    pthread_mutex_unlock(&w->mutex);
+  }
+
+  my_sigint_handler(workers_stop_signal);
+}
+#endif
+
+/* parks all workers at a datagram boundary; no-op without workers */
+void hold_workers()
+{
+#if defined ENABLE_THREADS
+  struct nf_worker *w;
+  int idx;
+
+  for (idx = 0; idx < workers_num; idx++) {
+    w = &workers[idx];
+
+    pthread_mutex_lock(&w->mutex);
+    w->hold = TRUE;
+    pthread_cond_broadcast(&w->cond);
+    while (!w->held) pthread_cond_wait(&w->cond, &w->mutex);
+    pthread_mutex_unlock(&w->mutex);
+  }
+#endif
+}
+
+void release_workers()
+{
+#if defined ENABLE_THREADS
+  struct nf_worker *w;
+  int idx;
+
+  for (idx = 0; idx < workers_num; idx++) {
+    w = &workers[idx];
+
+    pthread_mutex_lock(&w->mutex);
+    w->hold = FALSE;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+  }
+#endif
+}
+
+/* points a packet_ptrs vector, the core's or a worker's, to the maps loaded by the core */
+void set_packet_tables(struct packet_ptrs_vector *pptrs)
+{
+  set_sampling_table(pptrs, packet_tables.sampling_table);
+  pptrs->v4.bitr_table = packet_tables.bitr_table;
+  pptrs->v4.bpas_table = packet_tables.bpas_table;
+  pptrs->v4.blp_table = packet_tables.blp_table;
+  pptrs->v4.bmed_table = packet_tables.bmed_table;
+  pptrs->v4.bta_table = packet_tables.bta_table;
+}
+
+void init_dummy_packets(struct packet_ptrs_vector *pptrs, struct nf_dummy_packets *dummy, u_char *f_agent)
+{
+  memset(dummy->v4, 0, sizeof(dummy->v4));
+  pptrs->v4.f_agent = f_agent;
+  pptrs->v4.packet_ptr = dummy->v4;
+  pptrs->v4.pkthdr = &dummy->v4_hdr;
+  Assign16(((struct eth_header *)pptrs->v4.packet_ptr)->ether_type, htons(ETHERTYPE_IP)); /* 0x800 */
+  pptrs->v4.mac_ptr = (u_char *)((struct eth_header *)pptrs->v4.packet_ptr)->ether_dhost; 
+  pptrs->v4.iph_ptr = pptrs->v4.packet_ptr + ETHER_HDRLEN; 
+  pptrs->v4.tlh_ptr = pptrs->v4.packet_ptr + ETHER_HDRLEN + sizeof(struct my_iphdr); 
+  Assign8(((struct my_iphdr *)pptrs->v4.iph_ptr)->ip_vhl, 5);
+  // pptrs->v4.pkthdr->caplen = 38; /* eth_header + my_iphdr + my_tlhdr */
+  pptrs->v4.pkthdr->caplen = 55; 
+  pptrs->v4.pkthdr->len = 100; /* fake len */ 
+  pptrs->v4.l3_proto = ETHERTYPE_IP;
+
+  memset(dummy->vlan4, 0, sizeof(dummy->vlan4));
+  pptrs->vlan4.f_agent = f_agent;
+  pptrs->vlan4.packet_ptr = dummy->vlan4;
+  pptrs->vlan4.pkthdr = &dummy->vlan4_hdr;
+  Assign16(((struct eth_header *)pptrs->vlan4.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
+  pptrs->vlan4.mac_ptr = (u_char *)((struct eth_header *)pptrs->vlan4.packet_ptr)->ether_dhost;
+  pptrs->vlan4.vlan_ptr = pptrs->vlan4.packet_ptr + ETHER_HDRLEN;
+  Assign16(*(pptrs->vlan4.vlan_ptr+2), htons(ETHERTYPE_IP));
+  pptrs->vlan4.iph_ptr = pptrs->vlan4.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
+  pptrs->vlan4.tlh_ptr = pptrs->vlan4.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN + sizeof(struct my_iphdr);
+  Assign8(((struct my_iphdr *)pptrs->vlan4.iph_ptr)->ip_vhl, 5);
+  // pptrs->vlan4.pkthdr->caplen = 42; /* eth_header + vlan + my_iphdr + my_tlhdr */
+  pptrs->vlan4.pkthdr->caplen = 59;
+  pptrs->vlan4.pkthdr->len = 100; /* fake len */
+  pptrs->vlan4.l3_proto = ETHERTYPE_IP;
+
+  memset(dummy->mpls4, 0, sizeof(dummy->mpls4));
+  pptrs->mpls4.f_agent = f_agent;
+  pptrs->mpls4.packet_ptr = dummy->mpls4;
+  pptrs->mpls4.pkthdr = &dummy->mpls4_hdr;
+  Assign16(((struct eth_header *)pptrs->mpls4.packet_ptr)->ether_type, htons(ETHERTYPE_MPLS));
+  pptrs->mpls4.mac_ptr = (u_char *)((struct eth_header *)pptrs->mpls4.packet_ptr)->ether_dhost;
+  pptrs->mpls4.mpls_ptr = pptrs->mpls4.packet_ptr + ETHER_HDRLEN;
+  // pptrs->mpls4.pkthdr->caplen = 78; /* eth_header + upto 10 MPLS labels + my_iphdr + my_tlhdr */
+  pptrs->mpls4.pkthdr->caplen = 95; 
+  pptrs->mpls4.pkthdr->len = 100; /* fake len */
+  pptrs->mpls4.l3_proto = ETHERTYPE_IP;
+
+  memset(dummy->vlanmpls4, 0, sizeof(dummy->vlanmpls4));
+  pptrs->vlanmpls4.f_agent = f_agent;
+  pptrs->vlanmpls4.packet_ptr = dummy->vlanmpls4;
+  pptrs->vlanmpls4.pkthdr = &dummy->vlanmpls4_hdr;
+  Assign16(((struct eth_header *)pptrs->vlanmpls4.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
+  pptrs->vlanmpls4.mac_ptr = (u_char *)((struct eth_header *)pptrs->vlanmpls4.packet_ptr)->ether_dhost;
+  pptrs->vlanmpls4.vlan_ptr = pptrs->vlanmpls4.packet_ptr + ETHER_HDRLEN;
+  Assign16(*(pptrs->vlanmpls4.vlan_ptr+2), htons(ETHERTYPE_MPLS));
+  pptrs->vlanmpls4.mpls_ptr = pptrs->vlanmpls4.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
+  // pptrs->vlanmpls4.pkthdr->caplen = 82; /* eth_header + vlan + upto 10 MPLS labels + my_iphdr + my_tlhdr */
+  pptrs->vlanmpls4.pkthdr->caplen = 99; 
+  pptrs->vlanmpls4.pkthdr->len = 100; /* fake len */
+  pptrs->vlanmpls4.l3_proto = ETHERTYPE_IP;
+
+#if defined ENABLE_IPV6
+  memset(dummy->v6, 0, sizeof(dummy->v6));
+  pptrs->v6.f_agent = f_agent;
+  pptrs->v6.packet_ptr = dummy->v6;
+  pptrs->v6.pkthdr = &dummy->v6_hdr;
+  Assign16(((struct eth_header *)pptrs->v6.packet_ptr)->ether_type, htons(ETHERTYPE_IPV6)); 
+  pptrs->v6.mac_ptr = (u_char *)((struct eth_header *)pptrs->v6.packet_ptr)->ether_dhost; 
+  pptrs->v6.iph_ptr = pptrs->v6.packet_ptr + ETHER_HDRLEN;
+  pptrs->v6.tlh_ptr = pptrs->v6.packet_ptr + ETHER_HDRLEN + sizeof(struct ip6_hdr);
+  Assign16(((struct ip6_hdr *)pptrs->v6.iph_ptr)->ip6_plen, htons(100));
+  Assign16(((struct ip6_hdr *)pptrs->v6.iph_ptr)->ip6_hlim, htons(64));
+  // pptrs->v6.pkthdr->caplen = 60; /* eth_header + ip6_hdr + my_tlhdr */
+  pptrs->v6.pkthdr->caplen = 77; 
+  pptrs->v6.pkthdr->len = 100; /* fake len */
+  pptrs->v6.l3_proto = ETHERTYPE_IPV6;
+
+  memset(dummy->vlan6, 0, sizeof(dummy->vlan6));
+  pptrs->vlan6.f_agent = f_agent;
+  pptrs->vlan6.packet_ptr = dummy->vlan6;
+  pptrs->vlan6.pkthdr = &dummy->vlan6_hdr;
+  Assign16(((struct eth_header *)pptrs->vlan6.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
+  pptrs->vlan6.mac_ptr = (u_char *)((struct eth_header *)pptrs->vlan6.packet_ptr)->ether_dhost;
+  pptrs->vlan6.vlan_ptr = pptrs->vlan6.packet_ptr + ETHER_HDRLEN;
+  Assign8(*(pptrs->vlan6.vlan_ptr+2), 0x86);
+  Assign8(*(pptrs->vlan6.vlan_ptr+3), 0xDD);
+  pptrs->vlan6.iph_ptr = pptrs->vlan6.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
+  pptrs->vlan6.tlh_ptr = pptrs->vlan6.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN + sizeof(struct ip6_hdr);
+  Assign16(((struct ip6_hdr *)pptrs->vlan6.iph_ptr)->ip6_plen, htons(100));
+  Assign16(((struct ip6_hdr *)pptrs->vlan6.iph_ptr)->ip6_hlim, htons(64));
+  // pptrs->vlan6.pkthdr->caplen = 64; /* eth_header + vlan + ip6_hdr + my_tlhdr */
+  pptrs->vlan6.pkthdr->caplen = 81;
+  pptrs->vlan6.pkthdr->len = 100; /* fake len */
+  pptrs->vlan6.l3_proto = ETHERTYPE_IPV6;
+
+  memset(dummy->mpls6, 0, sizeof(dummy->mpls6));
+  pptrs->mpls6.f_agent = f_agent;
+  pptrs->mpls6.packet_ptr = dummy->mpls6;
+  pptrs->mpls6.pkthdr = &dummy->mpls6_hdr;
+  Assign16(((struct eth_header *)pptrs->mpls6.packet_ptr)->ether_type, htons(ETHERTYPE_MPLS));
+  pptrs->mpls6.mac_ptr = (u_char *)((struct eth_header *)pptrs->mpls6.packet_ptr)->ether_dhost;
+  pptrs->mpls6.mpls_ptr = pptrs->mpls6.packet_ptr + ETHER_HDRLEN;
+  // pptrs->mpls6.pkthdr->caplen = 100; /* eth_header + upto 10 MPLS labels + ip6_hdr + my_tlhdr */
+  pptrs->mpls6.pkthdr->caplen = 117; 
+  pptrs->mpls6.pkthdr->len = 128; /* fake len */
+  pptrs->mpls6.l3_proto = ETHERTYPE_IPV6;
+
+  memset(dummy->vlanmpls6, 0, sizeof(dummy->vlanmpls6));
+  pptrs->vlanmpls6.f_agent = f_agent;
+  pptrs->vlanmpls6.packet_ptr = dummy->vlanmpls6;
+  pptrs->vlanmpls6.pkthdr = &dummy->vlanmpls6_hdr;
+  Assign16(((struct eth_header *)pptrs->vlanmpls6.packet_ptr)->ether_type, htons(ETHERTYPE_8021Q));
+  pptrs->vlanmpls6.mac_ptr = (u_char *)((struct eth_header *)pptrs->vlanmpls6.packet_ptr)->ether_dhost;
+  pptrs->vlanmpls6.vlan_ptr = pptrs->vlanmpls6.packet_ptr + ETHER_HDRLEN;
+  Assign8(*(pptrs->vlanmpls6.vlan_ptr+2), 0x88);
+  Assign8(*(pptrs->vlanmpls6.vlan_ptr+3), 0x47);
+  pptrs->vlanmpls6.mpls_ptr = pptrs->vlanmpls6.packet_ptr + ETHER_HDRLEN + IEEE8021Q_TAGLEN;
+  // pptrs->vlanmpls6.pkthdr->caplen = 104; /* eth_header + vlan + upto 10 MPLS labels + ip6_hdr + my_tlhdr */
+  pptrs->vlanmpls6.pkthdr->caplen = 121;
+  pptrs->vlanmpls6.pkthdr->len = 128; /* fake len */
+  pptrs->vlanmpls6.l3_proto = ETHERTYPE_IPV6;
+#endif
 }
 
 void process_v1_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pptrs,
@@ -1011,7 +1402,7 @@ void process_v1_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pp
       if (config.nfacctd_isis) isis_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, pptrs, &pptrs->bta, &pptrs->bta2);
       if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, pptrs, &pptrs->bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(pptrs);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, pptrs, &pptrs->bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, pptrs, &pptrs->blp, NULL);
       if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, pptrs, &pptrs->bmed, NULL);
@@ -1032,6 +1423,7 @@ void process_v5_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pp
 {
   struct struct_header_v5 *hdr_v5 = (struct struct_header_v5 *)pkt;
   struct struct_export_v5 *exp_v5;
+  struct nfv5_columns cols;
   unsigned short int count = ntohs(hdr_v5->count);
 
   if (len < NfHdrV5Sz) {
@@ -1054,9 +1446,12 @@ void process_v5_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pp
       addr_to_str(debug_agent_addr, &debug_a);
 
       Log(LOG_DEBUG, "DEBUG ( %s/core ): Received NetFlow packet from [%s:%u] version [%u] seqno [%u]\n",
-                        config.name, debug_agent_addr, debug_agent_port, 5, ntohl(((struct struct_header_v5 *)pkt)->flow_sequence));
+                        config.name, debug_agent_addr, debug_agent_port, 5, ntohl(hdr_v5->flow_sequence));
     }
 
+    nfv5_decode_columns(hdr_v5, exp_v5, count, &cols);
+    pptrs->f_cols = (u_char *) &cols;
+
     while (count) {
       reset_net_status(pptrs);
       pptrs->f_data = (unsigned char *) exp_v5;
@@ -1082,14 +1477,17 @@ void process_v5_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pp
       if (config.nfacctd_isis) isis_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, pptrs, &pptrs->bta, &pptrs->bta2);
       if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, pptrs, &pptrs->bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(pptrs);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, pptrs, &pptrs->bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, pptrs, &pptrs->blp, NULL);
       if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, pptrs, &pptrs->bmed, NULL);
       exec_plugins(pptrs, req);
       exp_v5++;
+      cols.cur++;
       count--;
     }
+
+    pptrs->f_cols = NULL;
   }
   else {
     notify_malf_packet(LOG_INFO, "INFO: discarding malformed NetFlow v5 packet", (struct sockaddr *) pptrs->f_agent, 0);
@@ -1098,6 +1496,66 @@ void process_v5_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pp
   }
 } 
 
+#if defined NFV5_COLUMNS_SSSE3
+/*
+   dPkts, dOctets, First and Last are adjacent in each record: one load
+   and one byte shuffle per record, then four records get transposed into
+   four columns at once. Returns the amount of records decoded.
+*/
+__attribute__((target("ssse3")))
+static u_int16_t nfv5_decode_columns_ssse3(struct struct_export_v5 *exp, u_int16_t count, struct nfv5_columns *cols)
+{
+  const __m128i bswap32 = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  __m128i r0, r1, r2, r3, t0, t1, t2, t3;
+  u_int16_t idx = 0;
+
+  for (; idx+4 <= count; idx += 4) {
+    r0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) &exp[idx].dPkts), bswap32);
+    r1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) &exp[idx+1].dPkts), bswap32);
+    r2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) &exp[idx+2].dPkts), bswap32);
+    r3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) &exp[idx+3].dPkts), bswap32);
+
+    t0 = _mm_unpacklo_epi32(r0, r1);
+    t1 = _mm_unpacklo_epi32(r2, r3);
+    t2 = _mm_unpackhi_epi32(r0, r1);
+    t3 = _mm_unpackhi_epi32(r2, r3);
+
+    _mm_storeu_si128((__m128i *) &cols->dPkts[idx], _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *) &cols->dOctets[idx], _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *) &cols->First[idx], _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i *) &cols->Last[idx], _mm_unpackhi_epi64(t2, t3));
+  }
+
+  return idx;
+}
+#endif
+
+void nfv5_decode_columns(struct struct_header_v5 *hdr, struct struct_export_v5 *exp, u_int16_t count, struct nfv5_columns *cols)
+{
+  u_int16_t idx = 0;
+
+#if defined NFV5_COLUMNS_SSSE3
+  if (__builtin_cpu_supports("ssse3")) idx = nfv5_decode_columns_ssse3(exp, count, cols);
+#endif
+
+  for (; idx < count; idx++) {
+    cols->dPkts[idx] = ntohl(exp[idx].dPkts);
+    cols->dOctets[idx] = ntohl(exp[idx].dOctets);
+    cols->First[idx] = ntohl(exp[idx].First);
+    cols->Last[idx] = ntohl(exp[idx].Last);
+  }
+
+  cols->unix_secs = ntohl(hdr->unix_secs);
+  cols->SysUptime = ntohl(hdr->SysUptime);
+
+  for (idx = 0; idx < count; idx++) {
+    cols->time_start[idx] = cols->unix_secs-((cols->SysUptime-cols->First[idx])/1000);
+    cols->time_end[idx] = cols->unix_secs-((cols->SysUptime-cols->Last[idx])/1000);
+  }
+
+  cols->cur = 0;
+}
+
 void process_v7_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pptrs,
                 struct plugin_requests *req)
 {
@@ -1145,7 +1603,7 @@ void process_v7_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pp
       if (config.nfacctd_isis) isis_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, pptrs, &pptrs->bta, &pptrs->bta2);
       if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, pptrs, &pptrs->bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(pptrs);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, pptrs, &pptrs->bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, pptrs, &pptrs->blp, NULL);
       if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, pptrs, &pptrs->bmed, NULL);
@@ -1196,7 +1654,7 @@ void process_v8_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs *pp
       if (config.nfacctd_isis) isis_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, pptrs, &pptrs->bta, &pptrs->bta2);
       if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, pptrs, &pptrs->bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(pptrs);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, pptrs, &pptrs->bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, pptrs, &pptrs->blp, NULL);
       if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, pptrs, &pptrs->bmed, NULL);
@@ -1391,9 +1849,11 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
             sampler_id = pm_ntohll(t64); /* XXX: sampler_id to be moved to 64 bit */
           }
 
-	  if (entry) sentry = search_smp_id_status_table(entry->sampling, sampler_id, FALSE);
-	  if (!sentry) sentry = create_smp_entry_status_table(entry);
-	  else ssaved = sentry->next;
+	  if (entry) {
+	    sentry = search_smp_id_status_table(entry, sampler_id, FALSE);
+	    if (!sentry) sentry = create_smp_entry_status_table(entry);
+	    else ssaved = sentry->next;
+	  }
 
 	  if (sentry) {
 	    memset(sentry, 0, sizeof(struct xflow_status_entry_sampling));
@@ -1434,6 +1894,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 
 	    sentry->sampler_id = sampler_id;
 	    if (ssaved) sentry->next = ssaved;
+	    update_smp_cache_status_table(entry, sentry, sampler_id);
 	  }
 	}
 	else if (tpl->tpl[NF9_APPLICATION_ID].len == 4) {
@@ -1551,7 +2012,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(pptrs);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, pptrs, &pptrs->bta, &pptrs->bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, pptrs, &pptrs->bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(pptrs);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(pptrs);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, pptrs, &pptrs->bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, pptrs, &pptrs->blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, pptrs, &pptrs->bmed, NULL);
@@ -1606,7 +2067,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->v6);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->v6, &pptrsv->v6.bta, &pptrsv->v6.bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->v6, &pptrsv->v6.bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->v6);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->v6);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->v6, &pptrsv->v6.bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->v6, &pptrsv->v6.blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->v6, &pptrsv->v6.bmed, NULL);
@@ -1663,7 +2124,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlan4);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlan4, &pptrsv->vlan4.bta, &pptrsv->vlan4.bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlan4, &pptrsv->vlan4.bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlan4);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlan4);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlan4, &pptrsv->vlan4.bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlan4, &pptrsv->vlan4.blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlan4, &pptrsv->vlan4.bmed, NULL);
@@ -1720,7 +2181,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlan6);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlan6, &pptrsv->vlan6.bta, &pptrsv->vlan6.bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlan6, &pptrsv->vlan6.bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlan6);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlan6);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlan6, &pptrsv->vlan6.bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlan6, &pptrsv->vlan6.blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlan6, &pptrsv->vlan6.bmed, NULL);
@@ -1787,7 +2248,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->mpls4);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->mpls4, &pptrsv->mpls4.bta, &pptrsv->mpls4.bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->mpls4, &pptrsv->mpls4.bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->mpls4);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->mpls4);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->mpls4, &pptrsv->mpls4.bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->mpls4, &pptrsv->mpls4.blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->mpls4, &pptrsv->mpls4.bmed, NULL);
@@ -1853,7 +2314,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->mpls6);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->mpls6, &pptrsv->mpls6.bta, &pptrsv->mpls6.bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->mpls6, &pptrsv->mpls6.bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->mpls6);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->mpls6);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->mpls6, &pptrsv->mpls6.bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->mpls6, &pptrsv->mpls6.blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->mpls6, &pptrsv->mpls6.bmed, NULL);
@@ -1922,7 +2383,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlanmpls4);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bta, &pptrsv->vlanmpls4.bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlanmpls4);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlanmpls4);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bmed, NULL);
@@ -1990,7 +2451,7 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 	  if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlanmpls6);
 	  if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bta, &pptrsv->vlanmpls6.bta2);
 	  if (config.nfacctd_flow_to_rd_map) NF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bitr, NULL);
-	  if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlanmpls6);
+	  if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlanmpls6);
 	  if (config.nfacctd_bgp_peer_as_src_map) NF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bpas, NULL);
 	  if (config.nfacctd_bgp_src_local_pref_map) NF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.blp, NULL);
 	  if (config.nfacctd_bgp_src_med_map) NF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bmed, NULL);
@@ -2062,11 +2523,13 @@ void process_v9_packet(unsigned char *pkt, u_int16_t len, struct packet_ptrs_vec
 
   if (off < len) goto process_flowset;
 
-  /* Set IPFIX Sequence number increment */
-  if (version == 10) {
+  if (pptrsv->v4.f_status) {
     struct xflow_status_entry *entry = (struct xflow_status_entry *) pptrsv->v4.f_status;
 
-    entry->inc = FlowSeqInc;
+    entry->counters.flows += FlowSeqInc;
+
+    /* Set IPFIX Sequence number increment */
+    if (version == 10) entry->inc = FlowSeqInc;
   }
 }
 
@@ -2321,15 +2784,13 @@ char *nfv578_check_status(struct packet_ptrs *pptrs)
   struct struct_header_v8 *hdr = (struct struct_header_v8 *) pptrs->f_header;
   struct sockaddr *sa = (struct sockaddr *) pptrs->f_agent;
   u_int32_t aux1 = (hdr->engine_id << 8 | hdr->engine_type);
-  int hash = hash_status_table(aux1, sa, XFLOW_STATUS_TABLE_SZ);
   struct xflow_status_entry *entry = NULL;
   
-  if (hash >= 0) {
-    entry = search_status_table(sa, aux1, 0, hash, XFLOW_STATUS_TABLE_MAX_ENTRIES);
-    if (entry) {
-      update_status_table(entry, ntohl(hdr->flow_sequence));
-      entry->inc = ntohs(hdr->count);
-    }
+  entry = search_status_table(sa, aux1, 0, XFLOW_STATUS_TABLE_MAX_ENTRIES);
+  if (entry) {
+    update_status_table(entry, ntohl(hdr->flow_sequence));
+    entry->inc = ntohs(hdr->count);
+    entry->counters.flows += entry->inc;
   }
 
   return (char *) entry;
@@ -2338,15 +2799,12 @@ char *nfv578_check_status(struct packet_ptrs *pptrs)
 char *nfv9_check_status(struct packet_ptrs *pptrs, u_int32_t sid, u_int32_t flags, u_int32_t seq, u_int8_t update)
 {
   struct sockaddr *sa = (struct sockaddr *) pptrs->f_agent;
-  int hash = hash_status_table(sid, sa, XFLOW_STATUS_TABLE_SZ);
   struct xflow_status_entry *entry = NULL;
   
-  if (hash >= 0) {
-    entry = search_status_table(sa, sid, flags, hash, XFLOW_STATUS_TABLE_MAX_ENTRIES);
-    if (entry && update) {
-      update_status_table(entry, seq);
-      entry->inc = 1;
-    }
+  entry = search_status_table(sa, sid, flags, XFLOW_STATUS_TABLE_MAX_ENTRIES);
+  if (entry && update) {
+    update_status_table(entry, seq);
+    entry->inc = 1;
   }
 
   return (char *) entry;
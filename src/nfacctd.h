@@ -401,6 +401,8 @@ struct data_hdr_v9 {
 /* defines */
 #define DEFAULT_NFACCTD_PORT 2100
 #define NETFLOW_MSG_SIZE PKT_MSG_SIZE
+#define NFACCTD_MAX_WORKERS 64
+#define NFACCTD_WORKER_QUEUE 256	/* datagrams; power of two */
 #define V1_MAXFLOWS 24  /* max records in V1 packet */
 #define V5_MAXFLOWS 30  /* max records in V5 packet */
 #define V7_MAXFLOWS 27  /* max records in V7 packet */
@@ -418,7 +420,8 @@ struct data_hdr_v9 {
 #define V8_12_MAXFLOWS 44  /* max records in V8 DST_PREFIX_TOS packet */
 #define V8_13_MAXFLOWS 35  /* max records in V8 PREFIX_TOS packet */
 #define V8_14_MAXFLOWS 35  /* max records in V8 PREFIX_PORT_TOS packet */
-#define TEMPLATE_CACHE_ENTRIES 255
+#define TEMPLATE_CACHE_ENTRIES 256 /* initial buckets, power of 2 */
+#define TEMPLATE_CACHE_MAX_ENTRIES 65536
 
 #define NF_TIME_MSECS 0 /* times are in msecs */
 #define NF_TIME_SECS 1 /* times are in secs */ 
@@ -432,6 +435,8 @@ struct data_hdr_v9 {
 #define NF9_TEMPLATE_FLOWSET_ID         0
 #define NF9_OPTIONS_FLOWSET_ID          1
 #define NF9_MIN_RECORD_FLOWSET_ID       256
+#define IPFIX_TEMPLATE_FLOWSET_ID	2
+#define IPFIX_OPTIONS_FLOWSET_ID	3
 #define NF9_MAX_DEFINED_FIELD		384
 
 #define IES_PER_TPL_EXT_DB_ENTRY        32
@@ -731,14 +736,47 @@ struct template_cache_entry {
   u_int16_t len;                        /* total length of the described flowset */
   u_int8_t vlen;                        /* flag for variable-length fields */
   struct otpl_field tpl[NF9_MAX_DEFINED_FIELD];
-  struct tpl_field_db ext_db[TPL_EXT_DB_ENTRIES];
-  struct tpl_field_list list[TPL_LIST_ENTRIES];
+  struct tpl_field_db *ext_db;          /* allocated on first PEN/high IE seen */
+  struct tpl_field_list *list;          /* ordered list, sized to 'num' */
   struct template_cache_entry *next;
 };
 
 struct template_cache {
-  u_int16_t num;
-  struct template_cache_entry *c[TEMPLATE_CACHE_ENTRIES];
+  u_int32_t num;                        /* buckets, power of 2 */
+  u_int32_t entries;                    /* templates currently cached */
+  struct template_cache_entry **c;
+};
+
+/* dummy packets backing a packet_ptrs_vector */
+struct nf_dummy_packets {
+  unsigned char v4[64];
+  unsigned char vlan4[64];
+  unsigned char mpls4[128];
+  unsigned char vlanmpls4[128];
+  struct pcap_pkthdr v4_hdr;
+  struct pcap_pkthdr vlan4_hdr;
+  struct pcap_pkthdr mpls4_hdr;
+  struct pcap_pkthdr vlanmpls4_hdr;
+#if defined ENABLE_IPV6
+  unsigned char v6[92];
+  unsigned char vlan6[92];
+  unsigned char mpls6[128];
+  unsigned char vlanmpls6[128];
+  struct pcap_pkthdr v6_hdr;
+  struct pcap_pkthdr vlan6_hdr;
+  struct pcap_pkthdr mpls6_hdr;
+  struct pcap_pkthdr vlanmpls6_hdr;
+#endif
+};
+
+/* maps loaded by the core, shared by the core and the decoding workers */
+struct nf_packet_tables {
+  u_char *sampling_table;
+  u_char *bitr_table;
+  u_char *bpas_table;
+  u_char *blp_table;
+  u_char *bmed_table;
+  u_char *bta_table;
 };
 
 typedef void (*v8_filter_handler)(struct packet_ptrs *, void *);
@@ -748,6 +786,21 @@ struct v8_handler_entry {
   v8_filter_handler fh;
 };
 
+/* NetFlow v5 records are fixed-size: counters and timestamps are
+   byte-swapped once per packet, column by column, and picked up by
+   the NF_* handlers via pptrs->f_cols */
+struct nfv5_columns {
+  u_int8_t cur;				/* record being processed */
+  u_int32_t unix_secs;
+  u_int32_t SysUptime;
+  u_int32_t dPkts[V5_MAXFLOWS];
+  u_int32_t dOctets[V5_MAXFLOWS];
+  u_int32_t First[V5_MAXFLOWS];
+  u_int32_t Last[V5_MAXFLOWS];
+  u_int32_t time_start[V5_MAXFLOWS];	/* unix_secs adjusted by First, secs */
+  u_int32_t time_end[V5_MAXFLOWS];	/* unix_secs adjusted by Last, secs */
+};
+
 /* functions */
 #if (!defined __NFACCTD_C)
 #define EXT extern
@@ -756,10 +809,25 @@ struct v8_handler_entry {
 #endif
 EXT void process_v1_packet(unsigned char *, u_int16_t, struct packet_ptrs *, struct plugin_requests *);
 EXT void process_v5_packet(unsigned char *, u_int16_t, struct packet_ptrs *, struct plugin_requests *);
+EXT void nfv5_decode_columns(struct struct_header_v5 *, struct struct_export_v5 *, u_int16_t, struct nfv5_columns *);
 EXT void process_v7_packet(unsigned char *, u_int16_t, struct packet_ptrs *, struct plugin_requests *);
 EXT void process_v8_packet(unsigned char *, u_int16_t, struct packet_ptrs *, struct plugin_requests *);
 EXT void process_v9_packet(unsigned char *, u_int16_t, struct packet_ptrs_vector *, struct plugin_requests *, u_int16_t);
 EXT void process_raw_packet(unsigned char *, u_int16_t, struct packet_ptrs_vector *, struct plugin_requests *);
+EXT void process_nf_packet(unsigned char *, u_int16_t, struct packet_ptrs_vector *, struct plugin_requests *);
+EXT void init_dummy_packets(struct packet_ptrs_vector *, struct nf_dummy_packets *, u_char *);
+EXT void set_packet_tables(struct packet_ptrs_vector *);
+#if defined ENABLE_THREADS
+EXT void init_nfacctd_workers(struct plugin_requests *);
+EXT void nfacctd_worker_thread(void *);
+EXT unsigned char *dispatch_to_worker(unsigned char *, u_int16_t, struct sockaddr *, int);
+EXT void workers_signal_handler(int);
+EXT void wait_for_datagrams();
+EXT void handle_workers_signals();
+EXT void stop_nfacctd_workers();
+#endif
+EXT void hold_workers();
+EXT void release_workers();
 EXT u_int16_t NF_evaluate_flow_type(struct template_cache_entry *, struct packet_ptrs *);
 EXT u_int16_t NF_evaluate_direction(struct template_cache_entry *, struct packet_ptrs *);
 EXT pm_class_t NF_evaluate_classifiers(struct xflow_status_entry_class *, pm_class_t *, struct xflow_status_entry *);
@@ -773,12 +841,13 @@ EXT int NF_find_id(struct id_table *, struct packet_ptrs *, pm_id_t *, pm_id_t *
 EXT char *nfv578_check_status(struct packet_ptrs *);
 EXT char *nfv9_check_status(struct packet_ptrs *, u_int32_t, u_int32_t, u_int32_t, u_int8_t);
 
-EXT struct template_cache tpl_cache;
+EXT ThreadLocal struct template_cache tpl_cache;
 EXT struct v8_handler_entry v8_handlers[15];
+EXT struct nf_packet_tables packet_tables;
 
-EXT struct host_addr debug_a;
-EXT u_char debug_agent_addr[50];
-EXT u_int16_t debug_agent_port;
+EXT ThreadLocal struct host_addr debug_a;
+EXT ThreadLocal u_char debug_agent_addr[50];
+EXT ThreadLocal u_int16_t debug_agent_port;
 #undef EXT
 
 #if (!defined __NFV9_TEMPLATE_C)
@@ -786,6 +855,11 @@ EXT u_int16_t debug_agent_port;
 #else
 #define EXT
 #endif
+EXT void init_template_cache();
+EXT u_int32_t hash_template(struct host_addr *, u_int32_t, u_int16_t);
+EXT void link_template(struct template_cache_entry *, struct packet_ptrs *);
+EXT void grow_template_cache();
+EXT void free_template(struct template_cache_entry *);
 EXT struct template_cache_entry *handle_template(struct template_hdr_v9 *, struct packet_ptrs *, u_int16_t, u_int32_t, u_int16_t *, u_int16_t, u_int32_t);
 EXT struct template_cache_entry *find_template(u_int16_t, struct packet_ptrs *, u_int16_t, u_int32_t);
 EXT struct template_cache_entry *insert_template(struct template_hdr_v9 *, struct packet_ptrs *, u_int16_t, u_int32_t, u_int16_t *, u_int8_t, u_int16_t, u_int32_t);
@@ -26,6 +26,88 @@
 #include "pmacct.h"
 #include "nfacctd.h"
 #include "pmacct-data.h"
+#include "jhash.h"
+
+void init_template_cache()
+{
+  memset(&tpl_cache, 0, sizeof(tpl_cache));
+  tpl_cache.num = TEMPLATE_CACHE_ENTRIES;
+
+  tpl_cache.c = calloc(tpl_cache.num, sizeof(struct template_cache_entry *));
+  if (!tpl_cache.c) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate Template Cache. Exiting.\n", config.name);
+    exit(1);
+  }
+}
+
+/* Templates are keyed by (agent, source ID / observation domain, template ID):
+   hashing on the template ID alone piles every exporter sending the usual
+   256, 257, .. IDs onto the same few buckets. */
+u_int32_t hash_template(struct host_addr *agent, u_int32_t sid, u_int16_t id)
+{
+  u_int32_t a = 0;
+
+  if (agent->family == AF_INET) a = agent->address.ipv4.s_addr;
+#if defined ENABLE_IPV6
+  else if (agent->family == AF_INET6) a = jhash2((u_int32_t *) &agent->address.ipv6, 4, 0);
+#endif
+
+  return jhash_3words(a, sid, id, 0) & (tpl_cache.num-1);
+}
+
+void link_template(struct template_cache_entry *ptr, struct packet_ptrs *pptrs)
+{
+  struct xflow_status_entry *entry = (struct xflow_status_entry *) pptrs->f_status;
+  u_int32_t modulo = hash_template(&ptr->agent, ptr->source_id, ptr->template_id);
+
+  ptr->next = tpl_cache.c[modulo];
+  tpl_cache.c[modulo] = ptr;
+  tpl_cache.entries++;
+
+  if (entry) {
+    entry->last_tpl = ptr;
+    entry->templates++;
+  }
+
+  if (tpl_cache.entries > (tpl_cache.num*2) && tpl_cache.num < TEMPLATE_CACHE_MAX_ENTRIES)
+    grow_template_cache();
+}
+
+void grow_template_cache()
+{
+  struct template_cache_entry **old = tpl_cache.c, *ptr, *next;
+  u_int32_t idx, modulo, old_num = tpl_cache.num;
+
+  tpl_cache.c = calloc(old_num*2, sizeof(struct template_cache_entry *));
+  if (!tpl_cache.c) {
+    /* not fatal: we just carry on with longer chains */
+    tpl_cache.c = old;
+    return;
+  }
+  tpl_cache.num = old_num*2;
+
+  for (idx = 0; idx < old_num; idx++) {
+    for (ptr = old[idx]; ptr; ptr = next) {
+      next = ptr->next;
+      modulo = hash_template(&ptr->agent, ptr->source_id, ptr->template_id);
+      ptr->next = tpl_cache.c[modulo];
+      tpl_cache.c[modulo] = ptr;
+    }
+  }
+
+  free(old);
+
+  Log(LOG_DEBUG, "DEBUG ( %s/core ): Template Cache resized: buckets=%u templates=%u\n", config.name, tpl_cache.num, tpl_cache.entries);
+}
+
+void free_template(struct template_cache_entry *ptr)
+{
+  if (!ptr) return;
+
+  free(ptr->ext_db);
+  free(ptr->list);
+  free(ptr);
+}
 
 struct template_cache_entry *handle_template(struct template_hdr_v9 *hdr, struct packet_ptrs *pptrs, u_int16_t tpl_type,
 						u_int32_t sid, u_int16_t *pens, u_int16_t len, u_int32_t seq)
@@ -56,15 +138,27 @@ struct template_cache_entry *handle_template(struct template_hdr_v9 *hdr, struct
 
 struct template_cache_entry *find_template(u_int16_t id, struct packet_ptrs *pptrs, u_int16_t tpl_type, u_int32_t sid)
 {
+  struct xflow_status_entry *entry = (struct xflow_status_entry *) pptrs->f_status;
   struct template_cache_entry *ptr;
-  u_int16_t modulo = (ntohs(id)%tpl_cache.num);
+  struct host_addr agent;
+  u_int16_t port;
+
+  /* fast path: f_status is already keyed by (agent, source_id) and
+     exporters tend to send long runs of data for the same template */
+  if (entry && entry->last_tpl) {
+    ptr = (struct template_cache_entry *) entry->last_tpl;
+    if (ptr->template_id == id && ptr->source_id == sid) return ptr;
+  }
 
-  ptr = tpl_cache.c[modulo];
+  sa_to_addr((struct sockaddr *)pptrs->f_agent, &agent, &port);
+  ptr = tpl_cache.c[hash_template(&agent, sid, id)];
 
   while (ptr) {
     if ((ptr->template_id == id) && (!sa_addr_cmp((struct sockaddr *)pptrs->f_agent, &ptr->agent)) &&
-	(ptr->source_id == sid))
+	(ptr->source_id == sid)) {
+      if (entry) entry->last_tpl = ptr;
       return ptr;
+    }
     else ptr = ptr->next;
   }
 
@@ -74,21 +168,13 @@ struct template_cache_entry *find_template(u_int16_t id, struct packet_ptrs *ppt
 struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct packet_ptrs *pptrs, u_int16_t tpl_type,
 						u_int32_t sid, u_int16_t *pens, u_int8_t version, u_int16_t len, u_int32_t seq)
 {
-  struct template_cache_entry *ptr, *prevptr = NULL;
+  struct template_cache_entry *ptr;
   struct template_field_v9 *field;
-  u_int16_t modulo = (ntohs(hdr->template_id)%tpl_cache.num), count;
-  u_int16_t num = ntohs(hdr->num), type, port, off;
+  u_int16_t count, num = ntohs(hdr->num), type, port, off;
   u_int32_t *pen;
   u_int8_t ipfix_ebit;
   u_char *tpl;
 
-  ptr = tpl_cache.c[modulo];
-
-  while (ptr) {
-    prevptr = ptr;
-    ptr = ptr->next;
-  }
-
   ptr = malloc(sizeof(struct template_cache_entry));
   if (!ptr) {
     Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory for a new Template Cache Entry.\n", config.name);
@@ -102,6 +188,13 @@ struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct
   ptr->template_type = 0;
   ptr->num = num;
 
+  ptr->list = calloc(num, sizeof(struct tpl_field_list));
+  if (!ptr->list && num) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory for a new Template Cache Entry.\n", config.name);
+    free(ptr);
+    return NULL;
+  }
+
   log_template_header(ptr, pptrs, tpl_type, sid, version);
 
   count = off = 0;
@@ -115,7 +208,7 @@ struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct
       notify_malf_packet(LOG_INFO, "INFO: unable to read next Template Flowset (malformed template)",
                         (struct sockaddr *) pptrs->f_agent, seq);
       xflow_tot_bad_datagrams++;
-      free(ptr);
+      free_template(ptr);
       return NULL;
     }
 
@@ -188,8 +281,7 @@ struct template_cache_entry *insert_template(struct template_hdr_v9 *hdr, struct
     field++;
   }
 
-  if (prevptr) prevptr->next = ptr;
-  else tpl_cache.c[modulo] = ptr;
+  link_template(ptr, pptrs);
 
   log_template_footer(ptr->len, version);
 
@@ -216,6 +308,13 @@ struct template_cache_entry *refresh_template(struct template_hdr_v9 *hdr, struc
   tpl->num = num;
   tpl->next = next;
 
+  tpl->list = calloc(num, sizeof(struct tpl_field_list));
+  if (!tpl->list && num) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory to refresh a Template Cache Entry.\n", config.name);
+    memcpy(tpl, &backup, sizeof(struct template_cache_entry));
+    return NULL;
+  }
+
   log_template_header(tpl, pptrs, tpl_type, sid, version);
 
   count = off = 0;
@@ -229,6 +328,8 @@ struct template_cache_entry *refresh_template(struct template_hdr_v9 *hdr, struc
       notify_malf_packet(LOG_INFO, "INFO: unable to read next Template Flowset (malformed template)",
                         (struct sockaddr *) pptrs->f_agent, seq);
       xflow_tot_bad_datagrams++;
+      free(tpl->list);
+      free(tpl->ext_db);
       memcpy(tpl, &backup, sizeof(struct template_cache_entry));
       return NULL;
     }
@@ -297,6 +398,9 @@ struct template_cache_entry *refresh_template(struct template_hdr_v9 *hdr, struc
     field++;
   }
 
+  free(backup.list);
+  free(backup.ext_db);
+
   log_template_footer(tpl->len, version);
 
   return tpl;
@@ -372,33 +476,24 @@ struct template_cache_entry *insert_opt_template(void *hdr, struct packet_ptrs *
 {
   struct options_template_hdr_v9 *hdr_v9 = (struct options_template_hdr_v9 *) hdr;
   struct options_template_hdr_ipfix *hdr_v10 = (struct options_template_hdr_ipfix *) hdr;
-  struct template_cache_entry *ptr, *prevptr = NULL;
+  struct template_cache_entry *ptr;
   struct template_field_v9 *field;
-  u_int16_t modulo, count, slen, olen, type, port, tid, off;
+  u_int16_t count, slen, olen, type, port, tid, off;
   u_char *tpl;
 
   /* NetFlow v9 */
   if (tpl_type == 1) {
-    modulo = ntohs(hdr_v9->template_id)%tpl_cache.num;
     tid = hdr_v9->template_id;
     slen = ntohs(hdr_v9->scope_len)/sizeof(struct template_field_v9);
     olen = ntohs(hdr_v9->option_len)/sizeof(struct template_field_v9);
   }
   /* IPFIX */
   else if (tpl_type == 3) {
-    modulo = ntohs(hdr_v10->template_id)%tpl_cache.num;
     tid = hdr_v10->template_id;
     slen = ntohs(hdr_v10->scope_count);
     olen = ntohs(hdr_v10->option_count)-slen;
   }
 
-  ptr = tpl_cache.c[modulo];
-
-  while (ptr) {
-    prevptr = ptr;
-    ptr = ptr->next;
-  }
-
   ptr = malloc(sizeof(struct template_cache_entry));
   if (!ptr) {
     Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory for a new Options Template Cache Entry.\n", config.name);
@@ -426,7 +521,7 @@ struct template_cache_entry *insert_opt_template(void *hdr, struct packet_ptrs *
       notify_malf_packet(LOG_INFO, "INFO: unable to read next Options Template Flowset (malformed template)",
                         (struct sockaddr *) pptrs->f_agent, seq);
       xflow_tot_bad_datagrams++;
-      free(ptr);
+      free_template(ptr);
       return NULL;
     }
 
@@ -444,8 +539,7 @@ struct template_cache_entry *insert_opt_template(void *hdr, struct packet_ptrs *
     off += NfTplFieldV9Sz;
   }
 
-  if (prevptr) prevptr->next = ptr;
-  else tpl_cache.c[modulo] = ptr;
+  link_template(ptr, pptrs);
 
   log_template_footer(ptr->len, version);
 
@@ -517,6 +611,10 @@ struct template_cache_entry *refresh_opt_template(void *hdr, struct template_cac
     off += NfTplFieldV9Sz;
   }
 
+  /* in case the template ID was previously describing a data template */
+  free(backup.list);
+  free(backup.ext_db);
+
   log_template_footer(tpl->len, version);
 
   return tpl;
@@ -590,6 +688,8 @@ struct utpl_field *ext_db_get_ie(struct template_cache_entry *ptr, u_int32_t pen
   u_int16_t ie_idx, ext_db_modulo = (type%TPL_EXT_DB_ENTRIES);
   struct utpl_field *ext_db_ptr = NULL;
 
+  if (!ptr->ext_db) return NULL;
+
   for (ie_idx = 0; ie_idx < IES_PER_TPL_EXT_DB_ENTRY; ie_idx++) {
     if (ptr->ext_db[ext_db_modulo].ie[ie_idx].type == type &&
 	ptr->ext_db[ext_db_modulo].ie[ie_idx].pen == pen) {
@@ -606,6 +706,16 @@ struct utpl_field *ext_db_get_next_ie(struct template_cache_entry *ptr, u_int16_
   u_int16_t ie_idx, ext_db_modulo = (type%TPL_EXT_DB_ENTRIES);
   struct utpl_field *ext_db_ptr = NULL;
 
+  /* most templates only carry IEs which fit the legacy registry:
+     the extended database is allocated on first use */
+  if (!ptr->ext_db) {
+    ptr->ext_db = calloc(TPL_EXT_DB_ENTRIES, sizeof(struct tpl_field_db));
+    if (!ptr->ext_db) {
+      Log(LOG_ERR, "ERROR ( %s/core ): Unable to allocate enough memory for a Template extended database.\n", config.name);
+      return NULL;
+    }
+  }
+
   for (ie_idx = 0; ie_idx < IES_PER_TPL_EXT_DB_ENTRY; ie_idx++) {
     if (ptr->ext_db[ext_db_modulo].ie[ie_idx].type == 0) {
       ext_db_ptr = &ptr->ext_db[ext_db_modulo].ie[ie_idx];
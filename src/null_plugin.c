@@ -0,0 +1,307 @@
+/*
+    pmacct (Promiscuous mode IP Accounting package)
+    pmacct is Copyright (C) 2003-2016 by Paolo Lucente
+*/
+
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#define __NULL_PLUGIN_C
+
+/* includes */
+#include "pmacct.h"
+#include "pmacct-data.h"
+#include "plugin_hooks.h"
+#include "plugin_common.h"
+#include "null_plugin.h"
+
+/* variables */
+static struct null_stats np_stats;
+
+/* Functions */
+void null_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
+{
+  struct pkt_data *data;
+  unsigned char *pipebuf;
+  struct pollfd pfd;
+  time_t now;
+  int timeout, refresh_timeout, amqp_timeout, kafka_timeout, ret, num;
+  struct ring *rg = &((struct channels_list_entry *)ptr)->rg;
+  struct ch_status *status = ((struct channels_list_entry *)ptr)->status;
+  struct plugins_list_entry *plugin_data = ((struct channels_list_entry *)ptr)->plugin;
+  int datasize = ((struct channels_list_entry *)ptr)->datasize;
+  u_int32_t bufsz = ((struct channels_list_entry *)ptr)->bufsize;
+  pid_t core_pid = ((struct channels_list_entry *)ptr)->core_pid;
+  time_t refresh_deadline;
+
+  unsigned char *rgptr;
+  int pollagain = TRUE;
+  u_int32_t seq = 1, rg_err_count = 0, drained = 0, expected_seq = 0;
+  int seq_valid = FALSE;
+
+  struct extra_primitives extras;
+  struct primitives_ptrs prim_ptrs;
+  char *dataptr;
+  void *kafka_msg;
+
+#ifdef WITH_RABBITMQ
+  struct p_amqp_host *amqp_host = &((struct channels_list_entry *)ptr)->amqp_host;
+#endif
+
+#ifdef WITH_KAFKA
+  struct p_kafka_host *kafka_host = &((struct channels_list_entry *)ptr)->kafka_host;
+#endif
+
+  memcpy(&config, cfgptr, sizeof(struct configuration));
+  memcpy(&extras, &((struct channels_list_entry *)ptr)->extras, sizeof(struct extra_primitives));
+  recollect_pipe_memory(ptr);
+  pm_setproctitle("%s [%s]", "Null Plugin", config.name);
+  if (config.pidfile) write_pid_file_plugin(config.pidfile, config.type, config.name);
+  if (config.logfile) {
+    fclose(config.logfile_fd);
+    config.logfile_fd = open_logfile(config.logfile, "a");
+  }
+
+  if (config.proc_priority) {
+    int ret;
+
+    ret = setpriority(PRIO_PROCESS, 0, config.proc_priority);
+    if (ret) Log(LOG_WARNING, "WARN ( %s/%s ): proc_priority failed (errno: %d)\n", config.name, config.type, errno);
+    else Log(LOG_INFO, "INFO ( %s/%s ): proc_priority set to %d\n", config.name, config.type, getpriority(PRIO_PROCESS, 0));
+  }
+
+  /* signal handling */
+  signal(SIGINT, NP_exit_now);
+  signal(SIGUSR1, SIG_IGN);
+  signal(SIGUSR2, SIG_IGN);
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGCHLD, SIG_IGN);
+
+  if (!config.sql_refresh_time) config.sql_refresh_time = DEFAULT_NULL_REFRESH_TIME;
+  refresh_timeout = config.sql_refresh_time*1000;
+
+  pipebuf = (unsigned char *) pm_malloc(config.buffer_size);
+  memset(pipebuf, 0, config.buffer_size);
+
+  memset(&prim_ptrs, 0, sizeof(prim_ptrs));
+  set_primptrs_funcs(&extras);
+
+  if (config.pipe_amqp) {
+    plugin_pipe_amqp_compile_check();
+#ifdef WITH_RABBITMQ
+    pipe_fd = plugin_pipe_amqp_connect_to_consume(amqp_host, plugin_data);
+    amqp_timeout = plugin_pipe_set_retry_timeout(&amqp_host->btimers, pipe_fd);
+#endif
+  }
+  else if (config.pipe_kafka) {
+    plugin_pipe_kafka_compile_check();
+#ifdef WITH_KAFKA
+    pipe_fd = plugin_pipe_kafka_connect_to_consume(kafka_host, plugin_data);
+    kafka_timeout = plugin_pipe_set_retry_timeout(&kafka_host->btimers, pipe_fd);
+#endif
+  }
+  else setnonblocking(pipe_fd);
+
+  now = time(NULL);
+  memset(&np_stats, 0, sizeof(np_stats));
+  np_stats.since = now;
+  refresh_deadline = now+config.sql_refresh_time;
+
+  /* plugin main loop */
+  for(;;) {
+    poll_again:
+    status->wakeup = TRUE;
+
+    /* ring lag: buffers found ready since the last wakeup */
+    if (drained) {
+      np_stats.wakeups++;
+      np_stats.lag_sum += drained;
+      if (drained > np_stats.lag_max) np_stats.lag_max = drained;
+      drained = 0;
+    }
+
+    calc_refresh_timeout(refresh_deadline, now, &refresh_timeout);
+
+    pfd.fd = pipe_fd;
+    pfd.events = POLLIN;
+
+    if (config.pipe_homegrown || config.pipe_amqp) {
+      timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
+      ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
+    }
+#ifdef WITH_KAFKA
+    else if (config.pipe_kafka) {
+      timeout = MIN(refresh_timeout, (kafka_timeout ? kafka_timeout : INT_MAX));
+      ret = p_kafka_consume_poller(kafka_host, &kafka_msg, timeout);
+    }
+#endif
+
+    if (ret <= 0) {
+      if (getppid() == 1) {
+        Log(LOG_ERR, "ERROR ( %s/%s ): Core process *seems* gone. Exiting.\n", config.name, config.type);
+        exit_plugin(1);
+      }
+
+      if (ret < 0) goto poll_again;
+    }
+
+    now = time(NULL);
+
+#ifdef WITH_RABBITMQ
+    if (config.pipe_amqp && pipe_fd == ERR) {
+      if (timeout == amqp_timeout) {
+        pipe_fd = plugin_pipe_amqp_connect_to_consume(amqp_host, plugin_data);
+        amqp_timeout = plugin_pipe_set_retry_timeout(&amqp_host->btimers, pipe_fd);
+      }
+      else amqp_timeout = plugin_pipe_calc_retry_timeout_diff(&amqp_host->btimers, now);
+    }
+#endif
+
+#ifdef WITH_KAFKA
+    if (config.pipe_kafka && pipe_fd == ERR) {
+      if (timeout == kafka_timeout) {
+        pipe_fd = plugin_pipe_kafka_connect_to_consume(kafka_host, plugin_data);
+        kafka_timeout = plugin_pipe_set_retry_timeout(&kafka_host->btimers, pipe_fd);
+      }
+      else kafka_timeout = plugin_pipe_calc_retry_timeout_diff(&kafka_host->btimers, now);
+    }
+#endif
+
+    if (now >= refresh_deadline) {
+      NP_log_stats(now);
+      while (refresh_deadline <= now) refresh_deadline += config.sql_refresh_time;
+    }
+
+    switch (ret) {
+    case 0: /* timeout */
+      break;
+    default: /* we received data */
+      read_data:
+      if (config.pipe_homegrown) {
+        if (!pollagain) {
+          seq++;
+          seq %= MAX_SEQNUM;
+          if (seq == 0) rg_err_count = FALSE;
+        }
+        else {
+          if ((ret = read(pipe_fd, &rgptr, sizeof(rgptr))) == 0)
+	    exit_plugin(1); /* we exit silently; something happened at the write end */
+        }
+
+        if ((rg->ptr + bufsz) > rg->end) rg->ptr = rg->base;
+
+        if (((struct ch_buf_hdr *)rg->ptr)->seq != seq) {
+          if (!pollagain) {
+            pollagain = TRUE;
+            goto poll_again;
+          }
+          else {
+            rg_err_count++;
+            if (config.debug || (rg_err_count > MAX_RG_COUNT_ERR)) {
+              Log(LOG_ERR, "ERROR ( %s/%s ): We are missing data.\n", config.name, config.type);
+              Log(LOG_ERR, "If you see this message once in a while, discard it. Otherwise some solutions follow:\n");
+              Log(LOG_ERR, "- increase shared memory size, 'plugin_pipe_size'; now: '%u'.\n", config.pipe_size);
+              Log(LOG_ERR, "- increase buffer size, 'plugin_buffer_size'; now: '%u'.\n", config.buffer_size);
+              Log(LOG_ERR, "- increase system maximum socket size.\n\n");
+            }
+            seq = ((struct ch_buf_hdr *)rg->ptr)->seq;
+          }
+        }
+
+        pollagain = FALSE;
+        memcpy(pipebuf, rg->ptr, bufsz);
+        rg->ptr += bufsz;
+      }
+#ifdef WITH_RABBITMQ
+      else if (config.pipe_amqp) {
+        ret = p_amqp_consume_binary(amqp_host, pipebuf, config.buffer_size);
+	if (ret) pipe_fd = ERR;
+
+	seq = ((struct ch_buf_hdr *)pipebuf)->seq;
+	amqp_timeout = plugin_pipe_set_retry_timeout(&amqp_host->btimers, pipe_fd);
+      }
+#endif
+#ifdef WITH_KAFKA
+      else if (config.pipe_kafka) {
+        ret = p_kafka_consume_data(kafka_host, kafka_msg, pipebuf, config.buffer_size);
+        if (ret) pipe_fd = ERR;
+
+        seq = ((struct ch_buf_hdr *)pipebuf)->seq;
+        kafka_timeout = plugin_pipe_set_retry_timeout(&kafka_host->btimers, pipe_fd);
+      }
+#endif
+
+      if (config.debug_internal_msg)
+        Log(LOG_DEBUG, "DEBUG ( %s/%s ): buffer received cpid=%u seq=%u num_entries=%u\n",
+                config.name, config.type, core_pid, seq, ((struct ch_buf_hdr *)pipebuf)->num);
+
+      /* sequence numbers wrap at MAX_SEQNUM */
+      if (seq_valid) np_stats.seq_gaps += ((seq+MAX_SEQNUM)-expected_seq) % MAX_SEQNUM;
+      expected_seq = (seq+1) % MAX_SEQNUM;
+      seq_valid = TRUE;
+
+      np_stats.buffers++;
+      drained++;
+
+      if (!config.pipe_check_core_pid || ((struct ch_buf_hdr *)pipebuf)->core_pid == core_pid) {
+      data = (struct pkt_data *) (pipebuf+sizeof(struct ch_buf_hdr));
+
+      while (((struct ch_buf_hdr *)pipebuf)->num > 0) {
+	for (num = 0; primptrs_funcs[num]; num++)
+	  (*primptrs_funcs[num])((u_char *)data, &extras, &prim_ptrs);
+
+	np_stats.records++;
+	np_stats.packets += data->pkt_num;
+	np_stats.bytes += data->pkt_len;
+	np_stats.flows += data->flo_num;
+
+	((struct ch_buf_hdr *)pipebuf)->num--;
+        if (((struct ch_buf_hdr *)pipebuf)->num) {
+          dataptr = (unsigned char *) data;
+          if (!prim_ptrs.vlen_next_off) dataptr += datasize;
+	  else dataptr += prim_ptrs.vlen_next_off;
+          data = (struct pkt_data *) dataptr;
+	}
+      }
+      }
+      else np_stats.foreign++;
+
+      if (config.pipe_homegrown) goto read_data;
+    }
+  }
+}
+
+void NP_exit_now(int signum)
+{
+  NP_log_stats(time(NULL));
+  exit_plugin(0);
+}
+
+/* logs counters for the elapsed interval, then resets them */
+void NP_log_stats(time_t now)
+{
+  time_t elapsed = (now > np_stats.since) ? (now-np_stats.since) : 1;
+
+  Log(LOG_INFO, "INFO ( %s/%s ): *** Stats (%us) records=%llu (%llu/s) packets=%llu bytes=%llu flows=%llu buffers=%llu seq_gaps=%u foreign=%u ring_lag=%.1f/%u ***\n",
+	config.name, config.type, (u_int32_t) elapsed, (unsigned long long) np_stats.records,
+	(unsigned long long) (np_stats.records/elapsed), (unsigned long long) np_stats.packets,
+	(unsigned long long) np_stats.bytes, (unsigned long long) np_stats.flows,
+	(unsigned long long) np_stats.buffers, np_stats.seq_gaps, np_stats.foreign,
+	np_stats.wakeups ? (double) np_stats.lag_sum/np_stats.wakeups : 0.0, np_stats.lag_max);
+
+  memset(&np_stats, 0, sizeof(np_stats));
+  np_stats.since = now;
+}
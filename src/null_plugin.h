@@ -0,0 +1,52 @@
+/*
+    pmacct (Promiscuous mode IP Accounting package)
+    pmacct is Copyright (C) 2003-2016 by Paolo Lucente
+*/
+
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* includes */
+#include <sys/poll.h>
+
+/* defines */
+#define DEFAULT_NULL_REFRESH_TIME 60
+
+/* structures */
+struct null_stats {
+  time_t since;			/* start of the current interval */
+  u_int64_t buffers;		/* buffers drained from the Core Process */
+  u_int64_t records;
+  u_int64_t packets;
+  u_int64_t bytes;
+  u_int64_t flows;
+  u_int32_t seq_gaps;		/* buffers lost, per ch_buf_hdr sequence numbers */
+  u_int32_t foreign;		/* buffers discarded, core_pid mismatch */
+  u_int32_t wakeups;		/* poll() wakeups with data */
+  u_int32_t lag_max;		/* buffers drained in a single wakeup */
+  u_int64_t lag_sum;
+};
+
+/* prototypes */
+#if (!defined __NULL_PLUGIN_C)
+#define EXT extern
+#else
+#define EXT
+#endif
+EXT void null_plugin(int, struct configuration *, void *);
+EXT void NP_exit_now(int);
+EXT void NP_log_stats(time_t);
+#undef EXT
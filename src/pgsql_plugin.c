@@ -330,9 +330,22 @@ int PG_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
 {
   PGresult *ret;
   char *ptr_values, *ptr_where, *ptr_set, *ptr_insert;
-  int num=0, num_set=0, have_flows=0;
+  int num=0, num_set=0, have_flows=0, upsert=FALSE;
+
+  if (idata->mv.last_queue_elem) {
+    if (!idata->mv.buffer_elem_num) return FALSE;
+
+    ret = PQexec(db->desc, sql_upsert_close(idata));
+    Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d rows UPSERTed to the PostgreSQL server.\n",
+		config.name, config.type, idata->mv.buffer_elem_num);
+    idata->mv.buffer_elem_num = FALSE;
+    idata->mv.buffer_offset = 0;
+    goto upsert_result;
+  }
 
   if (config.what_to_count & COUNT_FLOWS) have_flows = TRUE;
+  if (config.sql_upsert_batch && cache_elem->flow_type != NF9_FTYPE_EVENT &&
+      cache_elem->flow_type != NF9_FTYPE_OPTION) upsert = TRUE;
 
   /* constructing SQL query */
   ptr_where = where_clause;
@@ -357,8 +370,8 @@ int PG_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
   }
 
   /* sending UPDATE query a) if not switched off and
-     b) if we actually have something to update */
-  if (!config.sql_dont_try_update && num_set) {
+     b) if we actually have something to update; UPSERTs skip it */
+  if (!config.sql_dont_try_update && !upsert && num_set) {
     strncpy(sql_data, update_clause, SPACELEFT(sql_data));
     strncat(sql_data, set_clause, SPACELEFT(sql_data));
     strncat(sql_data, where_clause, SPACELEFT(sql_data));
@@ -376,7 +389,7 @@ int PG_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
     PQclear(ret);
   }
 
-  if (config.sql_dont_try_update || !num_set || (!PG_affected_rows(ret))) {
+  if (config.sql_dont_try_update || upsert || !num_set || (!PG_affected_rows(ret))) {
     /* UPDATE failed, trying with an INSERT query */ 
     if (cache_elem->flow_type == NF9_FTYPE_EVENT || cache_elem->flow_type == NF9_FTYPE_OPTION) {
       strncpy(insert_full_clause, insert_clause, SPACELEFT(insert_full_clause));
@@ -394,6 +407,21 @@ int PG_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
       else snprintf(ptr_values, SPACELEFT(values_clause), ", %lu, %lu)", cache_elem->packet_counter, cache_elem->bytes_counter);
 #endif
     }
+
+    /* rows for a backup DB are not batched: they are the ones
+       a failed batch is being replayed with */
+    if (upsert) {
+      idata->een++;
+      if (!sql_upsert_append(idata) && db->type == BE_TYPE_PRIMARY) return FALSE;
+
+      ret = PQexec(db->desc, sql_upsert_close(idata));
+      Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d rows UPSERTed to the PostgreSQL server.\n",
+		config.name, config.type, idata->mv.buffer_elem_num);
+      idata->mv.buffer_elem_num = FALSE;
+      idata->mv.buffer_offset = 0;
+      goto upsert_result;
+    }
+
     strncpy(sql_data, insert_full_clause, sizeof(sql_data));
     strncat(sql_data, values_clause, SPACELEFT(sql_data));
 
@@ -416,6 +444,21 @@ int PG_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_
   Log(LOG_DEBUG, "DEBUG ( %s/%s ): %s\n\n", config.name, config.type, sql_data);
 
   return FALSE;
+
+  upsert_result:
+  if (PQresultStatus(ret) != PGRES_COMMAND_OK) {
+    db->errmsg = PQresultErrorMessage(ret);
+    PQclear(ret);
+    Log(LOG_DEBUG, "DEBUG ( %s/%s ): FAILED query follows:\n%s\n", config.name, config.type, multi_values_buffer);
+    if (db->errmsg) Log(LOG_ERR, "ERROR ( %s/%s ): %s\n\n", config.name, config.type, db->errmsg);
+    sql_db_fail(db);
+
+    return TRUE;
+  }
+  PQclear(ret);
+  idata->iqn++;
+
+  return FALSE;
 }
 
 void PG_cache_purge(struct db_cache *queue[], int index, struct insert_data *idata)
@@ -468,6 +511,7 @@ void PG_cache_purge(struct db_cache *queue[], int index, struct insert_data *ida
   strlcpy(orig_lock_clause, lock_clause, LONGSRVBUFLEN);
 
   start:
+  memset(&idata->mv, 0, sizeof(struct multi_values));
   memcpy(queue, pending_queries_queue, pqq_ptr*sizeof(struct db_cache *));
   memset(pending_queries_queue, 0, pqq_ptr*sizeof(struct db_cache *));
   index = pqq_ptr; pqq_ptr = 0;
@@ -552,11 +596,24 @@ void PG_cache_purge(struct db_cache *queue[], int index, struct insert_data *ida
         reprocess_idx++;
 
 	if (!reprocess) sql_db_fail(&p);
-        reprocess = REPROCESS_SPECIFIC;
+	/* a failed UPSERT batch takes along rows of earlier calls */
+        if (config.sql_upsert_batch) reprocess = REPROCESS_BULK;
+        else reprocess = REPROCESS_SPECIFIC;
       }
     }
   }
 
+  /* multi-row UPSERT query: wrap-up */
+  if (idata->mv.buffer_elem_num) {
+    idata->mv.last_queue_elem = TRUE;
+    if (sql_query(&bed, bulk_reprocess_queries_queue[bulk_reprocess_idx-1], idata)) {
+      if (!reprocess) sql_db_fail(&p);
+      reprocess = REPROCESS_BULK;
+    }
+    else idata->qn--; /* increased by sql_query() one time too much */
+    idata->mv.last_queue_elem = FALSE;
+  }
+
   /* Finalizing DB transaction */
   if (!p.fail) {
     if (config.sql_use_copy) {
@@ -708,6 +765,7 @@ int PG_compose_static_queries()
   if (config.sql_dont_try_update) snprintf(lock_clause, sizeof(lock_clause), "BEGIN;");
   else {
     if (config.sql_locking_style) lock = sql_select_locking_style(config.sql_locking_style); 
+    else if (config.sql_upsert_batch) lock = PM_LOCK_NONE; /* conflicts are solved by the server */
     switch (lock) {
     case PM_LOCK_NONE:
       snprintf(lock_clause, sizeof(lock_clause), "BEGIN;");
@@ -759,6 +817,9 @@ int PG_compose_static_queries()
     }
   }
 
+  /* "... ON CONFLICT ... DO UPDATE ..." stuff */
+  if (config.sql_upsert_batch) sql_compose_upsert_clause(" ON CONFLICT (%s) DO UPDATE SET ", "EXCLUDED.%s");
+
   /* values for COPY */
   memcpy(&copy_values, &values, sizeof(copy_values));
   {
@@ -986,6 +1047,11 @@ void PG_init_default_values(struct insert_data *idata)
 
   if (config.sql_backup_host) idata->recover = TRUE;
   if (!config.sql_dont_try_update && config.sql_use_copy) config.sql_use_copy = FALSE; 
+  if (config.sql_upsert_batch && config.sql_use_copy) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): 'sql_upsert_batch' takes precedence over 'sql_use_copy'.\n", config.name, config.type);
+    config.sql_use_copy = FALSE;
+  }
+  sql_init_upsert();
 
   if (config.sql_locking_style) idata->locks = sql_select_locking_style(config.sql_locking_style);
 }
@@ -396,11 +396,11 @@ void evaluate_packet_handlers()
         }
         primitives++;
       }
-      else if (config.acct_type == ACCT_NF && config.nfacctd_bgp) {
+      else if (config.acct_type == ACCT_NF && (config.nfacctd_bgp || config.nfacctd_bmp)) {
         channels_list[index].phandler[primitives] = bgp_ext_handler;
         primitives++;
       }
-      else if (config.acct_type == ACCT_SF && config.nfacctd_bgp) {
+      else if (config.acct_type == ACCT_SF && (config.nfacctd_bgp || config.nfacctd_bmp)) {
         channels_list[index].phandler[primitives] = bgp_ext_handler;
         primitives++;
       }
@@ -2406,6 +2406,16 @@ void NF_counters_msecs_handler(struct channels_list_entry *chptr, struct packet_
     }
     break;
   default:
+    if (pptrs->f_cols) {
+      struct nfv5_columns *cols = (struct nfv5_columns *) pptrs->f_cols;
+
+      pdata->pkt_len = cols->dOctets[cols->cur];
+      pdata->pkt_num = cols->dPkts[cols->cur];
+      pdata->time_start.tv_sec = cols->time_start[cols->cur];
+      pdata->time_end.tv_sec = cols->time_end[cols->cur];
+      break;
+    }
+
     pdata->pkt_len = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dOctets);
     pdata->pkt_num = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dPkts);
     pdata->time_start.tv_sec = ntohl(((struct struct_header_v5 *) pptrs->f_header)->unix_secs)-
@@ -2520,6 +2530,16 @@ void NF_counters_secs_handler(struct channels_list_entry *chptr, struct packet_p
     }
     break;
   default:
+    if (pptrs->f_cols) {
+      struct nfv5_columns *cols = (struct nfv5_columns *) pptrs->f_cols;
+
+      pdata->pkt_len = cols->dOctets[cols->cur];
+      pdata->pkt_num = cols->dPkts[cols->cur];
+      pdata->time_start.tv_sec = cols->unix_secs-(cols->SysUptime-cols->First[cols->cur]);
+      pdata->time_end.tv_sec = cols->unix_secs-(cols->SysUptime-cols->Last[cols->cur]);
+      break;
+    }
+
     pdata->pkt_len = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dOctets);
     pdata->pkt_num = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dPkts);
     pdata->time_start.tv_sec = ntohl(((struct struct_header_v5 *) pptrs->f_header)->unix_secs)-
@@ -2620,8 +2640,16 @@ void NF_counters_new_handler(struct channels_list_entry *chptr, struct packet_pt
     pdata->time_end.tv_usec = 0;
     break;
   default:
-    pdata->pkt_len = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dOctets);
-    pdata->pkt_num = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dPkts);
+    if (pptrs->f_cols) {
+      struct nfv5_columns *cols = (struct nfv5_columns *) pptrs->f_cols;
+
+      pdata->pkt_len = cols->dOctets[cols->cur];
+      pdata->pkt_num = cols->dPkts[cols->cur];
+    }
+    else {
+      pdata->pkt_len = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dOctets);
+      pdata->pkt_num = ntohl(((struct struct_export_v5 *) pptrs->f_data)->dPkts);
+    }
     pdata->time_start.tv_sec = 0;
     pdata->time_start.tv_usec = 0;
     pdata->time_end.tv_sec = 0;
@@ -2858,17 +2886,8 @@ void NF_out_iface_handler(struct channels_list_entry *chptr, struct packet_ptrs
 void NF_sampling_rate_handler(struct channels_list_entry *chptr, struct packet_ptrs *pptrs, char **data)
 {
   struct xflow_status_entry *xsentry = (struct xflow_status_entry *) pptrs->f_status;
-  struct xflow_status_entry *entry = (struct xflow_status_entry *) pptrs->f_status;
-  struct xflow_status_entry_sampling *sentry = NULL;
   struct pkt_data *pdata = (struct pkt_data *) *data;
-  struct struct_header_v8 *hdr = (struct struct_header_v8 *) pptrs->f_header;
-  struct struct_header_v5 *hdr5 = (struct struct_header_v5 *) pptrs->f_header;
-  struct template_cache_entry *tpl = (struct template_cache_entry *) pptrs->f_tpl;
-  u_int16_t srate = 0, is_sampled = 0;
-  u_int16_t t16 = 0;
-  u_int32_t sampler_id = 0, sample_pool = 0, t32 = 0;
-  u_int8_t t8 = 0;
-  u_int64_t t64 = 0;
+  u_int32_t srate = 0;
 
   pdata->primitives.sampling_rate = 0; /* 0 = unknown */
 
@@ -2887,79 +2906,7 @@ void NF_sampling_rate_handler(struct channels_list_entry *chptr, struct packet_p
   }
 
   if (pdata->primitives.sampling_rate == 0) { /* 0 = still unknown */
-    switch (hdr->version) {
-    case 10:
-    case 9:
-      if (tpl->tpl[NF9_FLOW_SAMPLER_ID].len || tpl->tpl[NF9_SELECTOR_ID].len == 8) {
-        if (tpl->tpl[NF9_FLOW_SAMPLER_ID].len == 1) {
-          memcpy(&t8, pptrs->f_data+tpl->tpl[NF9_FLOW_SAMPLER_ID].off, 1);
-          sampler_id = t8;
-        }
-        else if (tpl->tpl[NF9_FLOW_SAMPLER_ID].len == 2) {
-          memcpy(&t16, pptrs->f_data+tpl->tpl[NF9_FLOW_SAMPLER_ID].off, 2);
-          sampler_id = ntohs(t16);
-        }
-        else if (tpl->tpl[NF9_FLOW_SAMPLER_ID].len == 4) {
-          memcpy(&t32, pptrs->f_data+tpl->tpl[NF9_FLOW_SAMPLER_ID].off, 4);
-          sampler_id = ntohl(t32);
-        }
-        else if (tpl->tpl[NF9_SELECTOR_ID].len == 8) {
-          memcpy(&t64, pptrs->f_data+tpl->tpl[NF9_SELECTOR_ID].off, 8);
-          sampler_id = pm_ntohll(t64); /* XXX: sampler_id to be moved to 64 bit */
-        }
-
-        if (entry) {
-	  sentry = search_smp_id_status_table(entry->sampling, sampler_id, TRUE);
-	  if (!sentry && pptrs->f_status_g) {
-	    entry = (struct xflow_status_entry *) pptrs->f_status_g;
-	    sentry = search_smp_id_status_table(entry->sampling, sampler_id, FALSE);
-	  } 
-        }
-        if (sentry) pdata->primitives.sampling_rate = sentry->sample_pool;
-      }
-      /* SAMPLING_INTERVAL part of the NetFlow v9/IPFIX record seems to be reality, ie. FlowMon by Invea-Tech */
-      else if (tpl->tpl[NF9_SAMPLING_INTERVAL].len || tpl->tpl[NF9_FLOW_SAMPLER_INTERVAL].len) {
-        if (tpl->tpl[NF9_SAMPLING_INTERVAL].len == 2) {
-	  memcpy(&t16, pptrs->f_data+tpl->tpl[NF9_SAMPLING_INTERVAL].off, 2);
-	  sample_pool = ntohs(t16);
-        }
-        else if (tpl->tpl[NF9_SAMPLING_INTERVAL].len == 4) {
-	  memcpy(&t32, pptrs->f_data+tpl->tpl[NF9_SAMPLING_INTERVAL].off, 4);
-	  sample_pool = ntohl(t32);
-        }
-
-        if (tpl->tpl[NF9_FLOW_SAMPLER_INTERVAL].len == 2) {
-	  memcpy(&t16, pptrs->f_data+tpl->tpl[NF9_FLOW_SAMPLER_INTERVAL].off, 2);
-	  sample_pool = ntohs(t16);
-        }
-        else if (tpl->tpl[NF9_FLOW_SAMPLER_INTERVAL].len == 4) {
-	  memcpy(&t32, pptrs->f_data+tpl->tpl[NF9_FLOW_SAMPLER_INTERVAL].off, 4);
-          sample_pool = ntohl(t32);
-        }
-
-        pdata->primitives.sampling_rate = sample_pool;
-      }
-      /* case of no SAMPLER_ID, ALU & IPFIX */
-      else {
-        if (entry) {
-          sentry = search_smp_id_status_table(entry->sampling, 0, TRUE);
-          if (!sentry && pptrs->f_status_g) {
-            entry = (struct xflow_status_entry *) pptrs->f_status_g;
-            sentry = search_smp_id_status_table(entry->sampling, 0, FALSE);
-          }
-        }
-        if (sentry) pdata->primitives.sampling_rate = sentry->sample_pool;
-      }
-      break;
-    case 5:
-      hdr5 = (struct struct_header_v5 *) pptrs->f_header;
-      is_sampled = ( ntohs(hdr5->sampling) & 0xC000 );
-      srate = ( ntohs(hdr5->sampling) & 0x3FFF );
-      if (srate) pdata->primitives.sampling_rate = srate;
-      break;
-    default:
-      break;
-    }
+    if (NF_evaluate_sampling_rate(pptrs, &srate)) pdata->primitives.sampling_rate = srate;
   }
 
   if (config.sfacctd_renormalize && pdata->primitives.sampling_rate)
@@ -3038,7 +2985,8 @@ void NF_timestamp_start_handler(struct channels_list_entry *chptr, struct packet
     }
     break;
   default:
-    pnat->timestamp_start.tv_sec = ntohl(((struct struct_header_v5 *) pptrs->f_header)->unix_secs)-
+    if (pptrs->f_cols) pnat->timestamp_start.tv_sec = ((struct nfv5_columns *) pptrs->f_cols)->time_start[((struct nfv5_columns *) pptrs->f_cols)->cur];
+    else pnat->timestamp_start.tv_sec = ntohl(((struct struct_header_v5 *) pptrs->f_header)->unix_secs)-
       ((ntohl(((struct struct_header_v5 *) pptrs->f_header)->SysUptime)-ntohl(((struct struct_export_v5 *) pptrs->f_data)->First))/1000);
     break;
   }
@@ -3101,8 +3049,9 @@ void NF_timestamp_end_handler(struct channels_list_entry *chptr, struct packet_p
     }
     break;
   default:
-    pnat->timestamp_end.tv_sec = ntohl(((struct struct_header_v5 *) pptrs->f_header)->unix_secs)-
-      ((ntohl(((struct struct_header_v5 *) pptrs->f_header)->SysUptime)-ntohl(((struct struct_export_v5 *) pptrs->f_data)->Last))/1000); 
+    if (pptrs->f_cols) pnat->timestamp_end.tv_sec = ((struct nfv5_columns *) pptrs->f_cols)->time_end[((struct nfv5_columns *) pptrs->f_cols)->cur];
+    else pnat->timestamp_end.tv_sec = ntohl(((struct struct_header_v5 *) pptrs->f_header)->unix_secs)-
+      ((ntohl(((struct struct_header_v5 *) pptrs->f_header)->SysUptime)-ntohl(((struct struct_export_v5 *) pptrs->f_data)->Last))/1000);
     break;
   }
 
@@ -3553,22 +3502,23 @@ void NF_cust_label_handler(struct channels_list_entry *chptr, struct packet_ptrs
   }
 }
 
-void NF_counters_renormalize_handler(struct channels_list_entry *chptr, struct packet_ptrs *pptrs, char **data)
+/*
+   Resolves the sampling rate advertised by the exporter for the current
+   NetFlow/IPFIX record: v5 header, sampling fields within the record or
+   option data cached per exporter and sampler ID. Returns TRUE if found.
+*/
+int NF_evaluate_sampling_rate(struct packet_ptrs *pptrs, u_int32_t *srate)
 {
   struct xflow_status_entry *entry = (struct xflow_status_entry *) pptrs->f_status;
   struct xflow_status_entry_sampling *sentry = NULL;
-  struct pkt_data *pdata = (struct pkt_data *) *data;
   struct struct_header_v8 *hdr = (struct struct_header_v8 *) pptrs->f_header;
   struct struct_header_v5 *hdr5 = (struct struct_header_v5 *) pptrs->f_header;
   struct template_cache_entry *tpl = (struct template_cache_entry *) pptrs->f_tpl;
-  u_int16_t srate = 0, is_sampled = 0;
   u_int16_t t16 = 0;
   u_int32_t sampler_id = 0, sample_pool = 0, t32 = 0;
   u_int8_t t8 = 0;
   u_int64_t t64 = 0;
 
-  if (pptrs->renormalized) return;
-
   switch (hdr->version) {
   case 10:
   case 9:
@@ -3589,20 +3539,6 @@ void NF_counters_renormalize_handler(struct channels_list_entry *chptr, struct p
         memcpy(&t64, pptrs->f_data+tpl->tpl[NF9_SELECTOR_ID].off, 8);
         sampler_id = pm_ntohll(t64); /* XXX: sampler_id to be moved to 64 bit */
       }
-
-      if (entry) {
-        sentry = search_smp_id_status_table(entry->sampling, sampler_id, TRUE);
-        if (!sentry && pptrs->f_status_g) {
-          entry = (struct xflow_status_entry *) pptrs->f_status_g;
-          sentry = search_smp_id_status_table(entry->sampling, sampler_id, FALSE);
-        }
-      }
-      if (sentry) {
-        pdata->pkt_len = pdata->pkt_len * sentry->sample_pool;
-        pdata->pkt_num = pdata->pkt_num * sentry->sample_pool;
-
-	pptrs->renormalized = TRUE;
-      }
     }
     /* SAMPLING_INTERVAL part of the NetFlow v9/IPFIX record seems to be reality, ie. FlowMon by Invea-Tech */
     else if (tpl->tpl[NF9_SAMPLING_INTERVAL].len || tpl->tpl[NF9_FLOW_SAMPLER_INTERVAL].len) {
@@ -3624,45 +3560,49 @@ void NF_counters_renormalize_handler(struct channels_list_entry *chptr, struct p
         sample_pool = ntohl(t32);
       }
 
-      pdata->pkt_len = pdata->pkt_len * sample_pool;
-      pdata->pkt_num = pdata->pkt_num * sample_pool;
-
-      pptrs->renormalized = TRUE;
+      *srate = sample_pool;
+      return TRUE;
     }
-    /* case of no SAMPLER_ID, ALU & IPFIX */
-    else {
-      if (entry) {
-        sentry = search_smp_id_status_table(entry->sampling, 0, TRUE);
-        if (!sentry && pptrs->f_status_g) {
-          entry = (struct xflow_status_entry *) pptrs->f_status_g;
-          sentry = search_smp_id_status_table(entry->sampling, 0, FALSE);
-        }
-      }
-      if (sentry) {
-        pdata->pkt_len = pdata->pkt_len * sentry->sample_pool;
-        pdata->pkt_num = pdata->pkt_num * sentry->sample_pool;
+    /* else: case of no SAMPLER_ID, ALU & IPFIX; sampler_id stays zero */
 
-        pptrs->renormalized = TRUE;
+    if (entry) {
+      sentry = search_smp_id_status_table(entry, sampler_id, TRUE);
+      if (!sentry && pptrs->f_status_g) {
+        entry = (struct xflow_status_entry *) pptrs->f_status_g;
+        sentry = search_smp_id_status_table(entry, sampler_id, FALSE);
       }
     }
-
+    if (sentry) {
+      *srate = sentry->sample_pool;
+      return TRUE;
+    }
     break;
   case 5:
-    hdr5 = (struct struct_header_v5 *) pptrs->f_header;
-    is_sampled = ( ntohs(hdr5->sampling) & 0xC000 );
-    srate = ( ntohs(hdr5->sampling) & 0x3FFF );
     /* XXX: checking srate value instead of is_sampled as Sampling
        Mode seems not to be a mandatory field. */
-    if (srate) {
-      pdata->pkt_len = pdata->pkt_len * srate;
-      pdata->pkt_num = pdata->pkt_num * srate;
-
-      pptrs->renormalized = TRUE;
-    }
+    if ((*srate = (ntohs(hdr5->sampling) & 0x3FFF))) return TRUE;
     break;
   default:
     break;
   }
+
+  return FALSE;
+}
+
+void NF_counters_renormalize_handler(struct channels_list_entry *chptr, struct packet_ptrs *pptrs, char **data)
+{
+  struct pkt_data *pdata = (struct pkt_data *) *data;
+  u_int32_t srate = 0;
+
+  if (pptrs->renormalized) return;
+
+  if (NF_evaluate_sampling_rate(pptrs, &srate)) {
+    pdata->pkt_len = pdata->pkt_len * srate;
+    pdata->pkt_num = pdata->pkt_num * srate;
+
+    if (pptrs->f_status) ((struct xflow_status_entry *) pptrs->f_status)->srate = srate;
+    pptrs->renormalized = TRUE;
+  }
 }
 
 void NF_counters_map_renormalize_handler(struct channels_list_entry *chptr, struct packet_ptrs *pptrs, char **data)
@@ -3688,6 +3628,7 @@ void NF_counters_map_renormalize_handler(struct channels_list_entry *chptr, stru
     pdata->pkt_len = pdata->pkt_len * pptrs->st;
     pdata->pkt_num = pdata->pkt_num * pptrs->st;
 
+    if (xsentry) xsentry->srate = pptrs->st;
     pptrs->renormalized = TRUE;
   }
 }
@@ -4138,7 +4079,7 @@ void SF_counters_renormalize_handler(struct channels_list_entry *chptr, struct p
 
   if (pptrs->renormalized) return;
 
-  if (entry) sentry = search_smp_if_status_table(entry->sampling, (sample->ds_class << 24 | sample->ds_index));
+  if (entry) sentry = search_smp_if_status_table(entry, (sample->ds_class << 24 | sample->ds_index));
   if (sentry) { 
     /* flow sequence number is strictly increasing; however we need a) to avoid
        a division-by-zero by checking the last value and the new one and b) to
@@ -4147,6 +4088,7 @@ void SF_counters_renormalize_handler(struct channels_list_entry *chptr, struct p
       eff_srate = (sample->samplePool-sentry->sample_pool) / (sample->samplesGenerated-sentry->seqno);
       pdata->pkt_len = pdata->pkt_len * eff_srate;
       pdata->pkt_num = pdata->pkt_num * eff_srate;
+      entry->srate = eff_srate;
 
       sentry->sample_pool = sample->samplePool;
       sentry->seqno = sample->samplesGenerated;
@@ -4166,11 +4108,13 @@ void SF_counters_renormalize_handler(struct channels_list_entry *chptr, struct p
       sentry->interface = (sample->ds_class << 24 | sample->ds_index);
       sentry->sample_pool = sample->samplePool;
       sentry->seqno = sample->samplesGenerated; 
+      update_smp_cache_status_table(entry, sentry, sentry->interface);
     }
   }
 
   pdata->pkt_len = pdata->pkt_len * sample->meanSkipCount;
   pdata->pkt_num = pdata->pkt_num * sample->meanSkipCount;
+  if (entry) entry->srate = sample->meanSkipCount;
 
   pptrs->renormalized = TRUE;
 }
@@ -4198,6 +4142,7 @@ void SF_counters_map_renormalize_handler(struct channels_list_entry *chptr, stru
     pdata->pkt_len = pdata->pkt_len * pptrs->st;
     pdata->pkt_num = pdata->pkt_num * pptrs->st;
 
+    if (xsentry) xsentry->srate = pptrs->st;
     pptrs->renormalized = TRUE;
   }
 }
@@ -113,6 +113,7 @@ EXT void NF_sequence_number_handler(struct channels_list_entry *, struct packet_
 EXT void NF_version_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void NF_custom_primitives_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void NF_counters_renormalize_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
+EXT int NF_evaluate_sampling_rate(struct packet_ptrs *, u_int32_t *);
 EXT void NF_counters_map_renormalize_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void NF_cust_tag_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
 EXT void NF_cust_tag2_handler(struct channels_list_entry *, struct packet_ptrs *, char **);
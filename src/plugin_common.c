@@ -84,10 +84,10 @@ void P_init_default_values()
 	config.print_cache_entries, ((config.print_cache_entries * dbc_size) + (2 * ((sa.num +
 	config.print_cache_entries) * sizeof(struct chained_cache *))) + sa.size));
 
-  cache = (struct chained_cache *) pm_malloc(config.print_cache_entries*dbc_size);
-  queries_queue = (struct chained_cache **) pm_malloc((sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
-  pending_queries_queue = (struct chained_cache **) pm_malloc((sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
-  sa.base = (unsigned char *) pm_malloc(sa.size);
+  cache = (struct chained_cache *) pm_malloc_cache(config.print_cache_entries*dbc_size);
+  queries_queue = (struct chained_cache **) pm_malloc_cache((sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
+  pending_queries_queue = (struct chained_cache **) pm_malloc_cache((sa.num+config.print_cache_entries)*sizeof(struct chained_cache *));
+  sa.base = (unsigned char *) pm_malloc_cache(sa.size);
   sa.ptr = sa.base;
   sa.next = NULL;
 
@@ -98,6 +98,9 @@ void P_init_default_values()
   memset(&flushtime, 0, sizeof(flushtime));
   memset(&sql_writers, 0, sizeof(sql_writers));
 
+  /* one stitching record per cache entry, chained ones included */
+  if (config.nfacctd_stitching) stitch_pool_init(config.print_cache_entries+sa.num);
+
   /* handling purge preprocessor */
   set_preprocess_funcs(config.sql_preprocess, &prep, PREP_DICT_PRINT);
 }
@@ -409,25 +412,8 @@ void P_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *idata
     }
 
     if (config.nfacctd_stitching) {
-      if (!cache_ptr->stitch) cache_ptr->stitch = (struct pkt_stitching *) malloc(sizeof(struct pkt_stitching));
-      if (cache_ptr->stitch) {
-	if (data->time_start.tv_sec) {
-	  memcpy(&cache_ptr->stitch->timestamp_min, &data->time_start, sizeof(struct timeval));
-	}
-	else {
-	  cache_ptr->stitch->timestamp_min.tv_sec = idata->now; 
-	  cache_ptr->stitch->timestamp_min.tv_usec = 0;
-	}
-
-	if (data->time_end.tv_sec) {
-	  memcpy(&cache_ptr->stitch->timestamp_max, &data->time_end, sizeof(struct timeval));
-	}
-	else {
-	  cache_ptr->stitch->timestamp_max.tv_sec = idata->now;
-	  cache_ptr->stitch->timestamp_max.tv_usec = 0;
-	}
-      }
-      else Log(LOG_WARNING, "WARN ( %s/%s ): Finished memory for flow stitching.\n", config.name, config.type);
+      if (!cache_ptr->stitch) cache_ptr->stitch = stitch_alloc();
+      if (cache_ptr->stitch) stitch_init(cache_ptr->stitch, data, idata->now);
     }
     else assert(!cache_ptr->stitch);
 
@@ -450,17 +436,7 @@ void P_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *idata
         cache_ptr->flow_counter += data->cst.fa;
       }
 
-      if (config.nfacctd_stitching) {
-	if (cache_ptr->stitch) {
-	  if (data->time_end.tv_sec) {
-	    memcpy(&cache_ptr->stitch->timestamp_max, &data->time_end, sizeof(struct timeval));
-	  }
-	  else {
-	    cache_ptr->stitch->timestamp_max.tv_sec = idata->now;
-	    cache_ptr->stitch->timestamp_max.tv_usec = 0;
-	  }
-	}
-      }
+      if (config.nfacctd_stitching && cache_ptr->stitch) stitch_update(cache_ptr->stitch, data, idata->now);
     }
     else {
       /* entry invalidated; restarting counters */
@@ -474,6 +450,12 @@ void P_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *idata
         cache_ptr->packet_counter += data->cst.pa;
         cache_ptr->flow_counter += data->cst.fa;
       }
+
+      if (config.nfacctd_stitching) {
+        if (!cache_ptr->stitch) cache_ptr->stitch = stitch_alloc();
+        if (cache_ptr->stitch) stitch_init(cache_ptr->stitch, data, idata->now);
+      }
+
       cache_ptr->valid = PRINT_CACHE_INUSE;
       cache_ptr->basetime.tv_sec = ibasetime.tv_sec;
       cache_ptr->basetime.tv_usec = ibasetime.tv_usec;
@@ -575,7 +557,7 @@ void P_cache_insert_pending(struct chained_cache *queue[], int index, struct cha
     if (cache_ptr->pnat) free(cache_ptr->pnat);
     if (cache_ptr->pcust) free(cache_ptr->pcust);
     if (cache_ptr->pvlen) free(cache_ptr->pvlen);
-    if (cache_ptr->stitch) free(cache_ptr->stitch);
+    if (cache_ptr->stitch) stitch_free(cache_ptr->stitch);
 
     memcpy(cache_ptr, &container[j], dbc_size); 
 
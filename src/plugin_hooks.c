@@ -28,6 +28,11 @@
 #include "plugin_hooks.h"
 #include "pkt_handlers.h"
 
+#if defined ENABLE_THREADS
+static pthread_mutex_t channels_lock[MAX_N_PLUGINS];
+static int channels_lock_init;
+#endif
+
 /* functions */
 
 /* load_plugins() starts plugin processes; creates pipes
@@ -229,6 +234,9 @@ void load_plugins(struct plugin_requests *req)
 	close(config.sock);
 	close(config.bgp_sock);
 	if (!list->cfg.pipe_amqp) close(list->pipe[1]);
+	reset_placement(config.plugin_numa_node, config.proc_cpu_affinity, config.proc_sched_policy);
+	set_placement(list->name, list->type.string, "process", list->cfg.plugin_numa_node, list->cfg.proc_cpu_affinity,
+		      ERR, list->cfg.proc_sched_policy, list->cfg.proc_sched_priority);
 	(*list->type.func)(list->pipe[0], &list->cfg, chptr);
 	exit(0);
       default: /* Parent */
@@ -374,15 +382,17 @@ void exec_plugins(struct packet_ptrs *pptrs, struct plugin_requests *req)
   pm_id_t saved_tag = 0, saved_tag2 = 0;
   pt_label_t saved_label;
 
-  int num, ret, fixed_size, already_reprocessed = 0;
+  int num, fixed_size, already_reprocessed = 0;
   u_int32_t savedptr;
   char *bptr;
   int index, got_tags = FALSE;
+  struct channels_list_entry *chlist = producer_channels ? producer_channels : channels_list;
 
   pretag_init_label(&saved_label);
 
 #if defined WITH_GEOIPV2
-  if (reload_geoipv2_file && config.geoipv2_file) {
+  /* producer threads: reloaded by the thread handing datagrams over */
+  if (reload_geoipv2_file && config.geoipv2_file && !producer_channels) {
     pm_geoipv2_close();
     pm_geoipv2_init();
 
@@ -390,8 +400,8 @@ void exec_plugins(struct packet_ptrs *pptrs, struct plugin_requests *req)
   }
 #endif
 
-  for (index = 0; channels_list[index].aggregation || channels_list[index].aggregation_2; index++) {
-    struct plugins_list_entry *p = channels_list[index].plugin;
+  for (index = 0; chlist[index].aggregation || chlist[index].aggregation_2; index++) {
+    struct plugins_list_entry *p = chlist[index].plugin;
 
     if (p->cfg.pre_tag_map && find_id_func) {
       if (p->cfg.ptm_global && got_tags) {
@@ -420,41 +430,41 @@ void exec_plugins(struct packet_ptrs *pptrs, struct plugin_requests *req)
       }
     }
 
-    if (evaluate_filters(&channels_list[index].agg_filter, pptrs->packet_ptr, pptrs->pkthdr) &&
-        !evaluate_tags(&channels_list[index].tag_filter, pptrs->tag) && 
-        !evaluate_tags(&channels_list[index].tag2_filter, pptrs->tag2) && 
-        !evaluate_labels(&channels_list[index].label_filter, &pptrs->label) && 
-	!check_shadow_status(pptrs, &channels_list[index])) {
+    if (evaluate_filters(&chlist[index].agg_filter, pptrs->packet_ptr, pptrs->pkthdr) &&
+        !evaluate_tags(&chlist[index].tag_filter, pptrs->tag) && 
+        !evaluate_tags(&chlist[index].tag2_filter, pptrs->tag2) && 
+        !evaluate_labels(&chlist[index].label_filter, &pptrs->label) && 
+	!check_shadow_status(pptrs, &chlist[index])) {
       /* arranging buffer: supported primitives + packet total length */
 reprocess:
-      channels_list[index].reprocess = FALSE;
+      chlist[index].reprocess = FALSE;
       num = 0;
 
       /* rg.ptr points to slot's base address into the ring (shared memory); bufptr works
 	 as a displacement into the slot to place sequentially packets */
-      bptr = channels_list[index].rg.ptr+ChBufHdrSz+channels_list[index].bufptr; 
-      fixed_size = (*channels_list[index].clean_func)(bptr, channels_list[index].datasize);
-      channels_list[index].var_size = 0; 
-      savedptr = channels_list[index].bufptr;
+      bptr = chlist[index].rg.ptr+ChBufHdrSz+chlist[index].bufptr; 
+      fixed_size = (*chlist[index].clean_func)(bptr, chlist[index].datasize);
+      chlist[index].var_size = 0; 
+      savedptr = chlist[index].bufptr;
       reset_fallback_status(pptrs);
       
-      while (channels_list[index].phandler[num]) {
-        (*channels_list[index].phandler[num])(&channels_list[index], pptrs, &bptr);
+      while (chlist[index].phandler[num]) {
+        (*chlist[index].phandler[num])(&chlist[index], pptrs, &bptr);
         num++;
       }
 
-      if (channels_list[index].s.rate && !channels_list[index].s.sampled_pkts) {
-	channels_list[index].reprocess = FALSE;
-	channels_list[index].bufptr = savedptr;
-	channels_list[index].hdr.num--; /* let's cheat this value as it will get increased later */
+      if (chlist[index].s.rate && !chlist[index].s.sampled_pkts) {
+	chlist[index].reprocess = FALSE;
+	chlist[index].bufptr = savedptr;
+	chlist[index].hdr.num--; /* let's cheat this value as it will get increased later */
 	fixed_size = 0;
-	channels_list[index].var_size = 0;
+	chlist[index].var_size = 0;
       }
 
-      if (channels_list[index].reprocess) {
+      if (chlist[index].reprocess) {
         /* Let's check if we have an issue with the buffer size */
         if (already_reprocessed) {
-          struct plugins_list_entry *list = channels_list[index].plugin;
+          struct plugins_list_entry *list = chlist[index].plugin;
 
           Log(LOG_ERR, "ERROR ( %s/%s ): plugin_buffer_size is too short.\n", list->name, list->type.string);
           exit_all(1);
@@ -462,85 +472,27 @@ reprocess:
         already_reprocessed = TRUE;
 
 	/* Let's cheat the size in order to send out the current buffer */
-	fixed_size = channels_list[index].plugin->cfg.pipe_size;
+	fixed_size = chlist[index].plugin->cfg.pipe_size;
       }
       else {
-        channels_list[index].hdr.num++;
-        channels_list[index].bufptr += (fixed_size + channels_list[index].var_size);
+        chlist[index].hdr.num++;
+        chlist[index].bufptr += (fixed_size + chlist[index].var_size);
       }
 
-      if ((channels_list[index].bufptr+fixed_size) > channels_list[index].bufend ||
-	  channels_list[index].hdr.num == INT_MAX) {
-	channels_list[index].hdr.seq++;
-	channels_list[index].hdr.seq %= MAX_SEQNUM;
-
-	/* let's commit the buffer we just finished writing */
-	((struct ch_buf_hdr *)channels_list[index].rg.ptr)->seq = channels_list[index].hdr.seq;
-	((struct ch_buf_hdr *)channels_list[index].rg.ptr)->num = channels_list[index].hdr.num;
-	((struct ch_buf_hdr *)channels_list[index].rg.ptr)->core_pid = channels_list[index].core_pid;
-
-        if (config.debug_internal_msg) {
-	  struct plugins_list_entry *list = channels_list[index].plugin;
-	  Log(LOG_DEBUG, "DEBUG ( %s/%s ): buffer released cpid=%u seq=%u num_entries=%u\n", list->name, list->type.string,
-		channels_list[index].core_pid, channels_list[index].hdr.seq, channels_list[index].hdr.num);
-	}
-
-	/* sending the buffer to the AMQP broker */
-	if (channels_list[index].plugin->cfg.pipe_amqp) {
-#ifdef WITH_RABBITMQ
-          struct channels_list_entry *chptr = &channels_list[index];
-
-          plugin_pipe_amqp_sleeper_stop(chptr);
-	  if (!chptr->amqp_host_sleep) ret = p_amqp_publish_binary(&chptr->amqp_host, chptr->rg.ptr, chptr->bufsize);
-	  else ret = FALSE;
-          if (ret) plugin_pipe_amqp_sleeper_start(chptr);
-#endif
-	}
-	/* sending the buffer to the Kafka broker */
-	else if (channels_list[index].plugin->cfg.pipe_kafka) {
-#ifdef WITH_KAFKA
-          struct channels_list_entry *chptr = &channels_list[index];
-
-	  /* XXX: no sleeper thread, trusting librdkafka */
-	  ret = p_kafka_produce_data(&chptr->kafka_host, chptr->rg.ptr, chptr->bufsize);
-#endif
-	}
-	else {
-	  if (channels_list[index].status->wakeup) {
-	    channels_list[index].status->backlog++;
-	  
-	    if (channels_list[index].status->backlog >
-		((channels_list[index].plugin->cfg.pipe_size/channels_list[index].plugin->cfg.buffer_size)
-		*channels_list[index].plugin->cfg.pipe_backlog)/100) {
-	      channels_list[index].status->wakeup = channels_list[index].request;
-              if (write(channels_list[index].pipe, &channels_list[index].rg.ptr, CharPtrSz) != CharPtrSz) {
-	        struct plugins_list_entry *list = channels_list[index].plugin;
-	        Log(LOG_WARNING, "WARN ( %s/%s ): Failed during write: %s\n", list->name, list->type.string, strerror(errno));
-	      }
-	      channels_list[index].status->backlog = 0;
-	    }
-	  }
-	}
-
-	channels_list[index].rg.ptr += channels_list[index].bufsize;
-
-	if ((channels_list[index].rg.ptr+channels_list[index].bufsize) > channels_list[index].rg.end)
-	  channels_list[index].rg.ptr = channels_list[index].rg.base;
-
-	/* let's protect the buffer we are going to write */
-        ((struct ch_buf_hdr *)channels_list[index].rg.ptr)->seq = -1;
-        ((struct ch_buf_hdr *)channels_list[index].rg.ptr)->num = 0;
-        ((struct ch_buf_hdr *)channels_list[index].rg.ptr)->core_pid = 0;
+      if ((chlist[index].bufptr+fixed_size) > chlist[index].bufend ||
+	  chlist[index].hdr.num == INT_MAX) {
+	if (chlist[index].shared) commit_producer_buffer(&chlist[index]);
+	else release_pipe_buffer(&chlist[index]);
 
         /* rewind pointer */
-        channels_list[index].bufptr = channels_list[index].buf;
-        channels_list[index].hdr.num = 0;
+        chlist[index].bufptr = chlist[index].buf;
+        chlist[index].hdr.num = 0;
 
-	if (channels_list[index].reprocess) goto reprocess;
+	if (chlist[index].reprocess) goto reprocess;
 
 	/* if reading from a savefile, let's sleep a bit after
 	   having sent over a buffer worth of data */
-	if (channels_list[index].plugin->cfg.pcap_savefile) usleep(1000); /* 1 msec */ 
+	if (chlist[index].plugin->cfg.pcap_savefile) usleep(1000); /* 1 msec */ 
       }
     }
 
@@ -551,10 +503,11 @@ reprocess:
 
   /* check if we have to reload the map: new loop is to
      ensure we reload it for all plugins and prevent any
-     timing issues with pointers to labels */
-  if (reload_map_exec_plugins) {
-    for (index = 0; channels_list[index].aggregation || channels_list[index].aggregation_2; index++) {
-      struct plugins_list_entry *p = channels_list[index].plugin;
+     timing issues with pointers to labels; collectors may
+     have handed this over to the background map reload */
+  if (reload_map_exec_plugins && !map_reload_ptm()) {
+    for (index = 0; chlist[index].aggregation || chlist[index].aggregation_2; index++) {
+      struct plugins_list_entry *p = chlist[index].plugin;
 
       if (p->cfg.pre_tag_map && find_id_func) {
         load_pre_tag_map(config.acct_type, p->cfg.pre_tag_map, &p->cfg.ptm, req, &p->cfg.ptm_alloc,
@@ -602,11 +555,18 @@ struct channels_list_entry *insert_pipe_channel(int plugin_type, struct configur
       /* +PKT_MSG_SIZE has been introduced as a margin as a
          countermeasure against the reception of malicious NetFlow v9
 	 templates */
-      chptr->rg.base = map_shared(0, cfg->pipe_size+PKT_MSG_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+      chptr->rg.base = map_anonymous(cfg->pipe_size+PKT_MSG_SIZE, MAP_SHARED, cfg->plugin_hugepages);
       if (chptr->rg.base == MAP_FAILED) {
         Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate pipe buffer. Exiting ...\n", cfg->name, cfg->type); 
 	exit_all(1);
       }
+      /* pages get placed on first touch: bind before memset() */
+      if (cfg->plugin_numa_node != ERR) {
+	if (numa_bind_region(chptr->rg.base, map_anonymous_len(cfg->pipe_size+PKT_MSG_SIZE, cfg->plugin_hugepages),
+			     cfg->plugin_numa_node) == ERR)
+	  Log(LOG_WARNING, "WARN ( %s/%s ): Unable to bind pipe buffer to NUMA node %d: %s\n", cfg->name, cfg->type,
+		cfg->plugin_numa_node, strerror(errno));
+      }
       memset(chptr->rg.base, 0, cfg->pipe_size);
       chptr->rg.ptr = chptr->rg.base;
       chptr->rg.end = chptr->rg.base+cfg->pipe_size;
@@ -780,6 +740,141 @@ int evaluate_filters(struct aggregate_filter *filter, char *pkt, struct pcap_pkt
   return FALSE;
 }
 
+/* commits the buffer just filled in to the plugin and moves on to the next one */
+void release_pipe_buffer(struct channels_list_entry *chptr)
+{
+  chptr->hdr.seq++;
+  chptr->hdr.seq %= MAX_SEQNUM;
+
+  /* let's commit the buffer we just finished writing */
+  ((struct ch_buf_hdr *)chptr->rg.ptr)->seq = chptr->hdr.seq;
+  ((struct ch_buf_hdr *)chptr->rg.ptr)->num = chptr->hdr.num;
+  ((struct ch_buf_hdr *)chptr->rg.ptr)->core_pid = chptr->core_pid;
+
+  if (config.debug_internal_msg) {
+    struct plugins_list_entry *list = chptr->plugin;
+    Log(LOG_DEBUG, "DEBUG ( %s/%s ): buffer released cpid=%u seq=%u num_entries=%u\n", list->name, list->type.string,
+	chptr->core_pid, chptr->hdr.seq, chptr->hdr.num);
+  }
+
+  /* sending the buffer to the AMQP broker */
+  if (chptr->plugin->cfg.pipe_amqp) {
+#ifdef WITH_RABBITMQ
+    int ret;
+
+    plugin_pipe_amqp_sleeper_stop(chptr);
+    if (!chptr->amqp_host_sleep) ret = p_amqp_publish_binary(&chptr->amqp_host, chptr->rg.ptr, chptr->bufsize);
+    else ret = FALSE;
+    if (ret) plugin_pipe_amqp_sleeper_start(chptr);
+#endif
+  }
+  /* sending the buffer to the Kafka broker */
+  else if (chptr->plugin->cfg.pipe_kafka) {
+#ifdef WITH_KAFKA
+    /* XXX: no sleeper thread, trusting librdkafka */
+    p_kafka_produce_data(&chptr->kafka_host, chptr->rg.ptr, chptr->bufsize);
+#endif
+  }
+  else {
+    if (chptr->status->wakeup) {
+      chptr->status->backlog++;
+	  
+      if (chptr->status->backlog >
+	  ((chptr->plugin->cfg.pipe_size/chptr->plugin->cfg.buffer_size)*chptr->plugin->cfg.pipe_backlog)/100) {
+	chptr->status->wakeup = chptr->request;
+	if (write(chptr->pipe, &chptr->rg.ptr, CharPtrSz) != CharPtrSz) {
+	  struct plugins_list_entry *list = chptr->plugin;
+	  Log(LOG_WARNING, "WARN ( %s/%s ): Failed during write: %s\n", list->name, list->type.string, strerror(errno));
+	}
+	chptr->status->backlog = 0;
+      }
+    }
+  }
+
+  chptr->rg.ptr += chptr->bufsize;
+
+  if ((chptr->rg.ptr+chptr->bufsize) > chptr->rg.end)
+    chptr->rg.ptr = chptr->rg.base;
+
+  /* let's protect the buffer we are going to write */
+  ((struct ch_buf_hdr *)chptr->rg.ptr)->seq = -1;
+  ((struct ch_buf_hdr *)chptr->rg.ptr)->num = 0;
+  ((struct ch_buf_hdr *)chptr->rg.ptr)->core_pid = 0;
+}
+
+/*
+   Producer channels let multiple threads feed the same plugins: each
+   thread fills in a private copy of the channel buffer, with no locking,
+   and copies it over to the ring, serialized, only once it is full. The
+   plugin sees the usual sequence of buffers. To be called before the
+   producer thread is started.
+*/
+int init_producer_channels(struct channels_list_entry *chlist)
+{
+  int index;
+
+#if defined ENABLE_THREADS
+  if (!channels_lock_init) {
+    for (index = 0; index < MAX_N_PLUGINS; index++) pthread_mutex_init(&channels_lock[index], NULL);
+    channels_lock_init = TRUE;
+  }
+#endif
+
+  memset(chlist, 0, MAX_N_PLUGINS*sizeof(struct channels_list_entry));
+
+  for (index = 0; channels_list[index].aggregation || channels_list[index].aggregation_2; index++) {
+    memcpy(&chlist[index], &channels_list[index], sizeof(struct channels_list_entry));
+    chlist[index].shared = &channels_list[index];
+
+    /* room for a single buffer; some slack as per the ring */
+    chlist[index].rg.base = malloc(chlist[index].bufsize+PKT_MSG_SIZE);
+    if (!chlist[index].rg.base) return ERR;
+    memset(chlist[index].rg.base, 0, chlist[index].bufsize+PKT_MSG_SIZE);
+
+    chlist[index].rg.ptr = chlist[index].rg.base;
+    chlist[index].rg.end = chlist[index].rg.base+chlist[index].bufsize;
+    chlist[index].bufptr = chlist[index].buf;
+    chlist[index].hdr.num = 0;
+    chlist[index].reprocess = FALSE;
+  }
+
+  return SUCCESS;
+}
+
+void commit_producer_buffer(struct channels_list_entry *chptr)
+{
+  struct channels_list_entry *shared = chptr->shared;
+  u_int64_t len = MIN(chptr->bufptr, chptr->bufend);
+#if defined ENABLE_THREADS
+  int index = shared-channels_list;
+
+  pthread_mutex_lock(&channels_lock[index]);
+#endif
+
+  memcpy(shared->rg.ptr+ChBufHdrSz, chptr->rg.ptr+ChBufHdrSz, len);
+  shared->hdr.num = chptr->hdr.num;
+  release_pipe_buffer(shared);
+  shared->hdr.num = 0;
+
+#if defined ENABLE_THREADS
+  pthread_mutex_unlock(&channels_lock[index]);
+#endif
+}
+
+/* hands partially filled producer buffers over to the plugins, ie. on exit */
+void flush_producer_channels(struct channels_list_entry *chlist)
+{
+  int index;
+
+  for (index = 0; chlist[index].aggregation || chlist[index].aggregation_2; index++) {
+    if (chlist[index].shared && chlist[index].hdr.num) {
+      commit_producer_buffer(&chlist[index]);
+      chlist[index].bufptr = chlist[index].buf;
+      chlist[index].hdr.num = 0;
+    }
+  }
+}
+
 void recollect_pipe_memory(struct channels_list_entry *mychptr)
 {
   struct channels_list_entry *chptr;
@@ -788,7 +883,8 @@ void recollect_pipe_memory(struct channels_list_entry *mychptr)
   while (index < MAX_N_PLUGINS) {
     chptr = &channels_list[index];
     if (mychptr->rg.base != chptr->rg.base) {
-      munmap(chptr->rg.base, (chptr->rg.end-chptr->rg.base)+PKT_MSG_SIZE);
+      munmap(chptr->rg.base, map_anonymous_len((chptr->rg.end-chptr->rg.base)+PKT_MSG_SIZE,
+		chptr->plugin ? chptr->plugin->cfg.plugin_hugepages : PM_HUGEPAGES_NONE));
       munmap(chptr->status, sizeof(struct ch_status));
     }
     index++;
@@ -1073,7 +1169,7 @@ void plugin_pipe_amqp_sleeper_start(struct channels_list_entry *chptr)
   if (chptr && !chptr->amqp_host_sleep) {
     struct plugin_pipe_amqp_sleeper *pas;
 
-    chptr->amqp_host_sleep = allocate_thread_pool(1);
+    chptr->amqp_host_sleep = allocate_thread_pool(1, THREAD_POOL_INHERIT);
     assert(chptr->amqp_host_sleep);
 
     pas = plugin_pipe_amqp_sleeper_define(&chptr->amqp_host, &chptr->amqp_host_reconnect, chptr->plugin);
@@ -117,6 +117,7 @@ struct channels_list_entry {
   struct aggregate_filter agg_filter; 			/* filter aggregates basing on L2-L4 primitives */
   struct sampling s;
   struct plugins_list_entry *plugin;			/* backpointer to the plugin the actual channel belongs to */
+  struct channels_list_entry *shared;			/* producer channels: the channel buffers are committed to */
   struct extra_primitives extras;			/* offset for non-standard aggregation primitives structures */
 #ifdef WITH_RABBITMQ
   struct p_amqp_host amqp_host;
@@ -161,6 +162,10 @@ EXT int evaluate_filters(struct aggregate_filter *, char *, struct pcap_pkthdr *
 EXT void recollect_pipe_memory(struct channels_list_entry *);
 EXT void init_random_seed();
 EXT void fill_pipe_buffer();
+EXT void release_pipe_buffer(struct channels_list_entry *);
+EXT int init_producer_channels(struct channels_list_entry *);
+EXT void commit_producer_buffer(struct channels_list_entry *);
+EXT void flush_producer_channels(struct channels_list_entry *);
 EXT int check_pipe_buffer_space(struct channels_list_entry *, struct pkt_vlen_hdr_primitives *, int); 
 EXT void return_pipe_buffer_space(struct channels_list_entry *, int);
 EXT int check_shadow_status(struct packet_ptrs *, struct channels_list_entry *);
@@ -192,6 +197,8 @@ EXT int plugin_pipe_calc_retry_timeout_diff(struct p_broker_timers *, time_t);
 
 EXT void handle_plugin_pipe_dyn_strings(char *, int, char *, struct plugins_list_entry *);
 EXT char *plugin_pipe_compose_default_string(struct plugins_list_entry *, char *);
+
+EXT ThreadLocal struct channels_list_entry *producer_channels;
 #undef EXT
 
 #if (defined __PLUGIN_HOOKS_C)
@@ -201,6 +208,7 @@ EXT char *plugin_pipe_compose_default_string(struct plugins_list_entry *, char *
 #endif
 EXT void imt_plugin(int, struct configuration *, void *);
 EXT void print_plugin(int, struct configuration *, void *);
+EXT void null_plugin(int, struct configuration *, void *);
 EXT void nfprobe_plugin(int, struct configuration *, void *);
 EXT void sfprobe_plugin(int, struct configuration *, void *);
 EXT void tee_plugin(int, struct configuration *, void *);
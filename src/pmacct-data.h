@@ -32,6 +32,7 @@
 #define PLUGIN_ID_MONGODB	9
 #define PLUGIN_ID_AMQP		10
 #define PLUGIN_ID_KAFKA		11
+#define PLUGIN_ID_NULL		12
 #define PLUGIN_ID_UNKNOWN       -1
 
 /* vars */
@@ -315,6 +316,15 @@ static const struct _dictionary_line dictionary[] = {
   {"pcap_filter", cfg_key_pcap_filter},
   {"core_proc_name", cfg_key_proc_name},
   {"proc_priority", cfg_key_proc_priority},
+  {"plugin_hugepages", cfg_key_plugin_hugepages},
+  {"plugin_numa_node", cfg_key_plugin_numa_node},
+  {"proc_cpu_affinity", cfg_key_proc_cpu_affinity},
+  {"proc_sched_policy", cfg_key_proc_sched_policy},
+  {"proc_sched_priority", cfg_key_proc_sched_priority},
+  {"thread_pool_cpu_affinity", cfg_key_thread_pool_cpu_affinity},
+  {"thread_pool_numa_node", cfg_key_thread_pool_numa_node},
+  {"thread_pool_sched_policy", cfg_key_thread_pool_sched_policy},
+  {"thread_pool_sched_priority", cfg_key_thread_pool_sched_priority},
   {"pmacctd_as", cfg_key_nfacctd_as_new},
   {"uacctd_as", cfg_key_nfacctd_as_new},
   {"pmacctd_net", cfg_key_nfacctd_net},
@@ -359,6 +369,7 @@ static const struct _dictionary_line dictionary[] = {
   {"imt_buckets", cfg_key_imt_buckets},
   {"imt_mem_pools_number", cfg_key_imt_mem_pools_number},
   {"imt_mem_pools_size", cfg_key_imt_mem_pools_size},
+  {"imt_index", cfg_key_imt_index},
   {"sql_db", cfg_key_sql_db},
   {"sql_table", cfg_key_sql_table},
   {"sql_table_schema", cfg_key_sql_table_schema},
@@ -386,12 +397,18 @@ static const struct _dictionary_line dictionary[] = {
   {"sql_preprocess", cfg_key_sql_preprocess},
   {"sql_preprocess_type", cfg_key_sql_preprocess_type},
   {"sql_multi_values", cfg_key_sql_multi_values},
+  {"sql_upsert_batch", cfg_key_sql_upsert_batch},
+  {"sqlite3_prepare", cfg_key_sqlite3_prepare},
+  {"sqlite3_commit_batch", cfg_key_sqlite3_commit_batch},
+  {"sqlite3_journal_mode", cfg_key_sqlite3_journal_mode},
+  {"sqlite3_cache_size", cfg_key_sqlite3_cache_size},
   {"sql_aggressive_classification", cfg_key_sql_aggressive_classification},
   {"sql_locking_style", cfg_key_sql_locking_style},
   {"sql_use_copy", cfg_key_sql_use_copy},
   {"sql_num_protos", cfg_key_num_protos},
   {"sql_num_hosts", cfg_key_num_hosts},
   {"print_refresh_time", cfg_key_sql_refresh_time},
+  {"null_refresh_time", cfg_key_sql_refresh_time},
   {"print_cache_entries", cfg_key_print_cache_entries},
   {"print_markers", cfg_key_print_markers},
   {"print_output", cfg_key_print_output},
@@ -421,6 +438,7 @@ static const struct _dictionary_line dictionary[] = {
   {"mongo_time_roundoff", cfg_key_sql_history_roundoff},
   {"mongo_trigger_exec", cfg_key_sql_trigger_exec},
   {"mongo_insert_batch", cfg_key_mongo_insert_batch},
+  {"mongo_purge_workers", cfg_key_mongo_purge_workers},
   {"mongo_indexes_file", cfg_key_sql_table_schema},
   {"mongo_max_writers", cfg_key_sql_max_writers},
   {"mongo_preprocess", cfg_key_sql_preprocess},
@@ -478,6 +496,7 @@ static const struct _dictionary_line dictionary[] = {
   {"nfacctd_mcast_groups", cfg_key_nfacctd_mcast_groups},
   {"nfacctd_peer_as", cfg_key_nfprobe_peer_as},
   {"nfacctd_pipe_size", cfg_key_nfacctd_pipe_size},
+  {"nfacctd_workers", cfg_key_nfacctd_workers},
   {"nfacctd_pro_rating", cfg_key_nfacctd_pro_rating},
   {"nfacctd_account_options", cfg_key_nfacctd_account_options},
   {"nfacctd_stitching", cfg_key_nfacctd_stitching},
@@ -577,6 +596,8 @@ static const struct _dictionary_line dictionary[] = {
   {"sfprobe_direction", cfg_key_nfprobe_direction},
   {"sfprobe_ifindex", cfg_key_nfprobe_ifindex},
   {"sfprobe_ifspeed", cfg_key_sfprobe_ifspeed},
+  {"sfprobe_batch_size", cfg_key_sfprobe_batch_size},
+  {"sfprobe_datagram_size", cfg_key_sfprobe_datagram_size},
   {"tee_receiver", cfg_key_nfprobe_receiver},
   {"tee_receivers", cfg_key_tee_receivers},
   {"tee_source_ip", cfg_key_nfprobe_source_ip},
@@ -585,6 +606,10 @@ static const struct _dictionary_line dictionary[] = {
   {"tee_max_receiver_pools", cfg_key_tee_max_receiver_pools},
   {"tee_ipprec", cfg_key_nfprobe_ip_precedence},
   {"tee_pipe_size", cfg_key_tee_pipe_size},
+  {"tee_batch_size", cfg_key_tee_batch_size},
+  {"tee_gso", cfg_key_tee_gso},
+  {"tee_balance_templates", cfg_key_tee_balance_templates},
+  {"tee_templates_refresh_time", cfg_key_tee_templates_refresh_time},
   {"bgp_daemon", cfg_key_nfacctd_bgp},
   {"bgp_daemon_ip", cfg_key_nfacctd_bgp_ip},
   {"bgp_daemon_id", cfg_key_nfacctd_bgp_id},
@@ -642,6 +667,7 @@ static const struct _dictionary_line dictionary[] = {
   {"bgp_table_dump_file", cfg_key_nfacctd_bgp_table_dump_file},
   {"bgp_table_dump_latest_file", cfg_key_nfacctd_bgp_table_dump_latest_file},
   {"bgp_table_dump_refresh_time", cfg_key_nfacctd_bgp_table_dump_refresh_time},
+  {"bgp_table_dump_workers", cfg_key_nfacctd_bgp_table_dump_workers},
   {"bgp_table_dump_amqp_host", cfg_key_nfacctd_bgp_table_dump_amqp_host},
   {"bgp_table_dump_amqp_vhost", cfg_key_nfacctd_bgp_table_dump_amqp_vhost},
   {"bgp_table_dump_amqp_user", cfg_key_nfacctd_bgp_table_dump_amqp_user},
@@ -733,6 +759,8 @@ static const struct _dictionary_line dictionary[] = {
 #endif
   {"uacctd_group", cfg_key_uacctd_group},
   {"uacctd_nl_size", cfg_key_uacctd_nl_size},
+  {"uacctd_nflog", cfg_key_uacctd_nflog},
+  {"uacctd_nflog_qthreshold", cfg_key_uacctd_nflog_qthreshold},
   {"tunnel_0", cfg_key_tunnel_0},
   {"pkt_len_distrib_bins", cfg_key_pkt_len_distrib_bins},
   {"tmp_net_own_field", cfg_key_tmp_net_own_field},
@@ -743,6 +771,7 @@ static struct plugin_type_entry plugin_types_list[] = {
   {PLUGIN_ID_CORE, 	"core", 	NULL},
   {PLUGIN_ID_MEMORY, 	"memory", 	imt_plugin},
   {PLUGIN_ID_PRINT,	"print",	print_plugin},
+  {PLUGIN_ID_NULL,	"null",		null_plugin},
   {PLUGIN_ID_NFPROBE,	"nfprobe",	nfprobe_plugin},
   {PLUGIN_ID_SFPROBE,	"sfprobe",	sfprobe_plugin},
 #ifdef WITH_MYSQL
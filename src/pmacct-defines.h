@@ -20,10 +20,10 @@
 */
 
 /* defines */
-#define ARGS_NFACCTD "n:dDhP:b:f:F:c:m:p:r:s:S:L:l:v:o:O:uRVa"
-#define ARGS_SFACCTD "n:dDhP:b:f:F:c:m:p:r:s:S:L:l:v:o:O:uRVa"
-#define ARGS_PMACCTD "n:NdDhP:b:f:F:c:i:I:m:p:r:s:S:v:o:O:uwWL:RVaz"
-#define ARGS_UACCTD "n:NdDhP:b:f:F:c:m:p:r:s:S:v:o:O:uRg:L:Va"
+#define ARGS_NFACCTD "C:n:dDhP:b:f:F:c:m:p:r:s:S:L:l:v:o:O:uRVa"
+#define ARGS_SFACCTD "C:n:dDhP:b:f:F:c:m:p:r:s:S:L:l:v:o:O:uRVa"
+#define ARGS_PMACCTD "C:n:NdDhP:b:f:F:c:i:I:m:p:r:s:S:v:o:O:uwWL:RVaz"
+#define ARGS_UACCTD "C:n:NdDhP:b:f:F:c:m:p:r:s:S:v:o:O:uRg:L:Va"
 #define ARGS_PMACCT "Ssc:Cetm:p:P:M:arN:n:lT:O:E:uDVUoiI"
 #define N_PRIMITIVES 57
 #define N_FUNCS 10 
@@ -322,6 +322,7 @@
 #define WANT_LOCK_OP			0x00000100
 #define WANT_CUSTOM_PRIMITIVES_TABLE	0x00000200
 #define WANT_ERASE_LAST_TSTAMP		0x00000400
+#define WANT_TOPN			0x00000800
 
 #define PIPE_TYPE_METADATA	0x00000001
 #define PIPE_TYPE_PAYLOAD	0x00000002
@@ -366,6 +367,7 @@
 #define FUNC_TYPE_BGP			1
 #define FUNC_TYPE_BMP			2
 #define FUNC_TYPE_SFLOW_COUNTER		3
+#define FUNC_TYPE_MAX			4
 
 typedef u_int32_t pm_class_t;
 typedef u_int64_t pm_id_t;
@@ -88,8 +88,8 @@ void usage_client(char *prog)
   printf("  -n\t<bytes | packets | flows | all> \n\tSelect the counters to print (applies to -N)\n");
   printf("  -S\tSum counters instead of returning a single counter for each request (applies to -N)\n");
   printf("  -a\tDisplay all table fields (even those currently unused)\n");
-  printf("  -c\t< src_mac | dst_mac | vlan | cos | src_host | dst_host | src_net | dst_net | src_mask | dst_mask | \n\t src_port | dst_port | tos | proto | src_as | dst_as | sum_mac | sum_host | sum_net | sum_as | \n\t sum_port | in_iface | out_iface | tag | tag2 | flows | class | std_comm | ext_comm | as_path | \n\t peer_src_ip | peer_dst_ip | peer_src_as | peer_dst_as | src_as_path | src_std_comm | src_med | \n\t src_ext_comm | src_local_pref | mpls_vpn_rd | etype | sampling_rate | pkt_len_distrib |\n\t post_nat_src_host | post_nat_dst_host | post_nat_src_port | post_nat_dst_port | nat_event |\n\t timestamp_start | timestamp_end | timestamp_arrival | mpls_label_top | mpls_label_bottom | \n\t mpls_stack_depth | label | src_host_country | dst_host_country | export_proto_seqno | \n\t export_proto_version> \n\tSelect primitives to match (required by -N and -M)\n");
-  printf("  -T\t<bytes | packets | flows>,[<# how many>] \n\tOutput top N statistics (applies to -M and -s)\n");
+  printf("  -c\t< src_mac | dst_mac | vlan | cos | src_host | dst_host | src_net | dst_net | src_mask | dst_mask | \n\t src_port | dst_port | tos | proto | src_as | dst_as | sum_mac | sum_host | sum_net | sum_as | \n\t sum_port | in_iface | out_iface | tag | tag2 | flows | class | std_comm | ext_comm | as_path | \n\t peer_src_ip | peer_dst_ip | peer_src_as | peer_dst_as | src_as_path | src_std_comm | src_med | \n\t src_ext_comm | src_local_pref | mpls_vpn_rd | etype | sampling_rate | pkt_len_distrib |\n\t post_nat_src_host | post_nat_dst_host | post_nat_src_port | post_nat_dst_port | nat_event |\n\t timestamp_start | timestamp_end | timestamp_arrival | mpls_label_top | mpls_label_bottom | \n\t mpls_stack_depth | label | src_host_country | dst_host_country | export_proto_seqno | \n\t export_proto_version> \n\tSelect primitives to match (required by -N and -M); group statistics by (applies to -s)\n");
+  printf("  -T\t<bytes | packets | flows>,[<# how many>] \n\tOutput top N statistics (applies to -M and -s; computed by the daemon with -s)\n");
   printf("  -e\tClear statistics\n");
   printf("  -i\tShow time (in seconds) since statistics were last cleared (ie. pmacct -e)\n");
   printf("  -r\tReset counters (applies to -N and -M)\n");
@@ -636,6 +636,7 @@ int main(int argc,char **argv)
   struct pkt_data *acc_elem;
   struct bucket_desc *bd;
   struct query_header q; 
+  struct query_topn topn;
   struct pkt_primitives empty_addr;
   struct pkt_bgp_primitives empty_pbgp;
   struct pkt_nat_primitives empty_pnat;
@@ -683,6 +684,7 @@ int main(int argc,char **argv)
   clibuf = malloc(clibufsz);
 
   memset(&q, 0, sizeof(struct query_header));
+  memset(&topn, 0, sizeof(struct query_topn));
   memset(&empty_addr, 0, sizeof(struct pkt_primitives));
   memset(&empty_pbgp, 0, sizeof(struct pkt_bgp_primitives));
   memset(&empty_pnat, 0, sizeof(struct pkt_nat_primitives));
@@ -1254,6 +1256,24 @@ int main(int argc,char **argv)
     exit(1);
   }
 
+  /* top-N and group-by (-c) statistics are computed by the server. WANT_STATS
+     is kept: daemons not knowing WANT_TOPN reply with plain statistics and
+     leave WANT_STATS set in the reply header, newer ones clear it */
+  if (want_stats && (topN_counter || what_to_count || what_to_count_2)) {
+    if (custom_primitives_input.num) {
+      printf("ERROR: -s does not support grouping by custom primitives.\n  Exiting...\n\n");
+      exit(1);
+    }
+
+    q.type |= WANT_TOPN;
+    q.num = 0;
+
+    topn.counter = topN_counter;
+    topn.howmany = topN_howmany;
+    topn.what_to_count = what_to_count;
+    topn.what_to_count_2 = what_to_count_2;
+  }
+
   if (want_counter || want_match) {
     char *ptr = match_string, prefix[] = "file:";
 
@@ -1902,6 +1922,10 @@ int main(int argc,char **argv)
   /* arranging header and size of buffer to send */
   memcpy(clibuf, &q, sizeof(struct query_header)); 
   buflen = sizeof(struct query_header)+(q.num*sizeof(struct query_entry));
+  if (q.type & WANT_TOPN) {
+    memcpy(clibuf+buflen, &topn, sizeof(struct query_topn));
+    buflen += sizeof(struct query_topn);
+  }
   buflen++;
   clibuf[buflen] = '\x4'; /* EOT */
   buflen++;
@@ -1920,6 +1944,16 @@ int main(int argc,char **argv)
 
     if (want_all_fields) have_wtc = FALSE; 
     else have_wtc = TRUE; 
+    if ((q.type & WANT_TOPN) && (((struct query_header *)largebuf)->type & WANT_STATS)) {
+      /* the daemon predates server-side top-N: sort here, as it used to be */
+      if (what_to_count || what_to_count_2) {
+        printf("ERROR: the daemon does not support grouping statistics (-c with -s).\n  Exiting...\n\n");
+        exit(1);
+      }
+
+      q.type ^= WANT_TOPN;
+    }
+
     what_to_count = ((struct query_header *)largebuf)->what_to_count;
     what_to_count_2 = ((struct query_header *)largebuf)->what_to_count_2;
     datasize = ((struct query_header *)largebuf)->datasize;
@@ -2014,7 +2048,7 @@ int main(int argc,char **argv)
     acc_elem = (struct pkt_data *) elem;
 
     topN_printed = 0;
-    if (topN_counter) {
+    if (topN_counter && !(q.type & WANT_TOPN)) {
       int num = unpacked/datasize;
 
       client_counters_merge_sort((void *)acc_elem, 0, num, datasize, topN_counter);
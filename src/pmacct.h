@@ -131,6 +131,13 @@
 #define Inline static inline
 #endif
 
+/* per-thread instances of (decoding) state in multi-threaded daemons */
+#if defined ENABLE_THREADS
+#define ThreadLocal __thread
+#else
+#define ThreadLocal
+#endif
+
 /* Let work the unaligned copy macros the hard way: byte-per byte copy via
    u_char pointers. We discard the packed attribute way because it fits just
    to GNU compiler */
@@ -182,6 +189,8 @@ struct plugin_requests {
   int line_num;			/* line number being processed */
   int map_entries;		/* number of map entries: wins over global setting */
   int map_row_len;		/* map row length: wins over global setting */
+  u_int8_t map_standby;		/* loading a standby table: on failure keep the live one */
+  u_int8_t map_nocache;		/* set by the parser: lookups in the map can't be cached */
 };
 
 #include "pmacct-defines.h"
@@ -60,8 +60,9 @@ void usage_daemon(char *prog_name)
   printf("  -N  \tDisable promiscuous mode\n");
   printf("  -z  \tAllow to run with non root privileges (ie. setcap in use)\n");
   printf("  -n  \tPath to a file containing Network definitions\n");
+  printf("  -C  \tCompile the Network definitions file into the specified binary map and exit\n");
   printf("  -o  \tPath to a file containing Port definitions\n");
-  printf("  -P  \t[ memory | print | mysql | pgsql | sqlite3 | mongodb | nfprobe | sfprobe ] \n\tActivate plugin\n"); 
+  printf("  -P  \t[ memory | print | null | mysql | pgsql | sqlite3 | mongodb | nfprobe | sfprobe ] \n\tActivate plugin\n"); 
   printf("  -d  \tEnable debug\n");
   printf("  -i  \tListen on the specified interface\n");
   printf("  -I  \tRead packets from the specified savefile\n");
@@ -101,6 +102,7 @@ int main(int argc,char **argv, char **envp)
   struct plugins_list_entry *list;
   struct plugin_requests req;
   char config_file[SRVBUFLEN];
+  char *networks_map_out = NULL;
   int psize = DEFAULT_SNAPLEN;
 
   struct id_table bpas_table;
@@ -291,6 +293,9 @@ int main(int argc,char **argv, char **envp)
       usage_daemon(argv[0]);
       exit(0);
       break;
+    case 'C':
+      networks_map_out = optarg;
+      break;
     case 'V':
       version_daemon(PMACCTD_USAGE_HEADER);
       exit(0);
@@ -332,6 +337,8 @@ int main(int argc,char **argv, char **envp)
 
   if (config.files_umask) umask(config.files_umask);
 
+  if (networks_map_out) exit(compile_networks(config.networks_file, networks_map_out) == SUCCESS ? 0 : 1);
+
   /* Let's check whether we need superuser privileges */
   if (config.snaplen) psize = config.snaplen;
   else config.snaplen = psize;
@@ -384,6 +391,10 @@ int main(int argc,char **argv, char **envp)
     else Log(LOG_INFO, "INFO ( %s/core ): proc_priority set to %d\n", config.name, getpriority(PRIO_PROCESS, 0));
   }
 
+  /* inherited by threads; plugins reset what they don't define on their own */
+  set_placement(config.name, "core", "process", config.plugin_numa_node, config.proc_cpu_affinity, ERR,
+		config.proc_sched_policy, config.proc_sched_priority);
+
   if (strlen(config_file)) {
     char canonical_path[PATH_MAX], *canonical_path_ptr;
 
@@ -31,6 +31,10 @@
 #include "tee_plugin/tee_recvs-data.h"
 #include "isis/isis.h"
 #include "isis/isis-data.h"
+#include "net_aggr.h"
+#if defined ENABLE_THREADS
+#include "thread_pool.h"
+#endif
 #include "crc32.c"
 
 /*
@@ -38,7 +42,7 @@
    - if a table is tag-related then it is passed as argument t
    - else it is passed as argument req->key_value_table 
 */
-void load_id_file(int acct_type, char *filename, struct id_table *t, struct plugin_requests *req, int *map_allocated)
+int load_id_file(int acct_type, char *filename, struct id_table *t, struct plugin_requests *req, int *map_allocated)
 {
   struct id_table tmp;
   struct id_entry *ptr, *ptr2;
@@ -52,7 +56,7 @@ void load_id_file(int acct_type, char *filename, struct id_table *t, struct plug
   int v6_num = 0;
 #endif
 
-  if (!map_allocated) return;
+  if (!map_allocated) return ERR;
 
   if (acct_type == ACCT_NF || acct_type == ACCT_SF || acct_type == ACCT_PM ||
       acct_type == MAP_BGP_PEER_AS_SRC || acct_type == MAP_BGP_TO_XFLOW_AGENT ||
@@ -69,6 +73,7 @@ void load_id_file(int acct_type, char *filename, struct id_table *t, struct plug
 
   memset(&st, 0, sizeof(st));
   memset(&tmp, 0, sizeof(struct id_table));
+  req->map_nocache = FALSE;
 
   if (req->map_entries) map_entries = req->map_entries;
   else if (config.maps_entries) map_entries = config.maps_entries;
@@ -613,15 +618,18 @@ void load_id_file(int acct_type, char *filename, struct id_table *t, struct plug
   if (tmp.e) free(tmp.e) ;
   if (buf) free(buf) ;
 
+  /* standby maps get their caching flag applied when published */
+  if (acct_type == MAP_SAMPLING && req->map_nocache && !req->map_standby) sampling_map_caching = FALSE;
+
   Log(LOG_INFO, "INFO ( %s/%s ): map '%s' successfully (re)loaded.\n", config.name, config.type, filename);
 
-  return;
+  return SUCCESS;
 
   handle_error:
   if (*map_allocated && tmp.e) free(tmp.e) ;
   if (buf) free(buf);
 
-  if (t && t->timestamp) {
+  if (t && (t->timestamp || req->map_standby)) {
     Log(LOG_WARNING, "WARN ( %s/%s ): Rolling back the old map '%s'.\n", config.name, config.type, filename);
 
     /* we update the timestamp to avoid loops */
@@ -629,6 +637,8 @@ void load_id_file(int acct_type, char *filename, struct id_table *t, struct plug
     t->timestamp = st.st_mtime;
   }
   else exit_all(1);
+
+  return ERR;
 }
 
 u_int8_t pt_check_neg(char **value, u_int32_t *flags)
@@ -655,20 +665,24 @@ char *pt_check_range(char *str)
   else return NULL;
 }
 
-void load_pre_tag_map(int acct_type, char *filename, struct id_table *t, struct plugin_requests *req,
+int load_pre_tag_map(int acct_type, char *filename, struct id_table *t, struct plugin_requests *req,
 		      int *map_allocated, int map_entries, int map_row_len)
 {
+  int ret;
+
   if (req) {
     req->map_entries = map_entries;
     req->map_row_len = map_row_len;
   }
 
-  load_id_file(acct_type, filename, t, req, map_allocated);
+  ret = load_id_file(acct_type, filename, t, req, map_allocated);
 
   if (req) {
     req->map_entries = FALSE;
     req->map_row_len = FALSE;
   }
+
+  return ret;
 }
 
 void pretag_init_vars(struct packet_ptrs *pptrs, struct id_table *t)
@@ -758,7 +772,7 @@ int pretag_entry_process(struct id_entry *e, struct packet_ptrs *pptrs, pm_id_t
   pm_id_t id = 0, stop = 0, ret = 0;
   pt_label_t label_local;
 
-  e->last_matched = FALSE;
+  pptrs->pretag_last_matched = FALSE;
 
   for (j = 0, stop = 0, ret = 0; ((!ret || ret > TRUE) && (*e->func[j])); j++) {
     if (e->func_type[j] == PRETAG_SET_LABEL) {
@@ -1118,3 +1132,252 @@ int pretag_index_have_one(struct id_table *t)
 {
   return t->index[0].entries;
 }
+
+/*
+   Background map reload: tables registered via map_reload_add*() are
+   rebuilt by a loader thread into a standby copy while the collector
+   keeps serving from the live one; map_reload_publish(), called from the
+   collector loop, swaps live and standby with a plain struct copy. The
+   collector is the only reader of live tables, so once it has swapped
+   (ie. moved to a new epoch) the old tables, now in standby, are no longer
+   referenced and the loader frees or reuses them on the next reload.
+   Without threads support, reloads are run synchronously at kick time.
+*/
+struct map_reload_job {
+  int acct_type;
+  char *filename;
+  struct id_table *table;
+  struct id_table standby;
+  int standby_alloc;
+  int map_entries;
+  int map_row_len;
+  int ret;
+  int caching;
+};
+
+static struct {
+  struct map_reload_job jobs[MAP_RELOAD_JOBS];
+  int num;
+  int ptm;
+  char *networks_file;
+  struct networks_table nt_standby;
+  struct networks_cache nc_standby;
+  int networks_ret;
+  struct plugin_requests req;
+  struct timeval start;
+  volatile int state;
+#if defined ENABLE_THREADS
+  thread_pool_t *pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+#endif
+} mr;
+
+void map_reload_add(int acct_type, char *filename, struct id_table *t, int map_entries, int map_row_len)
+{
+  struct map_reload_job *job;
+
+  if (!filename || !t) return;
+
+  if (mr.num == MAP_RELOAD_JOBS) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): too many maps; '%s' will not be reloaded.\n", config.name, config.type, filename);
+    return;
+  }
+
+  job = &mr.jobs[mr.num];
+  memset(job, 0, sizeof(struct map_reload_job));
+  job->acct_type = acct_type;
+  job->filename = filename;
+  job->table = t;
+  job->map_entries = map_entries;
+  job->map_row_len = map_row_len;
+  mr.num++;
+
+  if (acct_type == ACCT_NF || acct_type == ACCT_SF || acct_type == ACCT_PM) mr.ptm = TRUE;
+}
+
+void map_reload_add_networks(char *filename)
+{
+  mr.networks_file = filename;
+}
+
+/* pre_tag_map reloads are owned by us rather than exec_plugins() */
+int map_reload_ptm()
+{
+  return mr.ptm;
+}
+
+/* mr.state is shared with the loader thread: read it under the mutex */
+static int map_reload_state()
+{
+  int state;
+
+#if defined ENABLE_THREADS
+  if (mr.pool) {
+    pthread_mutex_lock(&mr.mutex);
+    state = mr.state;
+    pthread_mutex_unlock(&mr.mutex);
+
+    return state;
+  }
+#endif
+
+  return mr.state;
+}
+
+static void map_reload_run()
+{
+  struct map_reload_job *job;
+  struct timeval now;
+  u_int32_t msecs;
+  int idx, failed = 0;
+
+  for (idx = 0; idx < mr.num; idx++) {
+    job = &mr.jobs[idx];
+
+    job->ret = load_pre_tag_map(job->acct_type, job->filename, &job->standby, &mr.req, &job->standby_alloc,
+				job->map_entries, job->map_row_len);
+    job->caching = !mr.req.map_nocache;
+    if (job->ret != SUCCESS) failed++;
+  }
+
+  if (mr.networks_file) {
+    if (!mr.nt_standby.timestamp) mr.nt_standby.timestamp = nt.timestamp;
+
+    mr.networks_ret = load_networks(mr.networks_file, &mr.nt_standby, &mr.nc_standby);
+    if (mr.networks_ret != SUCCESS) failed++;
+  }
+
+  gettimeofday(&now, NULL);
+  msecs = (now.tv_sec-mr.start.tv_sec)*1000+(now.tv_usec-mr.start.tv_usec)/1000;
+
+  map_reload_stats.reloads++;
+  if (failed) map_reload_stats.failures++;
+  map_reload_stats.last_msecs = msecs;
+  if (msecs > map_reload_stats.max_msecs) map_reload_stats.max_msecs = msecs;
+  map_reload_stats.last = now.tv_sec;
+}
+
+#if defined ENABLE_THREADS
+void map_reload_thread()
+{
+  for (;;) {
+    pthread_mutex_lock(&mr.mutex);
+    while (mr.state != MAP_RELOAD_BUSY) pthread_cond_wait(&mr.cond, &mr.mutex);
+    pthread_mutex_unlock(&mr.mutex);
+
+    map_reload_run();
+
+    pthread_mutex_lock(&mr.mutex);
+    mr.state = MAP_RELOAD_READY;
+    pthread_mutex_unlock(&mr.mutex);
+  }
+}
+#endif
+
+void map_reload_init()
+{
+  if (!mr.num && !mr.networks_file) return;
+
+#if defined ENABLE_THREADS
+  pthread_mutex_init(&mr.mutex, NULL);
+  pthread_cond_init(&mr.cond, NULL);
+
+  mr.pool = allocate_thread_pool(1, THREAD_POOL_INHERIT);
+  assert(mr.pool);
+  Log(LOG_DEBUG, "DEBUG ( %s/core ): map reload thread initialized (maps: %u)\n", config.name,
+	mr.num + (mr.networks_file ? 1 : 0));
+
+  send_to_pool(mr.pool, map_reload_thread, NULL);
+#endif
+}
+
+/*
+   Called upon a reload request: returns FALSE if a reload is already in
+   progress (the request should then be retained and re-tried later).
+*/
+int map_reload_kick(struct plugin_requests *req)
+{
+  if (!mr.num && !mr.networks_file) return TRUE;
+  if (map_reload_state() != MAP_RELOAD_IDLE) return FALSE;
+
+  memcpy(&mr.req, req, sizeof(struct plugin_requests));
+  mr.req.key_value_table = NULL;
+  mr.req.map_standby = TRUE;
+  gettimeofday(&mr.start, NULL);
+
+#if defined ENABLE_THREADS
+  if (mr.pool) {
+    pthread_mutex_lock(&mr.mutex);
+    mr.state = MAP_RELOAD_BUSY;
+    pthread_cond_signal(&mr.cond);
+    pthread_mutex_unlock(&mr.mutex);
+
+    return TRUE;
+  }
+#endif
+
+  map_reload_run();
+  mr.state = MAP_RELOAD_READY;
+
+  return TRUE;
+}
+
+int map_reload_ready()
+{
+  return (map_reload_state() == MAP_RELOAD_READY);
+}
+
+/*
+   Called by the collector loop: cheap unless the loader is done, in which
+   case successfully reloaded tables are swapped in, along with the caching
+   flags the parser determined for them, ie. sampling_map_caching. Returns
+   TRUE if any swap took place.
+*/
+int map_reload_publish(int *bta_caching, int *sampling_caching)
+{
+  struct map_reload_job *job;
+  struct id_table tmp_table;
+  struct networks_table tmp_nt;
+  struct networks_cache tmp_nc;
+  int idx, ret = FALSE;
+
+  if (map_reload_state() != MAP_RELOAD_READY) return FALSE;
+
+#if defined ENABLE_THREADS
+  if (mr.pool) pthread_mutex_lock(&mr.mutex);
+#endif
+
+  for (idx = 0; idx < mr.num; idx++) {
+    job = &mr.jobs[idx];
+
+    if (job->ret == SUCCESS) {
+      memcpy(&tmp_table, job->table, sizeof(struct id_table));
+      memcpy(job->table, &job->standby, sizeof(struct id_table));
+      memcpy(&job->standby, &tmp_table, sizeof(struct id_table));
+
+      if (job->acct_type == MAP_BGP_TO_XFLOW_AGENT) *bta_caching = job->caching;
+      else if (job->acct_type == MAP_SAMPLING) *sampling_caching = job->caching;
+      ret = TRUE;
+    }
+  }
+
+  if (mr.networks_file && mr.networks_ret == SUCCESS) {
+    memcpy(&tmp_nt, &nt, sizeof(struct networks_table));
+    memcpy(&nt, &mr.nt_standby, sizeof(struct networks_table));
+    memcpy(&mr.nt_standby, &tmp_nt, sizeof(struct networks_table));
+
+    memcpy(&tmp_nc, &nc, sizeof(struct networks_cache));
+    memcpy(&nc, &mr.nc_standby, sizeof(struct networks_cache));
+    memcpy(&mr.nc_standby, &tmp_nc, sizeof(struct networks_cache));
+    ret = TRUE;
+  }
+
+  mr.state = MAP_RELOAD_IDLE;
+
+#if defined ENABLE_THREADS
+  if (mr.pool) pthread_mutex_unlock(&mr.mutex);
+#endif
+
+  return ret;
+}
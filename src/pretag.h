@@ -183,7 +183,6 @@ struct id_entry {
   pt_jeq_t jeq;
   u_int8_t ret;
   pt_stack_t stack;
-  pt_bitmap_t last_matched;
   u_int8_t id_inc;
   u_int8_t id2_inc;
 };
@@ -240,14 +239,28 @@ struct pretag_label_filter {
   ptlt_t table[MAX_PRETAG_MAP_ENTRIES/4];
 };
 
+/* background map reload */
+#define MAP_RELOAD_IDLE		0
+#define MAP_RELOAD_BUSY		1
+#define MAP_RELOAD_READY	2
+#define MAP_RELOAD_JOBS		(MAX_N_PLUGINS+8)
+
+struct map_reload_stats {
+  u_int32_t reloads;
+  u_int32_t failures;
+  u_int32_t last_msecs;
+  u_int32_t max_msecs;
+  time_t last;
+};
+
 /* prototypes */
 #if (!defined __PRETAG_C)
 #define EXT extern
 #else
 #define EXT
 #endif
-EXT void load_id_file(int, char *, struct id_table *, struct plugin_requests *, int *);
-EXT void load_pre_tag_map(int, char *, struct id_table *, struct plugin_requests *, int *, int, int);
+EXT int load_id_file(int, char *, struct id_table *, struct plugin_requests *, int *);
+EXT int load_pre_tag_map(int, char *, struct id_table *, struct plugin_requests *, int *, int, int);
 EXT u_int8_t pt_check_neg(char **, u_int32_t *);
 EXT char * pt_check_range(char *);
 EXT void pretag_init_vars(struct packet_ptrs *, struct id_table *);
@@ -268,6 +281,16 @@ EXT void pretag_index_results_sort(struct id_entry **, int);
 EXT void pretag_index_results_compress(struct id_entry **, int);
 EXT void pretag_index_results_compress_jeqs(struct id_entry **, int);
 EXT int pretag_index_have_one(struct id_table *);
+EXT void map_reload_add(int, char *, struct id_table *, int, int);
+EXT void map_reload_add_networks(char *);
+EXT int map_reload_ptm();
+EXT void map_reload_init();
+EXT int map_reload_kick(struct plugin_requests *);
+EXT int map_reload_ready();
+EXT int map_reload_publish(int *, int *);
+#if defined ENABLE_THREADS
+EXT void map_reload_thread();
+#endif
 
 EXT int bpas_map_allocated;
 EXT int blp_map_allocated;
@@ -280,6 +303,7 @@ EXT int custom_primitives_allocated;
 
 EXT int bta_map_caching; 
 EXT int sampling_map_caching; 
+EXT struct map_reload_stats map_reload_stats;
 
 EXT int (*find_id_func)(struct id_table *, struct packet_ptrs *, pm_id_t *, pm_id_t *);
 #undef EXT
@@ -198,7 +198,7 @@ int PT_map_input_handler(char *filename, struct id_entry *e, char *value, struct
   int x = 0, len;
   char *endptr;
 
-  if (acct_type == MAP_SAMPLING) sampling_map_caching = FALSE;
+  if (acct_type == MAP_SAMPLING) req->map_nocache = TRUE;
 
   e->input.neg = pt_check_neg(&value, &((struct id_table *) req->key_value_table)->flags);
   len = strlen(value);
@@ -231,7 +231,7 @@ int PT_map_output_handler(char *filename, struct id_entry *e, char *value, struc
   int x = 0, len;
   char *endptr;
 
-  if (acct_type == MAP_SAMPLING) sampling_map_caching = FALSE;
+  if (acct_type == MAP_SAMPLING) req->map_nocache = TRUE;
 
   e->output.neg = pt_check_neg(&value, &((struct id_table *) req->key_value_table)->flags);
   len = strlen(value);
@@ -1378,7 +1378,7 @@ int pretag_bgp_nexthop_handler(struct packet_ptrs *pptrs, void *unused, void *e)
   struct struct_header_v8 *hdr = (struct struct_header_v8 *) pptrs->f_header;
   struct template_cache_entry *tpl = (struct template_cache_entry *) pptrs->f_tpl;
 
-  if (entry->last_matched == PRETAG_BGP_NEXTHOP) return FALSE;
+  if (pptrs->pretag_last_matched == PRETAG_BGP_NEXTHOP) return FALSE;
 
   /* check network-related primitives against fallback scenarios */
   if (!evaluate_lm_method(pptrs, TRUE, config.nfacctd_net, NF_NET_KEEP)) return TRUE;
@@ -1457,7 +1457,7 @@ int pretag_bgp_bgp_nexthop_handler(struct packet_ptrs *pptrs, void *unused, void
   way_out:
 
   if (!ret) {
-    entry->last_matched = PRETAG_BGP_NEXTHOP;
+    pptrs->pretag_last_matched = PRETAG_BGP_NEXTHOP;
     return (FALSE | entry->bgp_nexthop.neg);
   }
   else if (config.nfacctd_net & NF_NET_KEEP) return FALSE;
@@ -1584,7 +1584,7 @@ int pretag_src_as_handler(struct packet_ptrs *pptrs, void *unused, void *e)
   u_int16_t asn16 = 0;
   u_int32_t asn32 = 0;
 
-  if (entry->last_matched == PRETAG_SRC_AS) return FALSE;
+  if (pptrs->pretag_last_matched == PRETAG_SRC_AS) return FALSE;
 
   switch(hdr->version) {
   case 10:
@@ -1649,7 +1649,7 @@ int pretag_bgp_src_as_handler(struct packet_ptrs *pptrs, void *unused, void *e)
   }
 
   if (entry->src_as.n == asn) {
-    entry->last_matched = PRETAG_SRC_AS;
+    pptrs->pretag_last_matched = PRETAG_SRC_AS;
     return (FALSE | entry->src_as.neg);
   }
   else if (config.nfacctd_as & NF_AS_KEEP) return FALSE; 
@@ -1664,7 +1664,7 @@ int pretag_dst_as_handler(struct packet_ptrs *pptrs, void *unused, void *e)
   u_int16_t asn16 = 0;
   u_int32_t asn32 = 0;
 
-  if (entry->last_matched == PRETAG_DST_AS) return FALSE;
+  if (pptrs->pretag_last_matched == PRETAG_DST_AS) return FALSE;
 
   switch(hdr->version) {
   case 10:
@@ -1729,7 +1729,7 @@ int pretag_bgp_dst_as_handler(struct packet_ptrs *pptrs, void *unused, void *e)
   }
 
   if (entry->dst_as.n == asn) {
-    entry->last_matched = PRETAG_DST_AS;
+    pptrs->pretag_last_matched = PRETAG_DST_AS;
     return (FALSE | entry->dst_as.neg);
   }
   else if (config.nfacctd_as & NF_AS_KEEP) return FALSE;
@@ -2161,7 +2161,7 @@ int SF_pretag_bgp_nexthop_handler(struct packet_ptrs *pptrs, void *unused, void
   struct id_entry *entry = e;
   SFSample *sample = (SFSample *) pptrs->f_data;
 
-  if (entry->last_matched == PRETAG_BGP_NEXTHOP) return FALSE;
+  if (pptrs->pretag_last_matched == PRETAG_BGP_NEXTHOP) return FALSE;
 
   /* check network-related primitives against fallback scenarios */
   if (!evaluate_lm_method(pptrs, TRUE, config.nfacctd_net, NF_NET_KEEP)) return TRUE;
@@ -806,29 +806,30 @@ void P_cache_purge(struct chained_cache *queue[], int index)
           fprintf(f, "%-30s ", buf2);
         }
 
-        if (config.nfacctd_stitching && queue[j]->stitch) {
+        if (config.nfacctd_stitching) {
+          struct pkt_stitching *stitch = stitch_get(queue[j]->stitch);
           char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
           time_t time1;
           struct tm *time2;
 
           if (config.sql_history_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_min.tv_sec, queue[j]->stitch->timestamp_min.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%u.%u", stitch->timestamp_min.tv_sec, stitch->timestamp_min.tv_usec);
             fprintf(f, "%-30s ", buf2);
 
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_max.tv_sec, queue[j]->stitch->timestamp_max.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%u.%u", stitch->timestamp_max.tv_sec, stitch->timestamp_max.tv_usec);
             fprintf(f, "%-30s ", buf2);
           }
           else {
-	    time1 = queue[j]->stitch->timestamp_min.tv_sec;
+	    time1 = stitch->timestamp_min.tv_sec;
             time2 = localtime(&time1);
             strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_min.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, stitch->timestamp_min.tv_usec);
             fprintf(f, "%-30s ", buf2);
 
-            time1 = queue[j]->stitch->timestamp_max.tv_sec;
+            time1 = stitch->timestamp_max.tv_sec;
             time2 = localtime(&time1);
             strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_max.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, stitch->timestamp_max.tv_usec);
             fprintf(f, "%-30s ", buf2);
 	  }
         }
@@ -1110,29 +1111,30 @@ void P_cache_purge(struct chained_cache *queue[], int index)
           fprintf(f, "%s%s", write_sep(sep, &count), buf2);
         }
 
-        if (config.nfacctd_stitching && queue[j]->stitch) {
+        if (config.nfacctd_stitching) {
+          struct pkt_stitching *stitch = stitch_get(queue[j]->stitch);
           char buf1[SRVBUFLEN], buf2[SRVBUFLEN];
           time_t time1;
           struct tm *time2;
 
           if (config.sql_history_since_epoch) {
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_min.tv_sec, queue[j]->stitch->timestamp_min.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%u.%u", stitch->timestamp_min.tv_sec, stitch->timestamp_min.tv_usec);
 	    fprintf(f, "%s%s", write_sep(sep, &count), buf2);
 
-            snprintf(buf2, SRVBUFLEN, "%u.%u", queue[j]->stitch->timestamp_max.tv_sec, queue[j]->stitch->timestamp_max.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%u.%u", stitch->timestamp_max.tv_sec, stitch->timestamp_max.tv_usec);
 	    fprintf(f, "%s%s", write_sep(sep, &count), buf2);
           }
 	  else {
-            time1 = queue[j]->stitch->timestamp_min.tv_sec;
+            time1 = stitch->timestamp_min.tv_sec;
             time2 = localtime(&time1);
             strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_min.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, stitch->timestamp_min.tv_usec);
             fprintf(f, "%s%s", write_sep(sep, &count), buf2);
 
-            time1 = queue[j]->stitch->timestamp_max.tv_sec;
+            time1 = stitch->timestamp_max.tv_sec;
             time2 = localtime(&time1);
             strftime(buf1, SRVBUFLEN, "%Y-%m-%d %H:%M:%S", time2);
-            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, queue[j]->stitch->timestamp_max.tv_usec);
+            snprintf(buf2, SRVBUFLEN, "%s.%u", buf1, stitch->timestamp_max.tv_usec);
             fprintf(f, "%s%s", write_sep(sep, &count), buf2);
 	  }
         }
@@ -150,40 +150,21 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
 
   reset_counter = q->type & WANT_RESET;
 
-  if (q->type & WANT_STATS) {
+  if (q->type & WANT_TOPN) {
+    struct query_topn topn;
+
+    /* tells the client the reply is already ranked (and grouped) */
+    q->type &= ~WANT_STATS;
+    memcpy(&topn, bufptr, sizeof(struct query_topn));
+    process_topn_query(sd, &rb, &topn, extras, datasize);
+    if (rb.packed) send(sd, rb.buf, rb.packed, 0); /* send remainder data */
+  }
+  else if (q->type & WANT_STATS) {
     q->what_to_count = config.what_to_count; 
     q->what_to_count_2 = config.what_to_count_2; 
     for (idx = 0; idx < config.buckets; idx++) {
       if (!following_chain) acc_elem = (struct acc *) elem;
-      if (!test_zero_elem(acc_elem)) {
-	enQueue_elem(sd, &rb, acc_elem, PdataSz, datasize);
-
-	/* XXX: to be optimized ? */
-	if (extras->off_pkt_bgp_primitives) {
-	  if (acc_elem->cbgp) {
-	    struct pkt_bgp_primitives tmp_pbgp;
-
-	    cache_to_pkt_bgp_primitives(&tmp_pbgp, acc_elem->cbgp);
-	    enQueue_elem(sd, &rb, &tmp_pbgp, PbgpSz, datasize - extras->off_pkt_bgp_primitives);
-	  }
-	}
-
-        if (extras->off_pkt_nat_primitives && acc_elem->pnat) {
-          enQueue_elem(sd, &rb, acc_elem->pnat, PnatSz, datasize - extras->off_pkt_nat_primitives);
-	}
-
-        if (extras->off_pkt_mpls_primitives && acc_elem->pmpls) {
-          enQueue_elem(sd, &rb, acc_elem->pmpls, PmplsSz, datasize - extras->off_pkt_mpls_primitives);
-	}
-
-        if (extras->off_custom_primitives && acc_elem->pcust) {
-          enQueue_elem(sd, &rb, acc_elem->pcust, config.cpptrs.len, datasize - extras->off_custom_primitives);
-        }
-
-        if (extras->off_pkt_vlen_hdr_primitives && acc_elem->pvlen) {
-          enQueue_elem(sd, &rb, acc_elem->pvlen, PvhdrSz + acc_elem->pvlen->tot_len, datasize - extras->off_pkt_vlen_hdr_primitives);
-        }
-      } 
+      if (!test_zero_elem(acc_elem)) enQueue_acc(sd, &rb, acc_elem, extras, datasize);
       if (acc_elem->next != NULL) {
         Log(LOG_DEBUG, "DEBUG ( %s/%s ): Following chain in reply ...\n", config.name, config.type);
         acc_elem = acc_elem->next;
@@ -243,33 +224,7 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
         acc_elem = search_accounting_structure(&prim_ptrs);
         if (acc_elem) { 
 	  if (!test_zero_elem(acc_elem)) {
-	    enQueue_elem(sd, &rb, acc_elem, PdataSz, datasize);
-
-	    /* XXX: to be optimized ? */
-	    if (extras->off_pkt_bgp_primitives) {
-	      if (acc_elem->cbgp) {
-		struct pkt_bgp_primitives tmp_pbgp;
-
-		cache_to_pkt_bgp_primitives(&tmp_pbgp, acc_elem->cbgp);
-		enQueue_elem(sd, &rb, &tmp_pbgp, PbgpSz, datasize - extras->off_pkt_bgp_primitives);
-	      }
-	    }
-
-            if (extras->off_pkt_nat_primitives && acc_elem->pnat) {
-              enQueue_elem(sd, &rb, acc_elem->pnat, PnatSz, datasize - extras->off_pkt_nat_primitives);
-            }
-
-	    if (extras->off_pkt_mpls_primitives && acc_elem->pmpls) {
-	      enQueue_elem(sd, &rb, acc_elem->pmpls, PmplsSz, datasize - extras->off_pkt_mpls_primitives);
-	    }
-
-	    if (extras->off_custom_primitives && acc_elem->pcust) {
-	      enQueue_elem(sd, &rb, acc_elem->pcust, config.cpptrs.len, datasize - extras->off_custom_primitives);
-	    }
-
-	    if (extras->off_pkt_vlen_hdr_primitives && acc_elem->pvlen) {
-	      enQueue_elem(sd, &rb, acc_elem->pvlen, PvhdrSz + acc_elem->pvlen->tot_len, datasize - extras->off_pkt_vlen_hdr_primitives);
-	    }
+	    enQueue_acc(sd, &rb, acc_elem, extras, datasize);
 
 	    if (reset_counter) {
 	      if (forked) set_reset_flag(acc_elem);
@@ -324,58 +279,58 @@ void process_query_data(int sd, unsigned char *buf, int len, struct extra_primit
 	struct pkt_nat_primitives nbuf;
 	struct pkt_mpls_primitives mbuf;
 	struct pkt_data abuf;
+	struct imt_index *index;
+	struct imt_index_node *node;
+
         following_chain = FALSE;
 	elem = (unsigned char *) a;
 	memset(&abuf, 0, sizeof(abuf));
 
-        for (idx = 0; idx < config.buckets; idx++) {
-          if (!following_chain) acc_elem = (struct acc *) elem;
-	  if (!test_zero_elem(acc_elem)) {
-	    /* XXX: support for custom and vlen primitives */
-	    mask_elem(&tbuf, &bbuf, &nbuf, &mbuf, acc_elem, request.what_to_count, request.what_to_count_2, extras); 
+	/* a secondary index on exactly the requested primitives spares the table walk */
+	if ((index = search_index_structures(request.what_to_count, request.what_to_count_2))) {
+	  node = lookup_index_structure(index, &request.data, &request.pbgp, &request.pnat, &request.pmpls);
+
+	  for (; node; node = node->next) {
+	    acc_elem = node->acc;
+	    if (test_zero_elem(acc_elem)) continue;
+
+	    mask_elem(&tbuf, &bbuf, &nbuf, &mbuf, acc_elem, request.what_to_count, request.what_to_count_2, extras);
             if (!memcmp(&tbuf, &request.data, sizeof(struct pkt_primitives)) &&
 		!memcmp(&bbuf, &request.pbgp, sizeof(struct pkt_bgp_primitives)) &&
 		!memcmp(&nbuf, &request.pnat, sizeof(struct pkt_nat_primitives)) &&
 		!memcmp(&mbuf, &request.pmpls, sizeof(struct pkt_mpls_primitives))) {
-	      if (q->type & WANT_COUNTER) Accumulate_Counters(&abuf, acc_elem); 
-	      else {
-		enQueue_elem(sd, &rb, acc_elem, PdataSz, datasize); /* q->type == WANT_MATCH */
-
-		if (extras->off_pkt_bgp_primitives) {
-		  if (acc_elem->cbgp) {
-		    struct pkt_bgp_primitives tmp_pbgp;
-
-		    cache_to_pkt_bgp_primitives(&tmp_pbgp, acc_elem->cbgp);
-		    enQueue_elem(sd, &rb, &tmp_pbgp, PbgpSz, datasize - extras->off_pkt_bgp_primitives);
-		  }
-		}
-
-                if (extras->off_pkt_nat_primitives && acc_elem->pnat) {
-                  enQueue_elem(sd, &rb, acc_elem->pnat, PnatSz, datasize - extras->off_pkt_nat_primitives);
-                }
-		if (extras->off_pkt_mpls_primitives && acc_elem->pmpls) {
-		  enQueue_elem(sd, &rb, acc_elem->pmpls, PmplsSz, datasize - extras->off_pkt_mpls_primitives);
-		}
-                if (extras->off_custom_primitives && acc_elem->pcust) {
-                  enQueue_elem(sd, &rb, acc_elem->pcust, config.cpptrs.len, datasize - extras->off_custom_primitives);
-                }
-		if (extras->off_pkt_vlen_hdr_primitives && acc_elem->pvlen) {
-		  enQueue_elem(sd, &rb, acc_elem->pvlen, PvhdrSz + acc_elem->pvlen->tot_len, datasize - extras->off_pkt_vlen_hdr_primitives);
-		}
-	      }
+	      if (q->type & WANT_COUNTER) Accumulate_Counters(&abuf, acc_elem);
+	      else enQueue_acc(sd, &rb, acc_elem, extras, datasize); /* q->type == WANT_MATCH */
 	      if (reset_counter) set_reset_flag(acc_elem);
 	    }
+	  }
+	}
+	else {
+          for (idx = 0; idx < config.buckets; idx++) {
+            if (!following_chain) acc_elem = (struct acc *) elem;
+	    if (!test_zero_elem(acc_elem)) {
+	      /* XXX: support for custom and vlen primitives */
+	      mask_elem(&tbuf, &bbuf, &nbuf, &mbuf, acc_elem, request.what_to_count, request.what_to_count_2, extras); 
+              if (!memcmp(&tbuf, &request.data, sizeof(struct pkt_primitives)) &&
+		  !memcmp(&bbuf, &request.pbgp, sizeof(struct pkt_bgp_primitives)) &&
+		  !memcmp(&nbuf, &request.pnat, sizeof(struct pkt_nat_primitives)) &&
+		  !memcmp(&mbuf, &request.pmpls, sizeof(struct pkt_mpls_primitives))) {
+	        if (q->type & WANT_COUNTER) Accumulate_Counters(&abuf, acc_elem); 
+	        else enQueue_acc(sd, &rb, acc_elem, extras, datasize); /* q->type == WANT_MATCH */
+	        if (reset_counter) set_reset_flag(acc_elem);
+	      }
+            }
+            if (acc_elem->next) {
+              acc_elem = acc_elem->next;
+              following_chain = TRUE;
+              idx--;
+            }
+            else {
+              elem += sizeof(struct acc);
+              following_chain = FALSE;
+            }
           }
-          if (acc_elem->next) {
-            acc_elem = acc_elem->next;
-            following_chain = TRUE;
-            idx--;
-          }
-          else {
-            elem += sizeof(struct acc);
-            following_chain = FALSE;
-          }
-        }
+	}
 	if (q->type & WANT_COUNTER) enQueue_elem(sd, &rb, &abuf, PdataSz, PdataSz); /* enqueue accumulated data */
       }
     }
@@ -463,6 +418,7 @@ void mask_elem(struct pkt_primitives *d1, struct pkt_bgp_primitives *d2, struct
   struct pkt_nat_primitives *s3 = src->pnat;
   struct pkt_mpls_primitives *s4 = src->pmpls;
 
+  memset(&tmp_pbgp, 0, sizeof(struct pkt_bgp_primitives));
   cache_to_pkt_bgp_primitives(s2, src->cbgp);
 
   memset(d1, 0, sizeof(struct pkt_primitives));
@@ -559,6 +515,250 @@ void enQueue_elem(int sd, struct reply_buffer *rb, void *elem, int size, int tot
   }
 }
 
+void enQueue_acc(int sd, struct reply_buffer *rb, struct acc *acc_elem, struct extra_primitives *extras, int datasize)
+{
+  enQueue_elem(sd, rb, acc_elem, PdataSz, datasize);
+
+  /* XXX: to be optimized ? */
+  if (extras->off_pkt_bgp_primitives) {
+    if (acc_elem->cbgp) {
+      struct pkt_bgp_primitives tmp_pbgp;
+
+      cache_to_pkt_bgp_primitives(&tmp_pbgp, acc_elem->cbgp);
+      enQueue_elem(sd, rb, &tmp_pbgp, PbgpSz, datasize - extras->off_pkt_bgp_primitives);
+    }
+  }
+
+  if (extras->off_pkt_nat_primitives && acc_elem->pnat) {
+    enQueue_elem(sd, rb, acc_elem->pnat, PnatSz, datasize - extras->off_pkt_nat_primitives);
+  }
+
+  if (extras->off_pkt_mpls_primitives && acc_elem->pmpls) {
+    enQueue_elem(sd, rb, acc_elem->pmpls, PmplsSz, datasize - extras->off_pkt_mpls_primitives);
+  }
+
+  if (extras->off_custom_primitives && acc_elem->pcust) {
+    enQueue_elem(sd, rb, acc_elem->pcust, config.cpptrs.len, datasize - extras->off_custom_primitives);
+  }
+
+  if (extras->off_pkt_vlen_hdr_primitives && acc_elem->pvlen) {
+    enQueue_elem(sd, rb, acc_elem->pvlen, PvhdrSz + acc_elem->pvlen->tot_len, datasize - extras->off_pkt_vlen_hdr_primitives);
+  }
+}
+
+/*
+  Top-N and group-by queries, computed in a single walk of the table.
+  Entries, or groups of entries, are ranked through a min-heap bounded
+  to the number of entries to return, so only those get sorted and sent
+  back. Without a group-by (or with one equal to 'aggregate') entries
+  are ranked in place, without being copied.
+*/
+void process_topn_query(int sd, struct reply_buffer *rb, struct query_topn *topn, struct extra_primitives *extras, int datasize)
+{
+  struct query_header *q = (struct query_header *) rb->buf;
+  struct imt_topn_item *heap = NULL;
+  struct imt_topn_group *groups = NULL, *group;
+  struct pkt_primitives tbuf;
+  struct pkt_bgp_primitives bbuf;
+  struct pkt_nat_primitives nbuf;
+  struct pkt_mpls_primitives mbuf;
+  struct acc *acc_elem;
+  unsigned char *elem = a;
+  char *empty_pcust = NULL;
+  int *groups_table = NULL, grouped, gidx;
+  u_int32_t idx, heap_num = 0, heap_size = 0, groups_num = 0, groups_size = 0;
+  unsigned int hash;
+  pm_counter_t key;
+
+  topn->what_to_count &= (config.what_to_count & ~COUNT_COUNTERS);
+  topn->what_to_count_2 &= config.what_to_count_2;
+  grouped = ((topn->what_to_count || topn->what_to_count_2) &&
+	     (topn->what_to_count != (config.what_to_count & ~COUNT_COUNTERS) ||
+	      topn->what_to_count_2 != config.what_to_count_2));
+
+  if (grouped) {
+    q->what_to_count = (topn->what_to_count | COUNT_COUNTERS);
+    q->what_to_count_2 = topn->what_to_count_2;
+
+    groups_table = malloc(config.buckets*sizeof(int));
+    empty_pcust = calloc(1, config.cpptrs.len ? config.cpptrs.len : 1);
+    if (!groups_table || !empty_pcust) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (process_topn_query).\n", config.name, config.type);
+      goto exit_lane;
+    }
+    memset(groups_table, 0xff, config.buckets*sizeof(int)); /* -1, empty */
+  }
+  else {
+    q->what_to_count = config.what_to_count;
+    q->what_to_count_2 = config.what_to_count_2;
+  }
+
+  for (idx = 0; idx < config.buckets; idx++, elem += sizeof(struct acc)) {
+    for (acc_elem = (struct acc *) elem; acc_elem; acc_elem = acc_elem->next) {
+      if (test_zero_elem(acc_elem)) continue;
+
+      if (!grouped) {
+	if (topn->counter == 1) key = acc_elem->bytes_counter;
+	else if (topn->counter == 2) key = acc_elem->packet_counter;
+	else if (topn->counter == 3) key = acc_elem->flow_counter;
+	else key = 0;
+
+	topn_insert(&heap, &heap_num, &heap_size, topn->howmany, key, acc_elem);
+	continue;
+      }
+
+      mask_elem(&tbuf, &bbuf, &nbuf, &mbuf, acc_elem, topn->what_to_count, topn->what_to_count_2, extras);
+      hash = hash_masked_primitives(&tbuf, &bbuf, &nbuf, &mbuf, extras);
+
+      for (gidx = groups_table[hash % config.buckets]; gidx != -1; gidx = groups[gidx].next) {
+	group = &groups[gidx];
+	if (group->hash == hash && !memcmp(&group->data.primitives, &tbuf, sizeof(struct pkt_primitives)) &&
+	    !memcmp(&group->pbgp, &bbuf, sizeof(struct pkt_bgp_primitives)) &&
+	    !memcmp(&group->pnat, &nbuf, sizeof(struct pkt_nat_primitives)) &&
+	    !memcmp(&group->pmpls, &mbuf, sizeof(struct pkt_mpls_primitives))) break;
+      }
+
+      if (gidx == -1) {
+	if (groups_num == groups_size) {
+	  struct imt_topn_group *new_groups;
+	  u_int32_t new_size = groups_size ? groups_size*2 : 1024;
+
+	  new_groups = realloc(groups, new_size*sizeof(struct imt_topn_group));
+	  if (!new_groups) {
+	    Log(LOG_ERR, "ERROR ( %s/%s ): realloc() failed (process_topn_query).\n", config.name, config.type);
+	    goto exit_lane;
+	  }
+	  groups = new_groups;
+	  groups_size = new_size;
+	}
+
+	gidx = groups_num;
+	groups_num++;
+
+	group = &groups[gidx];
+	memset(&group->data, 0, sizeof(struct pkt_data));
+	memcpy(&group->data.primitives, &tbuf, sizeof(struct pkt_primitives));
+	memcpy(&group->pbgp, &bbuf, sizeof(struct pkt_bgp_primitives));
+	memcpy(&group->pnat, &nbuf, sizeof(struct pkt_nat_primitives));
+	memcpy(&group->pmpls, &mbuf, sizeof(struct pkt_mpls_primitives));
+	group->hash = hash;
+	group->next = groups_table[hash % config.buckets];
+	groups_table[hash % config.buckets] = gidx;
+      }
+
+      group->data.pkt_len += acc_elem->bytes_counter;
+      group->data.pkt_num += acc_elem->packet_counter;
+      group->data.flo_num += acc_elem->flow_counter;
+      group->data.tcp_flags |= acc_elem->tcp_flags;
+      group->data.flow_type = acc_elem->flow_type;
+    }
+  }
+
+  for (gidx = 0; gidx < groups_num; gidx++) {
+    group = &groups[gidx];
+
+    if (topn->counter == 1) key = group->data.pkt_len;
+    else if (topn->counter == 2) key = group->data.pkt_num;
+    else if (topn->counter == 3) key = group->data.flo_num;
+    else key = 0;
+
+    topn_insert(&heap, &heap_num, &heap_size, topn->howmany, key, group);
+  }
+
+  if (topn->counter) qsort(heap, heap_num, sizeof(struct imt_topn_item), topn_cmp);
+
+  for (idx = 0; idx < heap_num; idx++) {
+    if (!grouped) {
+      enQueue_acc(sd, rb, (struct acc *) heap[idx].ptr, extras, datasize);
+      continue;
+    }
+
+    group = (struct imt_topn_group *) heap[idx].ptr;
+    enQueue_elem(sd, rb, &group->data, PdataSz, datasize);
+
+    if (extras->off_pkt_bgp_primitives)
+      enQueue_elem(sd, rb, &group->pbgp, PbgpSz, datasize - extras->off_pkt_bgp_primitives);
+    if (extras->off_pkt_nat_primitives)
+      enQueue_elem(sd, rb, &group->pnat, PnatSz, datasize - extras->off_pkt_nat_primitives);
+    if (extras->off_pkt_mpls_primitives)
+      enQueue_elem(sd, rb, &group->pmpls, PmplsSz, datasize - extras->off_pkt_mpls_primitives);
+    if (extras->off_custom_primitives)
+      enQueue_elem(sd, rb, empty_pcust, config.cpptrs.len, datasize - extras->off_custom_primitives);
+  }
+
+  exit_lane:
+  if (heap) free(heap);
+  if (groups) free(groups);
+  if (groups_table) free(groups_table);
+  if (empty_pcust) free(empty_pcust);
+}
+
+/*
+  Appends to the heap; when 'howmany' is set, the heap is kept at that
+  size, as a min-heap over 'key', by evicting its smallest element.
+*/
+void topn_insert(struct imt_topn_item **heap, u_int32_t *num, u_int32_t *size, u_int32_t howmany, pm_counter_t key, void *ptr)
+{
+  struct imt_topn_item *h = *heap, tmp;
+  u_int32_t idx, child;
+
+  if (howmany && *num == howmany) {
+    if (key <= h[0].key) return;
+
+    h[0].key = key;
+    h[0].ptr = ptr;
+
+    for (idx = 0; (child = 2*idx+1) < *num; idx = child) {
+      if (child+1 < *num && h[child+1].key < h[child].key) child++;
+      if (h[idx].key <= h[child].key) break;
+
+      tmp = h[idx];
+      h[idx] = h[child];
+      h[child] = tmp;
+    }
+
+    return;
+  }
+
+  if (*num == *size) {
+    u_int32_t new_size = *size ? *size*2 : 1024;
+
+    if (howmany && new_size > howmany) new_size = howmany;
+    h = realloc(*heap, new_size*sizeof(struct imt_topn_item));
+    if (!h) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): realloc() failed (topn_insert). Entry skipped.\n", config.name, config.type);
+      return;
+    }
+
+    *heap = h;
+    *size = new_size;
+  }
+
+  idx = *num;
+  h[idx].key = key;
+  h[idx].ptr = ptr;
+  (*num)++;
+
+  if (howmany) {
+    for (; idx && h[(idx-1)/2].key > h[idx].key; idx = (idx-1)/2) {
+      tmp = h[idx];
+      h[idx] = h[(idx-1)/2];
+      h[(idx-1)/2] = tmp;
+    }
+  }
+}
+
+/* sorts top-N items, largest first */
+int topn_cmp(const void *x, const void *y)
+{
+  const struct imt_topn_item *ia = x, *ib = y;
+
+  if (ia->key > ib->key) return -1;
+  else if (ia->key < ib->key) return 1;
+
+  return 0;
+}
+
 void Accumulate_Counters(struct pkt_data *abuf, struct acc *elem)
 {
   abuf->pkt_len += elem->bytes_counter;
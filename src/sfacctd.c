@@ -72,8 +72,9 @@ void usage_daemon(char *prog_name)
   printf("  -c  \tAggregation method, see full list of primitives with -a (DEFAULT: src_host)\n");
   printf("  -D  \tDaemonize\n"); 
   printf("  -n  \tPath to a file containing Network definitions\n");
+  printf("  -C  \tCompile the Network definitions file into the specified binary map and exit\n");
   printf("  -o  \tPath to a file containing Port definitions\n");
-  printf("  -P  \t[ memory | print | mysql | pgsql | sqlite3 | mongodb | tee ] \n\tActivate plugin\n"); 
+  printf("  -P  \t[ memory | print | null | mysql | pgsql | sqlite3 | mongodb | tee ] \n\tActivate plugin\n"); 
   printf("  -d  \tEnable debug\n");
   printf("  -S  \t[ auth | mail | daemon | kern | user | local[0-7] ] \n\tLog to the specified syslog facility\n");
   printf("  -F  \tWrite Core Process PID into the specified file\n");
@@ -103,6 +104,7 @@ int main(int argc,char **argv, char **envp)
   struct plugin_requests req;
   struct packet_ptrs_vector pptrs;
   char config_file[SRVBUFLEN];
+  char *networks_map_out = NULL;
   unsigned char sflow_packet[SFLOW_MAX_MSG_SIZE];
   int logf, rc, yes=1, no=0, allowed;
   struct host_addr addr;
@@ -310,6 +312,9 @@ int main(int argc,char **argv, char **envp)
       usage_daemon(argv[0]);
       exit(0);
       break;
+    case 'C':
+      networks_map_out = optarg;
+      break;
     case 'V':
       version_daemon(SFACCTD_USAGE_HEADER);
       exit(0);
@@ -351,6 +356,8 @@ int main(int argc,char **argv, char **envp)
 
   if (config.files_umask) umask(config.files_umask);
 
+  if (networks_map_out) exit(compile_networks(config.networks_file, networks_map_out) == SUCCESS ? 0 : 1);
+
   if (config.daemon) {
     list = plugins_list;
     while (list) {
@@ -391,6 +398,10 @@ int main(int argc,char **argv, char **envp)
     else Log(LOG_INFO, "INFO ( %s/core ): proc_priority set to %d\n", config.name, getpriority(PRIO_PROCESS, 0));
   }
 
+  /* inherited by threads; plugins reset what they don't define on their own */
+  set_placement(config.name, "core", "process", config.plugin_numa_node, config.proc_cpu_affinity, ERR,
+		config.proc_sched_policy, config.proc_sched_priority);
+
   if (strlen(config_file)) {
     char canonical_path[PATH_MAX], *canonical_path_ptr;
 
@@ -464,8 +475,8 @@ int main(int argc,char **argv, char **envp)
 	    Log(LOG_ERR, "ERROR ( %s/%s ): AS aggregation was selected but NO 'networks_file' specified. Exiting...\n\n", list->name, list->type.string);
 	    exit(1);
 	  }
-          if (!list->cfg.nfacctd_bgp && list->cfg.nfacctd_as == NF_AS_BGP) {
-            Log(LOG_ERR, "ERROR ( %s/%s ): AS aggregation selected but 'bgp_daemon' is not enabled. Exiting...\n\n", list->name, list->type.string);
+          if (!list->cfg.nfacctd_bgp && !list->cfg.nfacctd_bmp && list->cfg.nfacctd_as == NF_AS_BGP) {
+            Log(LOG_ERR, "ERROR ( %s/%s ): AS aggregation selected but neither 'bgp_daemon' nor 'bmp_daemon' is enabled. Exiting...\n\n", list->name, list->type.string);
             exit(1);
 	  }
           if (list->cfg.nfacctd_as & NF_AS_FALLBACK && list->cfg.networks_file)
@@ -480,7 +491,7 @@ int main(int argc,char **argv, char **envp)
           else {
             if ((list->cfg.nfacctd_net == NF_NET_NEW && !list->cfg.networks_file) ||
                 (list->cfg.nfacctd_net == NF_NET_STATIC && !list->cfg.networks_mask) ||
-                (list->cfg.nfacctd_net == NF_NET_BGP && !list->cfg.nfacctd_bgp) ||
+                (list->cfg.nfacctd_net == NF_NET_BGP && !list->cfg.nfacctd_bgp && !list->cfg.nfacctd_bmp) ||
                 (list->cfg.nfacctd_net == NF_NET_IGP && !list->cfg.nfacctd_isis)) {
               Log(LOG_ERR, "ERROR ( %s/%s ): network aggregation selected but none of 'bgp_daemon', 'isis_daemon', 'networks_file', 'networks_mask' is specified. Exiting ...\n\n", list->name, list->type.string);
               exit(1);
@@ -751,11 +762,39 @@ int main(int argc,char **argv, char **envp)
   /* plugins glue: creation */
   load_plugins(&req);
   load_plugin_filters(1);
+  sf_decode_mask = sf_decode_mask_eval();
+  sf_flow_dispatch_init(sf_decode_mask);
   evaluate_packet_handlers();
   pm_setproctitle("%s [%s]", "Core Process", config.proc_name);
   if (config.pidfile) write_pid_file(config.pidfile);
   load_networks(config.networks_file, &nt, &nc);
 
+  /* maps are reloaded in background; to be started after plugins are forked */
+  if (config.maps_refresh) {
+    if (config.nfacctd_bgp && config.nfacctd_bgp_peer_as_src_map)
+      map_reload_add(MAP_BGP_PEER_AS_SRC, config.nfacctd_bgp_peer_as_src_map, &bpas_table, FALSE, FALSE);
+    if (config.nfacctd_bgp && config.nfacctd_bgp_src_local_pref_map)
+      map_reload_add(MAP_BGP_SRC_LOCAL_PREF, config.nfacctd_bgp_src_local_pref_map, &blp_table, FALSE, FALSE);
+    if (config.nfacctd_bgp && config.nfacctd_bgp_src_med_map)
+      map_reload_add(MAP_BGP_SRC_MED, config.nfacctd_bgp_src_med_map, &bmed_table, FALSE, FALSE);
+    if (config.nfacctd_bgp && config.nfacctd_bgp_to_agent_map)
+      map_reload_add(MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, FALSE, FALSE);
+    if (config.nfacctd_flow_to_rd_map)
+      map_reload_add(MAP_FLOW_TO_RD, config.nfacctd_flow_to_rd_map, &bitr_table, FALSE, FALSE);
+    if (config.sampling_map)
+      map_reload_add(MAP_SAMPLING, config.sampling_map, &sampling_table, FALSE, FALSE);
+
+    for (idx = 0; channels_list[idx].aggregation || channels_list[idx].aggregation_2; idx++) {
+      struct plugins_list_entry *p = channels_list[idx].plugin;
+
+      if (p->cfg.pre_tag_map && find_id_func)
+	map_reload_add(config.acct_type, p->cfg.pre_tag_map, &p->cfg.ptm, p->cfg.maps_entries, p->cfg.maps_row_len);
+    }
+
+    map_reload_add_networks(config.networks_file);
+    map_reload_init();
+  }
+
   /* signals to be handled only by pmacctd;
      we set proper handlers after plugin creation */
   signal(SIGINT, my_sigint_handler);
@@ -971,31 +1010,14 @@ int main(int argc,char **argv, char **envp)
     if (allow.num) allowed = check_allow(&allow, (struct sockaddr *)&client); 
     if (!allowed) continue;
 
-    if (reload_map) {
-      bta_map_caching = TRUE;
-      sampling_map_caching = TRUE;
-
-      load_networks(config.networks_file, &nt, &nc);
-
-      if (config.nfacctd_bgp && config.nfacctd_bgp_peer_as_src_map)
-        load_id_file(MAP_BGP_PEER_AS_SRC, config.nfacctd_bgp_peer_as_src_map, &bpas_table, &req, &bpas_map_allocated);
-      if (config.nfacctd_bgp && config.nfacctd_bgp_src_local_pref_map)
-        load_id_file(MAP_BGP_SRC_LOCAL_PREF, config.nfacctd_bgp_src_local_pref_map, &blp_table, &req, &blp_map_allocated);
-      if (config.nfacctd_bgp && config.nfacctd_bgp_src_med_map)
-        load_id_file(MAP_BGP_SRC_MED, config.nfacctd_bgp_src_med_map, &bmed_table, &req, &bmed_map_allocated);
-      if (config.nfacctd_bgp && config.nfacctd_bgp_to_agent_map)
-        load_id_file(MAP_BGP_TO_XFLOW_AGENT, config.nfacctd_bgp_to_agent_map, &bta_table, &req, &bta_map_allocated);
-      if (config.nfacctd_flow_to_rd_map)
-        load_id_file(MAP_FLOW_TO_RD, config.nfacctd_flow_to_rd_map, &bitr_table, &req, &bitr_map_allocated);
-      if (config.sampling_map) {
-        load_id_file(MAP_SAMPLING, config.sampling_map, &sampling_table, &req, &sampling_map_allocated);
-        set_sampling_table(&pptrs, (u_char *) &sampling_table);
-      }
-
+    if (reload_map && map_reload_kick(&req)) {
       reload_map = FALSE;
-      gettimeofday(&reload_map_tstamp, NULL);
+      reload_map_exec_plugins = FALSE;
     }
 
+    if (map_reload_publish(&bta_map_caching, &sampling_map_caching))
+      gettimeofday(&reload_map_tstamp, NULL);
+
     if (reload_log_sf_cnt) {
       int nodes_idx;
 
@@ -1037,6 +1059,10 @@ int main(int argc,char **argv, char **envp)
     }
 
     if (data_plugins) {
+      /* BPF filters may have been loaded by a map reload: they need L4 */
+      spp.decode = sf_decode_mask;
+      if (req.bpf_filter) spp.decode |= SF_DECODE_L4;
+
       switch(spp.datagramVersion = getData32(&spp)) {
       case 5:
 	getAddress(&spp, &spp.agent_addr);
@@ -1120,6 +1146,7 @@ void process_SFv2v4_packet(SFSample *spp, struct packet_ptrs_vector *pptrsv,
   
   pptrsv->v4.f_status = sfv245_check_status(spp, agent);
   set_vector_f_status(pptrsv);
+  if (pptrsv->v4.f_status) ((struct xflow_status_entry *) pptrsv->v4.f_status)->counters.flows += samplesInPacket;
 
   if (config.debug) {
     sa_to_addr((struct sockaddr *)pptrsv->v4.f_agent, &debug_a, &debug_agent_port);
@@ -1167,6 +1194,7 @@ void process_SFv5_packet(SFSample *spp, struct packet_ptrs_vector *pptrsv,
   samplesInPacket = getData32(spp);
   pptrsv->v4.f_status = sfv245_check_status(spp, agent);
   set_vector_f_status(pptrsv);
+  if (pptrsv->v4.f_status) ((struct xflow_status_entry *) pptrsv->v4.f_status)->counters.flows += samplesInPacket;
 
   if (config.debug) {
     sa_to_addr((struct sockaddr *)pptrsv->v4.f_agent, &debug_a, &debug_agent_port);
@@ -1503,7 +1531,7 @@ void decodeIPV4(SFSample *sample)
     sample->dcd_ipTTL = ip.ttl;
     /* check for fragments */
     sample->ip_fragmentOffset = ntohs(ip.frag_off) & 0x1FFF;
-    if (sample->ip_fragmentOffset == 0) {
+    if (sample->ip_fragmentOffset == 0 && (sample->decode & SF_DECODE_L4)) {
       /* advance the pointer to the next protocol layer */
       /* ip headerLen is expressed as a number of quads */
       ptr += (ip.version_and_headerLen & 0x0f) * 4;
@@ -1584,7 +1612,7 @@ void decodeIPV6(SFSample *sample)
     // now that we have eliminated the extension headers, nextHeader should have what we want to
     // remember as the ip protocol...
     sample->dcd_ipProtocol = nextHeader;
-    decodeIPLayer4(sample, ptr, sample->dcd_ipProtocol);
+    if (sample->decode & SF_DECODE_L4) decodeIPLayer4(sample, ptr, sample->dcd_ipProtocol);
   }
 }
 #endif
@@ -1719,6 +1747,7 @@ void readExtendedGateway(SFSample *sample)
   int len_tot, len_asn, len_comm, idx;
   char asn_str[MAX_BGP_ASPATH], comm_str[MAX_BGP_STD_COMMS], space[] = " ";
   char buf[51];
+  int strings = (sample->decode & SF_DECODE_GW_STRINGS);
 
   if(sample->datagramVersion >= 5) getAddress(sample, &sample->bgp_nextHop);
 
@@ -1739,6 +1768,16 @@ void readExtendedGateway(SFSample *sample)
 	u_int32_t asNumber;
 
 	asNumber = getData32(sample);
+
+	/* mark the first one as the dst_peer_as */
+	if(i == 0 && idx == 0) sample->dst_peer_as = asNumber;
+
+	/* mark the last one as the dst_as */
+	if (idx == (sample->dst_as_path_len - 1) && i == (seg_len - 1)) sample->dst_as = asNumber;
+
+	/* the string is built only if some plugin is going to read it */
+	if (!strings) continue;
+
 	snprintf(asn_str, MAX_BGP_ASPATH-1, "%u", asNumber);
         len_asn = strlen(asn_str);
 	len_tot = strlen(sample->dst_as_path);
@@ -1751,12 +1790,7 @@ void readExtendedGateway(SFSample *sample)
           sample->dst_as_path[MAX_BGP_ASPATH-1] = '\0';
         }
 
-	/* mark the first one as the dst_peer_as */
-	if(i == 0 && idx == 0) sample->dst_peer_as = asNumber;
-
-	/* mark the last one as the dst_as */
-	if (idx == (sample->dst_as_path_len - 1) && i == (seg_len - 1)) sample->dst_as = asNumber;
-        else {
+	if (!(idx == (sample->dst_as_path_len - 1) && i == (seg_len - 1))) {
           if (strlen(sample->dst_as_path) < (MAX_BGP_ASPATH-1))
             strncat(sample->dst_as_path, space, 1);
         }
@@ -1766,7 +1800,8 @@ void readExtendedGateway(SFSample *sample)
 
   sample->communities_len = getData32(sample);
   /* just point at the communities array */
-  if (sample->communities_len > 0) {
+  if (sample->communities_len > 0 && !strings) skipBytes(sample, sample->communities_len * 4);
+  else if (sample->communities_len > 0) {
     for (idx = 0, len_tot = 0; idx < sample->communities_len; idx++) {
       u_int32_t comm, as, val;
 
@@ -2273,6 +2308,93 @@ void readv2v4FlowSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, str
   finalizeSample(sample, pptrsv, req);
 }
 
+/*_________________---------------------------__________________
+  _________________    flow records dispatch    __________________
+  -----------------___________________________------------------
+  Flow records are decoded only if some configured consumer is
+  going to look at them; the rest is skipped by length. Entry 0 is
+  the catch-all for unknown and not needed records.
+*/
+
+struct sf_flow_dispatch sf_flow_dispatch_table[] = {
+  {0, NULL, 0},
+  {SFLFLOW_HEADER, readFlowSample_header, 0},
+  {SFLFLOW_ETHERNET, readFlowSample_ethernet, 0},
+  {SFLFLOW_IPV4, readFlowSample_IPv4, 0},
+  {SFLFLOW_IPV6, readFlowSample_IPv6, 0},
+  {SFLFLOW_EX_SWITCH, readExtendedSwitch, 0},
+  {SFLFLOW_EX_ROUTER, readExtendedRouter, 0},
+  {SFLFLOW_EX_GATEWAY, readExtendedGateway, 0},
+  {SFLFLOW_EX_USER, readExtendedUser, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_URL, readExtendedUrl, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_MPLS, readExtendedMpls, 0},
+  {SFLFLOW_EX_NAT, readExtendedNat, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_MPLS_TUNNEL, readExtendedMplsTunnel, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_MPLS_VC, readExtendedMplsVC, SF_DECODE_MPLS_VC},
+  {SFLFLOW_EX_MPLS_FTN, readExtendedMplsFTN, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_MPLS_LDP_FEC, readExtendedMplsLDP_FEC, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_VLAN_TUNNEL, readExtendedVlanTunnel, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_PROCESS, readExtendedProcess, SF_DECODE_UNUSED},
+  {SFLFLOW_EX_CLASS, readExtendedClass, 0},
+  {SFLFLOW_EX_TAG, readExtendedTag, 0},
+  {0, NULL, 0}
+};
+
+/* union of what the data plugins and the Core Process need out of a sample */
+u_int32_t sf_decode_mask_eval()
+{
+  struct plugins_list_entry *list = plugins_list;
+  u_int32_t mask = 0;
+
+  if (config.classifiers_path) mask |= SF_DECODE_L4;
+  if (config.pre_tag_map) mask |= SF_DECODE_MPLS_VC;
+
+  while (list) {
+    if (list->cfg.what_to_count & (COUNT_SRC_PORT|COUNT_DST_PORT|COUNT_SUM_PORT|COUNT_TCPFLAGS|COUNT_CLASS))
+      mask |= SF_DECODE_L4;
+    if (list->cfg.what_to_count & (COUNT_AS_PATH|COUNT_STD_COMM))
+      mask |= SF_DECODE_GW_STRINGS;
+    if (list->cfg.pre_tag_map) mask |= SF_DECODE_MPLS_VC;
+
+    list = list->next;
+  }
+
+  Log(LOG_DEBUG, "DEBUG ( %s/core ): sFlow decoding: L4 [%s] AS-PATH/communities [%s] MPLS VC [%s]\n", config.name,
+	(mask & SF_DECODE_L4) ? "yes" : "no", (mask & SF_DECODE_GW_STRINGS) ? "yes" : "no",
+	(mask & SF_DECODE_MPLS_VC) ? "yes" : "no");
+
+  return mask;
+}
+
+void sf_flow_dispatch_init(u_int32_t mask)
+{
+  int idx;
+
+  memset(sf_flow_dispatch_std, 0, sizeof(sf_flow_dispatch_std));
+
+  for (idx = 1; sf_flow_dispatch_table[idx].func; idx++) {
+    if (sf_flow_dispatch_table[idx].tag < SF_FLOW_STD_FORMATS &&
+	(sf_flow_dispatch_table[idx].need & mask) == sf_flow_dispatch_table[idx].need)
+      sf_flow_dispatch_std[sf_flow_dispatch_table[idx].tag] = idx;
+  }
+}
+
+/* enterprise != 0 records: a handful, a linear scan is fine */
+struct sf_flow_dispatch *sf_flow_dispatch_lookup(u_int32_t tag)
+{
+  int idx;
+
+  for (idx = 1; sf_flow_dispatch_table[idx].func; idx++) {
+    if (sf_flow_dispatch_table[idx].tag == tag) {
+      if ((sf_flow_dispatch_table[idx].need & sf_decode_mask) == sf_flow_dispatch_table[idx].need)
+	return &sf_flow_dispatch_table[idx];
+      else break;
+    }
+  }
+
+  return &sf_flow_dispatch_table[0];
+}
+
 /*_________________---------------------------__________________
   _________________    readv5FlowSample         __________________
   -----------------___________________________------------------
@@ -2281,6 +2403,7 @@ void readv2v4FlowSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, str
 void readv5FlowSample(SFSample *sample, int expanded, struct packet_ptrs_vector *pptrsv, struct plugin_requests *req)
 {
   struct sfv5_modules_db_field *db_field = NULL;
+  struct sf_flow_dispatch *handler;
   u_int32_t num_elements, sampleLength, actualSampleLength;
   u_char *sampleStart;
 
@@ -2326,31 +2449,14 @@ void readv5FlowSample(SFSample *sample, int expanded, struct packet_ptrs_vector
       length = getData32(sample);
       start = (u_char *)sample->datap;
 
-      switch(tag) {
-      case SFLFLOW_HEADER:     readFlowSample_header(sample); break;
-      case SFLFLOW_ETHERNET:   readFlowSample_ethernet(sample); break;
-      case SFLFLOW_IPV4:       readFlowSample_IPv4(sample); break;
-      case SFLFLOW_IPV6:       readFlowSample_IPv6(sample); break;
-      case SFLFLOW_EX_SWITCH:  readExtendedSwitch(sample); break;
-      case SFLFLOW_EX_ROUTER:  readExtendedRouter(sample); break;
-      case SFLFLOW_EX_GATEWAY: readExtendedGateway(sample); break;
-      case SFLFLOW_EX_USER:    readExtendedUser(sample); break;
-      case SFLFLOW_EX_URL:     readExtendedUrl(sample); break;
-      case SFLFLOW_EX_MPLS:    readExtendedMpls(sample); break;
-      case SFLFLOW_EX_NAT:     readExtendedNat(sample); break;
-      case SFLFLOW_EX_MPLS_TUNNEL:  readExtendedMplsTunnel(sample); break;
-      case SFLFLOW_EX_MPLS_VC:      readExtendedMplsVC(sample); break;
-      case SFLFLOW_EX_MPLS_FTN:     readExtendedMplsFTN(sample); break;
-      case SFLFLOW_EX_MPLS_LDP_FEC: readExtendedMplsLDP_FEC(sample); break;
-      case SFLFLOW_EX_VLAN_TUNNEL:  readExtendedVlanTunnel(sample); break;
-      case SFLFLOW_EX_PROCESS:      readExtendedProcess(sample); break;
-      case SFLFLOW_EX_CLASS:	    readExtendedClass(sample); break;
-      case SFLFLOW_EX_TAG:	    readExtendedTag(sample); break;
-      default:
-	// lengthCheck() here for extra security before skipBytes()
-	if (lengthCheck(sample, start, length) == ERR) return;
+      if (tag < SF_FLOW_STD_FORMATS) handler = &sf_flow_dispatch_table[sf_flow_dispatch_std[tag]];
+      else handler = sf_flow_dispatch_lookup(tag);
+
+      if (handler->func) handler->func(sample);
+      else {
+	/* not decoded: check bounds here for extra security before skipBytes() */
+	if ((start + length) > sample->endp || (start + length) < start) return;
 	skipBytes(sample, length);
-	break;
       }
 
       db_field = sfv5_modules_db_get_next_ie(tag);
@@ -2506,7 +2612,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, pptrs, &pptrs->bta, &pptrs->bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, pptrs, &pptrs->bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(pptrs);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(pptrs);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, pptrs, &pptrs->bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, pptrs, &pptrs->blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, pptrs, &pptrs->bmed, NULL);
@@ -2542,7 +2648,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->v6);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->v6, &pptrsv->v6.bta, &pptrsv->v6.bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->v6, &pptrsv->v6.bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->v6);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->v6);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->v6, &pptrsv->v6.bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->v6, &pptrsv->v6.blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->v6, &pptrsv->v6.bmed, NULL);
@@ -2579,7 +2685,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlan4);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlan4, &pptrsv->vlan4.bta, &pptrsv->vlan4.bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlan4, &pptrsv->vlan4.bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlan4);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlan4);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlan4, &pptrsv->vlan4.bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlan4, &pptrsv->vlan4.blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlan4, &pptrsv->vlan4.bmed, NULL);
@@ -2616,7 +2722,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlan6);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlan6, &pptrsv->vlan6.bta, &pptrsv->vlan6.bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlan6, &pptrsv->vlan6.bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlan6);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlan6);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlan6, &pptrsv->vlan6.bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlan6, &pptrsv->vlan6.blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlan6, &pptrsv->vlan6.bmed, NULL);
@@ -2666,7 +2772,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->mpls4);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->mpls4, &pptrsv->mpls4.bta, &pptrsv->mpls4.bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->mpls4, &pptrsv->mpls4.bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->mpls4);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->mpls4);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->mpls4, &pptrsv->mpls4.bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->mpls4, &pptrsv->mpls4.blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->mpls4, &pptrsv->mpls4.bmed, NULL);
@@ -2715,7 +2821,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->mpls6);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->mpls6, &pptrsv->mpls6.bta, &pptrsv->mpls6.bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->mpls6, &pptrsv->mpls6.bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->mpls6);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->mpls6);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->mpls6, &pptrsv->mpls6.bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->mpls6, &pptrsv->mpls6.blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->mpls6, &pptrsv->mpls6.bmed, NULL);
@@ -2765,7 +2871,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlanmpls4);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bta, &pptrsv->vlanmpls4.bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlanmpls4);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlanmpls4);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlanmpls4, &pptrsv->vlanmpls4.bmed, NULL);
@@ -2815,7 +2921,7 @@ void finalizeSample(SFSample *sample, struct packet_ptrs_vector *pptrsv, struct
       if (config.nfacctd_isis) isis_srcdst_lookup(&pptrsv->vlanmpls6);
       if (config.nfacctd_bgp_to_agent_map) BTA_find_id((struct id_table *)pptrs->bta_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bta, &pptrsv->vlanmpls6.bta2);
       if (config.nfacctd_flow_to_rd_map) SF_find_id((struct id_table *)pptrs->bitr_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bitr, NULL);
-      if (config.nfacctd_bgp) bgp_srcdst_lookup(&pptrsv->vlanmpls6);
+      if (config.nfacctd_bgp || config.nfacctd_bmp) bgp_srcdst_lookup(&pptrsv->vlanmpls6);
       if (config.nfacctd_bgp_peer_as_src_map) SF_find_id((struct id_table *)pptrs->bpas_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bpas, NULL);
       if (config.nfacctd_bgp_src_local_pref_map) SF_find_id((struct id_table *)pptrs->blp_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.blp, NULL);
       if (config.nfacctd_bgp_src_med_map) SF_find_id((struct id_table *)pptrs->bmed_table, &pptrsv->vlanmpls6, &pptrsv->vlanmpls6.bmed, NULL);
@@ -2969,7 +3075,6 @@ char *sfv245_check_status(SFSample *spp, struct sockaddr *sa)
   struct sockaddr salocal;
   u_int32_t aux1 = spp->agentSubId;
   struct xflow_status_entry *entry = NULL;
-  int hash; 
 
   memcpy(&salocal, sa, sizeof(struct sockaddr));
 
@@ -2978,14 +3083,10 @@ char *sfv245_check_status(SFSample *spp, struct sockaddr *sa)
   salocal.sa_family = AF_INET; 
   ( (struct sockaddr_in *)&salocal )->sin_addr = spp->agent_addr.address.ip_v4;
 
-  hash = hash_status_table(aux1, &salocal, XFLOW_STATUS_TABLE_SZ);
-
-  if (hash >= 0) {
-    entry = search_status_table(&salocal, aux1, 0, hash, XFLOW_STATUS_TABLE_MAX_ENTRIES);
-    if (entry) {
-      update_status_table(entry, spp->sequenceNo);
-      entry->inc = 1;
-    }
+  entry = search_status_table(&salocal, aux1, 0, XFLOW_STATUS_TABLE_MAX_ENTRIES);
+  if (entry) {
+    update_status_table(entry, spp->sequenceNo);
+    entry->inc = 1;
   }
 
   return (char *) entry;
@@ -65,6 +65,7 @@ typedef struct _SFSample {
   u_int32_t *datap;
 
   u_int32_t datagramVersion;
+  u_int32_t decode;		/* SF_DECODE_* bits, survives InterSampleCleanup() */
   u_int32_t sampleType;
   u_int32_t ds_class;
   u_int32_t ds_index;
@@ -240,6 +241,21 @@ struct SF_udphdr {
   u_int16_t uh_sum;
 };
 
+/* lazy decoding: optional parts of a flow sample, see sf_flow_dispatch_init() */
+#define SF_DECODE_L4		0x00000001	/* ports, TCP flags, ICMP type/code */
+#define SF_DECODE_GW_STRINGS	0x00000002	/* AS-PATH and communities strings */
+#define SF_DECODE_MPLS_VC	0x00000004	/* extended MPLS VC record */
+#define SF_DECODE_UNUSED	0x80000000	/* records no consumer looks at */
+#define SF_DECODE_ALL		0xFFFFFFFF
+
+#define SF_FLOW_STD_FORMATS	1024		/* enterprise 0 formats indexed directly */
+
+struct sf_flow_dispatch {
+  u_int32_t tag;
+  void (*func)(SFSample *);
+  u_int32_t need;	/* SF_DECODE_* bits: record is skipped unless all decoded */
+};
+
 /* and ICMP */
 struct SF_icmphdr
 {
@@ -303,6 +319,9 @@ EXT void readFlowSample_header(SFSample *);
 EXT void readFlowSample_ethernet(SFSample *);
 EXT void readFlowSample_IPv4(SFSample *);
 EXT void readFlowSample_IPv6(SFSample *);
+EXT u_int32_t sf_decode_mask_eval();
+EXT void sf_flow_dispatch_init(u_int32_t);
+EXT struct sf_flow_dispatch *sf_flow_dispatch_lookup(u_int32_t);
 
 EXT int sf_cnt_log_msg(struct bgp_peer *, SFSample *, u_int32_t, char *, int, u_int32_t);
 EXT int readCounters_generic(struct bgp_peer *, SFSample *, char *, int, void *);
@@ -323,8 +342,10 @@ EXT u_int64_t sf_cnt_log_seq;
 EXT struct timeval sf_cnt_log_tstamp;
 EXT char sf_cnt_log_tstamp_str[SRVBUFLEN];
 EXT int sfacctd_counter_backend_methods;
+EXT u_int32_t sf_decode_mask;
+EXT u_int8_t sf_flow_dispatch_std[SF_FLOW_STD_FORMATS];
 
-EXT struct host_addr debug_a;
-EXT u_char debug_agent_addr[50];
-EXT u_int16_t debug_agent_port;
+EXT ThreadLocal struct host_addr debug_a;
+EXT ThreadLocal u_char debug_agent_addr[50];
+EXT ThreadLocal u_int16_t debug_agent_port;
 #undef EXT
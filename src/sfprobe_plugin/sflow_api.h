@@ -93,6 +93,11 @@ typedef struct _SFLReceiver {
   /* private fields */
   SFLSampleCollector sampleCollector;
   struct sockaddr_in receiver;
+  /* batched send, see sfl_receiver_set_batchSize() */
+  u_int32_t batchSize;
+  u_int32_t batchLen;
+  u_char *batchBuf;
+  u_int32_t *batchPktLen;
 } SFLReceiver;
 
 typedef struct _SFLSampler {
@@ -238,6 +243,8 @@ SFLAddress *sfl_receiver_get_sFlowRcvrAddress(SFLReceiver *receiver);
 void        sfl_receiver_set_sFlowRcvrAddress(SFLReceiver *receiver, SFLAddress *sFlowRcvrAddress);
 u_int32_t   sfl_receiver_get_sFlowRcvrPort(SFLReceiver *receiver);
 void        sfl_receiver_set_sFlowRcvrPort(SFLReceiver *receiver, u_int32_t sFlowRcvrPort);
+int         sfl_receiver_set_batchSize(SFLReceiver *receiver, u_int32_t batchSize);
+void        sfl_receiver_flush(SFLReceiver *receiver);
 /* sampler */
 u_int32_t sfl_sampler_get_sFlowFsReceiver(SFLSampler *sampler);
 void      sfl_sampler_set_sFlowFsReceiver(SFLSampler *sampler, u_int32_t sFlowFsReceiver);
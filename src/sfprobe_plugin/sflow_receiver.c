@@ -1,6 +1,10 @@
 /* Copyright (c) 2002-2006 InMon Corp. Licensed under the terms of the InMon sFlow licence: */
 /* http://www.inmon.com/technology/sflowlicense.txt */
 
+#if defined HAVE_SENDMMSG
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,6 +19,8 @@
 
 static void resetSampleCollector(SFLReceiver *receiver);
 static void sendSample(SFLReceiver *receiver);
+static void sendDatagram(SFLReceiver *receiver, u_char *data, u_int32_t len);
+static void flushBatch(SFLReceiver *receiver);
 static void sflError(SFLReceiver *receiver, char *errm);
 static void putNet32(SFLReceiver *receiver, u_int32_t val);
 static void putAddress(SFLReceiver *receiver, SFLAddress *addr);
@@ -59,10 +65,19 @@ void sfl_receiver_init(SFLReceiver *receiver, SFLAgent *agent)
 */
 
 static void reset(SFLReceiver *receiver) {
+  u_int32_t batchSize = receiver->batchSize;
+  u_char *batchBuf = receiver->batchBuf;
+  u_int32_t *batchPktLen = receiver->batchPktLen;
+
   // ask agent to tell samplers and pollers to stop sending samples
   sfl_agent_resetReceiver(receiver->agent, receiver);
-  // reinitialize
+  // whatever is queued was encoded for the old settings
+  flushBatch(receiver);
+  // reinitialize, keeping the batch buffers
   sfl_receiver_init(receiver, receiver->agent);
+  receiver->batchSize = batchSize;
+  receiver->batchBuf = batchBuf;
+  receiver->batchPktLen = batchPktLen;
 }
 
 /*_________________----------------------------------------_____________
@@ -120,6 +135,7 @@ void sfl_receiver_tick(SFLReceiver *receiver, time_t now)
 {
   // if there are any samples to send, flush them now
   if(receiver->sampleCollector.numSamples > 0) sendSample(receiver);
+  flushBatch(receiver);
   // check the timeout
   if(receiver->sFlowRcvrTimeout && receiver->sFlowRcvrTimeout != 0xFFFFFFFF) {
     // count down one tick and reset if we reach 0
@@ -127,6 +143,88 @@ void sfl_receiver_tick(SFLReceiver *receiver, time_t now)
   }
 }
 
+/*_________________---------------------------__________________
+  _________________   batched send            __________________
+  -----------------___________________________------------------
+
+  With a non-zero batchSize complete datagrams are copied aside
+  and handed over to the kernel batchSize at a time, with a single
+  sendmmsg() where available. A zero batchSize frees the buffers.
+*/
+
+int sfl_receiver_set_batchSize(SFLReceiver *receiver, u_int32_t batchSize)
+{
+  flushBatch(receiver);
+
+  if(receiver->batchBuf) free(receiver->batchBuf);
+  if(receiver->batchPktLen) free(receiver->batchPktLen);
+  receiver->batchBuf = NULL;
+  receiver->batchPktLen = NULL;
+  receiver->batchSize = 0;
+
+  if(batchSize) {
+    receiver->batchBuf = malloc(batchSize * SFL_MAX_DATAGRAM_SIZE);
+    receiver->batchPktLen = malloc(batchSize * sizeof(u_int32_t));
+    if(!receiver->batchBuf || !receiver->batchPktLen) {
+      sflError(receiver, "unable to allocate batch buffers");
+      sfl_receiver_set_batchSize(receiver, 0);
+      return -1;
+    }
+    receiver->batchSize = batchSize;
+  }
+
+  return 0;
+}
+
+/* complete datagrams only: safe to call while a sample is being encoded */
+void sfl_receiver_flush(SFLReceiver *receiver)
+{
+  flushBatch(receiver);
+}
+
+static void flushBatch(SFLReceiver *receiver)
+{
+  u_int32_t idx;
+
+  if(!receiver->batchLen) return;
+
+#if defined HAVE_SENDMMSG
+  if(!receiver->agent->sendFn) {
+    struct mmsghdr mmsg[receiver->batchLen];
+    struct iovec iov[receiver->batchLen];
+    int ret;
+
+    memset(mmsg, 0, sizeof(mmsg));
+    for(idx = 0; idx < receiver->batchLen; idx++) {
+      iov[idx].iov_base = receiver->batchBuf + (idx * SFL_MAX_DATAGRAM_SIZE);
+      iov[idx].iov_len = receiver->batchPktLen[idx];
+      mmsg[idx].msg_hdr.msg_iov = &iov[idx];
+      mmsg[idx].msg_hdr.msg_iovlen = 1;
+      mmsg[idx].msg_hdr.msg_name = &receiver->receiver;
+      mmsg[idx].msg_hdr.msg_namelen = sizeof(receiver->receiver);
+    }
+
+    for(idx = 0; idx < receiver->batchLen; ) {
+      ret = sendmmsg(receiver->agent->receiverSocket, &mmsg[idx], receiver->batchLen - idx, 0);
+      if(ret > 0) idx += ret;
+      else {
+	if(errno != EINTR) sfl_agent_sysError(receiver->agent, "receiver", "socket sendmmsg error");
+	// give up on this datagram, carry on with the rest
+	idx++;
+      }
+    }
+
+    receiver->batchLen = 0;
+    return;
+  }
+#endif
+
+  for(idx = 0; idx < receiver->batchLen; idx++)
+    sendDatagram(receiver, receiver->batchBuf + (idx * SFL_MAX_DATAGRAM_SIZE), receiver->batchPktLen[idx]);
+
+  receiver->batchLen = 0;
+}
+
 /*_________________-----------------------------__________________
   _________________   receiver write utilities  __________________
   -----------------_____________________________------------------
@@ -770,25 +868,37 @@ static void sendSample(SFLReceiver *receiver)
   receiver->sampleCollector.data[hdrIdx++] = htonl(++receiver->sampleCollector.packetSeqNo); /* seq no */
   receiver->sampleCollector.data[hdrIdx++] = htonl((receiver->agent->now - receiver->agent->bootTime) * 1000); /* uptime */
   receiver->sampleCollector.data[hdrIdx++] = htonl(receiver->sampleCollector.numSamples); /* num samples */
-  /* send */
+  /* send, or queue it up */
+  if(receiver->batchSize) {
+    memcpy(receiver->batchBuf + (receiver->batchLen * SFL_MAX_DATAGRAM_SIZE),
+	   receiver->sampleCollector.data, receiver->sampleCollector.pktlen);
+    receiver->batchPktLen[receiver->batchLen] = receiver->sampleCollector.pktlen;
+    receiver->batchLen++;
+    if(receiver->batchLen == receiver->batchSize) flushBatch(receiver);
+  }
+  else sendDatagram(receiver, (u_char *)receiver->sampleCollector.data, receiver->sampleCollector.pktlen);
+  /* reset for the next time */
+  resetSampleCollector(receiver);
+}
+
+static void sendDatagram(SFLReceiver *receiver, u_char *data, u_int32_t len)
+{
   if(receiver->agent->sendFn) (*receiver->agent->sendFn)(receiver->agent->magic,
 						     receiver->agent,
 						     receiver,
-						     (u_char *)receiver->sampleCollector.data, 
-						     receiver->sampleCollector.pktlen);
+						     data,
+						     len);
   else {
     /* send it myself */
     int result = sendto(receiver->agent->receiverSocket,
-			receiver->sampleCollector.data,
-			receiver->sampleCollector.pktlen,
+			data,
+			len,
 			0,
 			(struct sockaddr *)&receiver->receiver,
 			sizeof(receiver->receiver));
     if(result == -1 && errno != EINTR) sfl_agent_sysError(receiver->agent, "receiver", "socket sendto error");
     if(result == 0) sfl_agent_error(receiver->agent, "receiver", "socket sendto returned 0");
   }
-  /* reset for the next time */
-  resetSampleCollector(receiver);
 }
 
 /*_________________---------------------------__________________
@@ -74,8 +74,13 @@ typedef struct _SflSp {
   SFLSampler *sampler;
 } SflSp;
 
+/* for the exit handler to flush queued datagrams */
+static SFLAgent *sfprobe_agent;
+
 void sfprobe_exit_now(int signum)
 {
+  if (sfprobe_agent) sfl_receiver_flush(sfl_agent_getReceiver(sfprobe_agent, 1));
+
   Log(LOG_WARNING, "WARN ( %s/%s ): Shutting down on user request.\n", config.name, config.type);
   exit_plugin(0);
 }
@@ -248,6 +253,20 @@ static void init_agent(SflSp *sp)
   // collector port
   sfl_receiver_set_sFlowRcvrPort(sfl_agent_getReceiver(sp->agent, 1), sp->collectorPort);
 
+  // datagram size and batched send
+  if (config.sfprobe_datagram_size)
+    sfl_receiver_set_sFlowRcvrMaximumDatagramSize(sfl_agent_getReceiver(sp->agent, 1), config.sfprobe_datagram_size);
+
+  if (config.sfprobe_batch_size) {
+    if (!sfl_receiver_set_batchSize(sfl_agent_getReceiver(sp->agent, 1), config.sfprobe_batch_size)) {
+#if defined HAVE_SENDMMSG
+      Log(LOG_INFO, "INFO ( %s/%s ): batched send enabled: sfprobe_batch_size=%u\n", config.name, config.type, config.sfprobe_batch_size);
+#else
+      Log(LOG_WARNING, "WARN ( %s/%s ): sendmmsg() not available: sfprobe_batch_size only defers sends.\n", config.name, config.type);
+#endif
+    }
+  }
+
   // set the sampling rate
   sfl_sampler_set_sFlowFsPacketSamplingRate(sfl_agent_getSampler(sp->agent, &dsi), sp->samplingRate);
 
@@ -262,6 +281,7 @@ static void init_agent(SflSp *sp)
 
   // cache the sampler pointer for performance reasons...
   sp->sampler = sfl_agent_getSampler(sp->agent, &dsi);
+  sfprobe_agent = sp->agent;
 }
 
 /*_________________---------------------------__________________
@@ -657,7 +677,6 @@ void sfprobe_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   }
   else setnonblocking(pipe_fd);
 
-  refresh_timeout = 60 * 1000; /* 1 min */
 
   for (;;) {
 poll_again:
@@ -666,6 +685,11 @@ poll_again:
     pfd.fd = pipe_fd;
     pfd.events = POLLIN;
 
+    /* queued datagrams are flushed by sfl_agent_tick(): wake up to tick
+       every second as long as there are any, even with no traffic */
+    if (sfl_agent_getReceiver(sp.agent, 1)->batchLen) refresh_timeout = 1000;
+    else refresh_timeout = 60 * 1000; /* 1 min */
+
     if (config.pipe_homegrown || config.pipe_amqp) {
       timeout = MIN(refresh_timeout, (amqp_timeout ? amqp_timeout : INT_MAX));
       ret = poll(&pfd, (pfd.fd == ERR ? 0 : 1), timeout);
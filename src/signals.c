@@ -26,6 +26,7 @@
 #include "pmacct.h"
 #include "pmacct-data.h"
 #include "plugin_hooks.h"
+#include "ip_frag.h"
 
 /* extern */
 extern struct plugins_list_entry *plugin_list;
@@ -189,9 +190,24 @@ void push_stats()
       Log(LOG_NOTICE, "%s: (%u) %u packets received by filter\n", config.dev, now, ps.ps_recv);
       Log(LOG_NOTICE, "%s: (%u) %u packets dropped by kernel\n", config.dev, now, ps.ps_drop);
     }
+    if (config.handle_fragments) {
+      Log(LOG_NOTICE, "Fragment/4: (%u) %u/%u nodes %u buckets %llu created %llu expired %llu orphans %llu evictions\n",
+	  now, ipft.nodes_used, ipft.nodes_budget, ipft.buckets_num, ipft.stats.created, ipft.stats.expired,
+	  ipft.stats.orphans, ipft.stats.evictions);
+#if defined ENABLE_IPV6
+      Log(LOG_NOTICE, "Fragment/6: (%u) %u/%u nodes %u buckets %llu created %llu expired %llu orphans %llu evictions\n",
+	  now, ipft6.nodes_used, ipft6.nodes_budget, ipft6.buckets_num, ipft6.stats.created, ipft6.stats.expired,
+	  ipft6.stats.orphans, ipft6.stats.evictions);
+#endif
+    }
   }
   else if (config.acct_type == ACCT_NF || config.acct_type == ACCT_SF)
-    print_status_table(now, XFLOW_STATUS_TABLE_SZ);
+    print_status_table(now);
+
+  if (map_reload_stats.reloads)
+    Log(LOG_NOTICE, "Map reloads: (%u) %u reloads %u failed %u ms last %u ms max (last at %u)\n",
+	now, map_reload_stats.reloads, map_reload_stats.failures, map_reload_stats.last_msecs,
+	map_reload_stats.max_msecs, map_reload_stats.last);
 
   signal(SIGUSR1, push_stats);
 }
@@ -98,11 +98,11 @@ void sql_init_global_buffers()
 	(2 * (qq_size * sizeof(struct db_cache *)))));
 
   pipebuf = (unsigned char *) malloc(config.buffer_size);
-  cache = (struct db_cache *) malloc(config.sql_cache_entries*sizeof(struct db_cache));
-  queries_queue = (struct db_cache **) malloc(qq_size*sizeof(struct db_cache *));
-  pending_queries_queue = (struct db_cache **) malloc(qq_size*sizeof(struct db_cache *));
+  cache = (struct db_cache *) pm_malloc_cache(config.sql_cache_entries*sizeof(struct db_cache));
+  queries_queue = (struct db_cache **) pm_malloc_cache(qq_size*sizeof(struct db_cache *));
+  pending_queries_queue = (struct db_cache **) pm_malloc_cache(qq_size*sizeof(struct db_cache *));
 
-  if (!pipebuf || !cache || !queries_queue || !pending_queries_queue) {
+  if (!pipebuf) {
     Log(LOG_ERR, "ERROR ( %s/%s ): malloc() failed (sql_init_global_buffers). Exiting ..\n", config.name, config.type);
     exit_plugin(1);
   }
@@ -111,6 +111,9 @@ void sql_init_global_buffers()
   memset(cache, 0, config.sql_cache_entries*sizeof(struct db_cache));
   memset(queries_queue, 0, qq_size*sizeof(struct db_cache *));
   memset(pending_queries_queue, 0, qq_size*sizeof(struct db_cache *));
+
+  /* one stitching record per cache entry, plus chained ones queued for purge */
+  if (config.nfacctd_stitching) stitch_pool_init(config.sql_cache_entries+qq_size);
 }
 
 /* being the first routine to be called by each SQL plugin, this is
@@ -451,7 +454,7 @@ int sql_cache_flush_pending(struct db_cache *queue[], int index, struct insert_d
 	    if (SavedCursor.pmpls) free(SavedCursor.pmpls);
 	    if (SavedCursor.pcust) free(SavedCursor.pcust);
 	    if (SavedCursor.pvlen) free(SavedCursor.pvlen);
-	    if (SavedCursor.stitch) free(SavedCursor.stitch);
+	    if (SavedCursor.stitch) stitch_free(SavedCursor.stitch);
           }
           /* We found at least one Cursor->valid == SQL_CACHE_INUSE */
           else SwapChainedElems(PendingElem, Cursor);
@@ -870,25 +873,8 @@ void sql_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *ida
     }
 
     if (config.nfacctd_stitching) {
-      if (!Cursor->stitch) Cursor->stitch = (struct pkt_stitching *) malloc(sizeof(struct pkt_stitching));
-      if (Cursor->stitch) {
-        if (data->time_start.tv_sec) {
-          memcpy(&Cursor->stitch->timestamp_min, &data->time_start, sizeof(struct timeval));
-        }
-        else {
-          Cursor->stitch->timestamp_min.tv_sec = idata->now;
-          Cursor->stitch->timestamp_min.tv_usec = 0;
-        }
-
-        if (data->time_end.tv_sec) {
-          memcpy(&Cursor->stitch->timestamp_max, &data->time_end, sizeof(struct timeval));
-        }
-        else {
-          Cursor->stitch->timestamp_max.tv_sec = idata->now;
-          Cursor->stitch->timestamp_max.tv_usec = 0;
-        }
-      }
-      else Log(LOG_WARNING, "WARN ( %s/%s ): Finished memory for flow stitching.\n", config.name, config.type);
+      if (!Cursor->stitch) Cursor->stitch = stitch_alloc();
+      if (Cursor->stitch) stitch_init(Cursor->stitch, data, idata->now);
     }
     else assert(!Cursor->stitch);
 
@@ -919,17 +905,7 @@ void sql_cache_insert(struct primitives_ptrs *prim_ptrs, struct insert_data *ida
       Cursor->tentatives = data->cst.tentatives;
     }
 
-    if (config.nfacctd_stitching) {
-      if (Cursor->stitch) {
-        if (data->time_end.tv_sec) {
-          memcpy(&Cursor->stitch->timestamp_max, &data->time_end, sizeof(struct timeval));
-        }
-        else {
-          Cursor->stitch->timestamp_max.tv_sec = idata->now;
-          Cursor->stitch->timestamp_max.tv_usec = 0;
-        }
-      }
-    }
+    if (config.nfacctd_stitching && Cursor->stitch) stitch_update(Cursor->stitch, data, idata->now);
 
     insert_status = SQL_INSERT_PRO_RATING;
   }
@@ -3254,6 +3230,112 @@ int sql_compose_static_set(int have_flows)
   return set_primitives;
 }
 
+/* size of the UPSERT batch buffer (multi_values_buffer), see sql_init_upsert() */
+static int upsert_buffer_len;
+
+static void sql_upsert_assign(char *buf, int len, char *column, char *op, char *excluded)
+{
+  char value[SRVBUFLEN];
+
+  snprintf(value, sizeof(value), excluded, column);
+  if (strlen(buf)) strncat(buf, ", ", len-strlen(buf)-1);
+  snprintf(buf+strlen(buf), len-strlen(buf), "%s=%s%s%s", column, column, op, value);
+}
+
+/*
+   sql_upsert_batch: clause closing the multi-row INSERT, ie. how a row
+   already in the table absorbs the incoming one. It mirrors the UPDATE SET
+   layout; 'excluded' tells how the incoming value of a column is referenced
+   and 'prefix' may list the conflict target: INSERT columns minus the ones
+   not part of the table key.
+*/
+void sql_compose_upsert_clause(char *prefix, char *excluded)
+{
+  char keys[LONGSRVBUFLEN], columns[LONGSRVBUFLEN], assign[LONGLONGSRVBUFLEN];
+  char *token, *saveptr = NULL, *ptr;
+  int num;
+
+  memset(keys, 0, sizeof(keys));
+  memset(columns, 0, sizeof(columns));
+  memset(assign, 0, sizeof(assign));
+
+  if ((ptr = strchr(insert_clause, '('))) strlcpy(columns, ptr+1, sizeof(columns));
+  for (token = strtok_r(columns, ", ", &saveptr); token; token = strtok_r(NULL, ", ", &saveptr)) {
+    if (!strcmp(token, "stamp_updated") || !strcmp(token, "tcp_flags")) continue;
+    if (strlen(keys)) strncat(keys, ", ", SPACELEFT(keys));
+    strncat(keys, token, SPACELEFT(keys));
+  }
+
+  for (num = 0; set[num].type; num++) {
+    if (set[num].type == COUNT_INT_COUNTERS) {
+      sql_upsert_assign(assign, sizeof(assign), "packets", "+", excluded);
+      sql_upsert_assign(assign, sizeof(assign), "bytes", "+", excluded);
+    }
+    else if (set[num].type == COUNT_INT_FLOWS)
+      sql_upsert_assign(assign, sizeof(assign), "flows", "+", excluded);
+    else if (set[num].type == COUNT_INT_TCPFLAGS)
+      sql_upsert_assign(assign, sizeof(assign), "tcp_flags", "|", excluded);
+    else if (set[num].type == TIMESTAMP) {
+      if (strlen(assign)) strncat(assign, ", ", SPACELEFT(assign));
+      strncat(assign, set[num].string+strspn(set[num].string, ", "), SPACELEFT(assign));
+    }
+  }
+
+  snprintf(upsert_clause, sizeof(upsert_clause), prefix, keys);
+  strncat(upsert_clause, assign, SPACELEFT(upsert_clause));
+}
+
+void sql_init_upsert()
+{
+  if (!config.sql_upsert_batch) return;
+
+  if (config.sql_multi_values) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): 'sql_upsert_batch' takes precedence over 'sql_multi_values'.\n", config.name, config.type);
+    config.sql_multi_values = FALSE;
+  }
+
+  /* INSERT head and closing clause plus the batch of rows */
+  upsert_buffer_len = (config.sql_upsert_batch+2)*LONGLONGSRVBUFLEN;
+  multi_values_buffer = malloc(upsert_buffer_len);
+  if (!multi_values_buffer) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to get enough room (%d) for UPSERT batches. Exiting.\n",
+		config.name, config.type, upsert_buffer_len);
+    exit_plugin(1);
+  }
+  memset(multi_values_buffer, 0, upsert_buffer_len);
+}
+
+/* appends the current row (insert_full_clause, values_clause) to the batch;
+   returns TRUE once the batch is full and has to be sent */
+int sql_upsert_append(struct insert_data *idata)
+{
+  char *ptr;
+
+  if (!idata->mv.buffer_elem_num) {
+    snprintf(multi_values_buffer, upsert_buffer_len, "%s VALUES", insert_full_clause);
+    idata->mv.buffer_offset = strlen(multi_values_buffer);
+    idata->mv.head_buffer_elem = idata->current_queue_elem;
+  }
+  else {
+    multi_values_buffer[idata->mv.buffer_offset] = ',';
+    idata->mv.buffer_offset++;
+  }
+
+  ptr = multi_values_buffer+idata->mv.buffer_offset;
+  strlcpy(ptr, values_clause+7, upsert_buffer_len-idata->mv.buffer_offset); /* cut the initial ' VALUES' */
+  idata->mv.buffer_offset += strlen(ptr);
+  idata->mv.buffer_elem_num++;
+
+  return (idata->mv.buffer_elem_num >= config.sql_upsert_batch);
+}
+
+char *sql_upsert_close(struct insert_data *idata)
+{
+  strlcpy(multi_values_buffer+idata->mv.buffer_offset, upsert_clause, upsert_buffer_len-idata->mv.buffer_offset);
+
+  return multi_values_buffer;
+}
+
 void primptrs_set_all_from_db_cache(struct primitives_ptrs *prim_ptrs, struct db_cache *entry)
 {
   struct pkt_data *data = prim_ptrs->data;
@@ -354,6 +354,10 @@ EXT void sql_invalidate_shadow_entries(struct db_cache *[], int *);
 EXT int sql_select_locking_style(char *);
 EXT int sql_compose_static_set(int); 
 EXT int sql_compose_static_set_event(); 
+EXT void sql_compose_upsert_clause(char *, char *);
+EXT void sql_init_upsert();
+EXT int sql_upsert_append(struct insert_data *);
+EXT char *sql_upsert_close(struct insert_data *);
 EXT void primptrs_set_all_from_db_cache(struct primitives_ptrs *, struct db_cache *);
 
 EXT void sql_sum_host_insert(struct primitives_ptrs *, struct insert_data *);
@@ -387,6 +391,7 @@ EXT char insert_nocounters_clause[LONGSRVBUFLEN];
 EXT char insert_full_clause[LONGSRVBUFLEN];
 EXT char values_clause[LONGLONGSRVBUFLEN];
 EXT char *multi_values_buffer;
+EXT char upsert_clause[LONGLONGSRVBUFLEN];
 EXT char where_clause[LONGLONGSRVBUFLEN];
 EXT unsigned char *pipebuf;
 EXT struct db_cache *cache;
@@ -404,10 +404,10 @@ void PG_copy_count_timestamp_min_handler(const struct db_cache *cache_elem, stru
   static char time_str[LONGSRVBUFLEN];
   struct tm *tme;
 
-  tme = localtime(&cache_elem->stitch->timestamp_min.tv_sec);
+  tme = localtime(&stitch_get(cache_elem->stitch)->timestamp_min.tv_sec);
   strftime(time_str, LONGSRVBUFLEN, "%Y-%m-%d %H:%M:%S", tme);
 
-  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, cache_elem->stitch->timestamp_min.tv_sec); // dummy
+  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, stitch_get(cache_elem->stitch)->timestamp_min.tv_sec); // dummy
   snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, time_str);
   *ptr_where += strlen(*ptr_where);
   *ptr_values += strlen(*ptr_values);
@@ -415,16 +415,16 @@ void PG_copy_count_timestamp_min_handler(const struct db_cache *cache_elem, stru
 
 void count_timestamp_min_handler(const struct db_cache *cache_elem, struct insert_data *idata, int num, char **ptr_values, char **ptr_where)
 {
-  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, cache_elem->stitch->timestamp_min.tv_sec);
-  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, cache_elem->stitch->timestamp_min.tv_sec);
+  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, stitch_get(cache_elem->stitch)->timestamp_min.tv_sec);
+  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, stitch_get(cache_elem->stitch)->timestamp_min.tv_sec);
   *ptr_where += strlen(*ptr_where);
   *ptr_values += strlen(*ptr_values);
 }
 
 void count_timestamp_min_residual_handler(const struct db_cache *cache_elem, struct insert_data *idata, int num, char **ptr_values, char **ptr_where)
 {
-  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, cache_elem->stitch->timestamp_min.tv_usec);
-  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, cache_elem->stitch->timestamp_min.tv_usec);
+  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, stitch_get(cache_elem->stitch)->timestamp_min.tv_usec);
+  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, stitch_get(cache_elem->stitch)->timestamp_min.tv_usec);
   *ptr_where += strlen(*ptr_where);
   *ptr_values += strlen(*ptr_values);
 }
@@ -434,10 +434,10 @@ void PG_copy_count_timestamp_max_handler(const struct db_cache *cache_elem, stru
   static char time_str[LONGSRVBUFLEN];
   struct tm *tme;
 
-  tme = localtime(&cache_elem->stitch->timestamp_max.tv_sec);
+  tme = localtime(&stitch_get(cache_elem->stitch)->timestamp_max.tv_sec);
   strftime(time_str, LONGSRVBUFLEN, "%Y-%m-%d %H:%M:%S", tme);
 
-  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, cache_elem->stitch->timestamp_max.tv_sec); // dummy
+  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, stitch_get(cache_elem->stitch)->timestamp_max.tv_sec); // dummy
   snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, time_str);
   *ptr_where += strlen(*ptr_where);
   *ptr_values += strlen(*ptr_values);
@@ -445,16 +445,16 @@ void PG_copy_count_timestamp_max_handler(const struct db_cache *cache_elem, stru
 
 void count_timestamp_max_handler(const struct db_cache *cache_elem, struct insert_data *idata, int num, char **ptr_values, char **ptr_where)
 {
-  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, cache_elem->stitch->timestamp_max.tv_sec);
-  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, cache_elem->stitch->timestamp_max.tv_sec);
+  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, stitch_get(cache_elem->stitch)->timestamp_max.tv_sec);
+  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, stitch_get(cache_elem->stitch)->timestamp_max.tv_sec);
   *ptr_where += strlen(*ptr_where);
   *ptr_values += strlen(*ptr_values);
 }
 
 void count_timestamp_max_residual_handler(const struct db_cache *cache_elem, struct insert_data *idata, int num, char **ptr_values, char **ptr_where)
 {
-  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, cache_elem->stitch->timestamp_max.tv_usec);
-  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, cache_elem->stitch->timestamp_max.tv_usec);
+  snprintf(*ptr_where, SPACELEFT(where_clause), where[num].string, stitch_get(cache_elem->stitch)->timestamp_max.tv_usec);
+  snprintf(*ptr_values, SPACELEFT(values_clause), values[num].string, stitch_get(cache_elem->stitch)->timestamp_max.tv_usec);
   *ptr_where += strlen(*ptr_where);
   *ptr_values += strlen(*ptr_values);
 }
@@ -268,9 +268,12 @@ void sqlite3_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 int SQLI_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct insert_data *idata)
 {
   char *ptr_values, *ptr_where, *ptr_mv, *ptr_set, *ptr_insert;
-  int num=0, num_set=0, ret=0, have_flows=0, len=0;
+  int num=0, num_set=0, ret=0, have_flows=0, len=0, upsert=FALSE;
+
+  if (config.sqlite3_prepare) return SQLI_cache_dbop_prepared(db, cache_elem, idata);
 
   if (idata->mv.last_queue_elem) {
+    if (config.sql_upsert_batch) sql_upsert_close(idata);
     ret = sqlite3_exec(db->desc, multi_values_buffer, NULL, NULL, NULL);
     Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d INSERT statements sent to the SQLite database.\n",
                 config.name, config.type, idata->mv.buffer_elem_num);
@@ -283,6 +286,8 @@ int SQLI_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct inser
   }
   
   if (config.what_to_count & COUNT_FLOWS) have_flows = TRUE;
+  if (config.sql_upsert_batch && cache_elem->flow_type != NF9_FTYPE_EVENT &&
+      cache_elem->flow_type != NF9_FTYPE_OPTION) upsert = TRUE;
 
   /* constructing sql query */
   ptr_where = where_clause;
@@ -307,8 +312,8 @@ int SQLI_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct inser
   }
   
   /* sending UPDATE query a) if not switched off and
-     b) if we actually have something to update */
-  if (!config.sql_dont_try_update && num_set) {
+     b) if we actually have something to update; UPSERTs skip it */
+  if (!config.sql_dont_try_update && !upsert && num_set) {
     strncpy(sql_data, update_clause, SPACELEFT(sql_data));
     strncat(sql_data, set_clause, SPACELEFT(sql_data));
     strncat(sql_data, where_clause, SPACELEFT(sql_data));
@@ -317,7 +322,7 @@ int SQLI_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct inser
     if (ret) goto signal_error; 
   }
 
-  if (config.sql_dont_try_update || !num_set || (sqlite3_changes(db->desc) == 0)) {
+  if (config.sql_dont_try_update || upsert || !num_set || (sqlite3_changes(db->desc) == 0)) {
     /* UPDATE failed, trying with an INSERT query */ 
     if (cache_elem->flow_type == NF9_FTYPE_EVENT || cache_elem->flow_type == NF9_FTYPE_OPTION) {
       strncpy(insert_full_clause, insert_clause, SPACELEFT(insert_full_clause));
@@ -339,7 +344,19 @@ int SQLI_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct inser
     strncpy(sql_data, insert_full_clause, sizeof(sql_data));
     strncat(sql_data, values_clause, SPACELEFT(sql_data));
 
-    if (config.sql_multi_values) {
+    if (upsert) {
+      if (sql_upsert_append(idata)) {
+	ret = sqlite3_exec(db->desc, sql_upsert_close(idata), NULL, NULL, NULL);
+	Log(LOG_DEBUG, "DEBUG ( %s/%s ): %d rows UPSERTed to the SQLite database.\n",
+		config.name, config.type, idata->mv.buffer_elem_num);
+	if (ret) goto signal_error;
+	idata->iqn++;
+	idata->mv.buffer_elem_num = FALSE;
+	idata->mv.head_buffer_elem = FALSE;
+	idata->mv.buffer_offset = 0;
+      }
+    }
+    else if (config.sql_multi_values) {
       multi_values_handling:
       len = config.sql_multi_values-idata->mv.buffer_offset;
       if (strlen(values_clause) < len) {
@@ -386,6 +403,7 @@ int SQLI_cache_dbop(struct DBdesc *db, struct db_cache *cache_elem, struct inser
 
   idata->een++;
   // cache_elem->valid = FALSE; /* committed */
+  SQLI_commit_batch(db, &sqli_stmts[db->type]);
   
   return ret;
 
@@ -629,6 +647,16 @@ int SQLI_compose_static_queries()
     }
   }
 
+  /* "... ON CONFLICT ... DO UPDATE ..." stuff */
+  if (config.sql_upsert_batch) sql_compose_upsert_clause(" ON CONFLICT (%s) DO UPDATE SET ", "excluded.%s");
+
+  /* placeholders for prepared statements */
+  if (config.sqlite3_prepare && SQLI_compose_bind_templates(primitives) == ERR) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): aggregation method can't be bound to prepared statements. Disabling 'sqlite3_prepare'.\n",
+	config.name, config.type);
+    config.sqlite3_prepare = FALSE;
+  }
+
   return primitives;
 }
 
@@ -657,12 +685,35 @@ void SQLI_DB_Connect(struct DBdesc *db, char *host)
       SQLI_get_errmsg(db);
       sql_db_errmsg(db);
     }
-    else sql_db_ok(db);
+    else {
+      char pragma[SRVBUFLEN];
+
+      if (config.sqlite3_journal_mode) {
+	snprintf(pragma, sizeof(pragma), "PRAGMA journal_mode=%s", config.sqlite3_journal_mode);
+	if (sqlite3_exec(db->desc, pragma, NULL, NULL, NULL)) {
+	  SQLI_get_errmsg(db);
+	  sql_db_errmsg(db);
+	}
+      }
+
+      if (config.sqlite3_cache_size) {
+	snprintf(pragma, sizeof(pragma), "PRAGMA cache_size=%d", config.sqlite3_cache_size);
+	if (sqlite3_exec(db->desc, pragma, NULL, NULL, NULL)) {
+	  SQLI_get_errmsg(db);
+	  sql_db_errmsg(db);
+	}
+      }
+
+      sql_db_ok(db);
+    }
   }
 }
 
 void SQLI_DB_Close(struct BE_descs *bed)
 {
+  SQLI_finalize_stmts(&sqli_stmts[BE_TYPE_PRIMARY]);
+  SQLI_finalize_stmts(&sqli_stmts[BE_TYPE_BACKUP]);
+
   if (bed->p->connected) sqlite3_close(bed->p->desc);
   if (bed->b->connected) sqlite3_close(bed->b->desc);
 }
@@ -723,6 +774,11 @@ void SQLI_init_default_values(struct insert_data *idata)
   
   if (config.sql_backup_host) idata->recover = TRUE;
 
+  sql_init_upsert();
+  if (config.sqlite3_prepare && config.sql_multi_values) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): 'sqlite3_prepare' takes precedence over 'sql_multi_values'.\n", config.name, config.type);
+    config.sql_multi_values = FALSE;
+  }
   if (config.sql_multi_values) {
     multi_values_buffer = malloc(config.sql_multi_values);
     if (!multi_values_buffer) {
@@ -735,3 +791,308 @@ void SQLI_init_default_values(struct insert_data *idata)
 
   if (config.sql_locking_style) idata->locks = sql_select_locking_style(config.sql_locking_style);
 }
+
+/*
+   sqlite3_prepare: turns a dbop format string into a) SQL text where each
+   conversion is a placeholder, appended to 'tpl', and b) a format in which
+   each conversion is preceded by a marker, telling whether the value was a
+   quoted or an unquoted literal, so that handlers print values ready to be
+   bound. Conversions making part of the SQL syntax, ie. function names,
+   can't be bound: ERR is returned.
+*/
+int SQLI_compose_bind_format(char *fmt, char *tpl, int tpl_len, char *bfmt, int bfmt_len)
+{
+  char *ptr, *spec, *tptr, *bptr;
+  int quoted, spec_len;
+
+  memset(bfmt, 0, bfmt_len);
+  tptr = tpl+strlen(tpl);
+  bptr = bfmt;
+
+  for (ptr = fmt; *ptr; ptr++) {
+    if ((tptr-tpl) >= (tpl_len-1)) return ERR;
+
+    if (*ptr != '%') {
+      *tptr = *ptr;
+      tptr++;
+      continue;
+    }
+
+    if (*(ptr+1) == '%') {
+      *tptr = '%';
+      tptr++;
+      ptr++;
+      continue;
+    }
+
+    /* flags, width, precision and length modifiers up to the conversion */
+    spec = ptr;
+    ptr += strspn(ptr+1, "0123456789.-+ #lhzjt")+1;
+    if (!(*ptr) || *(ptr+1) == '(') return ERR;
+    spec_len = (ptr-spec)+1;
+    if ((bptr-bfmt)+spec_len+1 >= bfmt_len) return ERR;
+
+    quoted = (spec > fmt && *(spec-1) == '\'' && *(ptr+1) == '\'');
+    *bptr = quoted ? SQLI_BIND_TEXT : SQLI_BIND_NUM;
+    memcpy(bptr+1, spec, spec_len);
+    bptr += spec_len+1;
+
+    if (quoted) {
+      tptr--;
+      ptr++;
+    }
+    *tptr = '?';
+    tptr++;
+  }
+  *tptr = '\0';
+
+  return SUCCESS;
+}
+
+int SQLI_compose_bind_templates(int primitives)
+{
+  struct frags *bind_values, *bind_where;
+  char unused[SRVBUFLEN];
+  int num, ret = ERR;
+
+  bind_values = malloc(primitives*sizeof(struct frags));
+  bind_where = malloc(primitives*sizeof(struct frags));
+  if (!bind_values || !bind_where) goto exit_lane;
+
+  memset(sqli_values_tpl, 0, sizeof(sqli_values_tpl));
+  memset(sqli_where_tpl, 0, sizeof(sqli_where_tpl));
+  memset(sqli_set_tpl, 0, sizeof(sqli_set_tpl));
+  memset(sqli_set_event_tpl, 0, sizeof(sqli_set_event_tpl));
+
+  /* all formats have to be bindable before any of them is replaced */
+  for (num = 0; num < primitives; num++) {
+    if (SQLI_compose_bind_format(values[num].string, sqli_values_tpl, sizeof(sqli_values_tpl),
+				 bind_values[num].string, sizeof(bind_values[num].string)) == ERR) goto exit_lane;
+    if (SQLI_compose_bind_format(where[num].string, sqli_where_tpl, sizeof(sqli_where_tpl),
+				 bind_where[num].string, sizeof(bind_where[num].string)) == ERR) goto exit_lane;
+  }
+
+  /* counters are bound straight from the cache entry */
+  for (num = 0; set[num].type; num++) {
+    if (SQLI_compose_bind_format(set[num].string, sqli_set_tpl, sizeof(sqli_set_tpl),
+				 unused, sizeof(unused)) == ERR) goto exit_lane;
+  }
+  for (num = 0; set_event[num].type; num++) {
+    if (SQLI_compose_bind_format(set_event[num].string, sqli_set_event_tpl, sizeof(sqli_set_event_tpl),
+				 unused, sizeof(unused)) == ERR) goto exit_lane;
+  }
+
+  if (config.what_to_count & COUNT_FLOWS) strlcpy(sqli_counters_tpl, ", ?, ?, ?)", sizeof(sqli_counters_tpl));
+  else strlcpy(sqli_counters_tpl, ", ?, ?)", sizeof(sqli_counters_tpl));
+
+  for (num = 0; num < primitives; num++) {
+    strlcpy(values[num].string, bind_values[num].string, sizeof(values[num].string));
+    strlcpy(where[num].string, bind_where[num].string, sizeof(where[num].string));
+  }
+  ret = SUCCESS;
+
+  exit_lane:
+  if (bind_values) free(bind_values);
+  if (bind_where) free(bind_where);
+
+  return ret;
+}
+
+void SQLI_prepare_stmts(struct DBdesc *db, struct SQLI_stmts *stmts, char *table)
+{
+  char sql[LARGEBUFLEN];
+
+  SQLI_finalize_stmts(stmts);
+
+  snprintf(sql, sizeof(sql), "%s%s%s%s%s", insert_clause, insert_counters_clause, sqli_values_tpl,
+	   sqli_counters_tpl, config.sql_upsert_batch ? upsert_clause : "");
+  if (sqlite3_prepare_v2(db->desc, sql, -1, &stmts->insert, NULL) != SQLITE_OK) goto signal_error;
+
+  snprintf(sql, sizeof(sql), "%s%s%s)", insert_clause, insert_nocounters_clause, sqli_values_tpl);
+  if (sqlite3_prepare_v2(db->desc, sql, -1, &stmts->insert_event, NULL) != SQLITE_OK) goto signal_error;
+
+  /* UPDATE statements a) if not switched off and b) if we actually have
+     something to update */
+  if (!config.sql_dont_try_update) {
+    if (strlen(sqli_set_tpl) && !config.sql_upsert_batch) {
+      snprintf(sql, sizeof(sql), "%s%s%s", update_clause, sqli_set_tpl, sqli_where_tpl);
+      if (sqlite3_prepare_v2(db->desc, sql, -1, &stmts->update, NULL) != SQLITE_OK) goto signal_error;
+    }
+
+    if (strlen(sqli_set_event_tpl)) {
+      snprintf(sql, sizeof(sql), "%s%s%s", update_clause, sqli_set_event_tpl, sqli_where_tpl);
+      if (sqlite3_prepare_v2(db->desc, sql, -1, &stmts->update_event, NULL) != SQLITE_OK) goto signal_error;
+    }
+  }
+
+  strlcpy(stmts->table, table, sizeof(stmts->table));
+  Log(LOG_DEBUG, "DEBUG ( %s/%s ): prepared statements for table '%s'.\n", config.name, config.type, table);
+
+  return;
+
+  signal_error:
+  Log(LOG_DEBUG, "DEBUG ( %s/%s ): FAILED query follows:\n%s\n", config.name, config.type, sql);
+  SQLI_get_errmsg(db);
+  sql_db_errmsg(db);
+  SQLI_finalize_stmts(stmts);
+}
+
+void SQLI_finalize_stmts(struct SQLI_stmts *stmts)
+{
+  /* sqlite3_finalize() is a no-op on NULL statements */
+  sqlite3_finalize(stmts->insert);
+  sqlite3_finalize(stmts->update);
+  sqlite3_finalize(stmts->insert_event);
+  sqlite3_finalize(stmts->update_event);
+  memset(stmts, 0, sizeof(struct SQLI_stmts));
+}
+
+/* binds the values printed by handlers via SQLI_compose_bind_format() formats;
+   returns the index of the next parameter to be bound */
+int SQLI_bind_clause(sqlite3_stmt *stmt, int idx, char *clause)
+{
+  char *ptr, *end, *endptr, type, markers[] = { SQLI_BIND_TEXT, SQLI_BIND_NUM, '\0' };
+  sqlite3_int64 num;
+  double dnum;
+
+  for (ptr = clause; *ptr; ptr = end) {
+    if (*ptr != SQLI_BIND_TEXT && *ptr != SQLI_BIND_NUM) {
+      end = ptr+strcspn(ptr, markers);
+      continue;
+    }
+
+    type = *ptr;
+    ptr++;
+    end = ptr+strcspn(ptr, markers);
+
+    if (type == SQLI_BIND_NUM && end > ptr) {
+      if (!strncmp(ptr, "0x", 2)) num = strtoll(ptr, &endptr, 16);
+      else num = strtoll(ptr, &endptr, 10);
+      if (endptr == end) {
+	sqlite3_bind_int64(stmt, idx, num);
+	idx++;
+	continue;
+      }
+
+      dnum = strtod(ptr, &endptr);
+      if (endptr == end) {
+	sqlite3_bind_double(stmt, idx, dnum);
+	idx++;
+	continue;
+      }
+    }
+
+    /* buffers are left untouched until the statement is stepped */
+    sqlite3_bind_text(stmt, idx, ptr, end-ptr, SQLITE_STATIC);
+    idx++;
+  }
+
+  return idx;
+}
+
+int SQLI_bind_set(sqlite3_stmt *stmt, int idx, struct frags *fr, struct db_cache *cache_elem)
+{
+  int num;
+
+  for (num = 0; fr[num].type; num++) {
+    if (fr[num].type == COUNT_INT_COUNTERS) {
+      sqlite3_bind_int64(stmt, idx, cache_elem->packet_counter);
+      sqlite3_bind_int64(stmt, idx+1, cache_elem->bytes_counter);
+      idx += 2;
+    }
+    else if (fr[num].type == COUNT_INT_FLOWS) {
+      sqlite3_bind_int64(stmt, idx, cache_elem->flows_counter);
+      idx++;
+    }
+    else if (fr[num].type == COUNT_INT_TCPFLAGS) {
+      sqlite3_bind_int64(stmt, idx, cache_elem->tcp_flags);
+      idx++;
+    }
+  }
+
+  return idx;
+}
+
+int SQLI_cache_dbop_prepared(struct DBdesc *db, struct db_cache *cache_elem, struct insert_data *idata)
+{
+  struct SQLI_stmts *stmts = &sqli_stmts[db->type];
+  sqlite3_stmt *update, *insert, *failed;
+  char *ptr_values, *ptr_where, *table;
+  int num, idx, ret, changes = 0;
+
+  table = idata->dyn_table ? idata->dyn_table_name : config.sql_table;
+  if (!stmts->insert || strcmp(stmts->table, table)) SQLI_prepare_stmts(db, stmts, table);
+  if (!stmts->insert) return TRUE;
+
+  ptr_where = where_clause;
+  ptr_values = values_clause;
+  memset(where_clause, 0, sizeof(where_clause));
+  memset(values_clause, 0, sizeof(values_clause));
+
+  for (num = 0; num < idata->num_primitives; num++)
+    (*where[num].handler)(cache_elem, idata, num, &ptr_values, &ptr_where);
+
+  if (cache_elem->flow_type == NF9_FTYPE_EVENT || cache_elem->flow_type == NF9_FTYPE_OPTION) {
+    update = stmts->update_event;
+    insert = stmts->insert_event;
+  }
+  else {
+    update = stmts->update;
+    insert = stmts->insert;
+  }
+
+  if (update) {
+    idx = SQLI_bind_set(update, 1, (update == stmts->update) ? set : set_event, cache_elem);
+    SQLI_bind_clause(update, idx, where_clause);
+
+    ret = sqlite3_step(update);
+    sqlite3_reset(update);
+    failed = update;
+    if (ret != SQLITE_DONE) goto signal_error;
+    changes = sqlite3_changes(db->desc);
+  }
+
+  if (!changes) {
+    idx = SQLI_bind_clause(insert, 1, values_clause);
+    if (insert == stmts->insert) {
+      sqlite3_bind_int64(insert, idx, cache_elem->packet_counter);
+      sqlite3_bind_int64(insert, idx+1, cache_elem->bytes_counter);
+      if (config.what_to_count & COUNT_FLOWS) sqlite3_bind_int64(insert, idx+2, cache_elem->flows_counter);
+    }
+
+    ret = sqlite3_step(insert);
+    sqlite3_reset(insert);
+    failed = insert;
+    if (ret != SQLITE_DONE) goto signal_error;
+    idata->iqn++;
+  }
+  else idata->uqn++;
+
+  idata->een++;
+  SQLI_commit_batch(db, stmts);
+
+  return FALSE;
+
+  signal_error:
+  Log(LOG_DEBUG, "DEBUG ( %s/%s ): FAILED statement follows:\n%s\n", config.name, config.type, sqlite3_sql(failed));
+  SQLI_get_errmsg(db);
+  if (db->errmsg) Log(LOG_ERR, "ERROR ( %s/%s ): %s\n\n", config.name, config.type, db->errmsg);
+
+  return TRUE;
+}
+
+/* sqlite3_commit_batch: closes the running transaction every N rows */
+void SQLI_commit_batch(struct DBdesc *db, struct SQLI_stmts *stmts)
+{
+  if (!config.sqlite3_commit_batch) return;
+
+  stmts->uncommitted++;
+  if (stmts->uncommitted >= config.sqlite3_commit_batch) {
+    if (sqlite3_exec(db->desc, unlock_clause, NULL, NULL, NULL) ||
+	sqlite3_exec(db->desc, lock_clause, NULL, NULL, NULL)) {
+      SQLI_get_errmsg(db);
+      sql_db_errmsg(db);
+    }
+    stmts->uncommitted = 0;
+  }
+}
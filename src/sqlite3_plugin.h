@@ -22,6 +22,20 @@
 /* includes */
 #include <sqlite3.h>
 
+/* defines */
+#define SQLI_BIND_TEXT		'\x1e'	/* quoted literal in the SQL text */
+#define SQLI_BIND_NUM		'\x1f'	/* unquoted literal in the SQL text */
+
+/* structures */
+struct SQLI_stmts {
+  char table[SRVBUFLEN];	/* table the statements are prepared for */
+  sqlite3_stmt *insert;
+  sqlite3_stmt *update;
+  sqlite3_stmt *insert_event;
+  sqlite3_stmt *update_event;
+  int uncommitted;		/* rows since last COMMIT (sqlite3_commit_batch) */
+};
+
 /* prototypes */
 void sqlite3_plugin(int, struct configuration *, void *);
 int SQLI_cache_dbop(struct DBdesc *, struct db_cache *, struct insert_data *);
@@ -37,6 +51,14 @@ void SQLI_get_errmsg(struct DBdesc *);
 void SQLI_create_backend(struct DBdesc *);
 void SQLI_set_callbacks(struct sqlfunc_cb_registry *);
 void SQLI_init_default_values(struct insert_data *);
+int SQLI_compose_bind_format(char *, char *, int, char *, int);
+int SQLI_compose_bind_templates(int);
+void SQLI_prepare_stmts(struct DBdesc *, struct SQLI_stmts *, char *);
+void SQLI_finalize_stmts(struct SQLI_stmts *);
+int SQLI_bind_clause(sqlite3_stmt *, int, char *);
+int SQLI_cache_dbop_prepared(struct DBdesc *, struct db_cache *, struct insert_data *);
+int SQLI_bind_set(sqlite3_stmt *, int, struct frags *, struct db_cache *);
+void SQLI_commit_batch(struct DBdesc *, struct SQLI_stmts *);
 
 /* variables */
 static char sqlite3_db[] = "/tmp/pmacct.db";
@@ -49,3 +71,12 @@ static char sqlite3_table_v6[] = "acct_v6";
 static char sqlite3_table_v7[] = "acct_v7";
 static char sqlite3_table_v8[] = "acct_v8";
 static char sqlite3_table_bgp[] = "acct_bgp";
+
+/* sqlite3_prepare: SQL text of the statements, with placeholders, and
+   prepared statements per backend (indexed by BE_TYPE_*) */
+static char sqli_values_tpl[LONGLONGSRVBUFLEN];
+static char sqli_where_tpl[LONGLONGSRVBUFLEN];
+static char sqli_set_tpl[LONGSRVBUFLEN];
+static char sqli_set_event_tpl[LONGSRVBUFLEN];
+static char sqli_counters_tpl[SRVBUFLEN];
+static struct SQLI_stmts sqli_stmts[2];
@@ -20,19 +20,38 @@
 */
 
 #define __TEE_PLUGIN_C
+#if defined HAVE_SENDMMSG
+#define _GNU_SOURCE
+#endif
 
 #include "../pmacct.h"
+#include "../nfacctd.h"
+#include "../addr.h"
 #include "tee_plugin.h"
 #include "pmacct-data.h"
 #include "plugin_hooks.h"
+#include "jhash.h"
+#include <sys/uio.h>
+#if defined HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+
+#if defined HAVE_SENDMMSG
+/* scratch areas for batched send, sized on tee_batch_size */
+static struct mmsghdr *tee_mmsg;
+static struct pkt_msg **tee_mmsg_first;
+static struct iovec *tee_iov;
+static char *tee_hdr_buf;
+static char *tee_cmsg_buf;
+#endif
 
 void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 {
-  struct pkt_msg *msg;
+  struct pkt_msg *msg, *tpl_msg;
   unsigned char *pipebuf;
   struct pollfd pfd;
   int timeout, refresh_timeout, amqp_timeout, err, ret, num;
-  int fd, pool_idx, recv_idx;
+  int fd, pool_idx, recv_idx, tpl_checked;
   struct ring *rg = &((struct channels_list_entry *)ptr)->rg;
   struct ch_status *status = ((struct channels_list_entry *)ptr)->status;
   struct plugins_list_entry *plugin_data = ((struct channels_list_entry *)ptr)->plugin;
@@ -107,12 +126,12 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   if (!config.tee_max_receivers) config.tee_max_receivers = MAX_TEE_RECEIVERS;
 
   for (pool_idx = 0; pool_idx < MAX_TEE_POOLS; pool_idx++) { 
-    receivers.pools[pool_idx].receivers = malloc(config.tee_max_receivers*sizeof(struct tee_receivers));
+    receivers.pools[pool_idx].receivers = malloc(config.tee_max_receivers*sizeof(struct tee_receiver));
     if (!receivers.pools[pool_idx].receivers) {
       Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate receivers for pool #%u. Exiting ...\n", config.name, config.type, pool_idx);
       exit_plugin(1);
     }
-    else memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receivers));
+    else memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receiver));
   }
 
   if (config.nfprobe_receiver) {
@@ -156,6 +175,8 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
   err_cant_bridge_af = 0;
 
   /* Arrange send socket */
+  Tee_init_batch();
+  Tee_init_tpl();
   Tee_init_socks();
 
   /* plugin main loop */
@@ -259,17 +280,33 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 
       if (!config.pipe_check_core_pid || ((struct ch_buf_hdr *)pipebuf)->core_pid == core_pid) {
       while (((struct ch_buf_hdr *)pipebuf)->num > 0) {
+	tpl_msg = NULL;
+	tpl_checked = FALSE;
+
 	for (pool_idx = 0; pool_idx < receivers.num; pool_idx++) {
 	  if (!evaluate_tags(&receivers.pools[pool_idx].tag_filter, msg->tag)) {
 	    if (!receivers.pools[pool_idx].balance.func) {
 	      for (recv_idx = 0; recv_idx < receivers.pools[pool_idx].num; recv_idx++) {
 	        target = &receivers.pools[pool_idx].receivers[recv_idx];
-	        Tee_send(msg, (struct sockaddr *) &target->dest, target->fd);
+	        Tee_enqueue(msg, target);
 	      }
 	    }
 	    else {
 	      target = receivers.pools[pool_idx].balance.func(&receivers.pools[pool_idx], msg);
-	      Tee_send(msg, (struct sockaddr *) &target->dest, target->fd);
+	      if (target) Tee_enqueue(msg, target);
+
+	      /* make sure templates reach the whole pool */
+	      if (config.tee_balance_templates && !tpl_checked) {
+		tpl_msg = Tee_tpl_extract(msg);
+		tpl_checked = TRUE;
+	      }
+
+	      if (tpl_msg) {
+	        for (recv_idx = 0; recv_idx < receivers.pools[pool_idx].num; recv_idx++) {
+		  if (&receivers.pools[pool_idx].receivers[recv_idx] != target)
+		    Tee_enqueue(tpl_msg, &receivers.pools[pool_idx].receivers[recv_idx]);
+		}
+	      }
 	    }
 	  }
 	}
@@ -281,6 +318,10 @@ void tee_plugin(int pipe_fd, struct configuration *cfgptr, void *ptr)
 	  msg = (struct pkt_msg *) dataptr;
 	}
       }
+
+      /* pipebuf is about to be recycled: drain what was queued from it */
+      Tee_flush_all();
+      tee_tpl_msgs.num = 0;
       }
 
       if (config.pipe_homegrown) goto read_data;
@@ -316,116 +357,312 @@ void Tee_send(struct pkt_msg *msg, struct sockaddr *target, int fd)
   }
 
   if (!config.tee_transparent) {
-    if (send(fd, msg->payload, msg->len, 0) == -1) {
-      struct host_addr a;
-      u_char agent_addr[50];
-      u_int16_t agent_port;
-
-      sa_to_addr((struct sockaddr *)msg, &a, &agent_port);
-      addr_to_str(agent_addr, &a);
+    if (send(fd, msg->payload, msg->len, 0) == -1) Tee_send_error(msg, target, "send()");
+  }
+  else {
+    int hdr_len;
 
-      sa_to_addr((struct sockaddr *)target, &r, &recv_port);
-      addr_to_str(recv_addr, &r);
+    if ((hdr_len = Tee_craft_transparent_hdr(msg, target, tee_send_buf))) {
+      /* Put everything together and send */
+      memcpy(tee_send_buf+hdr_len, msg->payload, msg->len);
 
-      Log(LOG_ERR, "ERROR ( %s/%s ): send() from [%s:%u] seqno [%u] to [%s] failed (%s)\n",
-			config.name, config.type, agent_addr, agent_port, msg->seqno, recv_addr, strerror(errno));
+      if (send(fd, tee_send_buf, hdr_len+msg->len, 0) == -1) Tee_send_error(msg, target, "raw send()");
     }
   }
-  else {
-    char *buf_ptr = tee_send_buf;
-    struct sockaddr_in *sa = (struct sockaddr_in *) &msg->agent;
-    struct my_iphdr *i4h = (struct my_iphdr *) buf_ptr;
+}
+
+void Tee_send_error(struct pkt_msg *msg, struct sockaddr *target, char *func)
+{
+  struct host_addr a, r;
+  u_char agent_addr[50], recv_addr[50];
+  u_int16_t agent_port, recv_port;
+
+  sa_to_addr((struct sockaddr *)msg, &a, &agent_port);
+  addr_to_str(agent_addr, &a);
+
+  sa_to_addr((struct sockaddr *)target, &r, &recv_port);
+  addr_to_str(recv_addr, &r);
+
+  Log(LOG_ERR, "ERROR ( %s/%s ): %s from [%s:%u] seqno [%u] to [%s] failed (%s)\n",
+		config.name, config.type, func, agent_addr, agent_port, msg->seqno, recv_addr, strerror(errno));
+}
+
+/*
+  Writes IP and UDP headers for transparent mode into 'buf'; returns the
+  headers length or zero if the datagram can't be sent to 'target'.
+*/
+int Tee_craft_transparent_hdr(struct pkt_msg *msg, struct sockaddr *target, char *buf)
+{
+  char *buf_ptr = buf;
+  struct sockaddr_in *sa = (struct sockaddr_in *) &msg->agent;
+  struct my_iphdr *i4h = (struct my_iphdr *) buf_ptr;
 #if defined ENABLE_IPV6
-    struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *) &msg->agent;
-    struct ip6_hdr *i6h = (struct ip6_hdr *) buf_ptr;
+  struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *) &msg->agent;
+  struct ip6_hdr *i6h = (struct ip6_hdr *) buf_ptr;
 #endif
-    struct my_udphdr *uh;
-
-    if (msg->agent.sa_family == target->sa_family) {
-      /* UDP header first */
-      if (target->sa_family == AF_INET) {
-        buf_ptr += IP4HdrSz;
-        uh = (struct my_udphdr *) buf_ptr;
-        uh->uh_sport = sa->sin_port;
-        uh->uh_dport = ((struct sockaddr_in *)target)->sin_port;
-      }
+  struct my_udphdr *uh;
+
+  if (((struct sockaddr *)&msg->agent)->sa_family == target->sa_family) {
+    /* UDP header first */
+    if (target->sa_family == AF_INET) {
+      buf_ptr += IP4HdrSz;
+      uh = (struct my_udphdr *) buf_ptr;
+      uh->uh_sport = sa->sin_port;
+      uh->uh_dport = ((struct sockaddr_in *)target)->sin_port;
+    }
 #if defined ENABLE_IPV6
-      else if (target->sa_family == AF_INET6) {
-        buf_ptr += IP6HdrSz;
-        uh = (struct my_udphdr *) buf_ptr;
-        uh->uh_sport = sa6->sin6_port;
-        uh->uh_dport = ((struct sockaddr_in6 *)target)->sin6_port;
-      }
+    else if (target->sa_family == AF_INET6) {
+      buf_ptr += IP6HdrSz;
+      uh = (struct my_udphdr *) buf_ptr;
+      uh->uh_sport = sa6->sin6_port;
+      uh->uh_dport = ((struct sockaddr_in6 *)target)->sin6_port;
+    }
 #endif
+    else return 0;
 
-      uh->uh_ulen = htons(msg->len+UDPHdrSz);
-      uh->uh_sum = 0;
+    uh->uh_ulen = htons(msg->len+UDPHdrSz);
+    uh->uh_sum = 0;
 
-      /* IP header then */
-      if (target->sa_family == AF_INET) {
-        i4h->ip_vhl = 4;
-        i4h->ip_vhl <<= 4;
-        i4h->ip_vhl |= (IP4HdrSz/4);
+    /* IP header then */
+    if (target->sa_family == AF_INET) {
+      i4h->ip_vhl = 4;
+      i4h->ip_vhl <<= 4;
+      i4h->ip_vhl |= (IP4HdrSz/4);
 
-	if (config.nfprobe_ipprec) {
-	  int opt = config.nfprobe_ipprec << 5;
-          i4h->ip_tos = opt;
-	}
-	else i4h->ip_tos = 0;
+      if (config.nfprobe_ipprec) {
+	int opt = config.nfprobe_ipprec << 5;
+        i4h->ip_tos = opt;
+      }
+      else i4h->ip_tos = 0;
 
 #if !defined BSD
-        i4h->ip_len = htons(IP4HdrSz+UDPHdrSz+msg->len);
+      i4h->ip_len = htons(IP4HdrSz+UDPHdrSz+msg->len);
 #else
-        i4h->ip_len = IP4HdrSz+UDPHdrSz+msg->len;
+      i4h->ip_len = IP4HdrSz+UDPHdrSz+msg->len;
 #endif
-        i4h->ip_id = 0;
-        i4h->ip_off = 0;
-        i4h->ip_ttl = 255;
-        i4h->ip_p = IPPROTO_UDP;
-        i4h->ip_sum = 0;
-        i4h->ip_src.s_addr = sa->sin_addr.s_addr;
-        i4h->ip_dst.s_addr = ((struct sockaddr_in *)target)->sin_addr.s_addr;
-      }
+      i4h->ip_id = 0;
+      i4h->ip_off = 0;
+      i4h->ip_ttl = 255;
+      i4h->ip_p = IPPROTO_UDP;
+      i4h->ip_sum = 0;
+      i4h->ip_src.s_addr = sa->sin_addr.s_addr;
+      i4h->ip_dst.s_addr = ((struct sockaddr_in *)target)->sin_addr.s_addr;
+    }
 #if defined ENABLE_IPV6
-      else if (target->sa_family == AF_INET6) {
-        i6h->ip6_vfc = 6;
-        i6h->ip6_vfc <<= 4;
-        i6h->ip6_plen = htons(UDPHdrSz+msg->len);
-        i6h->ip6_nxt = IPPROTO_UDP;
-        i6h->ip6_hlim = 255;
-        memcpy(&i6h->ip6_src, &sa6->sin6_addr, IP6AddrSz);
-        memcpy(&i6h->ip6_dst, &((struct sockaddr_in6 *)target)->sin6_addr, IP6AddrSz);
-      }
+    else if (target->sa_family == AF_INET6) {
+      i6h->ip6_vfc = 6;
+      i6h->ip6_vfc <<= 4;
+      i6h->ip6_plen = htons(UDPHdrSz+msg->len);
+      i6h->ip6_nxt = IPPROTO_UDP;
+      i6h->ip6_hlim = 255;
+      memcpy(&i6h->ip6_src, &sa6->sin6_addr, IP6AddrSz);
+      memcpy(&i6h->ip6_dst, &((struct sockaddr_in6 *)target)->sin6_addr, IP6AddrSz);
+    }
 #endif
 
-      /* Put everything together and send */
-      buf_ptr += UDPHdrSz;
-      memcpy(buf_ptr, msg->payload, msg->len);
+    buf_ptr += UDPHdrSz;
+
+    return (buf_ptr - buf);
+  }
+  else {
+    time_t now = time(NULL);
+
+    if (now > err_cant_bridge_af + 60) {
+      Log(LOG_ERR, "ERROR ( %s/%s ): Can't bridge Address Families when in transparent mode\n", config.name, config.type);
+      err_cant_bridge_af = now;
+    }
+  }
+
+  return 0;
+}
+
+void Tee_init_batch()
+{
+  tee_dirty_num = 0;
+
+  if (!config.tee_batch_size) return;
+
+  tee_dirty_recvs = malloc((config.tee_max_receiver_pools+1)*config.tee_max_receivers*sizeof(struct tee_receiver *));
+  if (!tee_dirty_recvs) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate batch queues. Exiting ...\n", config.name, config.type);
+    exit_plugin(1);
+  }
+
+#if defined HAVE_SENDMMSG
+  tee_mmsg = malloc(config.tee_batch_size*sizeof(struct mmsghdr));
+  tee_mmsg_first = malloc(config.tee_batch_size*sizeof(struct pkt_msg *));
+  tee_iov = malloc(config.tee_batch_size*2*sizeof(struct iovec));
+  tee_hdr_buf = malloc(config.tee_batch_size*TEE_HDR_SLOT_SZ);
+  tee_cmsg_buf = malloc(config.tee_batch_size*CMSG_SPACE(sizeof(u_int16_t)));
+
+  if (!tee_mmsg || !tee_mmsg_first || !tee_iov || !tee_hdr_buf || !tee_cmsg_buf) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate batch send buffers. Exiting ...\n", config.name, config.type);
+    exit_plugin(1);
+  }
 
-      if (send(fd, tee_send_buf, IP4HdrSz+UDPHdrSz+msg->len, 0) == -1) {
-        struct host_addr a;
-        u_char agent_addr[50];
-        u_int16_t agent_port;
+  Log(LOG_INFO, "INFO ( %s/%s ): batched send enabled: tee_batch_size=%u\n", config.name, config.type, config.tee_batch_size);
+#else
+  Log(LOG_WARNING, "WARN ( %s/%s ): sendmmsg() not available: tee_batch_size only defers sends to the end of each buffer.\n",
+		config.name, config.type);
+#endif
+}
+
+void Tee_enqueue(struct pkt_msg *msg, struct tee_receiver *target)
+{
+  if (!config.tee_batch_size || !target->queue) {
+    Tee_send(msg, (struct sockaddr *) &target->dest, target->fd);
+    return;
+  }
+
+  /* a full queue is flushed on the spot but the receiver stays listed */
+  if (!target->dirty) {
+    tee_dirty_recvs[tee_dirty_num++] = target;
+    target->dirty = TRUE;
+  }
+
+  target->queue[target->queue_len] = msg;
+  target->queue_len++;
+
+  if (target->queue_len == config.tee_batch_size) Tee_flush(target);
+}
+
+void Tee_flush_all()
+{
+  int idx;
+
+  for (idx = 0; idx < tee_dirty_num; idx++) {
+    Tee_flush(tee_dirty_recvs[idx]);
+    tee_dirty_recvs[idx]->dirty = FALSE;
+  }
 
-        sa_to_addr((struct sockaddr *)msg, &a, &agent_port);
-        addr_to_str(agent_addr, &a);
+  tee_dirty_num = 0;
+}
+
+/*
+  Sends out the datagrams queued for 'target'. Messages point straight into
+  pipebuf, hence the queue must be drained before pipebuf is overwritten.
+  In non-transparent mode, runs of equal-sized datagrams are coalesced into
+  a single UDP GSO super-datagram when the socket supports it.
+*/
+void Tee_flush(struct tee_receiver *target)
+{
+#if defined HAVE_SENDMMSG
+  struct pkt_msg *msg;
+  struct mmsghdr *mh;
+  struct cmsghdr *cm;
+  char *hdr_ptr;
+  int q_idx, m_idx, iov_idx, hdr_len, segs, sent, ret;
+  size_t gso_len;
+
+  if (!target->queue_len) return;
+
+  for (q_idx = 0, m_idx = 0, iov_idx = 0; q_idx < target->queue_len; q_idx++) {
+    msg = target->queue[q_idx];
 
-	sa_to_addr((struct sockaddr *)target, &r, &recv_port);
-	addr_to_str(recv_addr, &r);
+    if (config.debug) {
+      struct host_addr a, r;
+      u_char agent_addr[50], recv_addr[50];
+      u_int16_t agent_port, recv_port;
 
-        Log(LOG_ERR, "ERROR ( %s/%s ): raw send() from [%s:%u] seqno [%u] to [%s] failed (%s)\n",
-			config.name, config.type, agent_addr, agent_port, msg->seqno, recv_addr, strerror(errno));
+      sa_to_addr((struct sockaddr *)msg, &a, &agent_port);
+      addr_to_str(agent_addr, &a);
+
+      sa_to_addr((struct sockaddr *)&target->dest, &r, &recv_port);
+      addr_to_str(recv_addr, &r);
+
+      Log(LOG_DEBUG, "DEBUG ( %s/%s ): Queueing NetFlow packet from [%s:%u] seqno [%u] to [%s]\n",
+                        config.name, config.type, agent_addr, agent_port, msg->seqno, recv_addr);
+    }
+
+    mh = &tee_mmsg[m_idx];
+
+    if (config.tee_transparent) {
+      hdr_ptr = tee_hdr_buf + (m_idx*TEE_HDR_SLOT_SZ);
+      if (!(hdr_len = Tee_craft_transparent_hdr(msg, (struct sockaddr *) &target->dest, hdr_ptr))) continue;
+
+      tee_iov[iov_idx].iov_base = hdr_ptr;
+      tee_iov[iov_idx].iov_len = hdr_len;
+      tee_iov[iov_idx+1].iov_base = msg->payload;
+      tee_iov[iov_idx+1].iov_len = msg->len;
+
+      memset(mh, 0, sizeof(struct mmsghdr));
+      mh->msg_hdr.msg_iov = &tee_iov[iov_idx];
+      mh->msg_hdr.msg_iovlen = 2;
+      iov_idx += 2;
+    }
+    else {
+      memset(mh, 0, sizeof(struct mmsghdr));
+      mh->msg_hdr.msg_iov = &tee_iov[iov_idx];
+      mh->msg_hdr.msg_iovlen = 1;
+      tee_iov[iov_idx].iov_base = msg->payload;
+      tee_iov[iov_idx].iov_len = msg->len;
+      iov_idx++;
+
+      /* coalesce following datagrams of the very same size, if any */
+      if (target->gso) {
+        for (segs = 1, gso_len = msg->len; (q_idx+1) < target->queue_len && segs < TEE_GSO_MAX_SEGS; segs++) {
+	  struct pkt_msg *next = target->queue[q_idx+1];
+
+	  if (next->len != msg->len || (gso_len + next->len) > (UINT16_MAX - TEE_HDR_SLOT_SZ)) break;
+
+          tee_iov[iov_idx].iov_base = next->payload;
+          tee_iov[iov_idx].iov_len = next->len;
+	  gso_len += next->len;
+          iov_idx++;
+	  q_idx++;
+	}
+
+	if (segs > 1) {
+	  mh->msg_hdr.msg_iovlen = segs;
+	  mh->msg_hdr.msg_control = tee_cmsg_buf + (m_idx*CMSG_SPACE(sizeof(u_int16_t)));
+	  mh->msg_hdr.msg_controllen = CMSG_SPACE(sizeof(u_int16_t));
+
+	  cm = CMSG_FIRSTHDR(&mh->msg_hdr);
+	  cm->cmsg_level = SOL_UDP;
+	  cm->cmsg_type = UDP_SEGMENT;
+	  cm->cmsg_len = CMSG_LEN(sizeof(u_int16_t));
+	  *((u_int16_t *) CMSG_DATA(cm)) = msg->len;
+	}
       }
     }
+
+    tee_mmsg_first[m_idx] = msg;
+    m_idx++;
+  }
+
+  for (sent = 0; sent < m_idx; ) {
+    ret = sendmmsg(target->fd, &tee_mmsg[sent], m_idx - sent, 0);
+
+    if (ret > 0) sent += ret;
     else {
-      time_t now = time(NULL);
+      /* no checksum offload on the egress device: segment in userspace from now on;
+         entries already coalesced in this batch fail the same way and get unrolled too */
+      if (tee_mmsg[sent].msg_hdr.msg_controllen && errno == EIO) {
+	if (target->gso) {
+	  Log(LOG_WARNING, "WARN ( %s/%s ): UDP GSO not supported towards this receiver. Disabling.\n", config.name, config.type);
+	  target->gso = FALSE;
+	}
 
-      if (now > err_cant_bridge_af + 60) {
-        Log(LOG_ERR, "ERROR ( %s/%s ): Can't bridge Address Families when in transparent mode\n", config.name, config.type);
-	err_cant_bridge_af = now;
+	for (iov_idx = 0; iov_idx < tee_mmsg[sent].msg_hdr.msg_iovlen; iov_idx++) {
+	  struct iovec *iov = &tee_mmsg[sent].msg_hdr.msg_iov[iov_idx];
+
+	  if (send(target->fd, iov->iov_base, iov->iov_len, 0) == -1)
+	    Tee_send_error(tee_mmsg_first[sent], (struct sockaddr *) &target->dest, "send()");
+	}
       }
+      else Tee_send_error(tee_mmsg_first[sent], (struct sockaddr *) &target->dest, "sendmmsg()");
+
+      sent++;
     }
   }
+#else
+  int q_idx;
+
+  for (q_idx = 0; q_idx < target->queue_len; q_idx++)
+    Tee_send(target->queue[q_idx], (struct sockaddr *) &target->dest, target->fd);
+#endif
+
+  target->queue_len = 0;
 }
 
 void Tee_destroy_recvs()
@@ -437,9 +674,12 @@ void Tee_destroy_recvs()
     for (recv_idx = 0; recv_idx < receivers.pools[pool_idx].num; recv_idx++) {
       target = &receivers.pools[pool_idx].receivers[recv_idx];
       if (target->fd) close(target->fd);
+      if (target->queue) free(target->queue);
     }
 
-    memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receivers));
+    if (receivers.pools[pool_idx].balance.cache) free(receivers.pools[pool_idx].balance.cache);
+
+    memset(receivers.pools[pool_idx].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receiver));
     memset(&receivers.pools[pool_idx].tag_filter, 0, sizeof(struct pretag_filter));
     memset(&receivers.pools[pool_idx].balance, 0, sizeof(struct tee_balance));
     receivers.pools[pool_idx].id = 0;
@@ -471,12 +711,32 @@ void Tee_init_socks()
 
       target->fd = Tee_prepare_sock((struct sockaddr *) &target->dest, target->dest_len);
 
+      if (config.tee_batch_size) {
+	target->queue = malloc(config.tee_batch_size*sizeof(struct pkt_msg *));
+	if (!target->queue) {
+	  Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate batch queue. Exiting ...\n", config.name, config.type);
+	  exit_plugin(1);
+	}
+	target->queue_len = 0;
+	target->dirty = FALSE;
+
+#if defined HAVE_SENDMMSG && defined UDP_SEGMENT
+	/* probe kernel support; segment size is then given per sendmmsg() message */
+	if (config.tee_gso && !config.tee_transparent) {
+	  int gso_size = 0;
+
+	  if (!setsockopt(target->fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size))) target->gso = TRUE;
+	  else Log(LOG_WARNING, "WARN ( %s/%s ): UDP GSO not supported by the kernel (errno: %d)\n", config.name, config.type, errno);
+	}
+#endif
+      }
+
       if (config.debug) {
 	struct host_addr recv_addr;
         u_char recv_addr_str[INET6_ADDRSTRLEN];
 	u_int16_t recv_port;
 
-	sa_to_addr(&target->dest, &recv_addr, &recv_port); 
+	sa_to_addr((struct sockaddr *) &target->dest, &recv_addr, &recv_port); 
         addr_to_str(recv_addr_str, &recv_addr);
         Log(LOG_DEBUG, "DEBUG ( %s/%s ): pool ID: %u :: receiver: %s :: fd: %d.\n",
                 config.name, config.type, receivers.pools[pool_idx].id, recv_addr_str, target->fd);
@@ -596,6 +856,205 @@ int Tee_parse_hostport(const char *s, struct sockaddr *addr, socklen_t *len)
   return FALSE;
 }
 
+void Tee_init_tpl()
+{
+  if (!config.tee_balance_templates) return;
+
+  tee_tpl_table = malloc(TEE_TPL_HASHSZ*sizeof(struct tee_tpl_entry));
+  tee_tpl_msgs.max = (config.buffer_size/PmsgSz)+1;
+  tee_tpl_msgs.msgs = malloc(tee_tpl_msgs.max*PmsgSz);
+  tee_tpl_msgs.num = 0;
+
+  if (!tee_tpl_table || !tee_tpl_msgs.msgs) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): unable to allocate templates table. Exiting ...\n", config.name, config.type);
+    exit_plugin(1);
+  }
+  else memset(tee_tpl_table, 0, TEE_TPL_HASHSZ*sizeof(struct tee_tpl_entry));
+
+  if (!config.tee_templates_refresh_time) config.tee_templates_refresh_time = DEFAULT_TEE_TPL_REFRESH_TIME;
+}
+
+/*
+  Balancing sends a NetFlow v9/IPFIX datagram to a single receiver of the
+  pool, hence the rest of the pool would miss the templates it carries.
+  If the datagram contains template or options template records that are
+  new or changed for the exporter/source_id/template ID, or that were last
+  replicated more than tee_templates_refresh_time ago, a copy of the
+  datagram holding only its template FlowSets is crafted and returned for
+  the other receivers; otherwise NULL is returned. Only a hash of each
+  template is retained, so the common case costs a walk of the records;
+  keying per template ID makes it indifferent to how exporters spread
+  templates across datagrams.
+*/
+struct pkt_msg *Tee_tpl_extract(struct pkt_msg *msg)
+{
+  struct data_hdr_v9 *fs;
+  struct tee_tpl_entry *entry;
+  struct pkt_msg *tpl_msg;
+  u_char *ptr, *end, *tpl_ptr, *rec, *rec_end;
+  u_int16_t version, fid, flen, hdr_len, tpl_fid, opt_fid, count, tpl_id;
+  u_int32_t source_id, hash;
+  int rec_len, changed = FALSE;
+  time_t now;
+
+  if (msg->len < sizeof(u_int16_t)) return NULL;
+
+  ptr = msg->payload;
+  end = msg->payload + msg->len;
+  version = ntohs(*(u_int16_t *) ptr);
+
+  if (version == 9) {
+    hdr_len = sizeof(struct struct_header_v9);
+    tpl_fid = NF9_TEMPLATE_FLOWSET_ID;
+    opt_fid = NF9_OPTIONS_FLOWSET_ID;
+  }
+  else if (version == 10) {
+    hdr_len = sizeof(struct struct_header_ipfix);
+    tpl_fid = IPFIX_TEMPLATE_FLOWSET_ID;
+    opt_fid = IPFIX_OPTIONS_FLOWSET_ID;
+  }
+  else return NULL;
+
+  if (msg->len < hdr_len) return NULL;
+
+  /* no room to replicate: leave the table untouched so to retry next time */
+  if (tee_tpl_msgs.num == tee_tpl_msgs.max) return NULL;
+
+  if (version == 9) source_id = ((struct struct_header_v9 *) ptr)->source_id;
+  else source_id = ((struct struct_header_ipfix *) ptr)->source_id;
+
+  now = time(NULL);
+
+  for (ptr += hdr_len; (ptr + sizeof(struct data_hdr_v9)) <= end; ptr += flen) {
+    fs = (struct data_hdr_v9 *) ptr;
+    fid = ntohs(fs->flow_id);
+    flen = ntohs(fs->flow_len);
+
+    if (flen < sizeof(struct data_hdr_v9) || (ptr + flen) > end) break;
+    if (fid != tpl_fid && fid != opt_fid) continue;
+
+    rec_end = ptr + flen;
+    for (rec = ptr + sizeof(struct data_hdr_v9); (rec_len = Tee_tpl_record_len(version, (fid == opt_fid), rec, rec_end)) > 0; rec += rec_len) {
+      tpl_id = ntohs(((struct template_hdr_v9 *) rec)->template_id);
+      hash = jhash(rec, rec_len, 0);
+
+      entry = Tee_tpl_lookup(msg, source_id, tpl_id);
+      if (!entry) changed = TRUE;
+      else if (entry->hash != hash || now >= (entry->stamp + config.tee_templates_refresh_time)) {
+	entry->hash = hash;
+	entry->stamp = now;
+	changed = TRUE;
+      }
+    }
+  }
+
+  if (!changed) return NULL;
+
+  tpl_msg = (struct pkt_msg *) ((u_char *)tee_tpl_msgs.msgs + (tee_tpl_msgs.num*PmsgSz));
+  tee_tpl_msgs.num++;
+
+  memcpy(&tpl_msg->agent, &msg->agent, sizeof(msg->agent));
+  tpl_msg->seqno = msg->seqno;
+  tpl_msg->tag = msg->tag;
+  tpl_msg->tag2 = msg->tag2;
+  memcpy(tpl_msg->payload, msg->payload, hdr_len);
+  tpl_ptr = tpl_msg->payload + hdr_len;
+  count = 0;
+
+  for (ptr = msg->payload + hdr_len; (ptr + sizeof(struct data_hdr_v9)) <= end; ptr += flen) {
+    fs = (struct data_hdr_v9 *) ptr;
+    fid = ntohs(fs->flow_id);
+    flen = ntohs(fs->flow_len);
+
+    if (flen < sizeof(struct data_hdr_v9) || (ptr + flen) > end) break;
+
+    if (fid == tpl_fid || fid == opt_fid) {
+      memcpy(tpl_ptr, ptr, flen);
+      tpl_ptr += flen;
+
+      /* NetFlow v9 header counts records: count templates in the FlowSet */
+      if (version == 9) {
+	rec_end = ptr + flen;
+	for (rec = ptr + sizeof(struct data_hdr_v9); (rec_len = Tee_tpl_record_len(version, (fid == opt_fid), rec, rec_end)) > 0; rec += rec_len)
+	  count++;
+      }
+    }
+  }
+
+  tpl_msg->len = tpl_ptr - tpl_msg->payload;
+
+  if (version == 9) ((struct struct_header_v9 *) tpl_msg->payload)->count = htons(count);
+  else ((struct struct_header_ipfix *) tpl_msg->payload)->len = htons(tpl_msg->len);
+
+  return tpl_msg;
+}
+
+/*
+  Length of the template record at 'rec', or zero when the FlowSet is over:
+  end of buffer, padding or a malformed record. IPFIX field specifiers are
+  4 bytes plus 4 more if enterprise-specific; IPFIX options templates
+  count fields, NetFlow v9 ones give scope and option lengths in bytes.
+*/
+int Tee_tpl_record_len(u_int16_t version, int options, u_char *rec, u_char *rec_end)
+{
+  u_int16_t fields, idx, hdr_len, type;
+  u_char *fptr;
+
+  hdr_len = options ? sizeof(struct options_template_hdr_v9) : sizeof(struct template_hdr_v9);
+  if ((rec + hdr_len) > rec_end) return 0;
+  if (ntohs(((struct template_hdr_v9 *) rec)->template_id) < 256) return 0;
+
+  if (version == 9) {
+    if (options) {
+      struct options_template_hdr_v9 *oth = (struct options_template_hdr_v9 *) rec;
+
+      fptr = rec + hdr_len + ntohs(oth->scope_len) + ntohs(oth->option_len);
+    }
+    else fptr = rec + hdr_len + (ntohs(((struct template_hdr_v9 *) rec)->num) * 4);
+  }
+  else {
+    fields = ntohs(((struct template_hdr_v9 *) rec)->num);
+
+    for (idx = 0, fptr = rec + hdr_len; idx < fields && (fptr + 4) <= rec_end; idx++) {
+      type = ntohs(*(u_int16_t *) fptr);
+      fptr += (type & 0x8000) ? 8 : 4;
+    }
+
+    if (idx < fields) return 0;
+  }
+
+  if (fptr > rec_end) return 0;
+
+  return fptr - rec;
+}
+
+struct tee_tpl_entry *Tee_tpl_lookup(struct pkt_msg *msg, u_int32_t source_id, u_int16_t template_id)
+{
+  struct tee_tpl_entry *entry;
+  u_int32_t idx, probes;
+  u_int16_t port;
+
+  idx = jhash_3words(Tee_agent_key(msg), source_id, template_id, 0);
+
+  for (probes = 0; probes < TEE_TPL_HASHSZ; probes++, idx++) {
+    entry = &tee_tpl_table[idx & (TEE_TPL_HASHSZ-1)];
+
+    if (!entry->used) {
+      sa_to_addr((struct sockaddr *) &msg->agent, &entry->agent, &port);
+      entry->source_id = source_id;
+      entry->template_id = template_id;
+      entry->used = TRUE;
+
+      return entry;
+    }
+    else if (entry->source_id == source_id && entry->template_id == template_id &&
+	     !sa_addr_cmp((struct sockaddr *) &msg->agent, &entry->agent)) return entry;
+  }
+
+  /* table full: templates will just be replicated every time */
+  return NULL;
+}
+
 struct tee_receiver *Tee_rr_balance(void *pool, struct pkt_msg *msg)
 {
   struct tee_receivers_pool *p = pool;
@@ -614,11 +1073,13 @@ struct tee_receiver *Tee_hash_agent_balance(void *pool, struct pkt_msg *msg)
 {
   struct tee_receivers_pool *p = pool;
   struct tee_receiver *target = NULL;
-  struct sockaddr_in *sa4 = (struct sockaddr_in *) &msg->agent;
+  struct sockaddr *sa = (struct sockaddr *) &msg->agent;
 
   if (p) {
-    if (msg->agent.sa_family == AF_INET) target = &p->receivers[sa4->sin_addr.s_addr & p->num];
-    /* XXX: hashing against IPv6 agents is not supported (yet) */
+    if (sa->sa_family == AF_INET) target = &p->receivers[ntohl(((struct sockaddr_in *)sa)->sin_addr.s_addr) % p->num];
+#if defined ENABLE_IPV6
+    else if (sa->sa_family == AF_INET6) target = &p->receivers[Tee_agent_key(msg) % p->num];
+#endif
   }
 
   return target;
@@ -633,3 +1094,92 @@ struct tee_receiver *Tee_hash_tag_balance(void *pool, struct pkt_msg *msg)
 
   return target;
 }
+
+struct tee_receiver *Tee_chash_agent_balance(void *pool, struct pkt_msg *msg)
+{
+  struct tee_receivers_pool *p = pool;
+  struct tee_receiver *target = NULL;
+  struct sockaddr *sa = (struct sockaddr *) &msg->agent;
+
+  if (p) {
+    if (sa->sa_family == AF_INET
+#if defined ENABLE_IPV6
+        || sa->sa_family == AF_INET6
+#endif
+       ) target = Tee_chash_lookup(p, Tee_agent_key(msg));
+  }
+
+  return target;
+}
+
+struct tee_receiver *Tee_chash_tag_balance(void *pool, struct pkt_msg *msg)
+{
+  struct tee_receivers_pool *p = pool;
+  struct tee_receiver *target = NULL;
+
+  if (p) target = Tee_chash_lookup(p, jhash_2words((u_int32_t) msg->tag, (u_int32_t) (msg->tag >> 32), 0));
+
+  return target;
+}
+
+/*
+  Weighted rendezvous (highest random weight) hashing: each receiver takes
+  part with 'weight' virtual nodes, all derived from the hash of its own
+  address and port rather than from its position in the pool. Adding,
+  removing or re-ordering receivers in the map hence only moves the keys
+  owned by the receivers that changed. Results are remembered in a small
+  direct-mapped cache keyed by the very same 32-bit key fed to the hash,
+  making repeated lookups, ie. datagrams from the same exporter, O(1).
+*/
+struct tee_receiver *Tee_chash_lookup(struct tee_receivers_pool *p, u_int32_t key)
+{
+  struct tee_chash_cache_entry *ce = NULL;
+  u_int32_t score, best_score = 0;
+  int recv_idx, vnode, best_idx = 0;
+
+  if (p->balance.cache) {
+    ce = &p->balance.cache[key & (TEE_CHASH_CACHE_SZ-1)];
+    if (ce->idx && ce->key == key) return &p->receivers[ce->idx-1];
+  }
+
+  for (recv_idx = 0; recv_idx < p->num; recv_idx++) {
+    for (vnode = 0; vnode < p->receivers[recv_idx].weight; vnode++) {
+      score = jhash_2words(key, vnode, p->receivers[recv_idx].seed);
+      if (score >= best_score) {
+        best_score = score;
+        best_idx = recv_idx;
+      }
+    }
+  }
+
+  if (ce) {
+    ce->key = key;
+    ce->idx = best_idx+1;
+  }
+
+  return &p->receivers[best_idx];
+}
+
+u_int32_t Tee_agent_key(struct pkt_msg *msg)
+{
+  struct sockaddr *sa = (struct sockaddr *) &msg->agent;
+
+  if (sa->sa_family == AF_INET) return jhash_1word(((struct sockaddr_in *)sa)->sin_addr.s_addr, 0);
+#if defined ENABLE_IPV6
+  else if (sa->sa_family == AF_INET6) return jhash2((u_int32_t *) &((struct sockaddr_in6 *)sa)->sin6_addr, 4, 0);
+#endif
+
+  return 0;
+}
+
+u_int32_t Tee_dest_seed(struct sockaddr *sa)
+{
+  if (sa->sa_family == AF_INET)
+    return jhash_2words(((struct sockaddr_in *)sa)->sin_addr.s_addr, ((struct sockaddr_in *)sa)->sin_port, 0);
+#if defined ENABLE_IPV6
+  else if (sa->sa_family == AF_INET6)
+    return jhash2((u_int32_t *) &((struct sockaddr_in6 *)sa)->sin6_addr, 4, ((struct sockaddr_in6 *)sa)->sin6_port);
+#endif
+
+  return 0;
+}
@@ -28,11 +28,22 @@
 #define DEFAULT_TEE_REFRESH_TIME 10
 #define MAX_TEE_POOLS 128 
 #define MAX_TEE_RECEIVERS 32 
+#define TEE_BATCH_MAX 1024		/* UIO_MAXIOV, sendmmsg() vlen cap */
+#define TEE_GSO_MAX_SEGS 64		/* UDP_MAX_SEGMENTS */
+#define TEE_HDR_SLOT_SZ 64		/* room for IPv6 + UDP headers, transparent mode */
 
 #define TEE_BALANCE_NONE	0
 #define TEE_BALANCE_RR		1
 #define TEE_BALANCE_HASH_AGENT	2
 #define TEE_BALANCE_HASH_TAG	3
+#define TEE_BALANCE_CHASH_AGENT	4
+#define TEE_BALANCE_CHASH_TAG	5
+
+#define TEE_MAX_WEIGHT		100
+#define TEE_CHASH_CACHE_SZ	4096	/* power of two */
+
+#define TEE_TPL_HASHSZ		16384	/* power of two */
+#define DEFAULT_TEE_TPL_REFRESH_TIME 60
 
 typedef struct tee_receiver *(*tee_balance_algorithm) (void *, struct pkt_msg *);
 
@@ -45,12 +56,24 @@ struct tee_receiver {
 #endif
   socklen_t dest_len;
   int fd;
+  u_int32_t seed;			/* consistent hashing: hash of dest */
+  int weight;				/* consistent hashing: relative weight */
+  int gso;				/* UDP GSO usable on this socket */
+  struct pkt_msg **queue;		/* batched send: datagrams pending */
+  int queue_len;
+  int dirty;				/* batched send: listed in tee_dirty_recvs */
+};
+
+struct tee_chash_cache_entry {
+  u_int32_t key;
+  int idx;				/* receiver index + 1; zero if empty */
 };
 
 struct tee_balance {
   int type;				/* Balancing algorithm: id */
   tee_balance_algorithm func;		/* Balancing algorithm: handler */
   int next;				/* RR algorithm: next receiver */
+  struct tee_chash_cache_entry *cache;	/* consistent hashing algorithms: key -> receiver */
 };
 
 struct tee_receivers_pool {
@@ -66,6 +89,22 @@ struct tee_receivers {
   int num;
 };
 
+/* NetFlow v9/IPFIX templates last replicated, per exporter, source_id and template ID */
+struct tee_tpl_entry {
+  struct host_addr agent;
+  u_int32_t source_id;
+  u_int16_t template_id;
+  u_int32_t hash;			/* hash of the template record */
+  time_t stamp;				/* last time replicated to the pools */
+  u_int8_t used;
+};
+
+struct tee_tpl_msgs {
+  struct pkt_msg *msgs;			/* template-only datagrams crafted out of current buffer */
+  int num;
+  int max;
+};
+
 /* prototypes */
 #if (!defined __TEE_PLUGIN_C)
 #define EXT extern
@@ -77,15 +116,34 @@ EXT void Tee_exit_now(int);
 EXT void Tee_init_socks();
 EXT void Tee_destroy_recvs();
 EXT void Tee_send(struct pkt_msg *, struct sockaddr *, int);
+EXT void Tee_send_error(struct pkt_msg *, struct sockaddr *, char *);
+EXT int Tee_craft_transparent_hdr(struct pkt_msg *, struct sockaddr *, char *);
+EXT void Tee_enqueue(struct pkt_msg *, struct tee_receiver *);
+EXT void Tee_flush(struct tee_receiver *);
+EXT void Tee_flush_all();
+EXT void Tee_init_batch();
 EXT int Tee_prepare_sock(struct sockaddr *, socklen_t);
 EXT int Tee_parse_hostport(const char *, struct sockaddr *, socklen_t *);
 EXT struct tee_receiver *Tee_rr_balance(void *, struct pkt_msg *);
 EXT struct tee_receiver *Tee_hash_agent_balance(void *, struct pkt_msg *);
 EXT struct tee_receiver *Tee_hash_tag_balance(void *, struct pkt_msg *);
+EXT struct tee_receiver *Tee_chash_agent_balance(void *, struct pkt_msg *);
+EXT struct tee_receiver *Tee_chash_tag_balance(void *, struct pkt_msg *);
+EXT struct tee_receiver *Tee_chash_lookup(struct tee_receivers_pool *, u_int32_t);
+EXT u_int32_t Tee_agent_key(struct pkt_msg *);
+EXT u_int32_t Tee_dest_seed(struct sockaddr *);
+EXT void Tee_init_tpl();
+EXT struct pkt_msg *Tee_tpl_extract(struct pkt_msg *);
+EXT int Tee_tpl_record_len(u_int16_t, int, u_char *, u_char *);
+EXT struct tee_tpl_entry *Tee_tpl_lookup(struct pkt_msg *, u_int32_t, u_int16_t);
 
 /* global variables */
 EXT char tee_send_buf[65535];
 EXT struct tee_receivers receivers; 
 EXT int err_cant_bridge_af;
+EXT struct tee_receiver **tee_dirty_recvs;
+EXT int tee_dirty_num;
+EXT struct tee_tpl_entry *tee_tpl_table;
+EXT struct tee_tpl_msgs tee_tpl_msgs;
 
 #undef EXT
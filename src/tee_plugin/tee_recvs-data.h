@@ -24,5 +24,6 @@ const struct _map_dictionary_line tee_recvs_map_dictionary[] = {
   {"ip", tee_recvs_map_ip_handler},
   {"tag", tee_recvs_map_tag_handler},
   {"balance-alg", tee_recvs_map_balance_alg_handler},
+  {"weights", tee_recvs_map_weights_handler},
   {"", NULL}
 };
@@ -79,7 +79,10 @@ int tee_recvs_map_ip_handler(char *filename, struct id_entry *e, char *value, st
       if (recv_idx < config.tee_max_receivers) {
 	target = &table->pools[table->num].receivers[recv_idx];
 	target->dest_len = sizeof(target->dest);
-	if (!Tee_parse_hostport(token, &target->dest, &target->dest_len)) recv_idx++;
+	if (!Tee_parse_hostport(token, (struct sockaddr *) &target->dest, &target->dest_len)) {
+	  target->seed = Tee_dest_seed((struct sockaddr *) &target->dest);
+	  recv_idx++;
+	}
 	else Log(LOG_WARNING, "WARN ( %s/%s ): Invalid receiver %s in map '%s'.\n",
 		config.name, config.type, token, filename);
       }
@@ -119,6 +122,42 @@ int tee_recvs_map_tag_handler(char *filename, struct id_entry *e, char *value, s
   else return FALSE;
 }
 
+int tee_recvs_map_weights_handler(char *filename, struct id_entry *e, char *value, struct plugin_requests *req, int acct_type)
+{
+  struct tee_receivers *table = (struct tee_receivers *) req->key_value_table;
+  int recv_idx, weight;
+  char *str_ptr, *token;
+
+  if (table && table->pools && table->pools[table->num].receivers) {
+    str_ptr = value;
+    recv_idx = 0;
+
+    while (token = extract_token(&str_ptr, ',')) {
+      if (recv_idx < config.tee_max_receivers) {
+	weight = atoi(token);
+	if (weight < 1 || weight > TEE_MAX_WEIGHT) {
+	  Log(LOG_ERR, "ERROR ( %s/%s ): Invalid weight '%s': allowed values are 1-%u. ", config.name, config.type, token, TEE_MAX_WEIGHT);
+	  return TRUE;
+	}
+
+	table->pools[table->num].receivers[recv_idx].weight = weight;
+	recv_idx++;
+      }
+      else {
+	Log(LOG_WARNING, "WARN ( %s/%s ): More weights than receivers allowed per pool (%u) in map '%s'.\n",
+		config.name, config.type, config.tee_max_receivers, filename);
+	break;
+      }
+    }
+  }
+  else {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Receivers table not allocated. ", config.name, config.type);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
 int tee_recvs_map_balance_alg_handler(char *filename, struct id_entry *e, char *value, struct plugin_requests *req, int acct_type)
 {
   struct tee_receivers *table = (struct tee_receivers *) req->key_value_table;
@@ -137,6 +176,14 @@ int tee_recvs_map_balance_alg_handler(char *filename, struct id_entry *e, char *
       table->pools[table->num].balance.type = TEE_BALANCE_HASH_TAG;
       table->pools[table->num].balance.func = Tee_hash_tag_balance;
     }
+    else if (!strncmp(value, "chash-agent", 11)) {
+      table->pools[table->num].balance.type = TEE_BALANCE_CHASH_AGENT;
+      table->pools[table->num].balance.func = Tee_chash_agent_balance;
+    }
+    else if (!strncmp(value, "chash-tag", 9)) {
+      table->pools[table->num].balance.type = TEE_BALANCE_CHASH_TAG;
+      table->pools[table->num].balance.func = Tee_chash_tag_balance;
+    }
     else {
       table->pools[table->num].balance.func = NULL;
       Log(LOG_WARNING, "WARN ( %s/%s ): Unknown balance algorithm '%s' in map '%s'. Ignoring.\n", config.name, config.type, value, filename);
@@ -153,18 +200,32 @@ int tee_recvs_map_balance_alg_handler(char *filename, struct id_entry *e, char *
 void tee_recvs_map_validate(char *filename, struct plugin_requests *req)
 {
   struct tee_receivers *table = (struct tee_receivers *) req->key_value_table;
-  int valid = FALSE;
+  struct tee_receivers_pool *pool;
+  int valid = FALSE, recv_idx;
 
   if (table && table->pools && table->pools[table->num].receivers) {
+    pool = &table->pools[table->num];
+
     /* If we have got: a) a valid pool ID and b) at least a receiver THEN ok */
-    if (table->pools[table->num].id && table->pools[table->num].num > 0) valid = TRUE;
+    if (pool->id && pool->num > 0) valid = TRUE;
     else valid = FALSE;
 
+    if (valid && (pool->balance.type == TEE_BALANCE_CHASH_AGENT || pool->balance.type == TEE_BALANCE_CHASH_TAG)) {
+      for (recv_idx = 0; recv_idx < pool->num; recv_idx++) {
+	if (!pool->receivers[recv_idx].weight) pool->receivers[recv_idx].weight = 1;
+      }
+
+      pool->balance.cache = malloc(TEE_CHASH_CACHE_SZ*sizeof(struct tee_chash_cache_entry));
+      if (pool->balance.cache) memset(pool->balance.cache, 0, TEE_CHASH_CACHE_SZ*sizeof(struct tee_chash_cache_entry));
+      else Log(LOG_WARNING, "WARN ( %s/%s ): unable to allocate balancing cache for pool #%u in map '%s'.\n",
+		config.name, config.type, pool->id, filename);
+    }
+
     if (valid) table->num++;
     else {
       table->pools[table->num].id = 0;
       table->pools[table->num].num = 0;
-      memset(table->pools[table->num].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receivers));
+      memset(table->pools[table->num].receivers, 0, config.tee_max_receivers*sizeof(struct tee_receiver));
       memset(&table->pools[table->num].tag_filter, 0, sizeof(struct pretag_filter));
       memset(&table->pools[table->num].balance, 0, sizeof(struct tee_balance));
     }
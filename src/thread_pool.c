@@ -30,7 +30,12 @@
 #include "pmacct.h"
 #include "thread_pool.h"
 
-thread_pool_t *allocate_thread_pool(int count)
+static pthread_mutex_t workers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int workers_num;
+
+/* Threads of THREAD_POOL_PLACED pools apply the thread_pool_* placement keys,
+   any other keeps the placement inherited from the Core Process */
+thread_pool_t *allocate_thread_pool(int count, int placement)
 {
   int i, rc;
   thread_pool_t *pool;
@@ -68,6 +73,15 @@ thread_pool_t *allocate_thread_pool(int count)
     worker->id = i;
     worker->owner = pool;
 
+    worker->placement = placement;
+    worker->cpu_idx = 0;
+
+    if (placement == THREAD_POOL_PLACED) {
+      pthread_mutex_lock(&workers_mutex);
+      worker->cpu_idx = workers_num++;
+      pthread_mutex_unlock(&workers_mutex);
+    }
+
     worker->mutex = malloc(sizeof(pthread_mutex_t));
     assert(worker->mutex);
     pthread_mutex_init(worker->mutex, NULL);
@@ -167,6 +181,13 @@ void deallocate_thread_pool(thread_pool_t **pool)
 void *thread_runner(void *arg)
 {
   thread_pool_item_t *self = (thread_pool_item_t *) arg;
+  char what[SRVBUFLEN];
+
+  if (self->placement == THREAD_POOL_PLACED) {
+    snprintf(what, sizeof(what), "thread_pool worker %d", self->cpu_idx);
+    set_placement(config.name, config.type, what, config.thread_pool_numa_node, config.thread_pool_cpu_affinity,
+		  self->cpu_idx, config.thread_pool_sched_policy, config.thread_pool_sched_priority);
+  }
 
   pthread_mutex_lock(self->mutex);
   self->go = FALSE;
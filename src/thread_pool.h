@@ -33,8 +33,14 @@
 
 #define DEFAULT_TH_NUM 10
 
+/* placement of pool threads, see allocate_thread_pool() */
+#define THREAD_POOL_INHERIT	0	/* Core Process placement, as inherited */
+#define THREAD_POOL_PLACED	1	/* thread_pool_* keys: BGP, BMP and IS-IS daemons */
+
 typedef struct thread_pool_item {
   int			id;
+  int			placement;	/* THREAD_POOL_INHERIT or THREAD_POOL_PLACED */
+  int			cpu_idx;	/* process-wide among placed threads, for thread_pool_cpu_affinity */
 
   pthread_mutex_t   		*mutex;
   pthread_cond_t    		*cond;
@@ -66,7 +72,7 @@ typedef struct thread_pool {
 #else
 #define EXT
 #endif
-EXT thread_pool_t *allocate_thread_pool(int);
+EXT thread_pool_t *allocate_thread_pool(int, int);
 EXT void deallocate_thread_pool(thread_pool_t **);
 EXT void send_to_pool(thread_pool_t *, void *, void *);
 EXT void *thread_runner(void *);
@@ -33,6 +33,7 @@
 #include "ip_flow.h"
 #include "net_aggr.h"
 #include "thread_pool.h"
+#include "addr.h"
 
 /* variables to be exported away */
 int debug;
@@ -60,8 +61,9 @@ void usage_daemon(char *prog_name)
   printf("  -c  \tAggregation method, see full list of primitives with -a (DEFAULT: src_host)\n");
   printf("  -D  \tDaemonize\n"); 
   printf("  -n  \tPath to a file containing Network definitions\n");
+  printf("  -C  \tCompile the Network definitions file into the specified binary map and exit\n");
   printf("  -o  \tPath to a file containing Port definitions\n");
-  printf("  -P  \t[ memory | print | mysql | pgsql | sqlite3 | mongodb | nfprobe | sfprobe ] \n\tActivate plugin\n"); 
+  printf("  -P  \t[ memory | print | null | mysql | pgsql | sqlite3 | mongodb | nfprobe | sfprobe ] \n\tActivate plugin\n"); 
   printf("  -d  \tEnable debug\n");
   printf("  -S  \t[ auth | mail | daemon | kern | user | local[0-7] ] \n\tLog to the specified syslog facility\n");
   printf("  -F  \tWrite Core Process PID into the specified file\n");
@@ -98,6 +100,7 @@ int main(int argc,char **argv, char **envp)
   struct plugins_list_entry *list;
   struct plugin_requests req;
   char config_file[SRVBUFLEN];
+  char *networks_map_out = NULL;
   int psize = ULOG_BUFLEN;
 
   struct id_table bpas_table;
@@ -283,6 +286,9 @@ int main(int argc,char **argv, char **envp)
       usage_daemon(argv[0]);
       exit(0);
       break;
+    case 'C':
+      networks_map_out = optarg;
+      break;
     case 'V':
       version_daemon(UACCTD_USAGE_HEADER);
       exit(0);
@@ -324,6 +330,8 @@ int main(int argc,char **argv, char **envp)
 
   if (config.files_umask) umask(config.files_umask);
 
+  if (networks_map_out) exit(compile_networks(config.networks_file, networks_map_out) == SUCCESS ? 0 : 1);
+
   if (!config.snaplen) config.snaplen = psize;
   if (!config.uacctd_nl_size) config.uacctd_nl_size = psize;
 
@@ -383,6 +391,10 @@ int main(int argc,char **argv, char **envp)
     else Log(LOG_INFO, "INFO ( %s/core ): proc_priority set to %d\n", config.name, getpriority(PRIO_PROCESS, 0));
   }
 
+  /* inherited by threads; plugins reset what they don't define on their own */
+  set_placement(config.name, "core", "process", config.plugin_numa_node, config.proc_cpu_affinity, ERR,
+		config.proc_sched_policy, config.proc_sched_priority);
+
   if (strlen(config_file)) {
     char canonical_path[PATH_MAX], *canonical_path_ptr;
 
@@ -662,45 +674,57 @@ int main(int argc,char **argv, char **envp)
   signal(SIGUSR2, reload_maps); /* sets to true the reload_maps flag */
   signal(SIGPIPE, SIG_IGN); /* we want to exit gracefully when a pipe is broken */
 
-  ulog_fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_NFLOG);
-  if (ulog_fd == -1) {
-    Log(LOG_ERR, "ERROR ( %s/core ): Failed to create Netlink ULOG socket\n", config.name);
-    exit_all(1);
+  if (config.uacctd_nflog) {
+    ulog_fd = nflog_init();
+
+    ulog_buffer = malloc(NFLOG_BUFLEN);
+    if (ulog_buffer == NULL) {
+      Log(LOG_ERR, "ERROR ( %s/core ): NFLOG buffer malloc() failed\n", config.name);
+      close(ulog_fd);
+      exit_all(1);
+    }
   }
+  else {
+    ulog_fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_NFLOG);
+    if (ulog_fd == -1) {
+      Log(LOG_ERR, "ERROR ( %s/core ): Failed to create Netlink ULOG socket\n", config.name);
+      exit_all(1);
+    }
 
-  Log(LOG_INFO, "INFO ( %s/core ): Successfully connected Netlink ULOG socket\n", config.name);
+    Log(LOG_INFO, "INFO ( %s/core ): Successfully connected Netlink ULOG socket\n", config.name);
 
-  /* Turn off netlink errors from overrun. */
-  if (setsockopt(ulog_fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &one, sizeof(one)))
-    Log(LOG_ERR, "ERROR ( %s/core ): Failed to turn off netlink ENOBUFS\n", config.name);
+    /* Turn off netlink errors from overrun. */
+    if (setsockopt(ulog_fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &one, sizeof(one)))
+      Log(LOG_ERR, "ERROR ( %s/core ): Failed to turn off netlink ENOBUFS\n", config.name);
 
-  if (config.uacctd_nl_size > ULOG_BUFLEN) {
-    /* If configured buffer size is larger than default 4KB */
-    if (setsockopt(ulog_fd, SOL_SOCKET, SO_RCVBUF, &config.uacctd_nl_size, sizeof(config.uacctd_nl_size)))
-      Log(LOG_ERR, "ERROR ( %s/core ): Failed to set Netlink receive buffer size\n", config.name);
-    else
-      Log(LOG_INFO, "INFO ( %s/core ): Netlink receive buffer size set to %u\n", config.name, config.uacctd_nl_size);
-  }
+    if (config.uacctd_nl_size > ULOG_BUFLEN) {
+      /* If configured buffer size is larger than default 4KB */
+      if (setsockopt(ulog_fd, SOL_SOCKET, SO_RCVBUF, &config.uacctd_nl_size, sizeof(config.uacctd_nl_size)))
+        Log(LOG_ERR, "ERROR ( %s/core ): Failed to set Netlink receive buffer size\n", config.name);
+      else
+        Log(LOG_INFO, "INFO ( %s/core ): Netlink receive buffer size set to %u\n", config.name, config.uacctd_nl_size);
+    }
 
-  ulog_buffer = malloc(config.snaplen);
-  if (ulog_buffer == NULL) {
-    Log(LOG_ERR, "ERROR ( %s/core ): ULOG buffer malloc() failed\n", config.name);
-    close(ulog_fd);
-    exit_all(1);
-  }
+    ulog_buffer = malloc(config.snaplen);
+    if (ulog_buffer == NULL) {
+      Log(LOG_ERR, "ERROR ( %s/core ): ULOG buffer malloc() failed\n", config.name);
+      close(ulog_fd);
+      exit_all(1);
+    }
 
-  memset(&nls, 0, sizeof(nls));
-  nls.nl_family = AF_NETLINK;
-  nls.nl_pid = getpid();
-  nls.nl_groups = config.uacctd_group;
-  alen = sizeof(nls);
+    memset(&nls, 0, sizeof(nls));
+    nls.nl_family = AF_NETLINK;
+    nls.nl_pid = getpid();
+    nls.nl_groups = config.uacctd_group;
+    alen = sizeof(nls);
 
-  if (bind(ulog_fd, (struct sockaddr *) &nls, sizeof(nls))) {
-    Log(LOG_ERR, "ERROR ( %s/core ): bind() to Netlink ULOG socket failed\n", config.name);
-    close(ulog_fd);
-    exit_all(1);
+    if (bind(ulog_fd, (struct sockaddr *) &nls, sizeof(nls))) {
+      Log(LOG_ERR, "ERROR ( %s/core ): bind() to Netlink ULOG socket failed\n", config.name);
+      close(ulog_fd);
+      exit_all(1);
+    }
+    Log(LOG_INFO, "INFO ( %s/core ): Netlink ULOG: binding to group %u\n", config.name, config.uacctd_group);
   }
-  Log(LOG_INFO, "INFO ( %s/core ): Netlink ULOG: binding to group %u\n", config.name, config.uacctd_group);
 
 #if defined ENABLE_THREADS
   /* starting the ISIS threa */
@@ -828,6 +852,14 @@ int main(int argc,char **argv, char **envp)
       }
     }
 
+    if (config.uacctd_nflog) {
+      /* the kernel batches up to uacctd_nflog_qthreshold packets per read */
+      len = recv(ulog_fd, ulog_buffer, NFLOG_BUFLEN, 0);
+      if (len >= (int)sizeof(struct nlmsghdr)) nflog_process(ulog_buffer, len, &cb_data, jumbo_container);
+
+      continue;
+    }
+
     len = recvfrom(ulog_fd, ulog_buffer, config.snaplen, 0, (struct sockaddr*) &nls, &alen);
 
     /*
@@ -857,45 +889,282 @@ int main(int argc,char **argv, char **envp)
       }
       else cb_data.ifindex_out = 0;
 
-#if defined (HAVE_L2)
-      if (ulog_pkt->mac_len) {
-	memcpy(jumbo_container, ulog_pkt->mac, ulog_pkt->mac_len);
-	memcpy(jumbo_container+ulog_pkt->mac_len, ulog_pkt->payload, hdr.caplen);
-	// XXX
-	hdr.caplen += ulog_pkt->mac_len;
-	hdr.len += ulog_pkt->mac_len;
-      }
-      else {
-	memset(jumbo_container, 0, ETHER_HDRLEN);
-	memcpy(jumbo_container+ETHER_HDRLEN, ulog_pkt->payload, hdr.caplen);
-	hdr.caplen += ETHER_HDRLEN;
-	hdr.len += ETHER_HDRLEN;
-
-	switch (IP_V((struct my_iphdr *) ulog_pkt->payload)) {
-	case 4:
-	  ((struct eth_header *)jumbo_container)->ether_type = ntohs(ETHERTYPE_IP);
-	  break;
-	case 6:
-	  ((struct eth_header *)jumbo_container)->ether_type = ntohs(ETHERTYPE_IPV6);
-	  break;
-	}
+      uacctd_deliver(&cb_data, &hdr, ulog_pkt->mac, ulog_pkt->mac_len, ulog_pkt->payload, jumbo_container);
 
+      if (nlh->nlmsg_type == NLMSG_DONE || !(nlh->nlmsg_flags & NLM_F_MULTI)) {
+        /* Last part of the multilink message */
+        break;
       }
+      nlh = NLMSG_NEXT(nlh, len);
+    }
+  }
+}
 
-      pcap_cb((u_char *) &cb_data, &hdr, jumbo_container);
+/*
+  Hands a packet over to pcap_cb(), prepending the L2 header: 'mac' when
+  supplied, otherwise a blank Ethernet header with just the ethertype set.
+  When the 'mac_len' bytes right before 'payload' are scratch space, ie.
+  already parsed NFLOG attributes, the L2 header is written in place and
+  the copy of the payload to 'jumbo_container' is spared.
+*/
+void uacctd_deliver(struct pcap_callback_data *cb_data, struct pcap_pkthdr *hdr, u_char *mac, u_int16_t mac_len,
+		    u_char *payload, char *jumbo_container)
+{
+#if defined (HAVE_L2)
+  u_char *l2;
+
+  if (mac_len) {
+    if (mac == payload - mac_len) l2 = mac;
+    else {
+      memcpy(jumbo_container, mac, mac_len);
+      memcpy(jumbo_container+mac_len, payload, hdr->caplen);
+      l2 = (u_char *) jumbo_container;
+    }
+
+    // XXX
+    hdr->caplen += mac_len;
+    hdr->len += mac_len;
+  }
+  else {
+    memset(jumbo_container, 0, ETHER_HDRLEN);
+    memcpy(jumbo_container+ETHER_HDRLEN, payload, hdr->caplen);
+    hdr->caplen += ETHER_HDRLEN;
+    hdr->len += ETHER_HDRLEN;
+
+    switch (IP_V((struct my_iphdr *) payload)) {
+    case 4:
+      ((struct eth_header *)jumbo_container)->ether_type = ntohs(ETHERTYPE_IP);
+      break;
+    case 6:
+      ((struct eth_header *)jumbo_container)->ether_type = ntohs(ETHERTYPE_IPV6);
+      break;
+    }
+
+    l2 = (u_char *) jumbo_container;
+  }
+
+  pcap_cb((u_char *) cb_data, hdr, l2);
 #else
-      pcap_cb((u_char *) &cb_data, &hdr, ulog_pkt->payload);
+  pcap_cb((u_char *) cb_data, hdr, payload);
 #endif
+}
 
-      if (nlh->nlmsg_type == NLMSG_DONE || !(nlh->nlmsg_flags & NLM_F_MULTI)) {
-        /* Last part of the multilink message */
-        break;
+/*
+  NFLOG (nfnetlink_log) backend: binds all groups set in uacctd_group to
+  a single NETLINK_NETFILTER socket and asks the kernel to batch packets,
+  up to uacctd_nflog_qthreshold per netlink message or a 100ms timeout.
+*/
+int nflog_init()
+{
+  struct sockaddr_nl nls;
+  struct nfulnl_msg_config_cmd cmd;
+  struct nfulnl_msg_config_mode mode;
+  u_int32_t nlbufsiz, qthresh, timeout;
+  int fd, one = 1, group;
+
+  fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_NETFILTER);
+  if (fd == -1) {
+    Log(LOG_ERR, "ERROR ( %s/core ): Failed to create Netlink NFLOG socket\n", config.name);
+    exit_all(1);
+  }
+
+  Log(LOG_INFO, "INFO ( %s/core ): Successfully connected Netlink NFLOG socket\n", config.name);
+
+  /* Turn off netlink errors from overrun. */
+  if (setsockopt(fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &one, sizeof(one)))
+    Log(LOG_ERR, "ERROR ( %s/core ): Failed to turn off netlink ENOBUFS\n", config.name);
+
+  if (config.uacctd_nl_size > ULOG_BUFLEN) {
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &config.uacctd_nl_size, sizeof(config.uacctd_nl_size)))
+      Log(LOG_ERR, "ERROR ( %s/core ): Failed to set Netlink receive buffer size\n", config.name);
+    else
+      Log(LOG_INFO, "INFO ( %s/core ): Netlink receive buffer size set to %u\n", config.name, config.uacctd_nl_size);
+  }
+
+  memset(&nls, 0, sizeof(nls));
+  nls.nl_family = AF_NETLINK;
+
+  if (bind(fd, (struct sockaddr *) &nls, sizeof(nls))) {
+    Log(LOG_ERR, "ERROR ( %s/core ): bind() to Netlink NFLOG socket failed\n", config.name);
+    close(fd);
+    exit_all(1);
+  }
+
+  /* Older kernels want the address families bound explicitly; harmless otherwise */
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.command = NFULNL_CFG_CMD_PF_UNBIND;
+  nflog_send_cfg(fd, 0, AF_INET, NFULA_CFG_CMD, &cmd, sizeof(cmd));
+  cmd.command = NFULNL_CFG_CMD_PF_BIND;
+  nflog_send_cfg(fd, 0, AF_INET, NFULA_CFG_CMD, &cmd, sizeof(cmd));
+#if defined ENABLE_IPV6
+  cmd.command = NFULNL_CFG_CMD_PF_UNBIND;
+  nflog_send_cfg(fd, 0, AF_INET6, NFULA_CFG_CMD, &cmd, sizeof(cmd));
+  cmd.command = NFULNL_CFG_CMD_PF_BIND;
+  nflog_send_cfg(fd, 0, AF_INET6, NFULA_CFG_CMD, &cmd, sizeof(cmd));
+#endif
+
+  nlbufsiz = htonl(NFLOG_BUFLEN);
+  qthresh = htonl(config.uacctd_nflog_qthreshold ? config.uacctd_nflog_qthreshold : DEFAULT_NFLOG_QTHRESH);
+  timeout = htonl(DEFAULT_NFLOG_TIMEOUT);
+
+  memset(&mode, 0, sizeof(mode));
+  mode.copy_mode = NFULNL_COPY_PACKET;
+  mode.copy_range = htonl(config.snaplen);
+
+  for (group = 1; group <= 32; group++) {
+    if (!(config.uacctd_group & (1U << (group-1)))) continue;
+
+    cmd.command = NFULNL_CFG_CMD_BIND;
+    if (nflog_send_cfg(fd, group, AF_UNSPEC, NFULA_CFG_CMD, &cmd, sizeof(cmd))) {
+      Log(LOG_ERR, "ERROR ( %s/core ): bind() to Netlink NFLOG group %u failed: %s\n", config.name, group, strerror(errno));
+      close(fd);
+      exit_all(1);
+    }
+
+    if (nflog_send_cfg(fd, group, AF_UNSPEC, NFULA_CFG_MODE, &mode, sizeof(mode)) ||
+	nflog_send_cfg(fd, group, AF_UNSPEC, NFULA_CFG_NLBUFSIZ, &nlbufsiz, sizeof(nlbufsiz)) ||
+	nflog_send_cfg(fd, group, AF_UNSPEC, NFULA_CFG_QTHRESH, &qthresh, sizeof(qthresh)) ||
+	nflog_send_cfg(fd, group, AF_UNSPEC, NFULA_CFG_TIMEOUT, &timeout, sizeof(timeout)))
+      Log(LOG_WARNING, "WARN ( %s/core ): Netlink NFLOG group %u: failed to apply settings: %s\n", config.name, group, strerror(errno));
+
+    Log(LOG_INFO, "INFO ( %s/core ): Netlink NFLOG: binding to group %u\n", config.name, group);
+  }
+
+  return fd;
+}
+
+/* Sends a NFULNL_MSG_CONFIG message carrying a single attribute and waits for its ACK */
+int nflog_send_cfg(int fd, u_int16_t group, u_int8_t family, u_int16_t attr_type, void *attr_data, u_int16_t attr_len)
+{
+  static u_int32_t seq = 0;
+  char buf[NLMSG_SPACE(sizeof(struct nfgenmsg)) + NFA_SPACE(sizeof(struct nfulnl_msg_config_mode)) + 16];
+  char ackbuf[ULOG_BUFLEN];
+  struct nlmsghdr *nlh = (struct nlmsghdr *) buf;
+  struct nfgenmsg *nfg;
+  struct nfattr *nfa;
+  struct nlmsgerr *err;
+  struct sockaddr_nl kernel;
+  int len;
+
+  memset(buf, 0, sizeof(buf));
+  nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct nfgenmsg));
+  nlh->nlmsg_type = (NFNL_SUBSYS_ULOG << 8) | NFULNL_MSG_CONFIG;
+  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+  nlh->nlmsg_seq = ++seq;
+
+  nfg = NLMSG_DATA(nlh);
+  nfg->nfgen_family = family;
+  nfg->version = NFNETLINK_V0;
+  nfg->res_id = htons(group);
+
+  nfa = (struct nfattr *) (buf + NLMSG_ALIGN(nlh->nlmsg_len));
+  nfa->nfa_type = attr_type;
+  nfa->nfa_len = NFA_LENGTH(attr_len);
+  memcpy(NFA_DATA(nfa), attr_data, attr_len);
+  nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NFA_ALIGN(nfa->nfa_len);
+
+  memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+
+  if (sendto(fd, buf, nlh->nlmsg_len, 0, (struct sockaddr *) &kernel, sizeof(kernel)) == -1) return ERR;
+
+  /* packets of groups already bound may well come before the ACK */
+  for (;;) {
+    if ((len = recv(fd, ackbuf, sizeof(ackbuf), 0)) < 0) return ERR;
+
+    for (nlh = (struct nlmsghdr *) ackbuf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+      if (nlh->nlmsg_type == NLMSG_ERROR && nlh->nlmsg_seq == seq) {
+	err = NLMSG_DATA(nlh);
+	if (err->error) {
+	  errno = -err->error;
+	  return ERR;
+	}
+
+	return SUCCESS;
       }
-      nlh = NLMSG_NEXT(nlh, len);
     }
   }
 }
 
+/*
+  Walks a batch of NFLOG messages. Interfaces come as ifindexes straight
+  from the kernel, hence no name to ifindex lookups are needed.
+*/
+void nflog_process(u_char *buf, int len, struct pcap_callback_data *cb_data, char *jumbo_container)
+{
+  struct nlmsghdr *nlh;
+  struct nfattr *nfa;
+  struct nflog_pkt pkt;
+  struct pcap_pkthdr hdr;
+  struct timeval now;
+  int attrlen;
+
+  gettimeofday(&now, NULL);
+
+  for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+    if (nlh->nlmsg_type == NLMSG_DONE) break;
+    if ((nlh->nlmsg_type >> 8) != NFNL_SUBSYS_ULOG || (nlh->nlmsg_type & 0xff) != NFULNL_MSG_PACKET) continue;
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.ts = now;
+
+    nfa = (struct nfattr *) ((u_char *)NLMSG_DATA(nlh) + NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+    attrlen = nlh->nlmsg_len - NLMSG_SPACE(sizeof(struct nfgenmsg));
+
+    for (; NFA_OK(nfa, attrlen); nfa = NFA_NEXT(nfa, attrlen)) {
+      switch (NFA_TYPE(nfa)) {
+      case NFULA_PAYLOAD:
+	pkt.payload = NFA_DATA(nfa);
+	pkt.payload_len = NFA_PAYLOAD(nfa);
+	break;
+      case NFULA_IFINDEX_INDEV:
+	pkt.ifindex_in = ntohl(*(u_int32_t *) NFA_DATA(nfa));
+	break;
+      case NFULA_IFINDEX_OUTDEV:
+	pkt.ifindex_out = ntohl(*(u_int32_t *) NFA_DATA(nfa));
+	break;
+      case NFULA_HWTYPE:
+	pkt.hwtype = ntohs(*(u_int16_t *) NFA_DATA(nfa));
+	break;
+      case NFULA_HWHEADER:
+	pkt.hwheader = NFA_DATA(nfa);
+	break;
+      case NFULA_HWLEN:
+	pkt.hwheader_len = ntohs(*(u_int16_t *) NFA_DATA(nfa));
+	break;
+      case NFULA_TIMESTAMP:
+	{
+	  struct nfulnl_msg_packet_timestamp *ts = NFA_DATA(nfa);
+
+	  pkt.ts.tv_sec = pm_ntohll(ts->sec);
+	  pkt.ts.tv_usec = pm_ntohll(ts->usec);
+	}
+	break;
+      default:
+	break;
+      }
+    }
+
+    if (!pkt.payload) continue;
+
+    /* only Ethernet link headers make sense to us; else one is forged */
+    if (pkt.hwtype != ARPHRD_ETHER || pkt.hwheader_len != ETHER_HDRLEN) pkt.hwheader_len = 0;
+    else if (pkt.payload - ETHER_HDRLEN >= (u_char *) NLMSG_DATA(nlh)) {
+      memmove(pkt.payload - ETHER_HDRLEN, pkt.hwheader, ETHER_HDRLEN);
+      pkt.hwheader = pkt.payload - ETHER_HDRLEN;
+    }
+
+    hdr.ts = pkt.ts;
+    hdr.caplen = MIN(pkt.payload_len, config.snaplen);
+    hdr.len = pkt.payload_len;
+
+    cb_data->ifindex_in = pkt.ifindex_in;
+    cb_data->ifindex_out = pkt.ifindex_out;
+
+    uacctd_deliver(cb_data, &hdr, pkt.hwheader, pkt.hwheader_len, pkt.payload, jumbo_container);
+  }
+}
+
 unsigned int get_ifindex(char *device) 
 {
   static int sock = -1;
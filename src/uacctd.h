@@ -7,12 +7,19 @@
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter_ipv4/ipt_ULOG.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_log.h>
+#include <net/if_arp.h>
 
 #define ULOG_BUFLEN 10480 /*should be enough room up to 9K Ethernet jumbo frames */
 #define DEFAULT_ULOG_GROUP 1
 #define IFCACHE_HASHSIZ 32
 #define IFCACHE_LIFETIME 15 /* seconds */
 
+#define NFLOG_BUFLEN 131072 /* max nfnetlink_log kernel buffer, nlbufsiz */
+#define DEFAULT_NFLOG_QTHRESH 64
+#define DEFAULT_NFLOG_TIMEOUT 10 /* 1/100th of seconds */
+
 
 #ifndef SOL_NETLINK
 #define SOL_NETLINK    270
@@ -29,6 +36,18 @@ struct ifname_cache {
   char name[IFNAMSIZ];
 };
 
+/* NFLOG packet attributes relevant to us, see nflog_process() */
+struct nflog_pkt {
+  u_char *payload;
+  u_int32_t payload_len;
+  u_char *hwheader;
+  u_int16_t hwheader_len;
+  u_int16_t hwtype;
+  u_int32_t ifindex_in;
+  u_int32_t ifindex_out;
+  struct timeval ts;
+};
+
 /* functions */
 #if (!defined __UACCTD_C)
 #define EXT extern
@@ -37,6 +56,10 @@ struct ifname_cache {
 EXT unsigned int get_ifindex(char *);
 EXT unsigned int cache_ifindex(char *, unsigned long);
 EXT unsigned int hash_ifname(char *); 
+EXT int nflog_init();
+EXT int nflog_send_cfg(int, u_int16_t, u_int8_t, u_int16_t, void *, u_int16_t);
+EXT void nflog_process(u_char *, int, struct pcap_callback_data *, char *);
+EXT void uacctd_deliver(struct pcap_callback_data *, struct pcap_pkthdr *, u_char *, u_int16_t, u_char *, char *);
 
 EXT struct ifname_cache *hash_heads[IFCACHE_HASHSIZ];
 #endif
@@ -30,8 +30,13 @@
 #ifdef WITH_JANSSON
 #include <jansson.h>
 #endif
+#if defined (__linux__)
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
 
 static const char pkt_len_distrib_unknown[] = "unknown";
+static int hugepages_warned;
 
 /* functions */
 void setnonblocking(int sock)
@@ -928,6 +933,436 @@ void *map_shared(void *addr, size_t len, int prot, int flags, int fd, off_t off)
 #endif
 }
 
+size_t hugepage_size()
+{
+  static size_t size;
+  char buf[SRVBUFLEN];
+  unsigned long kb;
+  FILE *f;
+
+  if (size) return size;
+
+  size = DEFAULT_HUGEPAGE_SIZE;
+  if ((f = fopen("/proc/meminfo", "r"))) {
+    while (fgets(buf, sizeof(buf), f)) {
+      if (sscanf(buf, "Hugepagesize: %lu kB", &kb) == 1) {
+        size = kb*1024;
+        break;
+      }
+    }
+    fclose(f);
+  }
+
+  return size;
+}
+
+/* length of the mapping map_anonymous() returns for len bytes; to be used for munmap() */
+size_t map_anonymous_len(size_t len, int hugepages)
+{
+  if (hugepages == PM_HUGEPAGES_NONE || len < hugepage_size()) return len;
+
+  return ((len+hugepage_size()-1)/hugepage_size())*hugepage_size();
+}
+
+/*
+   Anonymous read-write memory, MAP_SHARED or MAP_PRIVATE as per 'flags',
+   optionally backed by hugepages: PM_HUGEPAGES_EXPLICIT asks for hugetlb
+   pages and falls back to regular pages, advised as transparent hugepages,
+   if none can be obtained; PM_HUGEPAGES_TRANSPARENT only advises. Regions
+   smaller than a hugepage are always mapped with regular pages; larger
+   ones are rounded up to a whole number of hugepages, see
+   map_anonymous_len().
+*/
+
+void *map_anonymous(size_t len, int flags, int hugepages)
+{
+  void *mem = MAP_FAILED;
+  size_t hlen = map_anonymous_len(len, hugepages);
+
+  if (len < hugepage_size()) hugepages = PM_HUGEPAGES_NONE;
+
+#if defined (MAP_HUGETLB)
+  if (hugepages == PM_HUGEPAGES_EXPLICIT) {
+    mem = mmap(0, hlen, PROT_READ|PROT_WRITE, flags|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) return mem;
+
+    if (!hugepages_warned) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): Unable to obtain hugepages (%llu bytes): %s. Check vm.nr_hugepages.\n",
+	  config.name, config.type, (unsigned long long) hlen, strerror(errno));
+      hugepages_warned = TRUE;
+    }
+  }
+#else
+  if (hugepages == PM_HUGEPAGES_EXPLICIT && !hugepages_warned) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): explicit hugepages are not supported on this platform.\n", config.name, config.type);
+    hugepages_warned = TRUE;
+  }
+#endif
+
+  mem = map_shared(0, hlen, PROT_READ|PROT_WRITE, flags|MAP_ANONYMOUS, -1, 0);
+
+#if defined (MADV_HUGEPAGE)
+  if (mem != MAP_FAILED && hugepages != PM_HUGEPAGES_NONE) {
+    if (madvise(mem, hlen, MADV_HUGEPAGE) && !hugepages_warned) {
+      Log(LOG_WARNING, "WARN ( %s/%s ): Unable to advise transparent hugepages: %s.\n", config.name, config.type, strerror(errno));
+      hugepages_warned = TRUE;
+    }
+  }
+#endif
+
+  return mem;
+}
+
+/* large, long-lived and never freed allocations, ie. plugin caches */
+void *pm_malloc_cache(size_t size)
+{
+  void *obj;
+
+  if (!config.plugin_hugepages) return pm_malloc(size);
+
+  /* caches are private and writers are forked off at every purge: with
+     hugetlb pages copy-on-write would need as many spare hugepages again
+     or the writer gets killed; transparent hugepages just fall back */
+  obj = map_anonymous(size, MAP_PRIVATE, PM_HUGEPAGES_TRANSPARENT);
+  if (obj == MAP_FAILED) {
+    Log(LOG_ERR, "ERROR ( %s/%s ): Unable to grab enough memory (requested: %llu bytes). Exiting ...\n",
+	config.name, config.type, (unsigned long long) size);
+    exit_plugin(1);
+  }
+
+  return obj;
+}
+
+/*
+   NUMA placement is done via raw syscalls, not to depend on libnuma: the
+   mask is large enough for MAX_NUMA_NODES nodes. Memory policy is
+   MPOL_PREFERRED so that allocations spill over to other nodes rather
+   than failing when the configured one runs out of memory.
+*/
+int numa_bind_region(void *addr, size_t len, int node)
+{
+#if defined (__linux__) && defined (SYS_mbind)
+  unsigned long mask[MAX_NUMA_NODES/(8*sizeof(unsigned long))];
+
+  if (node < 0 || node >= MAX_NUMA_NODES) return ERR;
+
+  memset(mask, 0, sizeof(mask));
+  mask[node/(8*sizeof(unsigned long))] |= (1UL << (node % (8*sizeof(unsigned long))));
+
+  if (syscall(SYS_mbind, addr, len, PM_MPOL_PREFERRED, mask, MAX_NUMA_NODES+1, 0)) return ERR;
+
+  return SUCCESS;
+#else
+  errno = ENOSYS;
+  return ERR;
+#endif
+}
+
+/*
+   CPU lists, ie. "0-3,8,10-11": the syntax of taskset(1) and of sysfs.
+   Returns the number of CPUs set in 'mask' or ERR on syntax errors.
+*/
+int parse_cpu_list(char *list, unsigned long *mask)
+{
+  char buf[LONGSRVBUFLEN], *token, *bufptr, *sep, *endptr;
+  int first, last, cpu, cpus_num = 0;
+
+  memset(mask, 0, CPU_MASK_SIZE);
+  if (!list) return ERR;
+
+  strlcpy(buf, list, sizeof(buf));
+  trim_all_spaces(buf);
+  bufptr = buf;
+
+  while ((token = extract_token(&bufptr, ','))) {
+    if ((sep = strchr(token, '-'))) *sep = '\0';
+
+    first = last = strtol(token, &endptr, 10);
+    if (!strlen(token) || *endptr != '\0') return ERR;
+
+    if (sep) {
+      last = strtol(sep+1, &endptr, 10);
+      if (!strlen(sep+1) || *endptr != '\0') return ERR;
+    }
+
+    if (first < 0 || last < first || last >= MAX_NUMA_CPUS) return ERR;
+
+    for (cpu = first; cpu <= last; cpu++) {
+      if (!CPU_MASK_ISSET(mask, cpu)) cpus_num++;
+      CPU_MASK_SET(mask, cpu);
+    }
+  }
+
+  return cpus_num ? cpus_num : ERR;
+}
+
+void print_cpu_list(unsigned long *mask, char *buf, int len)
+{
+  int cpu, last, off = 0;
+
+  buf[0] = '\0';
+
+  for (cpu = 0; cpu < MAX_NUMA_CPUS; cpu++) {
+    if (!CPU_MASK_ISSET(mask, cpu)) continue;
+
+    for (last = cpu; last+1 < MAX_NUMA_CPUS && CPU_MASK_ISSET(mask, last+1); last++);
+
+    if (last == cpu) off += snprintf(buf+off, len-off, "%s%d", off ? "," : "", cpu);
+    else off += snprintf(buf+off, len-off, "%s%d-%d", off ? "," : "", cpu, last);
+
+    if (off >= len) break;
+    cpu = last;
+  }
+}
+
+int numa_bind_process(int node, char *name, char *type)
+{
+#if defined (__linux__) && defined (SYS_set_mempolicy) && defined (SYS_sched_setaffinity)
+  unsigned long mask[MAX_NUMA_NODES/(8*sizeof(unsigned long))];
+  unsigned long cpus[MAX_NUMA_CPUS/(8*sizeof(unsigned long))];
+  char path[SRVBUFLEN], buf[LONGSRVBUFLEN];
+  FILE *f;
+
+  if (node < 0 || node >= MAX_NUMA_NODES) return ERR;
+
+  /* CPUs: all of those local to the node, from its sysfs cpulist */
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  memset(buf, 0, sizeof(buf));
+
+  if (!(f = fopen(path, "r")) || !fgets(buf, sizeof(buf), f)) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): NUMA node %d not found (%s).\n", name, type, node, path);
+    if (f) fclose(f);
+    return ERR;
+  }
+  fclose(f);
+
+  if (parse_cpu_list(buf, cpus) > 0 && syscall(SYS_sched_setaffinity, 0, sizeof(cpus), cpus)) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): Unable to bind to the CPUs of NUMA node %d: %s\n", name, type, node, strerror(errno));
+    return ERR;
+  }
+
+  /* memory */
+  memset(mask, 0, sizeof(mask));
+  mask[node/(8*sizeof(unsigned long))] |= (1UL << (node % (8*sizeof(unsigned long))));
+
+  if (syscall(SYS_set_mempolicy, PM_MPOL_PREFERRED, mask, MAX_NUMA_NODES+1)) {
+    Log(LOG_WARNING, "WARN ( %s/%s ): Unable to set memory policy for NUMA node %d: %s\n", name, type, node, strerror(errno));
+    return ERR;
+  }
+
+  return SUCCESS;
+#else
+  Log(LOG_WARNING, "WARN ( %s/%s ): NUMA binding is not supported on this platform.\n", name, type);
+  return ERR;
+#endif
+}
+
+int parse_sched_policy(char *policy)
+{
+  lower_string(policy);
+
+  if (!strcmp(policy, "other")) return PM_SCHED_OTHER;
+  else if (!strcmp(policy, "batch")) return PM_SCHED_BATCH;
+  else if (!strcmp(policy, "idle")) return PM_SCHED_IDLE;
+  else if (!strcmp(policy, "fifo")) return PM_SCHED_FIFO;
+  else if (!strcmp(policy, "rr")) return PM_SCHED_RR;
+
+  return ERR;
+}
+
+static const char *sched_policy_names[] = { "inherited", "other", "batch", "idle", "fifo", "rr" };
+
+int set_sched_policy(int policy, int priority)
+{
+#if defined (__linux__) && defined (SYS_sched_setscheduler)
+  struct sched_param param;
+  int kpolicy;
+
+  memset(&param, 0, sizeof(param));
+
+  switch (policy) {
+  case PM_SCHED_OTHER: kpolicy = PM_KSCHED_OTHER; break;
+  case PM_SCHED_BATCH: kpolicy = PM_KSCHED_BATCH; break;
+  case PM_SCHED_IDLE: kpolicy = PM_KSCHED_IDLE; break;
+  case PM_SCHED_FIFO: kpolicy = PM_KSCHED_FIFO; break;
+  case PM_SCHED_RR: kpolicy = PM_KSCHED_RR; break;
+  default: errno = EINVAL; return ERR;
+  }
+
+  /* real-time policies require a priority, others only accept zero */
+  if (policy == PM_SCHED_FIFO || policy == PM_SCHED_RR) param.sched_priority = priority ? priority : 1;
+
+  if (syscall(SYS_sched_setscheduler, 0, kpolicy, &param)) return ERR;
+
+  return SUCCESS;
+#else
+  errno = ENOSYS;
+  return ERR;
+#endif
+}
+
+/*
+   Placement the daemon was started with, ie. by taskset(1), numactl(8) or
+   chrt(1), saved before the Core Process applies its own: forked plugins
+   go back to it for whatever they do not define on their own.
+*/
+static struct {
+  int saved;
+  int cpus_ok;
+  unsigned long cpus[MAX_NUMA_CPUS/(8*sizeof(unsigned long))];
+  int mempolicy_ok;
+  int mempolicy;
+  unsigned long nodes[MAX_NUMA_NODES/(8*sizeof(unsigned long))];
+  int sched_ok;
+  int sched_policy;
+  int sched_priority;
+} orig_placement;
+
+static void save_placement()
+{
+  if (orig_placement.saved) return;
+  orig_placement.saved = TRUE;
+
+#if defined (__linux__) && defined (SYS_sched_getaffinity)
+  orig_placement.cpus_ok = (syscall(SYS_sched_getaffinity, 0, sizeof(orig_placement.cpus), orig_placement.cpus) > 0);
+#endif
+#if defined (__linux__) && defined (SYS_get_mempolicy)
+  orig_placement.mempolicy_ok = !syscall(SYS_get_mempolicy, &orig_placement.mempolicy, orig_placement.nodes,
+					 MAX_NUMA_NODES+1, NULL, 0);
+#endif
+#if defined (__linux__) && defined (SYS_sched_getscheduler) && defined (SYS_sched_getparam)
+  {
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    orig_placement.sched_policy = syscall(SYS_sched_getscheduler, 0);
+    orig_placement.sched_ok = (orig_placement.sched_policy != ERR && !syscall(SYS_sched_getparam, 0, &param));
+    orig_placement.sched_priority = param.sched_priority;
+  }
+#endif
+}
+
+/*
+   Places the calling process, or thread, as per configuration: NUMA node
+   first, then CPU affinity which wins over the CPUs of the node, then the
+   scheduling policy. 'cpu_idx' >= 0 narrows the affinity down to a single
+   CPU of the list, picked round-robin; the resulting placement is logged.
+*/
+void set_placement(char *name, char *type, char *what, int numa_node, char *cpu_list, int cpu_idx,
+		   int sched_policy, int sched_priority)
+{
+#if defined (__linux__) && defined (SYS_sched_setaffinity) && defined (SYS_sched_getaffinity)
+  unsigned long cpus[MAX_NUMA_CPUS/(8*sizeof(unsigned long))];
+  char cpus_str[LONGSRVBUFLEN], node_str[SRVBUFLEN], sched_str[SRVBUFLEN];
+  int cpus_num, cpu;
+
+  /* the first call is the Core Process at startup, before any thread */
+  save_placement();
+
+  if (numa_node == ERR && !cpu_list && !sched_policy) return;
+
+  if (numa_node != ERR) numa_bind_process(numa_node, name, type);
+
+  if (cpu_list) {
+    cpus_num = parse_cpu_list(cpu_list, cpus);
+
+    if (cpus_num > 0 && cpu_idx >= 0) {
+      cpu_idx %= cpus_num;
+      for (cpu = 0; cpu < MAX_NUMA_CPUS; cpu++) {
+	if (CPU_MASK_ISSET(cpus, cpu) && !cpu_idx--) break;
+      }
+      memset(cpus, 0, sizeof(cpus));
+      CPU_MASK_SET(cpus, cpu);
+    }
+
+    if (cpus_num <= 0 || syscall(SYS_sched_setaffinity, 0, sizeof(cpus), cpus))
+      Log(LOG_WARNING, "WARN ( %s/%s ): Unable to set %s CPU affinity to '%s': %s\n", name, type, what, cpu_list,
+	  cpus_num <= 0 ? "invalid CPU list" : strerror(errno));
+  }
+
+  if (sched_policy) {
+    if (set_sched_policy(sched_policy, sched_priority) == ERR)
+      Log(LOG_WARNING, "WARN ( %s/%s ): Unable to set %s scheduling policy to %s (priority: %d): %s\n", name, type, what,
+	  sched_policy_names[sched_policy], sched_priority, strerror(errno));
+  }
+
+  /* report what is actually in place, which may differ from what was configured */
+  memset(cpus, 0, sizeof(cpus));
+  if (syscall(SYS_sched_getaffinity, 0, sizeof(cpus), cpus) > 0) print_cpu_list(cpus, cpus_str, sizeof(cpus_str));
+  else strlcpy(cpus_str, "unknown", sizeof(cpus_str));
+
+  if (numa_node != ERR) snprintf(node_str, sizeof(node_str), "%d (preferred)", numa_node);
+  else strlcpy(node_str, "any", sizeof(node_str));
+
+#if defined (SYS_sched_getscheduler) && defined (SYS_sched_getparam)
+  {
+    struct sched_param param;
+    int kpolicy = syscall(SYS_sched_getscheduler, 0);
+
+    memset(&param, 0, sizeof(param));
+    syscall(SYS_sched_getparam, 0, &param);
+
+    /* SCHED_RESET_ON_FORK may be or-ed in */
+    switch (kpolicy & 0xff) {
+    case PM_KSCHED_OTHER: snprintf(sched_str, sizeof(sched_str), "other"); break;
+    case PM_KSCHED_BATCH: snprintf(sched_str, sizeof(sched_str), "batch"); break;
+    case PM_KSCHED_IDLE: snprintf(sched_str, sizeof(sched_str), "idle"); break;
+    case PM_KSCHED_FIFO: snprintf(sched_str, sizeof(sched_str), "fifo:%d", param.sched_priority); break;
+    case PM_KSCHED_RR: snprintf(sched_str, sizeof(sched_str), "rr:%d", param.sched_priority); break;
+    default: snprintf(sched_str, sizeof(sched_str), "unknown"); break;
+    }
+  }
+#else
+  strlcpy(sched_str, sched_policy_names[sched_policy], sizeof(sched_str));
+#endif
+
+  Log(LOG_INFO, "INFO ( %s/%s ): %s placement: CPUs %s, NUMA node %s, scheduling %s\n", name, type, what,
+	cpus_str, node_str, sched_str);
+#else
+  if (numa_node == ERR && !cpu_list && !sched_policy) return;
+
+  Log(LOG_WARNING, "WARN ( %s/%s ): %s placement is not supported on this platform.\n", name, type, what);
+#endif
+}
+
+/*
+   Undoes, in a forked plugin, the placement inherited from the Core
+   Process for the settings the plugin does not define on its own: the
+   plugin goes back to the placement the daemon was started with, so it
+   stays within any taskset(1)/numactl(8) restriction.
+*/
+void reset_placement(int numa_node, char *cpu_list, int sched_policy)
+{
+#if defined (__linux__) && defined (SYS_sched_setaffinity)
+  if ((numa_node != ERR || cpu_list) && orig_placement.cpus_ok)
+    syscall(SYS_sched_setaffinity, 0, sizeof(orig_placement.cpus), orig_placement.cpus);
+
+#if defined (SYS_set_mempolicy)
+  if (numa_node != ERR) {
+    int mode = orig_placement.mempolicy_ok ? orig_placement.mempolicy : PM_MPOL_DEFAULT;
+
+    if ((mode & PM_MPOL_MODE_MASK) == PM_MPOL_DEFAULT || (mode & PM_MPOL_MODE_MASK) == PM_MPOL_LOCAL)
+      syscall(SYS_set_mempolicy, mode, NULL, 0);
+    else
+      syscall(SYS_set_mempolicy, mode, orig_placement.nodes, MAX_NUMA_NODES+1);
+  }
+#endif
+
+#if defined (SYS_sched_setscheduler)
+  if (sched_policy) {
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    if (orig_placement.sched_ok) {
+      param.sched_priority = orig_placement.sched_priority;
+      syscall(SYS_sched_setscheduler, 0, orig_placement.sched_policy, &param);
+    }
+    else set_sched_policy(PM_SCHED_OTHER, 0);
+  }
+#endif
+#endif
+}
+
 void lower_string(char *string)
 {
   int i = 0;
@@ -2179,13 +2614,13 @@ void *compose_json(u_int64_t wtc, u_int64_t wtc_2, u_int8_t flow_type, struct pk
     json_decref(kv);
   }
 
-  if (config.nfacctd_stitching && stitch) {
-    compose_timestamp(tstamp_str, SRVBUFLEN, &stitch->timestamp_min, TRUE, config.sql_history_since_epoch);
+  if (config.nfacctd_stitching) {
+    compose_timestamp(tstamp_str, SRVBUFLEN, &stitch_get(stitch)->timestamp_min, TRUE, config.sql_history_since_epoch);
     kv = json_pack("{ss}", "timestamp_min", tstamp_str);
     json_object_update_missing(obj, kv);
     json_decref(kv);
 
-    compose_timestamp(tstamp_str, SRVBUFLEN, &stitch->timestamp_max, TRUE, config.sql_history_since_epoch);
+    compose_timestamp(tstamp_str, SRVBUFLEN, &stitch_get(stitch)->timestamp_max, TRUE, config.sql_history_since_epoch);
     kv = json_pack("{ss}", "timestamp_max", tstamp_str);
     json_object_update_missing(obj, kv);
     json_decref(kv);
@@ -2961,3 +3396,87 @@ void replace_string(char *str, int string_len, char *var, char *value)
     strncat(str, buf, len);
   }
 }
+
+/*
+  Flow stitching state: fixed-size records carved out of a single pool,
+  sized once by the plugin on its cache size, so that memory stays bounded
+  whatever the traffic mix. Free records are chained through themselves.
+  When the pool is exhausted entries go without stitching state and are
+  output with zero timestamps, same as for every backend.
+*/
+union stitch_slot {
+  struct pkt_stitching s;
+  union stitch_slot *next;
+};
+
+static union stitch_slot *stitch_pool, *stitch_free_list;
+static u_int64_t stitch_pool_size, stitch_pool_misses;
+
+void stitch_pool_init(u_int64_t entries)
+{
+  u_int64_t idx;
+
+  stitch_pool = (union stitch_slot *) pm_malloc(entries*sizeof(union stitch_slot));
+  stitch_pool_size = entries;
+  stitch_pool_misses = 0;
+
+  for (idx = 0; idx < (entries-1); idx++) stitch_pool[idx].next = &stitch_pool[idx+1];
+  stitch_pool[entries-1].next = NULL;
+  stitch_free_list = stitch_pool;
+
+  Log(LOG_INFO, "INFO ( %s/%s ): stitching entries=%llu memory=%llu bytes\n", config.name, config.type,
+	(unsigned long long)entries, (unsigned long long)(entries*sizeof(union stitch_slot)));
+}
+
+struct pkt_stitching *stitch_alloc()
+{
+  union stitch_slot *slot = stitch_free_list;
+
+  if (!slot) {
+    if (!stitch_pool_misses) Log(LOG_WARNING, "WARN ( %s/%s ): Finished memory for flow stitching (%llu entries).\n",
+				config.name, config.type, (unsigned long long)stitch_pool_size);
+    stitch_pool_misses++;
+    return NULL;
+  }
+
+  stitch_free_list = slot->next;
+
+  return &slot->s;
+}
+
+void stitch_free(struct pkt_stitching *stitch)
+{
+  union stitch_slot *slot = (union stitch_slot *) stitch;
+
+  if (!stitch) return;
+
+  slot->next = stitch_free_list;
+  stitch_free_list = slot;
+
+  if (stitch_pool_misses) {
+    Log(LOG_INFO, "INFO ( %s/%s ): flow stitching skipped for %llu cache entries.\n", config.name, config.type,
+	(unsigned long long)stitch_pool_misses);
+    stitch_pool_misses = 0;
+  }
+}
+
+/* new cache entry: first and last seen out of the very first record */
+void stitch_init(struct pkt_stitching *stitch, struct pkt_data *data, time_t now)
+{
+  if (data->time_start.tv_sec) stitch->timestamp_min = data->time_start;
+  else {
+    stitch->timestamp_min.tv_sec = now;
+    stitch->timestamp_min.tv_usec = 0;
+  }
+
+  stitch_update(stitch, data, now);
+}
+
+void stitch_update(struct pkt_stitching *stitch, struct pkt_data *data, time_t now)
+{
+  if (data->time_end.tv_sec) stitch->timestamp_max = data->time_end;
+  else {
+    stitch->timestamp_max.tv_sec = now;
+    stitch->timestamp_max.tv_usec = 0;
+  }
+}
@@ -23,6 +23,36 @@
 #define ADD 0
 #define SUB 1
 
+#define PM_HUGEPAGES_NONE		0
+#define PM_HUGEPAGES_TRANSPARENT	1
+#define PM_HUGEPAGES_EXPLICIT		2
+#define DEFAULT_HUGEPAGE_SIZE		2097152
+
+#define MAX_NUMA_NODES			64
+#define MAX_NUMA_CPUS			1024
+#define PM_MPOL_DEFAULT			0
+#define PM_MPOL_PREFERRED		1
+#define PM_MPOL_LOCAL			4
+#define PM_MPOL_MODE_MASK		0xff	/* strips MPOL_F_* mode flags */
+
+#define CPU_MASK_SIZE			(MAX_NUMA_CPUS/8)
+#define CPU_MASK_SET(m, c)		((m)[(c)/(8*sizeof(unsigned long))] |= (1UL << ((c) % (8*sizeof(unsigned long)))))
+#define CPU_MASK_ISSET(m, c)		((m)[(c)/(8*sizeof(unsigned long))] & (1UL << ((c) % (8*sizeof(unsigned long)))))
+
+/* scheduling policies: configuration values, 0 is not set */
+#define PM_SCHED_OTHER			1
+#define PM_SCHED_BATCH			2
+#define PM_SCHED_IDLE			3
+#define PM_SCHED_FIFO			4
+#define PM_SCHED_RR			5
+
+/* scheduling policies: Linux kernel values */
+#define PM_KSCHED_OTHER			0
+#define PM_KSCHED_FIFO			1
+#define PM_KSCHED_RR			2
+#define PM_KSCHED_BATCH			3
+#define PM_KSCHED_IDLE			5
+
 /* prototypes */
 #if (!defined __UTIL_C)
 #define EXT extern
@@ -51,6 +81,18 @@ EXT int sanitize_buf(char *);
 EXT void mark_columns(char *);
 EXT int Setsocksize(int, int, int, void *, int);
 EXT void *map_shared(void *, size_t, int, int, int, off_t);
+EXT size_t hugepage_size();
+EXT size_t map_anonymous_len(size_t, int);
+EXT void *map_anonymous(size_t, int, int);
+EXT void *pm_malloc_cache(size_t);
+EXT int numa_bind_region(void *, size_t, int);
+EXT int numa_bind_process(int, char *, char *);
+EXT int parse_cpu_list(char *, unsigned long *);
+EXT void print_cpu_list(unsigned long *, char *, int);
+EXT int parse_sched_policy(char *);
+EXT int set_sched_policy(int, int);
+EXT void set_placement(char *, char *, char *, int, char *, int, int, int);
+EXT void reset_placement(int, char *, int);
 EXT void lower_string(char *);
 EXT void evaluate_sums(u_int64_t *, char *, char *);
 EXT int file_archive(const char *, int);
@@ -143,4 +185,19 @@ EXT void vlen_prims_insert(struct pkt_vlen_hdr_primitives *, pm_cfgreg_t, int, c
 EXT int vlen_prims_delete(struct pkt_vlen_hdr_primitives *, pm_cfgreg_t);
 
 EXT void replace_string(char *, int, char *, char *);
+
+EXT void stitch_pool_init(u_int64_t);
+EXT struct pkt_stitching *stitch_alloc();
+EXT void stitch_free(struct pkt_stitching *);
+EXT void stitch_init(struct pkt_stitching *, struct pkt_data *, time_t);
+EXT void stitch_update(struct pkt_stitching *, struct pkt_data *, time_t);
 #undef EXT
+
+/* what the output backends read: never NULL, never written to; inline
+   as it is also linked in by tools not carrying util.o (ie. pmpgplay) */
+Inline struct pkt_stitching *stitch_get(struct pkt_stitching *stitch)
+{
+  static struct pkt_stitching stitch_null;
+
+  return stitch ? stitch : &stitch_null;
+}
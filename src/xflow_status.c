@@ -23,69 +23,113 @@
 
 /* includes */
 #include "pmacct.h"
+#include "jhash.h"
 
 /* functions */
-u_int32_t hash_status_table(u_int32_t data, struct sockaddr *sa, u_int32_t size)
+u_int32_t hash_status_table(struct sockaddr *sa, u_int32_t aux1, u_int32_t aux2)
 {
-  int hash = -1;
+  u_int32_t addr = 0;
 
   if (sa->sa_family == AF_INET)
-    hash = (data ^ ((struct sockaddr_in *)sa)->sin_addr.s_addr) % size;
+    addr = ((struct sockaddr_in *)sa)->sin_addr.s_addr;
 #if defined ENABLE_IPV6
   else if (sa->sa_family == AF_INET6) {
-    u_int32_t tmp;
+    u_int32_t words[4];
 
-    memcpy(&tmp, ((struct sockaddr_in6 *)sa)->sin6_addr.s6_addr+12, 4);
-    hash = (data ^ tmp) % size;
-    // hash = (data ^ ((struct sockaddr_in6 *)sa)->sin6_addr.s6_addr32[3]) % size;
+    memcpy(words, ((struct sockaddr_in6 *)sa)->sin6_addr.s6_addr, 16);
+
+    /* sa_addr_cmp() matches IPv4-mapped IPv6 addresses against IPv4 ones */
+    if (!words[0] && !words[1] && words[2] == htonl(0xffff)) addr = words[3];
+    else addr = jhash2(words, 4, 0);
   }
 #endif
 
-  return hash;
+  return jhash_3words(addr, aux1, aux2, 0);
 }
 
-struct xflow_status_entry *search_status_table(struct sockaddr *sa, u_int32_t aux1, u_int32_t aux2, int hash, int num_entries)
+int resize_status_table(u_int32_t size)
 {
-  struct xflow_status_entry *entry = xflow_status_table[hash], *saved = NULL;
+  struct xflow_status_entry **slots, *entry;
+  u_int32_t idx;
+
+  slots = calloc(size, sizeof(struct xflow_status_entry *));
+  if (!slots) return FALSE;
+
+  for (entry = xflow_status_table.head; entry; entry = entry->next) {
+    for (idx = entry->hash & (size-1); slots[idx]; idx = (idx+1) & (size-1));
+    slots[idx] = entry;
+  }
+
+  if (xflow_status_table.slots) free(xflow_status_table.slots);
+  xflow_status_table.slots = slots;
+  xflow_status_table.size = size;
+
+  return TRUE;
+}
+
+struct xflow_status_entry *search_status_table(struct sockaddr *sa, u_int32_t aux1, u_int32_t aux2, int num_entries)
+{
+  struct xflow_status_entry *entry;
+  u_int32_t hash, idx, mask;
   u_int16_t port;
 
-  cycle_again:
-  if (entry) {
-    saved = entry;
-    if (!sa_addr_cmp(sa, &entry->agent_addr) && aux1 == entry->aux1 && aux2 == entry->aux2); /* FOUND IT: we are done */
-    else {
-      entry = entry->next;
-      goto cycle_again;
-    }
+  if (sa->sa_family != AF_INET && sa->sa_family != AF_INET6) return NULL;
+
+  if (!xflow_status_table.slots && !resize_status_table(XFLOW_STATUS_TABLE_SZ)) goto error;
+
+  hash = hash_status_table(sa, aux1, aux2);
+  mask = xflow_status_table.size-1;
+
+  for (idx = hash & mask; (entry = xflow_status_table.slots[idx]); idx = (idx+1) & mask) {
+    if (entry->hash == hash && !sa_addr_cmp(sa, &entry->agent_addr) && aux1 == entry->aux1 && aux2 == entry->aux2)
+      return entry; /* FOUND IT: we are done */
   }
-  else {
-    if (xflow_status_table_entries < num_entries) {
-      entry = malloc(sizeof(struct xflow_status_entry));
-      if (!entry) goto error;
-      else {
-	memset(entry, 0, sizeof(struct xflow_status_entry));
-	sa_to_addr(sa, &entry->agent_addr, &port);
-	entry->aux1 = aux1;
-	entry->aux2 = aux2;
-	entry->seqno = 0;
-	entry->next = FALSE;
-        if (!saved) xflow_status_table[hash] = entry;
-        else saved->next = entry;
-	xflow_status_table_error = TRUE;
-	xflow_status_table_entries++;
-      }
-    }
-    else {
-      error:
-      if (xflow_status_table_error) {
-	Log(LOG_ERR, "ERROR: unable to allocate more entries into the xFlow status table.\n");
-	xflow_status_table_error = FALSE;
-	return NULL;
-      }
-    }
+
+  if (xflow_status_table_entries >= num_entries) goto error;
+
+  /* keeping load factor below 1/2 so that probe sequences stay short */
+  if ((xflow_status_table.used+1)*2 > xflow_status_table.size) {
+    if (!resize_status_table(xflow_status_table.size << 1)) goto error;
+
+    mask = xflow_status_table.size-1;
+    for (idx = hash & mask; xflow_status_table.slots[idx]; idx = (idx+1) & mask);
   }
 
+  if (!xflow_status_table.pool_left) {
+    xflow_status_table.pool = malloc(XFLOW_STATUS_POOL_CHUNK*sizeof(struct xflow_status_entry));
+    if (!xflow_status_table.pool) goto error;
+    xflow_status_table.pool_left = XFLOW_STATUS_POOL_CHUNK;
+  }
+
+  entry = xflow_status_table.pool;
+  xflow_status_table.pool++;
+  xflow_status_table.pool_left--;
+
+  memset(entry, 0, sizeof(struct xflow_status_entry));
+  sa_to_addr(sa, &entry->agent_addr, &port);
+  entry->aux1 = aux1;
+  entry->aux2 = aux2;
+  entry->hash = hash;
+
+  xflow_status_table.slots[idx] = entry;
+  xflow_status_table.used++;
+  xflow_status_table_entries++;
+  xflow_status_table_error = TRUE;
+
+  /* linking only once fully initialized: print_status_table() may be running */
+  if (xflow_status_table.tail) xflow_status_table.tail->next = entry;
+  else xflow_status_table.head = entry;
+  xflow_status_table.tail = entry;
+
   return entry;
+
+  error:
+  if (xflow_status_table_error) {
+    Log(LOG_ERR, "ERROR: unable to allocate more entries into the xFlow status table.\n");
+    xflow_status_table_error = FALSE;
+  }
+
+  return NULL;
 }
 
 void update_status_table(struct xflow_status_entry *entry, u_int32_t seqno)
@@ -115,7 +159,7 @@ void update_status_table(struct xflow_status_entry *entry, u_int32_t seqno)
       Log(LOG_INFO, "INFO: expecting flow '%u' but received '%u' collector=%s:%u agent=%s:%u\n",
 		      entry->seqno+entry->inc, seqno, collector_ip_address, config.nfacctd_port, agent_ip_address, entry->aux1);
       if (seqno > entry->seqno+entry->inc) {
-        // entry->counters.missed += (seqno-entry->seqno);
+        entry->counters.missed += (seqno-(entry->seqno+entry->inc));
         entry->counters.jumps_f++;
 	// entry->seqno = seqno;
       }
@@ -130,77 +174,169 @@ void update_status_table(struct xflow_status_entry *entry, u_int32_t seqno)
   entry->seqno = seqno;
 }
 
-void print_status_table(time_t now, int buckets)
+void print_status_table(time_t now)
 {
-  struct xflow_status_entry *entry; 
   char nf [] = "NetFlow";
   char sf [] = "sFlow";
   char uf [] = "unknown";
   char *ftype = uf; 
+  u_int32_t tot_bad_datagrams = 0;
   int idx;
+
+  if (config.acct_type == ACCT_NF) ftype = nf; 
+  if (config.acct_type == ACCT_SF) ftype = sf; 
+
+  if (!xflow_status_shards_num) {
+    print_status_table_entries(&xflow_status_table, now);
+    tot_bad_datagrams = xflow_tot_bad_datagrams;
+  }
+
+  for (idx = 0; idx < xflow_status_shards_num; idx++) {
+    print_status_table_entries(xflow_status_shards[idx]->table, now);
+    tot_bad_datagrams += *xflow_status_shards[idx]->tot_bad_datagrams;
+  }
+
+  Log(LOG_NOTICE, "+++\n");
+  for (idx = 0; idx < xflow_status_shards_num; idx++)
+    Log(LOG_NOTICE, "Worker %u: %llu datagrams %llu dropped (%u)\n", idx,
+	(unsigned long long)xflow_status_shards[idx]->datagrams,
+	(unsigned long long)xflow_status_shards[idx]->drops, now);
+  Log(LOG_NOTICE, "Total bad %s datagrams: %u (%u)\n", ftype, tot_bad_datagrams, now);
+  Log(LOG_NOTICE, "---\n\n");
+}
+
+void print_status_table_entries(struct xflow_status_table *table, time_t now)
+{
+  struct xflow_status_entry *entry; 
+  struct xflow_status_entry_counters *cur, *prev;
+  char nf [] = "NetFlow";
+  char sf [] = "sFlow";
+  char uf [] = "unknown";
+  char *ftype = uf; 
   char agent_ip_address[INET6_ADDRSTRLEN];
   char collector_ip_address[INET6_ADDRSTRLEN];
   char null_ip_address[] = "0.0.0.0";
+  time_t elapsed = 0;
 
 
   if (config.acct_type == ACCT_NF) ftype = nf; 
   if (config.acct_type == ACCT_SF) ftype = sf; 
+
+  if (table->dumped && now > table->dumped) elapsed = now-table->dumped;
   
-  for (idx = 0; idx < buckets; idx++) {
-    entry = xflow_status_table[idx];
+  /* walking the insertion list only: slots may be getting resized under us */
+  for (entry = table->head; entry; entry = entry->next) {
+    cur = &entry->counters;
+    prev = &entry->dumped;
+
+    addr_to_str(agent_ip_address, &entry->agent_addr);
+    if (config.nfacctd_ip)
+      memcpy(collector_ip_address, config.nfacctd_ip, MAX(strlen(config.nfacctd_ip), INET6_ADDRSTRLEN));
+    else
+      strcpy(collector_ip_address, null_ip_address);
+
+    Log(LOG_NOTICE, "\n+++\n");
+    Log(LOG_NOTICE, "%s statistics collector=%s:%u agent=%s:%u (%u):\n",
+		    ftype, collector_ip_address, config.nfacctd_port, agent_ip_address, entry->aux1, now);
+    Log(LOG_NOTICE, "Good datagrams:	%u\n", cur->good);
+    Log(LOG_NOTICE, "Forward jumps:	%u\n", cur->jumps_f);
+    Log(LOG_NOTICE, "Backward jumps:	%u\n", cur->jumps_b);
+    Log(LOG_NOTICE, "Flows:	%llu\n", (unsigned long long)cur->flows);
+    Log(LOG_NOTICE, "Lost (estimated):	%llu\n", (unsigned long long)cur->missed);
+    if (elapsed) {
+      Log(LOG_NOTICE, "Datagrams/s:	%.2f\n",
+	  (double)((cur->good+cur->jumps_f+cur->jumps_b)-(prev->good+prev->jumps_f+prev->jumps_b))/elapsed);
+      Log(LOG_NOTICE, "Flows/s:	%.2f\n", (double)(cur->flows-prev->flows)/elapsed);
+      Log(LOG_NOTICE, "Lost/s:	%.2f\n", (double)(cur->missed-prev->missed)/elapsed);
+    }
+    if (entry->srate)
+      Log(LOG_NOTICE, "Sampling rate:	%u\n", entry->srate);
+    if (config.acct_type == ACCT_NF) {
+      struct xflow_status_entry_sampling *sentry;
 
-    bucket_cycle:
-    if (entry) {
-      addr_to_str(agent_ip_address, &entry->agent_addr);
-      if (config.nfacctd_ip)
-	memcpy(collector_ip_address, config.nfacctd_ip, MAX(strlen(config.nfacctd_ip), INET6_ADDRSTRLEN));
-      else
-        strcpy(collector_ip_address, null_ip_address);
-
-      Log(LOG_NOTICE, "\n+++\n");
-      Log(LOG_NOTICE, "%s statistics collector=%s:%u agent=%s:%u (%u):\n",
-		      ftype, collector_ip_address, config.nfacctd_port, agent_ip_address, entry->aux1, now);
-      Log(LOG_NOTICE, "Good datagrams:	%u\n", entry->counters.good);
-      Log(LOG_NOTICE, "Forward jumps:	%u\n", entry->counters.jumps_f);
-      Log(LOG_NOTICE, "Backward jumps:	%u\n", entry->counters.jumps_b);
-      Log(LOG_NOTICE, "---\n");
-
-      if (entry->next) {
-	entry = entry->next;
-	goto bucket_cycle;
-      }
-    } 
+      for (sentry = entry->sampling; sentry; sentry = sentry->next)
+        Log(LOG_NOTICE, "Sampler ID %u:	%u\n", sentry->sampler_id, sentry->sample_pool);
+    }
+    if (config.acct_type == ACCT_NF && entry->templates)
+      Log(LOG_NOTICE, "Templates:	%u\n", entry->templates);
+    Log(LOG_NOTICE, "---\n");
+
+    memcpy(prev, cur, sizeof(struct xflow_status_entry_counters));
   }
 
-  Log(LOG_NOTICE, "+++\n");
-  Log(LOG_NOTICE, "Total bad %s datagrams: %u (%u)\n", ftype, xflow_tot_bad_datagrams, now);
-  Log(LOG_NOTICE, "---\n\n");
+  table->dumped = now;
+}
+
+int register_status_shard(struct xflow_status_shard *shard)
+{
+  if (xflow_status_shards_num == XFLOW_STATUS_MAX_SHARDS) return ERR;
+
+  xflow_status_shards[xflow_status_shards_num] = shard;
+  xflow_status_shards_num++;
+
+  return SUCCESS;
 }
 
+/*
+   Sampling entries are looked up per flow record; the list is the
+   authoritative store and a small direct-indexed cache, keyed by the
+   low bits of the sampler ID (NetFlow) or interface (sFlow), sits in
+   front of it. Entries are never freed and option data updates them
+   in place, hence cached pointers never go stale.
+*/
 struct xflow_status_entry_sampling *
-search_smp_if_status_table(struct xflow_status_entry_sampling *sentry, u_int32_t interface)
+search_smp_if_status_table(struct xflow_status_entry *entry, u_int32_t interface)
 {
-  while (sentry) {
-    if (sentry->interface == interface) return sentry;
-    sentry = sentry->next;
+  struct xflow_status_entry_sampling *sentry;
+
+  if (entry->smp_cache) {
+    sentry = entry->smp_cache[interface & (XFLOW_SMP_CACHE_SZ-1)];
+    if (sentry && sentry->interface == interface) return sentry;
+  }
+
+  for (sentry = entry->sampling; sentry; sentry = sentry->next) {
+    if (sentry->interface == interface) {
+      update_smp_cache_status_table(entry, sentry, interface);
+      return sentry;
+    }
   }
 
   return NULL;
 }
 
 struct xflow_status_entry_sampling *
-search_smp_id_status_table(struct xflow_status_entry_sampling *sentry, u_int32_t sampler_id, u_int8_t return_unequal)
+search_smp_id_status_table(struct xflow_status_entry *entry, u_int32_t sampler_id, u_int8_t return_unequal)
 {
+  struct xflow_status_entry_sampling *sentry;
+
+  if (entry->smp_cache) {
+    sentry = entry->smp_cache[sampler_id & (XFLOW_SMP_CACHE_SZ-1)];
+    if (sentry && sentry->sampler_id == sampler_id) return sentry;
+  }
+
   /* Match a samplerID or, if samplerID within a data record is zero and no match was
      possible, then return the last samplerID defined -- last part is C7600 workaround */
-  while (sentry) {
-    if (sentry->sampler_id == sampler_id || (return_unequal && !sampler_id && !sentry->next)) return sentry;
-    sentry = sentry->next;
+  for (sentry = entry->sampling; sentry; sentry = sentry->next) {
+    if (sentry->sampler_id == sampler_id) {
+      update_smp_cache_status_table(entry, sentry, sampler_id);
+      return sentry;
+    }
+    if (return_unequal && !sampler_id && !sentry->next) return sentry;
   }
 
   return NULL;
 }
 
+void update_smp_cache_status_table(struct xflow_status_entry *entry, struct xflow_status_entry_sampling *sentry, u_int32_t key)
+{
+  if (!entry->smp_cache) {
+    entry->smp_cache = calloc(XFLOW_SMP_CACHE_SZ, sizeof(struct xflow_status_entry_sampling *));
+    if (!entry->smp_cache) return;
+  }
+
+  entry->smp_cache[key & (XFLOW_SMP_CACHE_SZ-1)] = sentry;
+}
+
 struct xflow_status_entry_sampling *
 create_smp_entry_status_table(struct xflow_status_entry *entry)
 {
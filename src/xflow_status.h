@@ -21,8 +21,11 @@
 
 /* defines */
 #define XFLOW_RESET_BOUNDARY 50
-#define XFLOW_STATUS_TABLE_SZ 9973
+#define XFLOW_STATUS_TABLE_SZ 1024		/* initial slots; power of two */
 #define XFLOW_STATUS_TABLE_MAX_ENTRIES 100000
+#define XFLOW_STATUS_POOL_CHUNK 256
+#define XFLOW_SMP_CACHE_SZ 64			/* per-exporter sampler cache slots; power of two */
+#define XFLOW_STATUS_MAX_SHARDS 64
 
 /* structures */
 struct xflow_status_entry_counters
@@ -30,6 +33,8 @@ struct xflow_status_entry_counters
   u_int32_t good;
   u_int32_t jumps_f;
   u_int32_t jumps_b;
+  u_int64_t flows;		/* flow records (sFlow: samples) received */
+  u_int64_t missed;		/* estimated from sequence number gaps */
 };
 
 struct xflow_status_entry_sampling
@@ -76,9 +81,45 @@ struct xflow_status_entry
   struct xflow_status_map_cache st;			/* last known sampling_map result */
   struct xflow_status_entry_counters counters;
   struct xflow_status_entry_sampling *sampling;
+  struct xflow_status_entry_sampling **smp_cache;	/* direct-indexed by sampler ID or interface */
+  u_int32_t srate;		/* last sampling rate applied to this exporter's flows */
   struct xflow_status_entry_class *class;
   void *sf_cnt;			/* struct (ab)used for sFlow counters logging */
-  struct xflow_status_entry *next;
+  void *last_tpl;		/* NetFlow v9/IPFIX: last template hit for this exporter */
+  u_int32_t templates;		/* NetFlow v9/IPFIX: templates cached for this exporter */
+  u_int32_t hash;
+  struct xflow_status_entry_counters dumped;	/* counters at last print_status_table() */
+  struct xflow_status_entry *next;		/* insertion order; append-only */
+};
+
+/*
+   Open addressing (linear probing) over the full (agent, aux1, aux2)
+   key. Entries never move once allocated, as pointers to them are held
+   all over (ie. pptrs->f_status), and are linked in insertion order so
+   that stats can be dumped without looking at the slots.
+*/
+struct xflow_status_table
+{
+  struct xflow_status_entry **slots;
+  u_int32_t size;				/* power of two */
+  u_int32_t used;
+  struct xflow_status_entry *pool;
+  u_int32_t pool_left;
+  struct xflow_status_entry *head;
+  struct xflow_status_entry *tail;
+  time_t dumped;
+};
+
+/*
+   Collectors decoding in multiple threads keep one (thread-local)
+   status table per thread: shards are registered for stats dumps.
+*/
+struct xflow_status_shard
+{
+  struct xflow_status_table *table;
+  u_int32_t *tot_bad_datagrams;
+  u_int64_t datagrams;			/* handed over to the thread */
+  u_int64_t drops;			/* discarded as the thread was lagging behind */
 };
 
 /* prototypes */
@@ -87,22 +128,27 @@ struct xflow_status_entry
 #else
 #define EXT
 #endif
-EXT u_int32_t hash_status_table(u_int32_t, struct sockaddr *, u_int32_t);
-EXT struct xflow_status_entry *search_status_table(struct sockaddr *, u_int32_t, u_int32_t, int, int);
-EXT void update_good_status_table(struct xflow_status_entry *, u_int32_t);
-EXT void update_bad_status_table(struct xflow_status_entry *);
-EXT void print_status_table(time_t, int);
-EXT struct xflow_status_entry_sampling *search_smp_if_status_table(struct xflow_status_entry_sampling *, u_int32_t);
-EXT struct xflow_status_entry_sampling *search_smp_id_status_table(struct xflow_status_entry_sampling *, u_int32_t, u_int8_t);
+EXT u_int32_t hash_status_table(struct sockaddr *, u_int32_t, u_int32_t);
+EXT int resize_status_table(u_int32_t);
+EXT struct xflow_status_entry *search_status_table(struct sockaddr *, u_int32_t, u_int32_t, int);
+EXT void update_status_table(struct xflow_status_entry *, u_int32_t);
+EXT void print_status_table(time_t);
+EXT void print_status_table_entries(struct xflow_status_table *, time_t);
+EXT int register_status_shard(struct xflow_status_shard *);
+EXT struct xflow_status_entry_sampling *search_smp_if_status_table(struct xflow_status_entry *, u_int32_t);
+EXT struct xflow_status_entry_sampling *search_smp_id_status_table(struct xflow_status_entry *, u_int32_t, u_int8_t);
 EXT struct xflow_status_entry_sampling *create_smp_entry_status_table(struct xflow_status_entry *);
+EXT void update_smp_cache_status_table(struct xflow_status_entry *, struct xflow_status_entry_sampling *, u_int32_t);
 EXT struct xflow_status_entry_class *search_class_id_status_table(struct xflow_status_entry_class *, pm_class_t);
 EXT struct xflow_status_entry_class *create_class_entry_status_table(struct xflow_status_entry *);
 
-EXT struct xflow_status_entry *xflow_status_table[XFLOW_STATUS_TABLE_SZ];
-EXT u_int32_t xflow_status_table_entries;
-EXT u_int8_t xflow_status_table_error;
-EXT u_int32_t xflow_tot_bad_datagrams;
-EXT u_int8_t smp_entry_status_table_memerr, class_entry_status_table_memerr;
+EXT ThreadLocal struct xflow_status_table xflow_status_table;
+EXT ThreadLocal u_int32_t xflow_status_table_entries;
+EXT ThreadLocal u_int8_t xflow_status_table_error;
+EXT ThreadLocal u_int32_t xflow_tot_bad_datagrams;
+EXT ThreadLocal u_int8_t smp_entry_status_table_memerr, class_entry_status_table_memerr;
+EXT struct xflow_status_shard *xflow_status_shards[XFLOW_STATUS_MAX_SHARDS];
+EXT int xflow_status_shards_num;
 EXT void set_vector_f_status(struct packet_ptrs_vector *);
 EXT void set_vector_f_status_g(struct packet_ptrs_vector *);
 #undef EXT